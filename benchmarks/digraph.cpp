@@ -0,0 +1,183 @@
+#include <engine/digraph.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace Morpheus;
+using namespace std;
+
+// Compares walking the children of every vertex of a large graph through the linked
+// edge lists against the CSR snapshot taken by Digraph::freeze, both on a graph that
+// has been churned and after Digraph::compress has put it in depth first order.
+//
+// Usage: bench-digraph [vertex count] [repetitions]
+
+double timeMs(const function<void()>& f, uint32_t repetitions) {
+	double best = numeric_limits<double>::infinity();
+	for (uint32_t i = 0; i < repetitions; ++i) {
+		auto start = chrono::high_resolution_clock::now();
+		f();
+		chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+		best = min(best, elapsed.count());
+	}
+	return best;
+}
+
+uint64_t sumChildrenLinked(Digraph& graph) {
+	uint64_t sum = 0;
+	for (uint32_t v = 0; v < graph.vertexActiveBlock(); ++v) {
+		for (auto it = graph.getVertex(v).children(); it.valid(); it.next())
+			sum += it().id();
+	}
+	return sum;
+}
+
+uint64_t sumChildrenFrozen(Digraph& graph) {
+	uint64_t sum = 0;
+	const int* begin = nullptr;
+	const int* end = nullptr;
+	for (uint32_t v = 0; v < graph.vertexActiveBlock(); ++v) {
+		graph.tryGetFrozenChildren(v, &begin, &end);
+		for (; begin != end; ++begin)
+			sum += *begin;
+	}
+	return sum;
+}
+
+// A depth first walk from vertex 0, which is how the renderer visits a scene
+uint64_t walkLinked(Digraph& graph, vector<int>* stack, vector<bool>* visited) {
+	uint64_t visits = 0;
+	visited->assign(graph.vertexActiveBlock(), false);
+	stack->push_back(0);
+	while (!stack->empty()) {
+		int v = stack->back();
+		stack->pop_back();
+		if ((*visited)[v])
+			continue;
+		(*visited)[v] = true;
+		++visits;
+		for (auto it = graph.getVertex(v).children(); it.valid(); it.next())
+			stack->push_back(it().id());
+	}
+	return visits;
+}
+
+uint64_t walkFrozen(Digraph& graph, vector<int>* stack, vector<bool>* visited) {
+	uint64_t visits = 0;
+	const int* begin = nullptr;
+	const int* end = nullptr;
+	visited->assign(graph.vertexActiveBlock(), false);
+	stack->push_back(0);
+	while (!stack->empty()) {
+		int v = stack->back();
+		stack->pop_back();
+		if ((*visited)[v])
+			continue;
+		(*visited)[v] = true;
+		++visits;
+		graph.tryGetFrozenChildren(v, &begin, &end);
+		stack->insert(stack->end(), begin, end);
+	}
+	return visits;
+}
+
+// Times every traversal through both the edge lists and the snapshot, the graph must be frozen.
+// returns: Whether the snapshot agreed with the edge lists.
+bool runTraversals(Digraph& graph, const string& label, uint32_t repetitions) {
+	uint64_t linkedSum = 0;
+	uint64_t frozenSum = 0;
+	uint64_t linkedVisits = 0;
+	uint64_t frozenVisits = 0;
+	vector<int> stack;
+	vector<bool> visited;
+
+	double linkedTime = timeMs([&]() { linkedSum = sumChildrenLinked(graph); }, repetitions);
+	double frozenTime = timeMs([&]() { frozenSum = sumChildrenFrozen(graph); }, repetitions);
+	double linkedWalkTime = timeMs([&]() { linkedVisits = walkLinked(graph, &stack, &visited); }, repetitions);
+	double frozenWalkTime = timeMs([&]() { frozenVisits = walkFrozen(graph, &stack, &visited); }, repetitions);
+
+	if (linkedSum != frozenSum || linkedVisits != frozenVisits) {
+		cout << "Error: the snapshot does not match the edge lists!" << endl;
+		return false;
+	}
+
+	cout << "[" << label << "]" << endl;
+	cout << "All children, edge lists: " << linkedTime << " ms" << endl;
+	cout << "All children, frozen:     " << frozenTime << " ms (" <<
+		linkedTime / frozenTime << "x)" << endl;
+	cout << "Depth first, edge lists:  " << linkedWalkTime << " ms" << endl;
+	cout << "Depth first, frozen:      " << frozenWalkTime << " ms (" <<
+		linkedWalkTime / frozenWalkTime << "x)" << endl;
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t vertexCount = argc > 1 ? (uint32_t)stoul(argv[1]) : 1000000u;
+	uint32_t repetitions = argc > 2 ? (uint32_t)stoul(argv[2]) : 5u;
+
+	Digraph graph(vertexCount, vertexCount * 2);
+	mt19937 rng(1337);
+
+	// A random tree, with a few extra edges so that some vertices have several parents
+	for (uint32_t i = 0; i < vertexCount; ++i)
+		graph.createVertex();
+	for (uint32_t i = 1; i < vertexCount; ++i)
+		graph.createEdge(uniform_int_distribution<uint32_t>(0, i - 1)(rng), i);
+	for (uint32_t i = 0; i < vertexCount / 4; ++i) {
+		uint32_t child = uniform_int_distribution<uint32_t>(1, vertexCount - 1)(rng);
+		graph.createEdge(uniform_int_distribution<uint32_t>(0, child - 1)(rng), child);
+	}
+
+	// Churn the edges like a long running scene would, so that the edge lists end up
+	// scattered across the edge array
+	vector<pair<int, int>> churned;
+	for (auto it = graph.edges(); it.valid(); it.next()) {
+		if (rng() % 2 == 0)
+			churned.emplace_back(it().tail().id(), it().head().id());
+	}
+	shuffle(churned.begin(), churned.end(), rng);
+	for (auto& edge : churned) {
+		auto tail = graph.getVertex(edge.first);
+		for (auto it = tail.outgoing(); it.valid(); it.next()) {
+			if (it().head().id() == edge.second) {
+				graph.deleteEdge(it());
+				break;
+			}
+		}
+	}
+	shuffle(churned.begin(), churned.end(), rng);
+	for (auto& edge : churned)
+		graph.createEdge(edge.first, edge.second);
+
+	cout << "Vertices: " << graph.vertexCount() << ", edges: " << graph.edgeCount() <<
+		", churned edges: " << churned.size() << endl;
+
+	cout << fixed << setprecision(2);
+
+	double freezeTime = timeMs([&]() {
+		// Force a rebuild every repetition
+		auto v = graph.createVertex();
+		graph.deleteVertex(v);
+		graph.freeze();
+	}, repetitions);
+
+	if (!runTraversals(graph, "scattered", repetitions))
+		return 1;
+
+	double reorderTime = timeMs([&]() {
+		graph.compress(DigraphOrder::DEPTH_FIRST, { 0 });
+	}, 1);
+	graph.freeze();
+
+	if (!runTraversals(graph, "depth first order", repetitions))
+		return 1;
+
+	cout << "Freeze: " << freezeTime << " ms" << endl;
+	cout << "Compress in depth first order: " << reorderTime << " ms" << endl;
+	return 0;
+}
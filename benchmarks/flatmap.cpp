@@ -0,0 +1,182 @@
+#include <engine/flatmap.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace Morpheus;
+using namespace std;
+
+// Compares FlatHashMap against std::unordered_map on the operations the graph lookups
+// perform: inserting names, finding them, and remapping ids after Digraph::compress,
+// both by rewriting the values of a name to id lookup and by rekeying an id to value
+// map like sparse data does.
+//
+// Usage: bench-flatmap [entry count] [repetitions]
+
+double timeMs(const function<void()>& f, uint32_t repetitions) {
+	double best = numeric_limits<double>::infinity();
+	for (uint32_t i = 0; i < repetitions; ++i) {
+		auto start = chrono::high_resolution_clock::now();
+		f();
+		chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+		best = min(best, elapsed.count());
+	}
+	return best;
+}
+
+struct Timings {
+	double mInsert;
+	double mFindHit;
+	double mFindMiss;
+	double mRemapValues;
+	double mRemapKeys;
+	uint64_t mChecksum;
+};
+
+// K: The key type, int or std::string.
+// MapKV: The map from keys to ids.
+// MapIdK: The map from ids to keys.
+template <typename K, typename MapKV, typename MapIdK>
+Timings run(const vector<K>& keys, const vector<K>& missing, const vector<int>& idMap, uint32_t repetitions) {
+	Timings t;
+	uint64_t checksum = 0;
+
+	MapKV map;
+	t.mInsert = timeMs([&]() {
+		map = MapKV();
+		for (size_t i = 0; i < keys.size(); ++i)
+			map[keys[i]] = (int)i;
+	}, repetitions);
+
+	t.mFindHit = timeMs([&]() {
+		uint64_t sum = 0;
+		for (auto& key : keys) {
+			auto it = map.find(key);
+			if (it != map.end())
+				sum += it->second;
+		}
+		checksum += sum;
+	}, repetitions);
+
+	t.mFindMiss = timeMs([&]() {
+		uint64_t found = 0;
+		for (auto& key : missing)
+			found += map.find(key) != map.end();
+		checksum += found;
+	}, repetitions);
+
+	// What DigraphLookup::applyMap does, a copy is remapped every repetition
+	t.mRemapValues = 0.0;
+	for (uint32_t r = 0; r < repetitions; ++r) {
+		MapKV copy = map;
+		double time = timeMs([&]() {
+			for (auto it = copy.begin(); it != copy.end();) {
+				int next = idMap[it->second];
+				if (next < 0) {
+					it = copy.erase(it);
+				} else {
+					it->second = next;
+					++it;
+				}
+			}
+		}, 1);
+		t.mRemapValues = r == 0 ? time : min(t.mRemapValues, time);
+		checksum += copy.size();
+	}
+
+	// What DigraphSparseData::compress and DigraphTwoWayLookup::applyMap do
+	MapIdK byId;
+	for (size_t i = 0; i < keys.size(); ++i)
+		byId[(int)i] = keys[i];
+	t.mRemapKeys = timeMs([&]() {
+		MapIdK next;
+		next.reserve(byId.size());
+		for (auto& entry : byId) {
+			int id = idMap[entry.first];
+			if (id >= 0)
+				next[id] = entry.second;
+		}
+		checksum += next.size();
+	}, repetitions);
+
+	t.mChecksum = checksum;
+	return t;
+}
+
+template <typename K>
+bool compare(const string& label, const vector<K>& keys, const vector<K>& missing,
+	const vector<int>& idMap, uint32_t repetitions) {
+	auto stdTimes = run<K, unordered_map<K, int>, unordered_map<int, K>>(keys, missing, idMap, repetitions);
+	auto flatTimes = run<K, FlatHashMap<K, int>, FlatHashMap<int, K>>(keys, missing, idMap, repetitions);
+
+	if (stdTimes.mChecksum != flatTimes.mChecksum) {
+		cout << "Error: FlatHashMap does not agree with std::unordered_map!" << endl;
+		return false;
+	}
+
+	auto row = [](const string& name, double stdTime, double flatTime) {
+		cout << left << setw(14) << name << right << setw(10) << stdTime << " ms" <<
+			setw(10) << flatTime << " ms" << setw(8) << stdTime / flatTime << "x" << endl;
+	};
+
+	cout << "[" << label << "]" << endl;
+	cout << left << setw(14) << "" << right << setw(13) << "unordered" << setw(13) << "flat" << endl;
+	row("insert", stdTimes.mInsert, flatTimes.mInsert);
+	row("find hit", stdTimes.mFindHit, flatTimes.mFindHit);
+	row("find miss", stdTimes.mFindMiss, flatTimes.mFindMiss);
+	row("remap values", stdTimes.mRemapValues, flatTimes.mRemapValues);
+	row("remap keys", stdTimes.mRemapKeys, flatTimes.mRemapKeys);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t count = argc > 1 ? (uint32_t)stoul(argv[1]) : 1000000u;
+	uint32_t repetitions = argc > 2 ? (uint32_t)stoul(argv[2]) : 5u;
+
+	mt19937 rng(1337);
+
+	// Sparse ids like those of a churned graph
+	vector<int> intKeys(count);
+	vector<int> intMissing(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		intKeys[i] = (int)(i * 2);
+		intMissing[i] = (int)(i * 2 + 1);
+	}
+	shuffle(intKeys.begin(), intKeys.end(), rng);
+
+	// Content paths, which is what the content manager looks up by
+	vector<string> stringKeys(count);
+	vector<string> stringMissing(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		stringKeys[i] = "content/models/asset_" + to_string(i) + ".obj";
+		stringMissing[i] = "content/textures/asset_" + to_string(i) + ".png";
+	}
+	shuffle(stringKeys.begin(), stringKeys.end(), rng);
+
+	// A compress that drops a tenth of the ids and shuffles the rest
+	vector<int> order(count);
+	for (uint32_t i = 0; i < count; ++i)
+		order[i] = (int)i;
+	shuffle(order.begin(), order.end(), rng);
+	vector<int> idMap(count, -1);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (rng() % 10 != 0)
+			idMap[i] = order[i];
+	}
+
+	cout << "Entries: " << count << endl;
+	cout << fixed << setprecision(2);
+
+	if (!compare<int>("int keys", intKeys, intMissing, idMap, repetitions))
+		return 1;
+	if (!compare<string>("string keys", stringKeys, stringMissing, idMap, repetitions))
+		return 1;
+	return 0;
+}
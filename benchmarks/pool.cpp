@@ -0,0 +1,180 @@
+#include <engine/concurrentpool.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Morpheus;
+using namespace std;
+
+// Measures alloc/free churn on ConcurrentPool from 1 to 32 threads, against a Pool
+// behind a mutex, which is what sharing a Pool between threads would take otherwise.
+// Every thread keeps a window of live objects and replaces a random one per step.
+// In the handoff run, each thread frees objects that the previous thread allocated,
+// like content decoded on a worker and released on the main thread.
+//
+// Usage: bench-pool [steps per thread] [max threads]
+
+struct Payload {
+	uint64_t mData[8];
+};
+
+#define WINDOW_SIZE 256
+
+double timeMs(uint32_t threadCount, const function<void(uint32_t)>& body) {
+	vector<thread> threads;
+	auto start = chrono::high_resolution_clock::now();
+	for (uint32_t t = 0; t < threadCount; ++t)
+		threads.emplace_back(body, t);
+	for (auto& th : threads)
+		th.join();
+	chrono::duration<double, milli> elapsed = chrono::high_resolution_clock::now() - start;
+	return elapsed.count();
+}
+
+// alloc(value) allocates an object and stores value in it, release(h) returns the
+// value of an object and frees it. Both touch the payload, so that a locked pool
+// can resolve the handle under its lock.
+template <typename Handle, typename AllocF, typename ReleaseF>
+void churn(uint32_t thread, uint32_t steps, AllocF&& alloc, ReleaseF&& release, uint64_t* checksum) {
+	mt19937 rng(thread + 1);
+	vector<Handle> window(WINDOW_SIZE);
+	uint64_t sum = 0;
+	for (auto& h : window)
+		h = alloc(thread);
+	for (uint32_t i = 0; i < steps; ++i) {
+		auto& h = window[rng() % WINDOW_SIZE];
+		sum += release(h);
+		h = alloc(i);
+	}
+	for (auto& h : window)
+		sum += release(h);
+	*checksum += sum;
+}
+
+double runLocked(uint32_t threadCount, uint32_t steps) {
+	Pool<Payload> pool;
+	mutex m;
+	vector<uint64_t> sums(threadCount);
+	return timeMs(threadCount, [&](uint32_t t) {
+		// Pool::alloc may reallocate the chunk table, so handles are only resolved
+		// under the lock as well
+		churn<PoolHandle<Payload>>(t, steps,
+			[&](uint64_t value) {
+				lock_guard<mutex> lock(m);
+				auto h = pool.alloc();
+				h->mData[0] = value;
+				return h;
+			},
+			[&](PoolHandle<Payload>& h) {
+				lock_guard<mutex> lock(m);
+				uint64_t value = h->mData[0];
+				pool.dealloc(h);
+				return value;
+			},
+			&sums[t]);
+	});
+}
+
+double runConcurrent(uint32_t threadCount, uint32_t steps, ConcurrentPoolStats* stats) {
+	auto pool = make_unique<ConcurrentPool<Payload>>();
+	vector<uint64_t> sums(threadCount);
+	double time = timeMs(threadCount, [&](uint32_t t) {
+		churn<ConcurrentPoolHandle<Payload>>(t, steps,
+			[&](uint64_t value) {
+				auto h = pool->alloc();
+				h->mData[0] = value;
+				return h;
+			},
+			[&](ConcurrentPoolHandle<Payload>& h) {
+				uint64_t value = h->mData[0];
+				pool->dealloc(h);
+				return value;
+			},
+			&sums[t]);
+	});
+	*stats = pool->stats();
+	return time;
+}
+
+// Every thread allocates a batch, then frees the batch of the previous thread.
+double runHandoff(uint32_t threadCount, uint32_t steps, ConcurrentPoolStats* stats) {
+	auto pool = make_unique<ConcurrentPool<Payload>>();
+	uint32_t rounds = max(1u, steps / WINDOW_SIZE);
+	vector<vector<ConcurrentPoolHandle<Payload>>> batches(threadCount,
+		vector<ConcurrentPoolHandle<Payload>>(WINDOW_SIZE));
+	vector<unique_ptr<mutex>> locks;
+	for (uint32_t t = 0; t < threadCount; ++t)
+		locks.emplace_back(new mutex);
+
+	double time = timeMs(threadCount, [&](uint32_t t) {
+		vector<ConcurrentPoolHandle<Payload>> mine(WINDOW_SIZE);
+		uint32_t other = (t + threadCount - 1) % threadCount;
+		for (uint32_t r = 0; r < rounds; ++r) {
+			for (auto& h : mine)
+				h = pool->alloc();
+			{
+				// Take what the other thread left, leave ours in our slot
+				lock_guard<mutex> lock(*locks[other]);
+				swap(mine, batches[other]);
+			}
+			for (auto& h : mine) {
+				if (h.getPool())
+					pool->dealloc(h);
+				h = ConcurrentPoolHandle<Payload>();
+			}
+			{
+				// And free what the next thread left us
+				lock_guard<mutex> lock(*locks[t]);
+				for (auto& h : batches[t]) {
+					if (h.getPool())
+						pool->dealloc(h);
+					h = ConcurrentPoolHandle<Payload>();
+				}
+			}
+		}
+	});
+	*stats = pool->stats();
+	return time;
+}
+
+int main(int argc, char* argv[]) {
+	uint32_t steps = argc > 1 ? (uint32_t)stoul(argv[1]) : 1000000u;
+	uint32_t maxThreads = argc > 2 ? (uint32_t)stoul(argv[2]) : 32u;
+
+	cout << "Steps per thread: " << steps << endl;
+	cout << fixed << setprecision(2);
+	cout << right << setw(8) << "threads" << setw(14) << "locked Mops" << setw(14) << "concurrent" <<
+		setw(10) << "speedup" << setw(14) << "handoff Mops" << setw(14) << "cross frees" <<
+		setw(12) << "depot ops" << endl;
+
+	for (uint32_t threads = 1; threads <= maxThreads; threads *= 2) {
+		// An alloc and a free per step
+		double ops = 2.0 * steps * threads / 1000.0;
+		ConcurrentPoolStats stats;
+		ConcurrentPoolStats handoffStats;
+		double locked = runLocked(threads, steps);
+		double concurrent = runConcurrent(threads, steps, &stats);
+		double handoff = runHandoff(threads, steps, &handoffStats);
+
+		if (stats.mAllocs != stats.mFrees) {
+			cout << "Error: ConcurrentPool lost track of " << stats.mAllocs - stats.mFrees << " objects!" << endl;
+			return 1;
+		}
+
+		double handoffOps = (handoffStats.mAllocs + handoffStats.mFrees) / 1000.0;
+		cout << setw(8) << threads << setw(14) << ops / locked << setw(14) << ops / concurrent <<
+			setw(9) << locked / concurrent << "x" << setw(14) << handoffOps / handoff <<
+			setw(14) << handoffStats.mCrossThreadFrees <<
+			setw(12) << handoffStats.mDepotPops + handoffStats.mDepotPushes << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: atom.hpp
+*	Description: A global table of interned strings. Every distinct string is stored
+*	once and identified by a 32 bit atom, so node names and content sources can be
+*	compared and looked up as integers instead of being copied and hashed on every use.
+*/
+
+#pragma once
+
+#include <engine/flatmap.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+namespace Morpheus {
+
+	// An interned string. Atoms are never freed, so an atom and the string it refers
+	// to stay valid for the lifetime of the program. The default atom is the empty string.
+	struct Atom {
+		uint32_t mId = 0;
+
+		inline bool operator==(const Atom& other) const { return mId == other.mId; }
+		inline bool operator!=(const Atom& other) const { return mId != other.mId; }
+		inline bool empty() const { return mId == 0; }
+
+		// returns: The interned string.
+		inline const std::string& str() const;
+		// returns: The hash of the string, computed once when it was interned.
+		inline uint64_t hash() const;
+	};
+
+	// The table behind Atom. Interning takes a lock, looking up the string of an atom
+	// takes a shared lock, so atoms can be created and read from any thread.
+	class AtomTable {
+	private:
+		struct Entry {
+			std::string mString;
+			uint64_t mHash;
+		};
+
+		// A deque so that entries never move, mIds keys point into them
+		std::deque<Entry> mEntries;
+		FlatHashMap<std::string_view, uint32_t> mIds;
+		mutable std::shared_mutex mMutex;
+
+	public:
+		AtomTable();
+
+		// Interns a string.
+		// s: The string to intern.
+		// returns: The atom of the string, the same for every call with an equal string.
+		Atom intern(std::string_view s);
+
+		// Interns a path with its backslashes replaced by forward slashes, so that
+		// "a\\b" and "a/b" are the same atom.
+		// path: The path to intern.
+		// returns: The atom of the normalized path.
+		Atom internPath(std::string_view path);
+
+		// Finds the atom of a string without interning it.
+		// s: The string to look for.
+		// out: Receives the atom if the string has been interned.
+		// returns: Whether the string has been interned.
+		bool tryFind(std::string_view s, Atom* out) const;
+
+		// Same as tryFind, with the path normalized like internPath.
+		bool tryFindPath(std::string_view path, Atom* out) const;
+
+		// returns: The string of an atom.
+		const std::string& str(Atom atom) const;
+		// returns: The hash of the string of an atom.
+		uint64_t hash(Atom atom) const;
+		// returns: The number of interned strings.
+		size_t size() const;
+	};
+
+	// returns: The global atom table.
+	AtomTable* atoms();
+
+	// Shorthand for atoms()->intern(s).
+	inline Atom intern(std::string_view s) {
+		return atoms()->intern(s);
+	}
+
+	// Shorthand for atoms()->internPath(path).
+	inline Atom internPath(std::string_view path) {
+		return atoms()->internPath(path);
+	}
+
+	inline const std::string& Atom::str() const {
+		return atoms()->str(*this);
+	}
+
+	inline uint64_t Atom::hash() const {
+		return atoms()->hash(*this);
+	}
+}
+
+namespace std {
+	// Atoms are dense, the id is as good a hash as any
+	template <>
+	struct hash<Morpheus::Atom> {
+		inline size_t operator()(const Morpheus::Atom& atom) const {
+			return atom.mId;
+		}
+	};
+}
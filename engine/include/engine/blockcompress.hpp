@@ -0,0 +1,112 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: blockcompress.hpp
+*	Description: Encoders for the BCn block compressed texture formats, used to cook
+*	textures into .ktx files and optionally to compress textures as they are imported.
+*/
+
+#pragma once
+
+#include <engine/json.hpp>
+#include <engine/mipgen.hpp>
+#include <engine/threadpool.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rows of blocks that a single job encodes
+#define BLOCK_ROWS_PER_JOB 8
+
+namespace Morpheus {
+
+	enum class BlockFormat {
+		// Chooses a format based on the number of components of the image
+		AUTO,
+		// RGB at 4 bits per texel
+		BC1,
+		// RGBA at 8 bits per texel, BC1 color with BC4 alpha
+		BC3,
+		// A single channel at 4 bits per texel
+		BC4,
+		// Two channels at 8 bits per texel, i.e., for normal maps
+		BC5,
+		// RGBA at 8 bits per texel with much better quality than BC3
+		BC7
+	};
+
+	enum class BlockQuality {
+		// Bounding box endpoints
+		FAST,
+		// Principal axis endpoints with a least squares refinement
+		NORMAL,
+		// Several refinement passes and alternative block modes
+		HIGH
+	};
+
+	struct BlockCompressParameters {
+		BlockFormat mFormat;
+		BlockQuality mQuality;
+		// Use the sRGB variant of the format for BC1, BC3 and BC7
+		bool bSRGB;
+
+		static BlockCompressParameters defaults();
+		// Reads the "texture_compression" block of the engine config.
+		static BlockCompressParameters fromConfig(const nlohmann::json& config);
+
+		// returns: A description of everything that affects the compressed result, for
+		// use as the parameters of a DerivedDataCache key.
+		std::string cacheParameters() const;
+	};
+
+	// returns: The format that AUTO resolves to for an image with the given components.
+	BlockFormat resolveBlockFormat(BlockFormat format, uint32_t components);
+	// returns: The number of bytes in a 4x4 block of the format.
+	uint32_t blockSize(BlockFormat format);
+
+	// Encodes a single 4x4 block of RGBA8 texels, rows from top to bottom.
+	// rgba: 64 bytes of texels.
+	// format: The format to encode into, must not be AUTO.
+	// quality: The quality to encode with.
+	// output: Receives blockSize(format) bytes.
+	void compressBlock(const uint8_t rgba[64], BlockFormat format, BlockQuality quality, uint8_t* output);
+
+	// Compresses images on a pool of worker threads, with the rows of blocks of an
+	// image split across the workers.
+	class BlockCompressor {
+	private:
+		ThreadPool mWorkers;
+
+		// Queues the jobs that compress an image into output, without waiting for them.
+		void submit(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t components,
+			BlockFormat format, BlockQuality quality, uint8_t* output);
+
+	public:
+		// threadCount: The number of worker threads, 0 to do all work on the calling thread.
+		BlockCompressor(uint32_t threadCount);
+
+		// Compresses an 8 bit image. Images whose size is not a multiple of 4 are padded
+		// by repeating their last row and column.
+		// pixels: The image, tightly packed rows from top to bottom.
+		// width: The width of the image.
+		// height: The height of the image.
+		// components: The number of components per pixel, 1 to 4.
+		// format: The format to compress into, must not be AUTO.
+		// quality: The quality to encode with.
+		// output: Receives the blocks, row by row.
+		void compress(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t components,
+			BlockFormat format, BlockQuality quality, std::vector<uint8_t>* output);
+
+		// Compresses every level of a mip chain in place.
+		// levels: The levels to compress, 8 bit with the given number of components.
+		// components: The number of components per pixel, 1 to 4.
+		// format: The format to compress into, must not be AUTO.
+		// quality: The quality to encode with.
+		void compress(std::vector<MipLevel>* levels, uint32_t components,
+			BlockFormat format, BlockQuality quality);
+
+		inline uint32_t threadCount() const { return mWorkers.threadCount(); }
+	};
+}
@@ -0,0 +1,492 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: concurrentpool.hpp
+*	Description: A thread-safe counterpart of Pool. Every thread allocates from and
+*	frees into its own magazines, full and empty magazines are traded through a
+*	lock-free depot, so threads only touch shared state once per magazine.
+*/
+
+#pragma once
+
+#include <engine/pool.hpp>
+#include <engine/log.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// The number of objects in a chunk of a concurrent pool, must be a power of two
+#define CONCURRENT_POOL_CHUNK_SIZE 1024
+#define CONCURRENT_POOL_CHUNK_SHIFT 10
+// The chunk directory never moves, this bounds a pool to 4M objects
+#define CONCURRENT_POOL_MAX_CHUNKS 4096
+// The number of objects a thread caches in each of its two magazines
+#define CONCURRENT_POOL_MAGAZINE_SIZE 64
+// Threads past this many share one cache behind a lock
+#define CONCURRENT_POOL_MAX_THREADS 64
+#define CONCURRENT_POOL_CACHE_LINE 64
+
+namespace Morpheus {
+
+	template <typename T>
+	class ConcurrentPool;
+
+	// A handle to an object in a concurrent pool, with the same interface as PoolHandle.
+	template <typename T>
+	class ConcurrentPoolHandle {
+	private:
+		ConcurrentPool<T>* mPoolPtr;
+		uint32_t mOffset;
+		uint32_t mGeneration;
+
+	public:
+		inline ConcurrentPoolHandle(ConcurrentPool<T>* ptr, uint32_t offset, uint32_t generation) :
+			mPoolPtr(ptr), mOffset(offset), mGeneration(generation) { }
+		inline ConcurrentPoolHandle() : mPoolPtr(nullptr), mOffset(POOL_INVALID_OFFSET), mGeneration(0) { }
+
+		inline T* operator->();
+		inline T* get() const;
+		inline ConcurrentPool<T>* getPool() { return mPoolPtr; }
+		inline uint32_t offset() const { return mOffset; }
+		inline uint32_t generation() const { return mGeneration; }
+		inline bool operator==(const ConcurrentPoolHandle& other) {
+			return mPoolPtr == other.mPoolPtr && mOffset == other.mOffset && mGeneration == other.mGeneration;
+		}
+
+		friend class ConcurrentPool<T>;
+	};
+
+	struct ConcurrentPoolStats {
+		uint64_t mAllocs = 0;
+		uint64_t mFrees = 0;
+		// Frees of objects that another thread allocated
+		uint64_t mCrossThreadFrees = 0;
+		// Magazines taken from and given to the depot
+		uint64_t mDepotPops = 0;
+		uint64_t mDepotPushes = 0;
+		uint32_t mChunks = 0;
+	};
+
+	// Hands every thread a small index for the per-thread caches of concurrent pools.
+	// Indices are recycled when threads exit, so the caches of an exited thread are
+	// picked up by the next thread. Threads past CONCURRENT_POOL_MAX_THREADS get
+	// CONCURRENT_POOL_MAX_THREADS.
+	class ConcurrentPoolThreadIndex {
+	private:
+		uint32_t mIndex;
+
+		struct Registry {
+			std::mutex mMutex;
+			std::vector<uint32_t> mFree;
+			uint32_t mNext = 0;
+		};
+
+		static Registry& registry() {
+			static Registry instance;
+			return instance;
+		}
+
+		ConcurrentPoolThreadIndex() {
+			auto& r = registry();
+			std::lock_guard<std::mutex> lock(r.mMutex);
+			if (!r.mFree.empty()) {
+				mIndex = r.mFree.back();
+				r.mFree.pop_back();
+			}
+			else if (r.mNext < CONCURRENT_POOL_MAX_THREADS)
+				mIndex = r.mNext++;
+			else
+				mIndex = CONCURRENT_POOL_MAX_THREADS;
+		}
+
+		~ConcurrentPoolThreadIndex() {
+			if (mIndex == CONCURRENT_POOL_MAX_THREADS)
+				return;
+			auto& r = registry();
+			std::lock_guard<std::mutex> lock(r.mMutex);
+			r.mFree.push_back(mIndex);
+		}
+
+	public:
+		// returns: The index of the calling thread.
+		static inline uint32_t get() {
+			static thread_local ConcurrentPoolThreadIndex index;
+			return index.mIndex;
+		}
+	};
+
+	// A pool that many threads can allocate from and free into at once. Like Pool,
+	// objects live in chunks that never move and handles carry generations. Each
+	// thread keeps two magazines of free slots (Bonwick's magazine layer) and only
+	// goes to the global depot when both are empty or both are full. The depot is a
+	// lock-free stack of magazines, each stored as a list threaded through its free
+	// slots, with a tag in the head against ABA. Growing the pool takes a lock, but
+	// happens once per chunk.
+	// Unlike Pool, there is no compress, objects never move.
+	// T: The object type.
+	template <typename T>
+	class ConcurrentPool {
+	private:
+		struct Chunk {
+			alignas(T) unsigned char mStorage[CONCURRENT_POOL_CHUNK_SIZE * sizeof(T)];
+			// Odd while the slot holds an object
+			std::atomic<uint32_t> mGenerations[CONCURRENT_POOL_CHUNK_SIZE];
+			// The next slot of a magazine in the depot
+			uint32_t mNextFree[CONCURRENT_POOL_CHUNK_SIZE];
+			// The next magazine in the depot, stored in the first slot of a magazine.
+			// Atomic since a losing pop may read it while it is rewritten.
+			std::atomic<uint32_t> mNextMagazine[CONCURRENT_POOL_CHUNK_SIZE];
+			// The number of slots of a magazine, stored in the first slot
+			uint32_t mMagazineCount[CONCURRENT_POOL_CHUNK_SIZE];
+			// The thread index that allocated the slot
+			uint16_t mOwner[CONCURRENT_POOL_CHUNK_SIZE];
+			bool bConstructed[CONCURRENT_POOL_CHUNK_SIZE];
+		};
+
+		struct alignas(CONCURRENT_POOL_CACHE_LINE) Cache {
+			uint32_t mLoaded[CONCURRENT_POOL_MAGAZINE_SIZE];
+			uint32_t mPrevious[CONCURRENT_POOL_MAGAZINE_SIZE];
+			uint32_t mLoadedCount = 0;
+			uint32_t mPreviousCount = 0;
+			// Only written by the thread that owns the cache, atomic so stats can read them
+			std::atomic<uint64_t> mAllocs{0};
+			std::atomic<uint64_t> mFrees{0};
+			std::atomic<uint64_t> mCrossThreadFrees{0};
+			std::atomic<uint64_t> mDepotPops{0};
+			std::atomic<uint64_t> mDepotPushes{0};
+		};
+
+		std::atomic<Chunk*> mChunks[CONCURRENT_POOL_MAX_CHUNKS];
+		alignas(CONCURRENT_POOL_CACHE_LINE) std::atomic<uint32_t> mChunkCount;
+		// Slots from here on have never been used
+		alignas(CONCURRENT_POOL_CACHE_LINE) std::atomic<uint32_t> mFreeBlockStart;
+		// Tag in the high 32 bits, first slot of the top magazine in the low 32 bits
+		alignas(CONCURRENT_POOL_CACHE_LINE) std::atomic<uint64_t> mDepot;
+		std::mutex mGrowMutex;
+		// The last cache is shared by threads that have no index of their own
+		Cache mCaches[CONCURRENT_POOL_MAX_THREADS + 1];
+		std::mutex mOverflowMutex;
+
+		static inline uint32_t slotOf(uint32_t offset) {
+			return offset & (CONCURRENT_POOL_CHUNK_SIZE - 1);
+		}
+		inline Chunk* chunkOf(uint32_t offset) const {
+			return mChunks[offset >> CONCURRENT_POOL_CHUNK_SHIFT].load(std::memory_order_acquire);
+		}
+		inline T* slot(uint32_t offset) const {
+			return reinterpret_cast<T*>(chunkOf(offset)->mStorage) + slotOf(offset);
+		}
+		static inline void bump(std::atomic<uint64_t>& counter) {
+			counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		}
+
+		// Makes sure that the chunks up to an offset exist.
+		// returns: Whether the pool could grow that far.
+		bool grow(uint32_t end) {
+			uint32_t needed = (end + CONCURRENT_POOL_CHUNK_SIZE - 1) >> CONCURRENT_POOL_CHUNK_SHIFT;
+			if (needed <= mChunkCount.load(std::memory_order_acquire))
+				return true;
+			if (needed > CONCURRENT_POOL_MAX_CHUNKS)
+				return false;
+
+			std::lock_guard<std::mutex> lock(mGrowMutex);
+			uint32_t count = mChunkCount.load(std::memory_order_relaxed);
+			for (; count < needed; ++count) {
+				auto chunk = new Chunk;
+				for (uint32_t i = 0; i < CONCURRENT_POOL_CHUNK_SIZE; ++i) {
+					chunk->mGenerations[i].store(0, std::memory_order_relaxed);
+					chunk->mNextMagazine[i].store(POOL_INVALID_OFFSET, std::memory_order_relaxed);
+					chunk->bConstructed[i] = false;
+				}
+				mChunks[count].store(chunk, std::memory_order_release);
+			}
+			mChunkCount.store(count, std::memory_order_release);
+			return true;
+		}
+
+		// Threads a magazine through its slots and pushes it onto the depot.
+		void pushMagazine(const uint32_t* offsets, uint32_t count) {
+			for (uint32_t i = 0; i + 1 < count; ++i)
+				chunkOf(offsets[i])->mNextFree[slotOf(offsets[i])] = offsets[i + 1];
+			uint32_t head = offsets[0];
+			auto headChunk = chunkOf(head);
+			headChunk->mMagazineCount[slotOf(head)] = count;
+
+			uint64_t old = mDepot.load(std::memory_order_relaxed);
+			uint64_t next;
+			do {
+				headChunk->mNextMagazine[slotOf(head)].store((uint32_t)old, std::memory_order_relaxed);
+				next = ((old >> 32) + 1) << 32 | head;
+			} while (!mDepot.compare_exchange_weak(old, next,
+				std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		// Pops a magazine off the depot.
+		// offsets: Receives the slots of the magazine.
+		// returns: The number of slots, zero if the depot is empty.
+		uint32_t popMagazine(uint32_t* offsets) {
+			uint64_t old = mDepot.load(std::memory_order_acquire);
+			uint64_t next;
+			uint32_t head;
+			do {
+				head = (uint32_t)old;
+				if (head == POOL_INVALID_OFFSET)
+					return 0;
+				uint32_t below = chunkOf(head)->mNextMagazine[slotOf(head)].load(std::memory_order_relaxed);
+				next = ((old >> 32) + 1) << 32 | below;
+			} while (!mDepot.compare_exchange_weak(old, next,
+				std::memory_order_acquire, std::memory_order_acquire));
+
+			uint32_t count = chunkOf(head)->mMagazineCount[slotOf(head)];
+			uint32_t offset = head;
+			for (uint32_t i = 0; i < count; ++i) {
+				offsets[i] = offset;
+				offset = chunkOf(offset)->mNextFree[slotOf(offset)];
+			}
+			return count;
+		}
+
+		// Refills the loaded magazine of a cache, from the previous magazine, the
+		// depot or the never used slots, in that order.
+		bool refill(Cache& cache) {
+			if (cache.mPreviousCount > 0) {
+				std::swap(cache.mLoaded, cache.mPrevious);
+				std::swap(cache.mLoadedCount, cache.mPreviousCount);
+				return true;
+			}
+
+			cache.mLoadedCount = popMagazine(cache.mLoaded);
+			if (cache.mLoadedCount > 0) {
+				bump(cache.mDepotPops);
+				return true;
+			}
+
+			// Only claim never used slots that fit, so failed allocs cannot push the
+			// counter past the end and wrap it around onto live slots
+			uint32_t start = mFreeBlockStart.load(std::memory_order_relaxed);
+			do {
+				if (start > CONCURRENT_POOL_MAX_CHUNKS * CONCURRENT_POOL_CHUNK_SIZE - CONCURRENT_POOL_MAGAZINE_SIZE) {
+					logError() << "ConcurrentPool is out of chunks!";
+					return false;
+				}
+			} while (!mFreeBlockStart.compare_exchange_weak(start, start + CONCURRENT_POOL_MAGAZINE_SIZE,
+				std::memory_order_relaxed, std::memory_order_relaxed));
+			grow(start + CONCURRENT_POOL_MAGAZINE_SIZE);
+			// Hand out the lowest slot first
+			for (uint32_t i = 0; i < CONCURRENT_POOL_MAGAZINE_SIZE; ++i)
+				cache.mLoaded[i] = start + CONCURRENT_POOL_MAGAZINE_SIZE - 1 - i;
+			cache.mLoadedCount = CONCURRENT_POOL_MAGAZINE_SIZE;
+			return true;
+		}
+
+		ConcurrentPoolHandle<T> allocFrom(Cache& cache, uint32_t thread) {
+			if (cache.mLoadedCount == 0 && !refill(cache))
+				return ConcurrentPoolHandle<T>();
+
+			uint32_t of = cache.mLoaded[--cache.mLoadedCount];
+			auto chunk = chunkOf(of);
+			auto i = slotOf(of);
+			chunk->mOwner[i] = (uint16_t)thread;
+			uint32_t generation = chunk->mGenerations[i].load(std::memory_order_relaxed) + 1;
+			chunk->mGenerations[i].store(generation, std::memory_order_release);
+			bump(cache.mAllocs);
+			return ConcurrentPoolHandle<T>(this, of, generation);
+		}
+
+		void deallocInto(Cache& cache, uint32_t thread, uint32_t of) {
+			if (cache.mLoadedCount == CONCURRENT_POOL_MAGAZINE_SIZE) {
+				// Keep the full magazine around and start on an empty one
+				if (cache.mPreviousCount == CONCURRENT_POOL_MAGAZINE_SIZE) {
+					pushMagazine(cache.mPrevious, cache.mPreviousCount);
+					bump(cache.mDepotPushes);
+					cache.mPreviousCount = 0;
+				}
+				std::swap(cache.mLoaded, cache.mPrevious);
+				std::swap(cache.mLoadedCount, cache.mPreviousCount);
+			}
+
+			cache.mLoaded[cache.mLoadedCount++] = of;
+			bump(cache.mFrees);
+			if (chunkOf(of)->mOwner[slotOf(of)] != thread)
+				bump(cache.mCrossThreadFrees);
+		}
+
+	public:
+		ConcurrentPool() : mChunkCount(0), mFreeBlockStart(0),
+			mDepot(POOL_INVALID_OFFSET) {
+			for (auto& chunk : mChunks)
+				chunk.store(nullptr, std::memory_order_relaxed);
+		}
+
+		ConcurrentPool(const uint32_t initialSize) : ConcurrentPool() {
+			resize(initialSize);
+		}
+
+		ConcurrentPool(const ConcurrentPool&) = delete;
+		ConcurrentPool& operator=(const ConcurrentPool&) = delete;
+
+		// No other thread may use the pool while it is destroyed.
+		~ConcurrentPool() {
+			uint32_t count = mChunkCount.load(std::memory_order_acquire);
+			for (uint32_t c = 0; c < count; ++c) {
+				auto chunk = mChunks[c].load(std::memory_order_relaxed);
+				for (uint32_t i = 0; i < CONCURRENT_POOL_CHUNK_SIZE; ++i)
+					if (chunk->bConstructed[i] &&
+						(chunk->mGenerations[i].load(std::memory_order_relaxed) & 1u))
+						reinterpret_cast<T*>(chunk->mStorage)[i].~T();
+				delete chunk;
+			}
+		}
+
+		inline T* at(const uint32_t offset) {
+			return slot(offset);
+		}
+
+		// Makes sure that the pool has room for a number of objects. Only ever grows
+		// the pool, objects are never moved.
+		// newSize: The number of objects.
+		void resize(const uint32_t newSize) {
+			if (!grow(newSize))
+				logError() << "ConcurrentPool cannot hold " << newSize << " objects!";
+		}
+
+		// returns: Whether a handle refers to an object that is still in the pool.
+		inline bool isValid(const ConcurrentPoolHandle<T>& h) const {
+			return h.mPoolPtr == this &&
+				(h.mOffset >> CONCURRENT_POOL_CHUNK_SHIFT) < mChunkCount.load(std::memory_order_acquire) &&
+				chunkOf(h.mOffset)->mGenerations[slotOf(h.mOffset)].load(std::memory_order_acquire) == h.mGeneration;
+		}
+
+		// returns: The object of a handle, or nullptr if the handle is stale.
+		inline T* tryGet(const ConcurrentPoolHandle<T>& h) const {
+			return isValid(h) ? slot(h.mOffset) : nullptr;
+		}
+
+		// Allocate an object from the pool. Note the constructor of the object will not be called.
+		// returns: A new object, or an invalid handle if the pool is full.
+		ConcurrentPoolHandle<T> alloc() {
+			uint32_t thread = ConcurrentPoolThreadIndex::get();
+			if (thread < CONCURRENT_POOL_MAX_THREADS)
+				return allocFrom(mCaches[thread], thread);
+
+			std::lock_guard<std::mutex> lock(mOverflowMutex);
+			return allocFrom(mCaches[thread], thread);
+		}
+
+		// Allocate an object and construct it in place. The pool destroys objects that
+		// are still alive when it is destroyed.
+		// args: The arguments of the constructor.
+		// returns: The new object, or an invalid handle if the pool is full.
+		template <typename... Args>
+		ConcurrentPoolHandle<T> create(Args&&... args) {
+			auto h = alloc();
+			if (h.mPoolPtr) {
+				new (slot(h.mOffset)) T(std::forward<Args>(args)...);
+				chunkOf(h.mOffset)->bConstructed[slotOf(h.mOffset)] = true;
+			}
+			return h;
+		}
+
+		// Frees an object in the pool from any thread. Objects from create are
+		// destroyed first. Freeing a stale handle prints a warning and does nothing,
+		// even if two threads free the same handle at once.
+		// h: Handle to the object to free
+		void dealloc(ConcurrentPoolHandle<T>& h) {
+			auto chunk = chunkOf(h.mOffset);
+			auto i = slotOf(h.mOffset);
+
+			// Claim the slot first, so only one of two racing frees destroys the object.
+			// The slot is not reused until it is back in a magazine below.
+			uint32_t expected = h.mGeneration;
+			if (!chunk->mGenerations[i].compare_exchange_strong(expected, expected + 1,
+				std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				logWarning() << "ConcurrentPool handle freed twice!";
+				return;
+			}
+
+			if (chunk->bConstructed[i]) {
+				slot(h.mOffset)->~T();
+				chunk->bConstructed[i] = false;
+			}
+
+			uint32_t thread = ConcurrentPoolThreadIndex::get();
+			if (thread < CONCURRENT_POOL_MAX_THREADS) {
+				deallocInto(mCaches[thread], thread, h.mOffset);
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mOverflowMutex);
+			deallocInto(mCaches[thread], thread, h.mOffset);
+		}
+
+		// Same as dealloc, named to pair with create.
+		inline void destroy(ConcurrentPoolHandle<T>& h) {
+			dealloc(h);
+		}
+
+		// Gives the free slots cached by the calling thread back to the depot, so that
+		// other threads can use them. Call before a thread goes idle for long.
+		void flush() {
+			uint32_t thread = ConcurrentPoolThreadIndex::get();
+			std::unique_lock<std::mutex> lock(mOverflowMutex, std::defer_lock);
+			if (thread == CONCURRENT_POOL_MAX_THREADS)
+				lock.lock();
+
+			auto& cache = mCaches[thread];
+			if (cache.mLoadedCount > 0) {
+				pushMagazine(cache.mLoaded, cache.mLoadedCount);
+				bump(cache.mDepotPushes);
+				cache.mLoadedCount = 0;
+			}
+			if (cache.mPreviousCount > 0) {
+				pushMagazine(cache.mPrevious, cache.mPreviousCount);
+				bump(cache.mDepotPushes);
+				cache.mPreviousCount = 0;
+			}
+		}
+
+		// returns: The counters of all threads added up. Counters of other threads may
+		// lag behind while they are still running.
+		ConcurrentPoolStats stats() const {
+			ConcurrentPoolStats result;
+			for (auto& cache : mCaches) {
+				result.mAllocs += cache.mAllocs.load(std::memory_order_relaxed);
+				result.mFrees += cache.mFrees.load(std::memory_order_relaxed);
+				result.mCrossThreadFrees += cache.mCrossThreadFrees.load(std::memory_order_relaxed);
+				result.mDepotPops += cache.mDepotPops.load(std::memory_order_relaxed);
+				result.mDepotPushes += cache.mDepotPushes.load(std::memory_order_relaxed);
+			}
+			result.mChunks = mChunkCount.load(std::memory_order_relaxed);
+			return result;
+		}
+
+		// returns: The number of objects in the pool, exact only while no thread is
+		// allocating or freeing.
+		inline uint32_t count() const {
+			auto s = stats();
+			return (uint32_t)(s.mAllocs - s.mFrees);
+		}
+
+		friend class ConcurrentPoolHandle<T>;
+	};
+
+	template<typename T>
+	inline T* ConcurrentPoolHandle<T>::operator->()
+	{
+		return get();
+	}
+	template<typename T>
+	inline T* ConcurrentPoolHandle<T>::get() const
+	{
+#ifdef _DEBUG
+		assert(mPoolPtr->isValid(*this));
+#endif
+		return mPoolPtr->slot(mOffset);
+	}
+}
@@ -11,11 +11,16 @@
 #pragma once
 
 #include <engine/core.hpp>
+#include <engine/derivedcache.hpp>
 #include <engine/pool.hpp>
 #include <engine/engine.hpp>
 #include <engine/glslpreprocessor.hpp>
 
+#include <deque>
+#include <list>
+#include <map>
 #include <set>
+#include <unordered_set>
 #include <iostream>
 
 /*
@@ -44,6 +49,61 @@ namespace Morpheus {
 	template <>
 	struct ContentExtParams<Sampler>;
 
+	template <>
+	struct ContentExtParams<Geometry>;
+
+	// The memory that a piece of content takes up.
+	struct ContentSize {
+		// Bytes of system memory
+		size_t mCpuBytes;
+		// Bytes of video memory
+		size_t mGpuBytes;
+
+		inline size_t total() const {
+			return mCpuBytes + mGpuBytes;
+		}
+
+		inline ContentSize& operator+=(const ContentSize& other) {
+			mCpuBytes += other.mCpuBytes;
+			mGpuBytes += other.mGpuBytes;
+			return *this;
+		}
+	};
+
+	// Totals over all content of a single type.
+	struct ContentResidency {
+		// The number of loaded pieces of content
+		uint32_t mCount;
+		ContentSize mSize;
+		// The part of the above that is only kept alive by the content cache
+		uint32_t mCachedCount;
+		ContentSize mCachedSize;
+	};
+
+	struct GarbageCollectionParameters {
+		// Collect a little every frame from Engine::update instead of all at once in prune
+		bool bIncremental;
+		// The time per frame that incremental collection may take, in milliseconds
+		double mBudget;
+
+		static GarbageCollectionParameters defaults();
+		// Reads the "garbage_collection" block of the engine config.
+		static GarbageCollectionParameters fromConfig(const nlohmann::json& config);
+	};
+
+	struct ContentCacheStats {
+		// Loads of content that was revived from the cache
+		uint64_t mHits;
+		// Loads that went through a content factory
+		uint64_t mMisses;
+		// Content that was unloaded to stay within the budget
+		uint64_t mEvictions;
+		// The number of pieces of content in the cache
+		uint32_t mEntries;
+		// The size of the content in the cache, as measured when it entered
+		size_t mBytes;
+	};
+
 	// An interface that all content factories must inherit from.
 	// Defines the interface for loading and unloading assets.
 	class IContentFactory {
@@ -52,6 +112,9 @@ namespace Morpheus {
 		virtual INodeOwner* loadEx(const std::string& source, Node loadInto, const void* extParams);
 
 		virtual void unload(INodeOwner* ref) = 0;
+		// Measures the memory that a piece of content from this factory takes up.
+		// The default is for content that holds no sizable buffers.
+		virtual ContentSize measure(INodeOwner* ref) const;
 		virtual std::string getContentTypeString() const = 0;
 
 		virtual ~IContentFactory();
@@ -73,13 +136,34 @@ namespace Morpheus {
 	// content manager as one of their parents. The content manager can also do basic garbage
 	// collection, whereby it checks for each of its children whether or not they have exactly
 	// one parent - if they do, they are unloaded by their respective content manager and removed
-	// from the scene graph. 
+	// from the scene graph. Optionally, content that garbage collection releases is kept in
+	// an LRU cache up to a byte budget, so that it can be loaded again without going back
+	// to disk. The node graph tells the content manager whenever content loses a user,
+	// so collection works through a queue instead of scanning every child, and can be
+	// spread over frames with collectIncremental.
 	class ContentManager : public INodeOwner {
 	private:
+		struct CacheEntry {
+			std::list<INodeOwner*>::iterator mPosition;
+			ContentSize mSize;
+		};
+
 		std::set<IContentFactory*> mFactories;
 		std::unordered_map<NodeType, IContentFactory*> mTypeToFactory;
-		DigraphTwoWayVertexLookupView<std::string> mSources;
-		std::set<INodeOwner*> mMarkedNodes;
+		// Sources are interned with internPath, so a source that has been loaded before
+		// is found with a single integer lookup
+		DigraphTwoWayVertexLookupView<Atom> mSources;
+		// Content that may be collectable, in the order it was released. Nodes that
+		// have been unloaded since are left in the deque but removed from mQueued.
+		std::deque<INodeOwner*> mCollectQueue;
+		std::unordered_set<INodeOwner*> mQueued;
+		GarbageCollectionParameters mCollectParameters;
+
+		// Most recently released first
+		std::list<INodeOwner*> mCacheOrder;
+		std::unordered_map<INodeOwner*, CacheEntry> mCacheEntries;
+		size_t mCacheBudget;
+		ContentCacheStats mCacheStats;
 
 		ContentFactory<Texture>* mTextureFactory;
 		ContentFactory<Shader>* mShaderFactory;
@@ -89,6 +173,23 @@ namespace Morpheus {
 		ContentFactory<Geometry>* mGeometryFactory;
 		ContentFactory<HalfEdgeGeometry>* mHalfEdgeGeometryFactory;
 		ContentFactory<StaticMesh>* mStaticMeshFactory;
+		DerivedDataCache* mDerivedCache;
+
+		// Keeps released content in the cache instead of unloading it.
+		// returns: Whether the content is now in the cache.
+		bool cacheRelease(INodeOwner* node);
+		// Takes content that is being loaded again out of the cache.
+		void cacheRevive(INodeOwner* node);
+		// Unloads the least recently released content until the cache fits its budget.
+		// Children that were only used by the evicted content are queued for collection.
+		void trimCache();
+
+		// Called by the node graph when a node has lost a parent.
+		void onRelease(INodeOwner* node);
+		// Collects queued content until the queue is empty.
+		// budget: The time to stop after in milliseconds, or a negative value for no limit.
+		// returns: The number of queued nodes that were processed.
+		uint32_t drainCollectQueue(double budget);
 
 	public:
 		inline ContentFactory<Texture>* getTextureFactory() {
@@ -123,19 +224,33 @@ namespace Morpheus {
 			return mStaticMeshFactory;
 		}
 
+		// The cache of cooked content that factories check before loading a source,
+		// nullptr if the engine config does not enable it.
+		inline DerivedDataCache* derivedCache() {
+			return mDerivedCache;
+		}
+
 		void init() override;
 	
 		ContentManager();
 		~ContentManager() override;
 
 		inline std::string getSourceString(INodeOwner* node) {
-			std::string src;
+			Atom src;
 			if (mSources.tryFind(node->node(), &src))
-				return src;
+				return src.str();
 			else
 				return "UNNAMED";
 		}
 
+		// Get the source that content was loaded from.
+		// node: The content.
+		// out: Receives the source.
+		// returns: Whether the content has a source.
+		inline bool tryGetSource(INodeOwner* node, Atom* out) {
+			return mSources.tryFind(node->node(), out);
+		}
+
 		// Add a factory to this content manager.
 		// ContentType: The content type of the factory to add.
 		template <typename ContentType> ContentFactory<ContentType>* addFactory() {
@@ -164,7 +279,7 @@ namespace Morpheus {
 
 		inline void createContentNode(INodeOwner* content, const std::string& source) {
 			graph()->createNode(content, this);
-			mSources.set(content->node(), source);
+			mSources.set(content->node(), internPath(source));
 		}
 
 		inline void createContentNode(INodeOwner* content, INodeOwner* parent) {
@@ -175,7 +290,7 @@ namespace Morpheus {
 		inline void createContentNode(INodeOwner* content, INodeOwner* parent, const std::string& source) {
 			createNode(content, this);
 			parent->addChild(content);
-			mSources.set(content->node(), source);
+			mSources.set(content->node(), internPath(source));
 		}
 
 		// Get a content factory by content type.
@@ -192,9 +307,12 @@ namespace Morpheus {
 		// ContentManager::load.
 		// content: The node for which to transfer ownership.
 		// sourceName: The name of the content so it can be looked up with ContentManager::load.
-		void setSource(INodeOwner* content, const std::string& sourceName) {
+		void setSource(INodeOwner* content, Atom sourceName) {
 			mSources.set(content->node(), sourceName);
 		}
+		void setSource(INodeOwner* content, const std::string& sourceName) {
+			setSource(content, internPath(sourceName));
+		}
 
 		// Loads an asset for a parent node.
 		// ContentType: Specifies the type of content. This determines which content factory is used.
@@ -204,17 +322,21 @@ namespace Morpheus {
 		// returns: A node containing the asset. 
 		template <typename ContentType>
 		ContentType* load(const std::string& source, INodeOwner* parent = nullptr) {
+			return load<ContentType>(internPath(source), parent);
+		}
+
+		// Same as load, with a source that has already been interned with internPath.
+		template <typename ContentType>
+		ContentType* load(Atom source, INodeOwner* parent = nullptr) {
 			assert(IS_BASE_TYPE_<ContentType>::RESULT);
 
-			std::string source_mod = source;
-			std::replace(source_mod.begin(), source_mod.end(), '\\', '/');
-			
 			auto graph_ = graph();
 			Node contentNode;
 			INodeOwner* content;
 			
-			if (mSources.tryFind(source_mod, &contentNode)) {
+			if (mSources.tryFind(source, &contentNode)) {
 				content = graph()->owner(contentNode);
+				cacheRevive(content);
 
 				if (parent)
 					parent->addChild(content);
@@ -227,7 +349,8 @@ namespace Morpheus {
 				
 				// Load a ref via the correct content factory
 				auto type = NODE_ENUM(ContentType);
-				content = mTypeToFactory[type]->load(source_mod, contentNode);
+				content = mTypeToFactory[type]->load(source.str(), contentNode);
+				++mCacheStats.mMisses;
 
 				if (content == nullptr) {
 					graph_->deleteVertex(contentNode);
@@ -238,7 +361,7 @@ namespace Morpheus {
 				graph_->setOwner(contentNode, content);
 
 				// Set the node description of the created node appropriately
-				mSources.set(contentNode, source_mod);
+				mSources.set(contentNode, source);
 				
 				// If a parent was passed, add the created content as a child of the parent
 				if (parent)
@@ -253,20 +376,24 @@ namespace Morpheus {
 
 		template <typename ContentType>
 		ContentType* loadEx(const std::string& source, const ContentExtParams<ContentType>& extParams, INodeOwner* parent = nullptr,
+			bool bOverrideExistingSource = false) {
+			return loadEx<ContentType>(internPath(source), extParams, parent, bOverrideExistingSource);
+		}
+
+		template <typename ContentType>
+		ContentType* loadEx(Atom source, const ContentExtParams<ContentType>& extParams, INodeOwner* parent = nullptr,
 			bool bOverrideExistingSource = false) {
 			assert(IS_BASE_TYPE_<ContentType>::RESULT);
 
-			std::string source_mod = source;
-			std::replace(source_mod.begin(), source_mod.end(), '\\', '/');
-			
 			auto graph_ = graph();
 			Node contentNode;
 			INodeOwner* content;
 
-			bool bAlreadyExists = mSources.tryFind(source_mod, &contentNode);
+			bool bAlreadyExists = mSources.tryFind(source, &contentNode);
 			
 			if (bAlreadyExists && !bOverrideExistingSource) {
 				content = graph_->owner(contentNode);
+				cacheRevive(content);
 
 				if (parent)
 					parent->addChild(content);
@@ -275,7 +402,7 @@ namespace Morpheus {
 			}
 			else {
 				if (bAlreadyExists) {
-					std::cout << "Content " << source << " already exists! The content attached to this source will be overriden!" << std::endl;
+					std::cout << "Content " << source.str() << " already exists! The content attached to this source will be overriden!" << std::endl;
 				}
 
 				// Create a vertex to load the content into
@@ -283,7 +410,8 @@ namespace Morpheus {
 				
 				// Load a ref via the correct content factory
 				auto type = NODE_ENUM(ContentType);
-				content = mTypeToFactory[type]->loadEx(source_mod, contentNode, &extParams);
+				content = mTypeToFactory[type]->loadEx(source.str(), contentNode, &extParams);
+				++mCacheStats.mMisses;
 
 				if (content == nullptr) {
 					graph_->deleteVertex(contentNode);
@@ -294,7 +422,7 @@ namespace Morpheus {
 				graph_->setOwner(contentNode, content);
 
 				// Set the node description of the created node appropriately
-				mSources.set(contentNode, source_mod);
+				mSources.set(contentNode, source);
 				
 				// If a parent was passed, add the created content as a child of the parent
 				if (parent)
@@ -316,16 +444,56 @@ namespace Morpheus {
 		void unload(INodeOwner* node);
 
 		// Marks this node for an unload if necessary
-		inline void markForUnload(INodeOwner* node) {
-			mMarkedNodes.emplace(node);
-		}
+		void markForUnload(INodeOwner* node);
 
 		// Checks to see if marked nodes are still in use, otherwise unloads them
 		void unloadMarked();
 
+		// Collects queued content for at most the configured budget, but always at least
+		// one node so that the queue drains eventually. Called every frame by the engine
+		// when incremental collection is enabled.
+		void collectIncremental();
+
+		inline void setCollectParameters(const GarbageCollectionParameters& params) {
+			mCollectParameters = params;
+		}
+		inline const GarbageCollectionParameters& collectParameters() const {
+			return mCollectParameters;
+		}
+		// returns: The number of nodes waiting to be checked for collection.
+		inline size_t collectQueueSize() const {
+			return mQueued.size();
+		}
+
 		// Unload all children.
 		void unloadAll();
 
+		// Measures the memory that a piece of content takes up.
+		// node: The content to measure.
+		// returns: Its size, zero if it is not content.
+		ContentSize sizeOf(INodeOwner* node);
+
+		// Measures all content owned by the content manager. Content that is loaded
+		// unmanaged is not included.
+		// returns: Totals keyed by content type, see IContentFactory::getContentTypeString.
+		std::map<std::string, ContentResidency> residency();
+
+		// Sets how many bytes of released content the cache may keep loaded, 0 to
+		// disable the cache. Content that only cached content refers to stays loaded
+		// with it, and is counted once it is released itself.
+		// bytes: The budget, in CPU and GPU bytes combined.
+		void setCacheBudget(size_t bytes);
+		inline size_t cacheBudget() const {
+			return mCacheBudget;
+		}
+
+		// Unloads everything in the cache, without changing its budget.
+		void clearCache();
+
+		inline const ContentCacheStats& cacheStats() const {
+			return mCacheStats;
+		}
+
 		friend class Engine;
 	};
 
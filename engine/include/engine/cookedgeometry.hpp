@@ -0,0 +1,197 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: cookedgeometry.hpp
+*	Description: The cooked .mgeo geometry format. A cooked file holds vertex and
+*	index buffers that are already packed and optimized, so that they can be mapped
+*	into memory and handed to glBufferData without any parsing.
+*/
+
+#pragma once
+
+#include <engine/geobase.hpp>
+#include <engine/mappedfile.hpp>
+#include <engine/vertexformat.hpp>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// "MGEO" read as a little endian integer
+#define COOKED_GEOMETRY_MAGIC 0x4F45474D
+#define COOKED_GEOMETRY_VERSION 1
+#define COOKED_GEOMETRY_EXTENSION ".mgeo"
+// Alignment of every section of a cooked file in bytes
+#define COOKED_GEOMETRY_ALIGNMENT 16
+#define COOKED_BVH_MAX_LEAF_SIZE 4
+
+namespace Morpheus {
+
+	// The first bytes of a cooked file. All offsets are in bytes from the start of the file.
+	struct CookedGeometryHeader {
+		uint32_t mMagic;
+		uint32_t mVersion;
+		// The VertexFormat that the levels were packed with
+		uint32_t mPositionFormat;
+		uint32_t mNormalFormat;
+		uint32_t mUVFormat;
+		uint32_t mShortIndices;
+		uint32_t mLevelCount;
+		uint32_t mBvhNodeCount;
+		uint64_t mLevelOffset;
+		uint64_t mBvhNodeOffset;
+		uint64_t mBvhTriangleOffset;
+		uint64_t mBvhTriangleCount;
+	};
+
+	// A level of detail in a cooked file, level 0 is the full resolution geometry.
+	struct CookedGeometryLevelHeader {
+		uint64_t mAttributeOffset;
+		uint64_t mVertexOffset;
+		uint64_t mVertexSize;
+		uint64_t mIndexOffset;
+		uint64_t mIndexSize;
+		uint64_t mReserved;
+		glm::mat4 mPositionDecode;
+		BoundingBox mAabb;
+		// Object space error relative to level 0
+		float mError;
+		uint32_t mVertexCount;
+		uint32_t mVertexStride;
+		uint32_t mIndexCount;
+		uint32_t mIndexType;
+		uint32_t mAttributeCount;
+	};
+
+	// A PackedVertexAttribute with a fixed layout.
+	struct CookedVertexAttribute {
+		int32_t mLocation;
+		int32_t mComponents;
+		uint32_t mType;
+		uint32_t mNormalized;
+		uint32_t mOffset;
+	};
+
+	// A node of a bounding volume hierarchy over the triangles of level 0. Nodes are stored
+	// depth first, so the left child of an internal node directly follows it.
+	struct CookedBVHNode {
+		BoundingBox mAabb;
+		// Leaves: index of the first triangle in the triangle list of the BVH.
+		// Internal nodes: index of the right child.
+		uint32_t mFirst;
+		// Number of triangles in a leaf, 0 for internal nodes
+		uint32_t mCount;
+	};
+
+	static_assert(sizeof(CookedGeometryHeader) == 64, "Cooked geometry header must not have padding!");
+	static_assert(sizeof(CookedGeometryLevelHeader) == 160, "Cooked level header must not have padding!");
+	static_assert(sizeof(CookedVertexAttribute) == 20, "Cooked attribute must not have padding!");
+	static_assert(sizeof(CookedBVHNode) == 32, "Cooked BVH node must not have padding!");
+
+	// Interleaved float vertex data and a triangle list, before it is packed.
+	struct GeometryBuffers {
+		std::vector<float> mVertices;
+		std::vector<uint32_t> mIndices;
+		std::vector<VertexAttributeSource> mAttributes;
+		// The number of floats per vertex
+		uint32_t mStride;
+		uint32_t mVertexCount;
+		// Offset of the position in floats, -1 if there are no positions
+		int mPositionOffset;
+		BoundingBox mAabb;
+	};
+
+	// A level of detail packed into its final GPU layout.
+	struct CookedGeometryLevel {
+		PackedVertexBuffer mVertices;
+		std::vector<uint8_t> mIndices;
+		uint32_t mVertexCount;
+		uint32_t mIndexCount;
+		GLenum mIndexType;
+		BoundingBox mAabb;
+		float mError;
+	};
+
+	// Everything that goes into a cooked file.
+	struct CookedGeometry {
+		VertexFormat mFormat;
+		std::vector<CookedGeometryLevel> mLevels;
+		std::vector<CookedBVHNode> mBvhNodes;
+		std::vector<uint32_t> mBvhTriangles;
+	};
+
+	// Packs float buffers into the given vertex format and shrinks indices if possible.
+	// buffers: The buffers to pack.
+	// format: The format to pack into.
+	// error: The object space error of the level.
+	// output: Receives the packed level.
+	void packGeometryLevel(const GeometryBuffers& buffers, const VertexFormat& format,
+		float error, CookedGeometryLevel* output);
+
+	// Builds a bounding volume hierarchy over triangles by median splits along the longest axis.
+	// buffers: The triangles, must have positions.
+	// maxLeafSize: The maximum number of triangles in a leaf.
+	// nodes: Receives the nodes, the root is node 0.
+	// triangles: Receives the triangle indices referenced by the leaves.
+	void buildTriangleBVH(const GeometryBuffers& buffers, uint32_t maxLeafSize,
+		std::vector<CookedBVHNode>* nodes, std::vector<uint32_t>* triangles);
+
+	// Writes a cooked file.
+	// path: The file to write.
+	// geometry: The levels and BVH to write, must have at least one level.
+	// returns: Whether the file was written successfully.
+	bool writeCookedGeometry(const std::string& path, const CookedGeometry& geometry);
+
+	// returns: The path of the cooked file for a source mesh, i.e., bunny.obj -> bunny.mgeo.
+	std::string cookedGeometryPath(const std::string& source);
+	bool isCookedGeometryPath(const std::string& path);
+
+	// returns: Whether the cooked file exists and was written after the source was last changed.
+	bool isCookedGeometryFresh(const std::string& source, const std::string& cooked);
+
+	// A cooked file mapped into memory. All pointers point into the mapped pages
+	// and are valid until the file is closed.
+	class CookedGeometryFile {
+	private:
+		MappedFile mFile;
+		const CookedGeometryHeader* mHeader;
+		const CookedGeometryLevelHeader* mLevels;
+
+		bool validate() const;
+
+	public:
+		inline CookedGeometryFile() : mHeader(nullptr), mLevels(nullptr) { }
+
+		// Maps a cooked file and checks that all of its sections lie within it.
+		// path: The file to open.
+		// returns: Whether the file is a valid cooked file.
+		bool open(const std::string& path);
+		void close();
+
+		inline bool isOpen() const { return mHeader != nullptr; }
+
+		VertexFormat format() const;
+		std::vector<PackedVertexAttribute> attributes(uint32_t level) const;
+
+		inline uint32_t levelCount() const { return mHeader->mLevelCount; }
+		inline const CookedGeometryLevelHeader& level(uint32_t level) const { return mLevels[level]; }
+		inline const void* vertices(uint32_t level) const {
+			return mFile.data() + mLevels[level].mVertexOffset;
+		}
+		inline const void* indices(uint32_t level) const {
+			return mFile.data() + mLevels[level].mIndexOffset;
+		}
+
+		inline uint32_t bvhNodeCount() const { return mHeader->mBvhNodeCount; }
+		inline const CookedBVHNode* bvhNodes() const {
+			return reinterpret_cast<const CookedBVHNode*>(mFile.data() + mHeader->mBvhNodeOffset);
+		}
+		inline const uint32_t* bvhTriangles() const {
+			return reinterpret_cast<const uint32_t*>(mFile.data() + mHeader->mBvhTriangleOffset);
+		}
+	};
+}
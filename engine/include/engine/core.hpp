@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <engine/atom.hpp>
 #include <engine/json.hpp>
 #include <engine/digraph.hpp>
 #include <engine/pool.hpp>
@@ -17,6 +18,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <functional>
 #include <string>
 
 #define HANDLE_INVALID 0
@@ -68,6 +70,7 @@ namespace Morpheus {
 	class TransformNode;
 	class Skybox;
 	class Framebuffer;
+	class Occluder;
 
 	typedef DigraphVertex Node;
 	
@@ -126,6 +129,7 @@ namespace Morpheus {
 		DYNAMIC_OBJECT_MANAGER,
 		NANOGUI_SCREEN,
 		SKYBOX,
+		OCCLUDER,
 		SCENE_END,
 
 		// All nodes that are children of the content manager
@@ -197,6 +201,7 @@ namespace Morpheus {
 	SET_RENDERABLE(SCENE_ROOT, 							true);
 	SET_RENDERABLE(ACCELERATOR,							true);
 	SET_RENDERABLE(SKYBOX, 								true);
+	SET_RENDERABLE(OCCLUDER,							true);
 
 	SET_RENDERABLE(HALF_EDGE_GEOMETRY, 					false);
 	SET_RENDERABLE(CONTENT_MANAGER, 					false);
@@ -273,39 +278,61 @@ namespace Morpheus {
 	class INodeOwner;
 	class NodeGraph;
 
+	// Walks the children of a node, either through the edge lists or through
+	// the snapshot of a frozen graph.
 	struct NodeOwnerIteratorF {
 	private:
 		NodeGraph* mGraph;
 		DigraphVertexIteratorF mInternalIt;
+		const int* mFrozen;
+		const int* mFrozenEnd;
+		bool bFrozen;
 
 	public:
 		inline NodeOwnerIteratorF(NodeGraph* graph, const DigraphVertexIteratorF& it) :
-			mGraph(graph), mInternalIt(it) {
+			mGraph(graph), mInternalIt(it), mFrozen(nullptr), mFrozenEnd(nullptr), bFrozen(false) {
+		}
+		inline NodeOwnerIteratorF(NodeGraph* graph, const int* begin, const int* end) :
+			mGraph(graph), mInternalIt(nullptr, -1), mFrozen(begin), mFrozenEnd(end), bFrozen(true) {
 		}
 		inline INodeOwner* operator()();
 		inline bool valid() const {
-			return mInternalIt.valid();
+			return bFrozen ? mFrozen != mFrozenEnd : mInternalIt.valid();
 		}
 		inline void next() {
-			mInternalIt.next();
+			if (bFrozen)
+				++mFrozen;
+			else
+				mInternalIt.next();
 		}
 	};
 
+	// Walks the parents of a node, either through the edge lists or through
+	// the snapshot of a frozen graph.
 	struct NodeOwnerIteratorB {
 	private:
 		NodeGraph* mGraph;
 		DigraphVertexIteratorB mInternalIt;
+		const int* mFrozen;
+		const int* mFrozenEnd;
+		bool bFrozen;
 
 	public:
 		inline NodeOwnerIteratorB(NodeGraph* graph, const DigraphVertexIteratorB& it) :
-			mGraph(graph), mInternalIt(it) {
+			mGraph(graph), mInternalIt(it), mFrozen(nullptr), mFrozenEnd(nullptr), bFrozen(false) {
+		}
+		inline NodeOwnerIteratorB(NodeGraph* graph, const int* begin, const int* end) :
+			mGraph(graph), mInternalIt(nullptr, -1), mFrozen(begin), mFrozenEnd(end), bFrozen(true) {
 		}
 		inline INodeOwner* operator()();
 		inline bool valid() const {
-			return mInternalIt.valid();
+			return bFrozen ? mFrozen != mFrozenEnd : mInternalIt.valid();
 		}
 		inline void next() {
-			mInternalIt.next();
+			if (bFrozen)
+				++mFrozen;
+			else
+				mInternalIt.next();
 		}
 	};
 
@@ -368,6 +395,8 @@ namespace Morpheus {
 
 		template <typename T>
 		inline T& data(const std::string& s);
+		template <typename T>
+		inline T& data(DigraphVertexDataId<T> id);
 
 		virtual bool isUpdatable() const { return false; }
 		virtual void setEnabled(bool v) { }
@@ -417,6 +446,7 @@ namespace Morpheus {
 		virtual TransformNode* toTransform();
 		virtual Skybox* toSkybox();
 		virtual Framebuffer* toFramebuffer();
+		virtual Occluder* toOccluder();
 
 		virtual ~INodeOwner() {}
 
@@ -482,23 +512,43 @@ namespace Morpheus {
 	}
 
 	typedef DigraphDataView<INodeOwner*> OwnerDataView;
-	typedef DigraphVertexLookupView<std::string> NodeNameLookupView;
+	typedef DigraphVertexLookupView<Atom> NodeNameLookupView;
+
+	// Where a node is in the registry of its type, see NodeGraph::nodesOfType.
+	struct NodeRegistration {
+		// END if the node is not registered
+		NodeType mType = NodeType::END;
+		uint32_t mIndex = 0;
+	};
 	
 	/// A directed graph containing all nodes of the current engine instance.
 	class NodeGraph : public Digraph {
 	private:
 		// Descriptions of the types and owners of each node
 		DigraphDataView<INodeOwner*> mOwners;
-		DigraphVertexLookupView<std::string> mNames;
+		DigraphVertexLookupView<Atom> mNames;
+		// Told about nodes that have lost a parent and are down to at most one
+		std::function<void(INodeOwner*)> mReleaseListener;
+		// Every node by type, packed so that nodes are removed by swapping in the last one
+		std::vector<INodeOwner*> mRegistry[(uint32_t)NodeType::END];
+		// The back index of every vertex into mRegistry. Kept per vertex rather than in the
+		// owner, since owners may already be deleted when their vertex is.
+		DigraphDataView<NodeRegistration> mRegistrations;
+
+		void registerNode(INodeOwner* owner);
+		void unregisterNode(int v);
 
 	protected:
 	 	void applyVertexMap(const int map[], const uint32_t mapLen, const uint32_t newSize) override;
+		void onEdgeDeleted(int tail, int head) override;
+		void onVertexDeleted(int v) override;
 
 	public:
 		inline void setOwner(const Node& v, INodeOwner* owner) {
 			mOwners[v] = owner;
 			owner->mGraph = this;
 			owner->mNodeId = v.id();
+			registerNode(owner);
 		}
 
 		inline OwnerDataView& owners() { 
@@ -507,13 +557,19 @@ namespace Morpheus {
 		inline INodeOwner* owner(const Node& v) {
 			return mOwners[v];
 		}
+		inline INodeOwner* owner(int id) {
+			return mOwners[id];
+		}
+		inline INodeOwner* find(Atom name) {
+			return mOwners[mNames[name]];
+		}
 		inline INodeOwner* find(const std::string& s) {
-			return mOwners[mNames[s]];
+			return find(intern(s));
 		}
 		inline NodeNameLookupView names() const {
 			return mNames;
 		}
-		inline bool tryFind(const std::string& name, INodeOwner** out) {
+		inline bool tryFind(Atom name, INodeOwner** out) {
 			Node n;
 			if (mNames.tryFind(name, &n)) {
 				*out = mOwners[n];
@@ -524,12 +580,22 @@ namespace Morpheus {
 				return false;
 			}
 		}
+		inline bool tryFind(const std::string& name, INodeOwner** out) {
+			Atom atom;
+			// A string that was never interned cannot be the name of a node
+			if (!atoms()->tryFind(name, &atom)) {
+				*out = nullptr;
+				return false;
+			}
+			return tryFind(atom, out);
+		}
 		inline void createNode(INodeOwner* owner) {
 			assert(owner->mNodeType != NodeType::END);
 			auto v = createVertex();
 			owner->mGraph = this;
 			owner->mNodeId = v.id();
 			mOwners[v] = owner;
+			registerNode(owner);
 		}
 		inline void createNode(INodeOwner* owner, INodeOwner* parent) {
 			createNode(owner);
@@ -543,42 +609,96 @@ namespace Morpheus {
 		// the [] operator.
 		// vertex: The vertex to assign a name to.
 		// name: The name to assign.
-		inline void setName(const Node& vertex, const std::string& name) {
+		inline void setName(const Node& vertex, Atom name) {
 			mNames.set(vertex, name);
 		}
+		inline void setName(const Node& vertex, const std::string& name) {
+			setName(vertex, intern(name));
+		}
 
-		inline void setName(const INodeOwner* owner, const std::string& name) {
+		inline void setName(const INodeOwner* owner, Atom name) {
 			mNames.set(Node(owner->mGraph, owner->mNodeId), name);
 		}
+		inline void setName(const INodeOwner* owner, const std::string& name) {
+			setName(owner, intern(name));
+		}
 		
 		// Specifies to the graph that the given name is no longer in use.
 		// name: The name to assign.
-		inline void recallName(const std::string& name) {
+		inline void recallName(Atom name) {
 			mNames.clear(name);
 		}
+		inline void recallName(const std::string& name) {
+			Atom atom;
+			if (atoms()->tryFind(name, &atom))
+				recallName(atom);
+		}
+
+		// Sets the function that is called whenever a node loses a parent and is left
+		// with at most one, i.e., so that the content manager can collect it without
+		// scanning its children. Pass nullptr to stop listening.
+		// listener: The function to call with the owner of the node.
+		inline void setReleaseListener(const std::function<void(INodeOwner*)>& listener) {
+			mReleaseListener = listener;
+		}
+
+		// Get every node of a type without walking the graph. The array is packed and
+		// in no particular order, creating or deleting nodes of the type changes it.
+		// type: The type of node.
+		// returns: The owners of every node of the type.
+		inline const std::vector<INodeOwner*>& nodesOfType(NodeType type) const {
+			return mRegistry[(uint32_t)type];
+		}
+		template <typename T>
+		inline const std::vector<INodeOwner*>& nodesOfType() const {
+			return nodesOfType(NODE_ENUM(T));
+		}
+
+		// returns: The number of nodes of a type.
+		inline uint32_t countOfType(NodeType type) const {
+			return (uint32_t)mRegistry[(uint32_t)type].size();
+		}
+		template <typename T>
+		inline uint32_t countOfType() const {
+			return countOfType(NODE_ENUM(T));
+		}
 
 		NodeGraph() {
 			mOwners = createVertexData<INodeOwner*>("owner");
-			mNames = createVertexLookup<std::string>("name");
+			mNames = createVertexLookup<Atom>("name");
+			mRegistrations = createVertexData<NodeRegistration>("registration");
+			// Content is added as a child every time it is loaded, one edge between
+			// two nodes is enough and lets removeChild find it in constant time
+			enableEdgeIndex(DigraphMultiEdgePolicy::UNIQUE);
 		}
 	};
 
 	INodeOwner* NodeOwnerIteratorF::operator()() {
-		return mGraph->owner(mInternalIt());
+		return bFrozen ? mGraph->owner(*mFrozen) : mGraph->owner(mInternalIt());
 	}
 
 	INodeOwner* NodeOwnerIteratorB::operator()() {
-		return mGraph->owner(mInternalIt());
+		return bFrozen ? mGraph->owner(*mFrozen) : mGraph->owner(mInternalIt());
 	}
 
 	Node INodeOwner::node() {
 		return Node(mGraph, mNodeId);
 	}
 	NodeOwnerIteratorF INodeOwner::children() {
+		const int* begin;
+		const int* end;
+		if (mGraph->tryGetFrozenChildren(mNodeId, &begin, &end))
+			return NodeOwnerIteratorF(mGraph, begin, end);
+
 		Node n(mGraph, mNodeId);
 		return NodeOwnerIteratorF(mGraph, n.children());
 	}
 	NodeOwnerIteratorB INodeOwner::parents() {
+		const int* begin;
+		const int* end;
+		if (mGraph->tryGetFrozenParents(mNodeId, &begin, &end))
+			return NodeOwnerIteratorB(mGraph, begin, end);
+
 		Node n(mGraph, mNodeId);
 		return NodeOwnerIteratorB(mGraph, n.parents());
 	}
@@ -623,26 +743,10 @@ namespace Morpheus {
 		return mGraph->owner(n_parent);
 	}
 	void INodeOwner::removeChild(INodeOwner* child) {
-		Node n(mGraph, mNodeId);
-		int childId = child->node().id();
-		for (auto it = n.outgoing(); it.valid(); it.next()) {
-			auto e = it();
-			if (e.head().id() == childId) {
-				mGraph->deleteEdge(e);
-				break;
-			}
-		}
+		mGraph->deleteEdge(mNodeId, child->mNodeId);
 	}
 	void INodeOwner::removeParent(INodeOwner* parent) {
-		Node n(mGraph, mNodeId);
-		int parentId = parent->node().id();
-		for (auto it = n.outgoing(); it.valid(); it.next()) {
-			auto e = it();
-			if (e.tail().id() == parentId) {
-				mGraph->deleteEdge(e);
-				break;
-			}
-		}
+		mGraph->deleteEdge(parent->mNodeId, mNodeId);
 	}
 
 	template <typename T>
@@ -652,6 +756,13 @@ namespace Morpheus {
 		return n.data<T>(s);
 	}
 
+	template <typename T>
+	T& INodeOwner::data(DigraphVertexDataId<T> id) 
+	{
+		Node n(mGraph, mNodeId);
+		return n.data<T>(id);
+	}
+
 	std::string nodeTypeString(NodeType t);
 	void print(INodeOwner* start);
 
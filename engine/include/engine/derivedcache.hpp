@@ -0,0 +1,77 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: derivedcache.hpp
+*	Description: A cache of derived data (cooked meshes, textures and content files)
+*	keyed by hashes of the source bytes and of the parameters used to cook them.
+*/
+
+#pragma once
+
+#include <engine/json.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Bump to invalidate everything that was cooked before
+#define DERIVED_DATA_VERSION 1
+// Extension of content JSON (materials, static meshes) cooked into MessagePack
+#define DERIVED_JSON_EXTENSION ".msgpack"
+#define DERIVED_JSON_PARAMETERS "json"
+
+namespace Morpheus {
+
+	// A fast non-cryptographic 64 bit hash.
+	// data: The bytes to hash.
+	// size: The number of bytes.
+	// seed: Used to chain hashes together.
+	uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+	// Hashes the contents of a file.
+	// path: The file to hash.
+	// hash: Receives the hash.
+	// returns: Whether the file could be read.
+	bool hashFile(const std::string& path, uint64_t* hash);
+
+	// Maps a source file and cook parameters to a location in the cache. Entries are
+	// never modified, a changed source or changed parameters lead to a different key.
+	class DerivedDataCache {
+	private:
+		std::string mRoot;
+
+	public:
+		// root: The directory that the cache lives in.
+		DerivedDataCache(const std::string& root);
+
+		// Computes the cache key of a source file.
+		// source: The source file, whose bytes are hashed.
+		// parameters: A description of everything that affects the cooked result.
+		// key: Receives the key.
+		// returns: Whether the source could be read.
+		bool makeKey(const std::string& source, const std::string& parameters, std::string* key) const;
+
+		// returns: Where the entry for a key is stored.
+		std::string path(const std::string& key, const std::string& extension) const;
+
+		// Looks for an existing entry for a source file.
+		// source: The source file.
+		// parameters: The parameters that the entry must have been cooked with.
+		// extension: The extension of the cooked entry.
+		// cachedPath: Receives the location of the entry if it exists.
+		// returns: Whether the entry exists.
+		bool find(const std::string& source, const std::string& parameters,
+			const std::string& extension, std::string* cachedPath) const;
+
+		inline const std::string& root() const { return mRoot; }
+	};
+
+	// Reads a content JSON file, preferring a cooked MessagePack version from the cache.
+	// A cache entry that fails to parse is removed and the source is read instead.
+	// source: The JSON file to read.
+	// cache: The derived data cache, may be nullptr.
+	// j: Receives the parsed JSON.
+	// returns: Whether the file could be read.
+	bool readContentJson(const std::string& source, const DerivedDataCache* cache, nlohmann::json* j);
+}
@@ -9,7 +9,10 @@
 #include <stack>
 #include <assert.h>
 #include <sstream>
+#include <cstdint>
+#include <typeinfo>
 
+#include <engine/flatmap.hpp>
 #include <engine/mapcpy.hpp>
 
 namespace Morpheus {
@@ -29,6 +32,10 @@ namespace Morpheus {
 	template <typename T>
 	struct DigraphDataView;
 	template <typename T>
+	struct DigraphVertexDataId;
+	template <typename T>
+	struct DigraphEdgeDataId;
+	template <typename T>
 	struct DigraphVertexLookupView;
 	template <typename T>
 	struct DigraphEdgeLookupView;
@@ -39,9 +46,51 @@ namespace Morpheus {
 	template <typename T>
 	struct DigraphTwoWayEdgeLookupView;
 
+	// Hashes the name of a data attachment with 64 bit FNV-1a. Usable in constant
+	// expressions, so names known at compile time never have to be hashed at runtime.
+	// s: The name to hash.
+	// returns: The hash of the name.
+	constexpr uint64_t digraphHash(const char* s) {
+		uint64_t hash = 14695981039346656037ull;
+		for (; *s; ++s) {
+			hash ^= (uint64_t)(unsigned char)*s;
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	inline uint64_t digraphHash(const std::string& s) {
+		return digraphHash(s.c_str());
+	}
+
+	// A handle to a vertex data attachment, the index of the attachment in the graph.
+	// Resolve it once with Digraph::vertexDataId and keep it, accessing data through
+	// it does not hash or compare names.
+	// T: The type of the attachment.
+	template <typename T>
+	struct DigraphVertexDataId {
+		uint32_t mIndex;
+
+		inline bool isValid() const { return mIndex != UINT32_MAX; }
+		static inline DigraphVertexDataId<T> invalid() { return DigraphVertexDataId<T>{ UINT32_MAX }; }
+	};
+
+	// A handle to an edge data attachment, see DigraphVertexDataId.
+	// T: The type of the attachment.
+	template <typename T>
+	struct DigraphEdgeDataId {
+		uint32_t mIndex;
+
+		inline bool isValid() const { return mIndex != UINT32_MAX; }
+		static inline DigraphEdgeDataId<T> invalid() { return DigraphEdgeDataId<T>{ UINT32_MAX }; }
+	};
+
 	struct DigraphVertexRaw {
 		int mInEdge;
 		int mOutEdge;
+		// Kept up to date as edges are created and deleted
+		uint32_t mInDegree;
+		uint32_t mOutDegree;
 	};
 
 	struct DigraphEdgeRaw {
@@ -132,7 +181,8 @@ namespace Morpheus {
 
 		// Gets the i-th child of a node. Note that children are stored
 		// in a linked list format, so this is not a good way to retrieve
-		// children if the number of children is large.
+		// children if the number of children is large, unless the graph
+		// is frozen.
 		// i: The index of the child.
 		// returns: The i-th child. 
 		inline DigraphVertex getChild(const uint32_t i);
@@ -140,7 +190,8 @@ namespace Morpheus {
 		
 		// Gets the i-th parent of a node. Note that the parents are stored
 		// in a linked list format, so this is not a good way to retrieve
-		// parents if the number of parents is large.
+		// parents if the number of parents is large, unless the graph
+		// is frozen.
 		// i: The index of the parent.
 		// returns: The i-th parent. 
 		inline DigraphVertex getParent(const uint32_t i);
@@ -151,6 +202,13 @@ namespace Morpheus {
 		// returns: Data associated with this vertex. 
 		template <typename T>
 		inline T& data(const std::string& s);
+
+		// Query data associated with this vertex by handle.
+		// T: The data type to return.
+		// id: The handle of the data, see Digraph::vertexDataId.
+		// returns: Data associated with this vertex. 
+		template <typename T>
+		inline T& data(DigraphVertexDataId<T> id);
 		
 		// Create an invalid vertex.
 		// returns: An invalid vertex. 
@@ -175,12 +233,54 @@ namespace Morpheus {
 
 		template <typename T>
 		inline T& data(const std::string& s);
+
+		template <typename T>
+		inline T& data(DigraphEdgeDataId<T> id);
 	};
 
 	class IDigraphLookup;
 	template <typename T>
 	class DigraphLookup;
 
+	// The order that Digraph::compress renumbers vertices and edges in.
+	enum class DigraphOrder {
+		// Keep the current relative order of vertices and edges
+		ID,
+		// Vertices in depth first preorder from the roots, edges grouped by tail
+		DEPTH_FIRST,
+		// Vertices in breadth first order from the roots, edges grouped by tail
+		BREADTH_FIRST
+	};
+
+	// What createEdge does when an edge between the same two vertices already exists,
+	// see Digraph::enableEdgeIndex.
+	enum class DigraphMultiEdgePolicy {
+		// Create another edge, every edge has to be deleted separately
+		ALLOW,
+		// Return the existing edge instead
+		UNIQUE
+	};
+
+	struct DigraphEdgeIndexEntry {
+		// One of the edges from the tail to the head
+		int mEdge;
+		// The number of edges from the tail to the head
+		uint32_t mCount;
+	};
+
+	// A compressed sparse row snapshot of the adjacency of a graph, see Digraph::freeze.
+	// The neighbors of vertex v are the entries [mOffsets[v], mOffsets[v + 1]), in the
+	// same order as the linked edge lists. Vertices in the graveyard have no entries.
+	struct DigraphCSR {
+		std::vector<uint32_t> mChildOffsets;
+		std::vector<int> mChildren;
+		std::vector<uint32_t> mParentOffsets;
+		std::vector<int> mParents;
+		// The version of the graph that the snapshot was taken of
+		uint64_t mVersion;
+		bool bBuilt;
+	};
+
 	// A directed graph class which features resizing memory and recycling of destroyed edges and vertices.
 	class Digraph {
 	private:
@@ -197,17 +297,59 @@ namespace Morpheus {
 		int mFirstUnusedEdge;
 		int mFirstUnusedVertex;
 		float mRescaleFactor;
-		std::unordered_map<std::string, IDigraphData*> mVertexDatas;
-		std::unordered_map<std::string, IDigraphData*> mEdgeDatas;
+		// Attachments by handle, destroyed attachments leave a nullptr behind
+		std::vector<IDigraphData*> mVertexDatas;
+		std::vector<IDigraphData*> mEdgeDatas;
+		// Handles by the hash of the attachment name
+		FlatHashMap<uint64_t, uint32_t> mVertexDataNames;
+		FlatHashMap<uint64_t, uint32_t> mEdgeDataNames;
 		std::unordered_map<std::string, IDigraphLookup*> mVertexLookups;
 		std::unordered_map<std::string, IDigraphLookup*> mEdgeLookups;
+		// Incremented whenever vertices or edges are created, deleted or renumbered
+		uint64_t mVersion;
+		DigraphCSR mFrozen;
+		// Edges by (tail, head), only maintained if bEdgeIndex is set
+		FlatHashMap<uint64_t, DigraphEdgeIndexEntry> mEdgeIndex;
+		DigraphMultiEdgePolicy mMultiEdgePolicy;
+		bool bEdgeIndex;
 
 		void resizeVertices(uint32_t newSize);
 		void resizeEdges(uint32_t newSize);
+		void unlinkEdge(int id);
+		void rebuildEdgeIndex();
+		// Finds an edge by walking the shorter of the edge lists of the tail and head.
+		int scanEdge(int tail, int head) const;
+		static inline uint64_t edgeKey(int tail, int head) {
+			return ((uint64_t)(uint32_t)tail << 32) | (uint64_t)(uint32_t)head;
+		}
+		uint32_t registerData(IDigraphData* data, std::vector<IDigraphData*>* datas,
+			FlatHashMap<uint64_t, uint32_t>* names);
+		void unregisterData(IDigraphData* data, std::vector<IDigraphData*>* datas,
+			FlatHashMap<uint64_t, uint32_t>* names);
+		// Computes the new id of every vertex in the active block, -1 for dead vertices.
+		void orderVertices(DigraphOrder order, const std::vector<int>& roots, int vmap[]);
+		// Computes the new id of every edge in the active block, -1 for dead edges.
+		void orderEdges(DigraphOrder order, const int vmap[], int emap[]);
 
 	protected:
-
+		// Called after an edge has been deleted, except for the edges into a vertex
+		// that is being deleted itself.
+		// tail: The tail of the deleted edge.
+		// head: The head of the deleted edge.
+		virtual void onEdgeDeleted(int tail, int head) { }
+
+		// Called when a vertex is about to be deleted, before any of its edges are.
+		// v: The numerical id of the vertex.
+		virtual void onVertexDeleted(int v) { }
+
+		// Called by compress once vertices have been renumbered, after the graph itself
+		// has been relabeled. Remaps every vertex data attachment and lookup. Derived
+		// graphs that keep vertex ids elsewhere should override this and call the base.
+		// map: The new id of every old vertex id, -1 for vertices that were dead.
+		// mapLen: The number of entries in map, the old size of the active block.
+		// newSize: The new number of reserved vertices.
 		virtual void applyVertexMap(const int map[], const uint32_t mapLen, const uint32_t newSize);
+		// Same as applyVertexMap, but for edges.
 		virtual void applyEdgeMap(const int map[], const uint32_t mapLen, const uint32_t newSize);
 
 	public:
@@ -248,11 +390,92 @@ namespace Morpheus {
 		// Deletes an edge in the graph.
 		// e: The edge to delete.
 		void deleteEdge(DigraphEdge e);
+
+		// Deletes an edge between two vertices, O(1) if the edge index is enabled.
+		// If there are several, only one of them is deleted.
+		// tail: The numerical id of the tail vertex.
+		// head: The numerical id of the head vertex.
+		// returns: Whether there was an edge to delete.
+		bool deleteEdge(int tail, int head);
+
+		// Finds an edge between two vertices. O(1) if the edge index is enabled, otherwise
+		// linear in the smaller of the out degree of the tail and the in degree of the head.
+		// tail: The numerical id of the tail vertex.
+		// head: The numerical id of the head vertex.
+		// returns: The edge, with an id of -1 if there is none.
+		DigraphEdge findEdge(int tail, int head);
+
+		// returns: Whether there is an edge from tail to head, see findEdge.
+		inline bool hasEdge(int tail, int head) { return findEdge(tail, head).id() != -1; }
+
+		// Starts keeping a hash index of edges by (tail, head), which makes findEdge,
+		// hasEdge and deleteEdge(tail, head) constant time at the cost of a hash
+		// insertion and removal for every edge created and deleted.
+		// policy: Whether createEdge may create several edges between the same vertices.
+		void enableEdgeIndex(DigraphMultiEdgePolicy policy = DigraphMultiEdgePolicy::ALLOW);
+
+		// Stops keeping the edge index and allows multiple edges again.
+		void disableEdgeIndex();
+
+		inline bool hasEdgeIndex() const { return bEdgeIndex; }
+		inline DigraphMultiEdgePolicy multiEdgePolicy() const { return mMultiEdgePolicy; }
 		
 		// Attempts to reduce the amount of memory needed to store the graph.
 		// bTight: Whether or not the amount of memory to use should be exactly the amount needed.
 		void compress(bool bTight = false);
 
+		// Packs the graph like compress, but also renumbers vertices so that traversals from
+		// the given roots visit them in memory order, and stores the outgoing edges of every
+		// vertex next to each other. Vertices that cannot be reached from the roots are
+		// placed after them, in the same order starting from the lowest id. All data
+		// attachments and lookups are remapped, ids held outside the graph are invalidated.
+		// order: How vertices are ordered.
+		// roots: The numerical ids of the vertices to start from, in order.
+		// bTight: Whether or not the amount of memory to use should be exactly the amount needed.
+		void compress(DigraphOrder order, const std::vector<int>& roots, bool bTight = false);
+
+		// Takes a compact snapshot of the children and parents of every vertex, so that
+		// read-only traversals walk contiguous arrays instead of chasing edge lists. The
+		// snapshot is invalidated by any change to the graph and is only rebuilt by the
+		// next call to freeze, which does nothing if the snapshot is still valid. Must not
+		// be called while iterating over the snapshot.
+		void freeze();
+
+		// Returns whether the snapshot taken by freeze matches the graph.
+		inline bool isFrozen() const { return mFrozen.bBuilt && mFrozen.mVersion == mVersion; }
+
+		// Returns a counter that changes whenever the structure of the graph does.
+		inline uint64_t version() const { return mVersion; }
+
+		// Returns the snapshot taken by the last freeze, which may be out of date.
+		inline const DigraphCSR& frozen() const { return mFrozen; }
+
+		// Gets the children of a vertex from the snapshot, if it is valid.
+		// v: The numerical id of the vertex.
+		// begin: Receives the first child.
+		// end: Receives one past the last child.
+		// returns: Whether the graph is frozen, otherwise begin and end are not written.
+		inline bool tryGetFrozenChildren(int v, const int** begin, const int** end) const {
+			if (!isFrozen())
+				return false;
+			*begin = mFrozen.mChildren.data() + mFrozen.mChildOffsets[v];
+			*end = mFrozen.mChildren.data() + mFrozen.mChildOffsets[v + 1];
+			return true;
+		}
+
+		// Gets the parents of a vertex from the snapshot, if it is valid.
+		// v: The numerical id of the vertex.
+		// begin: Receives the first parent.
+		// end: Receives one past the last parent.
+		// returns: Whether the graph is frozen, otherwise begin and end are not written.
+		inline bool tryGetFrozenParents(int v, const int** begin, const int** end) const {
+			if (!isFrozen())
+				return false;
+			*begin = mFrozen.mParents.data() + mFrozen.mParentOffsets[v];
+			*end = mFrozen.mParents.data() + mFrozen.mParentOffsets[v + 1];
+			return true;
+		}
+
 		// Returns the number of edges in the graph.
 		uint32_t edgeCount() const { return mEdgeCount; }
 		
@@ -386,6 +609,40 @@ namespace Morpheus {
 		template <typename T>
 		void destroyData(DigraphSparseDataView<T> view);
 
+		// Get the handle of a vertex data attachment. Handles stay valid until the
+		// attachment is destroyed.
+		// T: The type of the attachment.
+		// nameHash: The hash of the name of the attachment, see digraphHash.
+		// returns: The handle, or an invalid handle if there is no such attachment.
+		template <typename T>
+		inline DigraphVertexDataId<T> vertexDataId(uint64_t nameHash) const;
+		template <typename T>
+		inline DigraphVertexDataId<T> vertexDataId(const std::string& name) const;
+		template <typename T>
+		inline DigraphVertexDataId<T> vertexDataId(const DigraphDataView<T>& view) const;
+
+		// Get the handle of an edge data attachment, see vertexDataId.
+		template <typename T>
+		inline DigraphEdgeDataId<T> edgeDataId(uint64_t nameHash) const;
+		template <typename T>
+		inline DigraphEdgeDataId<T> edgeDataId(const std::string& name) const;
+		template <typename T>
+		inline DigraphEdgeDataId<T> edgeDataId(const DigraphDataView<T>& view) const;
+
+		// Get a vertex data attachment by handle.
+		// T: The type of the attachment.
+		// id: The handle of the attachment.
+		// returns: A view to the data attachment.
+		template <typename T>
+		inline DigraphDataView<T> getVertexData(DigraphVertexDataId<T> id);
+
+		// Get an edge data attachment by handle.
+		// T: The type of the attachment.
+		// id: The handle of the attachment.
+		// returns: A view to the data attachment.
+		template <typename T>
+		inline DigraphDataView<T> getEdgeData(DigraphEdgeDataId<T> id);
+
 		// Destroys the lookup associated with this view
 		// T: The type of the lookup attachment.
 		// view: The view to the lookup attachment to destroy.
@@ -444,10 +701,17 @@ namespace Morpheus {
 	// An interface to a graph data attachment.
 	class IDigraphData {
 	protected:
+		// The index of the attachment in its graph, see DigraphVertexDataId
+		uint32_t mIndex = UINT32_MAX;
+
 		virtual void resize(uint32_t newSize) = 0;
 		virtual void compress(const int map[], uint32_t mapSize, uint32_t newSize) = 0;
 
 	public:
+		// returns: The type of the attached values, used to check handles in debug builds.
+		virtual const std::type_info& valueType() const = 0;
+		// returns: Whether this is a sparse attachment, which handles cannot refer to.
+		virtual bool isSparse() const = 0;
 
 		template <typename T>
 		inline DigraphData<T>* as() { return (DigraphData<T>*)this; }
@@ -482,7 +746,11 @@ namespace Morpheus {
 		}
 		void compress(const int map[], const uint32_t mapSize, const uint32_t newSize) override {
 			auto new_data = new T[newSize];
-			mapcpy(new_data, mData, map, mapSize);
+			// Moved rather than copied bytewise, attachments may hold non-trivial types
+			for (uint32_t i = 0; i < mapSize; ++i) {
+				if (map[i] >= 0)
+					new_data[map[i]] = std::move(mData[i]);
+			}
 			delete[] mData;
 			mData = new_data;
 			mDataSize = newSize;
@@ -493,6 +761,12 @@ namespace Morpheus {
 		std::string name() const override {
 			return mName;
 		}
+		const std::type_info& valueType() const override {
+			return typeid(T);
+		}
+		bool isSparse() const override {
+			return false;
+		}
 
 		explicit DigraphData(Digraph* parent, const std::string& name, const DigraphDataType type_) :
 			mParent(parent), mName(name) {
@@ -510,7 +784,7 @@ namespace Morpheus {
 				break;
 			}
 
-			mData = new T[parent->vertexReserve()];
+			mData = new T[mDataSize];
 		}
 
 		~DigraphData() override
@@ -527,7 +801,7 @@ namespace Morpheus {
 	class DigraphSparseData : public IDigraphData {
 	protected:
 		Digraph* mParent;
-		std::unordered_map<int, T> mMap;
+		FlatHashMap<int, T> mMap;
 		std::string mName;
 		T mDefault;
 
@@ -539,10 +813,14 @@ namespace Morpheus {
 		}
 		void compress(const int map[], const uint32_t mapSize, const uint32_t newSize) override {
 
-			std::unordered_map<int, T> newMap;
+			FlatHashMap<int, T> newMap;
+			newMap.reserve(mMap.size());
 
-			for (auto& it : mMap)
-				newMap[map[it.first]] = it.second;
+			for (auto& it : mMap) {
+				// Data of dead vertices and edges is dropped
+				if ((uint32_t)it.first < mapSize && map[it.first] >= 0)
+					newMap[map[it.first]] = it.second;
+			}
 
 			std::swap(mMap, newMap);
 		}
@@ -552,6 +830,12 @@ namespace Morpheus {
 		std::string name() const override {
 			return mName;
 		}
+		const std::type_info& valueType() const override {
+			return typeid(T);
+		}
+		bool isSparse() const override {
+			return true;
+		}
 
 		explicit DigraphSparseData(Digraph* parent, const std::string& name, const T& default_) :
 			mParent(parent), mName(name), mDefault(default_) {
@@ -570,6 +854,8 @@ namespace Morpheus {
 	class IDigraphLookup {
 	public:
 		virtual void applyMap(const int map[], const uint32_t mapSize) = 0;
+
+		virtual ~IDigraphLookup() { }
 	};
 
 	// A digraph lookup attachment by type.
@@ -579,13 +865,20 @@ namespace Morpheus {
 	private:
 		Digraph* mParent;
 		DigraphLookupType mType;
-		std::unordered_map<T, int> mTtoId;
+		FlatHashMap<T, int> mTtoId;
 		std::string mName;
 
 	protected:
 		void applyMap(const int map[], const uint32_t mapSize) override {
-			for (auto& item : mTtoId)
-				item.second = map[item.second];
+			for (auto it = mTtoId.begin(); it != mTtoId.end();) {
+				// Names of dead vertices and edges are dropped
+				if (it->second < 0 || (uint32_t)it->second >= mapSize || map[it->second] < 0) {
+					it = mTtoId.erase(it);
+				} else {
+					it->second = map[it->second];
+					++it;
+				}
+			}
 		}
 
 	public:
@@ -619,17 +912,23 @@ namespace Morpheus {
 	private:
 		Digraph* mParent;
 		DigraphLookupType mType;
-		std::unordered_map<T, int> mTtoId;
-		std::unordered_map<int, T> mIdToT;
+		FlatHashMap<T, int> mTtoId;
+		FlatHashMap<int, T> mIdToT;
 		std::string mName;
 
 	protected:
 		void applyMap(const int map[], const uint32_t mapSize) override {
 			mIdToT.clear();
 			mIdToT.reserve(mTtoId.size());
-			for (auto& item : mTtoId) {
-				item.second = map[item.second];
-				mIdToT[item.second] = item.first;
+			for (auto it = mTtoId.begin(); it != mTtoId.end();) {
+				// Names of dead vertices and edges are dropped
+				if (it->second < 0 || (uint32_t)it->second >= mapSize || map[it->second] < 0) {
+					it = mTtoId.erase(it);
+				} else {
+					it->second = map[it->second];
+					mIdToT[it->second] = it->first;
+					++it;
+				}
 			}
 		}
 
@@ -994,6 +1293,7 @@ namespace Morpheus {
 		inline T& operator[](const DigraphVertex& v) { return mPtr->mData[v.id()]; }
 		inline T& operator[](const DigraphEdge& e) { return mPtr->mData[e.id()]; }
 		inline std::string name() { return mPtr->name(); }
+		inline bool isValid() const { return mPtr != nullptr; }
 
 		friend class Digraph;
 	};
@@ -1223,16 +1523,10 @@ namespace Morpheus {
 		return DigraphVertexIteratorF(mPtr, mPtr->mVertices[mId].mOutEdge);
 	}
 	inline uint32_t DigraphVertex::childCount() {
-		uint32_t count = 0;
-		for (auto it = children(); it.valid(); it.next())
-			++count;
-		return count;
+		return mPtr->mVertices[mId].mOutDegree;
 	}
 	inline uint32_t DigraphVertex::parentCount() {
-		uint32_t count = 0;
-		for (auto it = parents(); it.valid(); it.next())
-			++count;
-		return count;
+		return mPtr->mVertices[mId].mInDegree;
 	}
 	inline DigraphEdgeIteratorAll Digraph::edges() {
 		return DigraphEdgeIteratorAll(this, 0);
@@ -1263,16 +1557,14 @@ namespace Morpheus {
 	template <typename T>
 	DigraphDataView<T> Digraph::createEdgeData(const std::string& name) {
 		auto ptr = new DigraphEdgeData<T>(this, name);
-		mEdgeDatas[name] = ptr;
-		++mDatasCreated;
+		registerData(ptr, &mEdgeDatas, &mEdgeDataNames);
 		return DigraphDataView<T>(ptr);
 	}
 
 	template <typename T>
 	DigraphDataView<T> Digraph::createVertexData(const std::string& name) {
 		auto ptr = new DigraphVertexData<T>(this, name);
-		mVertexDatas[name] = ptr;
-		++mDatasCreated;
+		registerData(ptr, &mVertexDatas, &mVertexDataNames);
 		return DigraphDataView<T>(ptr);
 	}
 
@@ -1280,10 +1572,10 @@ namespace Morpheus {
 	void Digraph::destroyData(DigraphDataView<T> view) {
 		switch (view.type()) {
 		case DigraphDataType::VERTEX:
-			mVertexDatas.erase(view.name());
+			unregisterData(view.mPtr, &mVertexDatas, &mVertexDataNames);
 			break;
 		case DigraphDataType::EDGE:
-			mEdgeDatas.erase(view.name());
+			unregisterData(view.mPtr, &mEdgeDatas, &mEdgeDataNames);
 			break;
 		default:
 			break;
@@ -1295,10 +1587,10 @@ namespace Morpheus {
 	void Digraph::destroyData(DigraphSparseDataView<T> view) {
 		switch (view.type()) {
 		case DigraphDataType::VERTEX:
-			mVertexDatas.erase(view.name());
+			unregisterData(view.mPtr, &mVertexDatas, &mVertexDataNames);
 			break;
 		case DigraphDataType::EDGE:
-			mEdgeDatas.erase(view.name());
+			unregisterData(view.mPtr, &mEdgeDatas, &mEdgeDataNames);
 			break;
 		}
 		delete view.mPtr;
@@ -1331,35 +1623,109 @@ namespace Morpheus {
 
 	template <typename T>
 	inline T& DigraphVertex::data(const std::string& s) {
-		return mPtr->getVertexData<T>(s)[*this];
+		return data<T>(mPtr->vertexDataId<T>(s));
+	}
+
+	template <typename T>
+	inline T& DigraphVertex::data(DigraphVertexDataId<T> id) {
+		return mPtr->getVertexData<T>(id)[*this];
 	}
 
 	template <typename T>
 	inline T& DigraphEdge::data(const std::string& s) {
-		return mPtr->getEdgeData<T>(s)[*this];
+		return data<T>(mPtr->edgeDataId<T>(s));
+	}
+
+	template <typename T>
+	inline T& DigraphEdge::data(DigraphEdgeDataId<T> id) {
+		return mPtr->getEdgeData<T>(id)[*this];
 	}
 
 	template <typename T>
 	inline DigraphDataView<T> Digraph::getEdgeData(const std::string& name) {
-		return DigraphDataView<T>(mEdgeDatas[name]->as<T>());
+		auto id = edgeDataId<T>(name);
+#ifdef _DEBUG
+		// No attachment has this name
+		assert(id.isValid());
+#endif
+		return getEdgeData<T>(id);
 	}
 
 	template <typename T>
 	inline DigraphDataView<T> Digraph::getVertexData(const std::string& name) {
-		return DigraphDataView<T>(mVertexDatas[name]->as<T>());
+		auto id = vertexDataId<T>(name);
+#ifdef _DEBUG
+		// No attachment has this name
+		assert(id.isValid());
+#endif
+		return getVertexData<T>(id);
+	}
+
+	template <typename T>
+	inline DigraphDataView<T> Digraph::getVertexData(DigraphVertexDataId<T> id) {
+#ifdef _DEBUG
+		assert(id.isValid() && id.mIndex < mVertexDatas.size());
+#endif
+		auto data = mVertexDatas[id.mIndex];
+#ifdef _DEBUG
+		assert(data != nullptr && !data->isSparse() && data->valueType() == typeid(T));
+#endif
+		return DigraphDataView<T>(static_cast<DigraphData<T>*>(data));
+	}
+
+	template <typename T>
+	inline DigraphDataView<T> Digraph::getEdgeData(DigraphEdgeDataId<T> id) {
+#ifdef _DEBUG
+		assert(id.isValid() && id.mIndex < mEdgeDatas.size());
+#endif
+		auto data = mEdgeDatas[id.mIndex];
+#ifdef _DEBUG
+		assert(data != nullptr && !data->isSparse() && data->valueType() == typeid(T));
+#endif
+		return DigraphDataView<T>(static_cast<DigraphData<T>*>(data));
+	}
+
+	template <typename T>
+	inline DigraphVertexDataId<T> Digraph::vertexDataId(uint64_t nameHash) const {
+		auto it = mVertexDataNames.find(nameHash);
+		if (it == mVertexDataNames.end())
+			return DigraphVertexDataId<T>::invalid();
+		return DigraphVertexDataId<T>{ it->second };
+	}
+
+	template <typename T>
+	inline DigraphVertexDataId<T> Digraph::vertexDataId(const std::string& name) const {
+		return vertexDataId<T>(digraphHash(name));
+	}
+
+	template <typename T>
+	inline DigraphVertexDataId<T> Digraph::vertexDataId(const DigraphDataView<T>& view) const {
+		return DigraphVertexDataId<T>{ view.mPtr->mIndex };
+	}
+
+	template <typename T>
+	inline DigraphEdgeDataId<T> Digraph::edgeDataId(uint64_t nameHash) const {
+		auto it = mEdgeDataNames.find(nameHash);
+		if (it == mEdgeDataNames.end())
+			return DigraphEdgeDataId<T>::invalid();
+		return DigraphEdgeDataId<T>{ it->second };
+	}
+
+	template <typename T>
+	inline DigraphEdgeDataId<T> Digraph::edgeDataId(const std::string& name) const {
+		return edgeDataId<T>(digraphHash(name));
+	}
+
+	template <typename T>
+	inline DigraphEdgeDataId<T> Digraph::edgeDataId(const DigraphDataView<T>& view) const {
+		return DigraphEdgeDataId<T>{ view.mPtr->mIndex };
 	}
 
 	inline uint32_t DigraphVertex::outDegree() {
-		uint32_t result = 0u;
-		for (auto it = outgoing(); it.valid(); it.next())
-			++result;
-		return result;
+		return mPtr->mVertices[mId].mOutDegree;
 	}
 	inline uint32_t DigraphVertex::inDegree() {
-		uint32_t result = 0u;
-		for (auto it = incomming(); it.valid(); it.next())
-			++result;
-		return result;
+		return mPtr->mVertices[mId].mInDegree;
 	}
 
 	inline void DigraphVertex::addChild(const DigraphVertex& v) {
@@ -1371,12 +1737,22 @@ namespace Morpheus {
 	}
 
 	inline DigraphVertex DigraphVertex::getChild(const uint32_t i) {
+		const int* begin;
+		const int* end;
+		if (mPtr->tryGetFrozenChildren(mId, &begin, &end))
+			return DigraphVertex(mPtr, begin[i]);
+
 		auto it = children();
 		for (uint32_t current = 0; it.valid() && current < i; it.next(), ++current);
 		return it();
 	}
 
 	inline DigraphVertex DigraphVertex::getParent(const uint32_t i) {
+		const int* begin;
+		const int* end;
+		if (mPtr->tryGetFrozenParents(mId, &begin, &end))
+			return DigraphVertex(mPtr, begin[i]);
+
 		auto it = parents();
 		for (uint32_t current = 0; it.valid() && current < i; it.next(), ++current);
 		return it();
@@ -1469,16 +1845,14 @@ namespace Morpheus {
 	template <typename T>
 	DigraphSparseDataView<T> Digraph::createSparseVertexData(const T& default_, const std::string& name) {
 		DigraphSparseVertexData<T>* dat = new DigraphSparseVertexData<T>(this, name, default_);
-		mVertexDatas[name] = dat;
-		++mDatasCreated;
+		registerData(dat, &mVertexDatas, &mVertexDataNames);
 		return DigraphSparseDataView<T>(dat);
 	}
 
 	template <typename T>
 	DigraphSparseDataView<T> Digraph::createSparseEdgeData(const T& default_, const std::string& name) {
 		DigraphSparseEdgeData<T>* dat = new DigraphSparseEdgeData<T>(this, name, default_);
-		mEdgeDatas[name] = dat;
-		++mDatasCreated;
+		registerData(dat, &mEdgeDatas, &mEdgeDataNames);
 		return DigraphSparseDataView<T>(dat);
 	}
 }	
\ No newline at end of file
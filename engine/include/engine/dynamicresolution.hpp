@@ -0,0 +1,93 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: dynamicresolution.hpp
+*	Description: GPU timing and a controller that picks the render resolution
+*	scale needed to hit a target frame time.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <ostream>
+
+#define GPU_TIMER_QUERY_COUNT 4
+
+namespace Morpheus {
+
+	// Measures GPU time with GL_TIME_ELAPSED queries. Results are read back a few frames
+	// later so that measuring never stalls the pipeline.
+	class GpuTimer {
+	private:
+		GLuint mQueries[GPU_TIMER_QUERY_COUNT];
+		bool bPending[GPU_TIMER_QUERY_COUNT];
+		uint32_t mCurrent;
+		bool bInitialized;
+
+	public:
+		GpuTimer();
+		~GpuTimer();
+
+		// Begin timing, must be followed by end before the next begin.
+		void begin();
+		// End timing.
+		void end();
+
+		// Reads the most recent available measurement without blocking.
+		// milliseconds: Output for the measured time.
+		// returns: Whether a new measurement was available.
+		bool tryRead(double* milliseconds);
+	};
+
+	struct DynamicResolutionStats {
+		// Current resolution scale along each axis
+		float mScale;
+		// Last GPU frame time measured, in milliseconds
+		double mGpuFrameTime;
+		// Smoothed GPU frame time, in milliseconds
+		double mAverageGpuFrameTime;
+		// Number of times the scale has changed
+		uint64_t mScaleChanges;
+
+		void print(std::ostream& os) const;
+	};
+
+	// Adjusts a resolution scale toward a target GPU frame time. The scale only drops after
+	// several consecutive frames over budget and only rises after many frames comfortably
+	// under budget, so that the resolution does not oscillate.
+	class DynamicResolutionController {
+	private:
+		DynamicResolutionStats mStats;
+		uint32_t mFramesOver;
+		uint32_t mFramesUnder;
+
+	public:
+		// Target GPU frame time, in milliseconds
+		double mTargetFrameTime;
+		float mMinScale;
+		float mMaxScale;
+		// Scales are quantized to multiples of this step
+		float mStep;
+		// Frame time above target * (1 + mUpperThreshold) counts as over budget
+		double mUpperThreshold;
+		// Frame time below target * (1 - mLowerThreshold) counts as under budget
+		double mLowerThreshold;
+		uint32_t mFramesBeforeDecrease;
+		uint32_t mFramesBeforeIncrease;
+
+		DynamicResolutionController();
+
+		// Feed a new GPU frame time measurement to the controller.
+		// gpuFrameTime: The measured time, in milliseconds.
+		void update(double gpuFrameTime);
+
+		// Reset the scale to its maximum.
+		void reset();
+
+		inline float scale() const { return mStats.mScale; }
+		inline const DynamicResolutionStats& stats() const { return mStats; }
+	};
+}
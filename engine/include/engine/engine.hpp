@@ -12,6 +12,8 @@
 #include <engine/updater.hpp>
 #include <engine/input.hpp>
 
+#include <glad/glad.h>
+
 #include <set>
 #include <string>
 
@@ -19,6 +21,7 @@ namespace Morpheus {
 
 	class Scene;
 	class Texture;
+	class ReadbackQueue;
 
 	struct DisplayParameters {
 		int32_t mFramebufferWidth;
@@ -45,8 +48,13 @@ namespace Morpheus {
 		Updater* mUpdater;
 		// Component responsible for handling input
 		Input mInput;
+		// Queue for asynchronous GPU -> CPU readbacks, polled every update
+		ReadbackQueue* mReadback;
 		// Whether or not the engine is still valid, i.e., not exitting.
 		bool bValid;
+		// Whether the graph is frozen before rendering, so that the renderer walks
+		// the snapshot instead of the edge lists
+		bool bFreezeGraph;
 
 	public:
 
@@ -73,6 +81,10 @@ namespace Morpheus {
 		// The engine's input module.
 		// returns: A reference to the engine's input module. 
 		inline Input* input() { return &mInput; }
+
+		// The engine's asynchronous readback queue.
+		// returns: A pointer to the engine's readback queue.
+		inline ReadbackQueue* readback() { return mReadback; }
 		
 		// Gets the current display parameters.
 		// returns: Display parameters
@@ -104,6 +116,10 @@ namespace Morpheus {
 		void present();
 		// Creates a new scene as a child of the engine.
 		Scene* makeScene();
+		// Packs the graph and renumbers its nodes in depth first order from the engine,
+		// so that traversals of a scene touch memory in order. Best called once a scene
+		// has finished loading. Invalidates any Node held outside of an INodeOwner.
+		void compressGraph();
 	};
 	
 	// The global engine.
@@ -150,6 +166,11 @@ namespace Morpheus {
 	inline Input* input() {
 		return engine()->input();
 	}
+	// A reference to the global readback queue.
+	// returns: The global readback queue.
+	inline ReadbackQueue* readback() {
+		return engine()->readback();
+	}
 
 	// Return the description of a node.
 	// n: The node.
@@ -169,6 +190,21 @@ namespace Morpheus {
 	inline bool tryFind(const std::string& name, INodeOwner** out) {
 		return globalGraph()->tryFind(name, out);
 	}
+	inline INodeOwner* find(Atom name) {
+		return globalGraph()->find(name);
+	}
+	inline void setName(const Node& n, Atom name) {
+		globalGraph()->setName(n, name);
+	}
+	inline void recallName(Atom name) {
+		globalGraph()->recallName(name);
+	}
+	inline void setName(const INodeOwner* n, Atom name) {
+		globalGraph()->setName(n, name);
+	}
+	inline bool tryFind(Atom name, INodeOwner** out) {
+		return globalGraph()->tryFind(name, out);
+	}
 
 	inline void createNode(INodeOwner* owner) {
 		globalGraph()->createNode(owner);
@@ -185,6 +221,29 @@ namespace Morpheus {
 	struct RenderSettings {
 		uint mMSAASamples;
 		uint mAnisotropySamples;
+		// Internal format of the HDR scene target, i.e., GL_R11F_G11F_B10F, GL_RGBA16F or GL_RGB32F
+		GLenum mHDRFormat;
+		// Whether depth / stencil is resolved out of the multisample target for later passes
+		bool bResolveDepth;
+		// Whether the scene resolution adapts to hit mTargetFrameTime
+		bool bDynamicResolution;
+		// Target GPU frame time for dynamic resolution, in milliseconds
+		double mTargetFrameTime;
+		float mMinResolutionScale;
+		float mMaxResolutionScale;
+		// Strength of the sharpening applied when upscaling, 0 to disable
+		float mUpscaleSharpness;
+		// Whether draws are tested against occluders rasterized on the CPU
+		bool bOcclusionCulling;
+		// Size of the CPU occlusion depth buffer
+		uint mOcclusionBufferWidth;
+		uint mOcclusionBufferHeight;
+		// Worker threads used to rasterize occluders, 0 for the render thread only
+		uint mOcclusionThreads;
+		// Whether the occlusion depth buffer is drawn in the corner of the screen
+		bool bOcclusionDebug;
+		// Largest acceptable screen space error when picking a mesh LOD, in pixels
+		float mLodErrorThreshold;
 	};
 
 	class IRenderer : public INodeOwner {
@@ -200,6 +259,9 @@ namespace Morpheus {
 		virtual void postGlfwRequests() = 0;
 		// Draw the given scene
 		virtual void draw(INodeOwner* node) = 0;
+		// Draw the given scene into an offscreen framebuffer instead of the back buffer.
+		// GUIs are not drawn. The output must be the same size as the window framebuffer.
+		virtual void draw(INodeOwner* node, Framebuffer* output) = 0;
 		// Get the type of this renderer
 		virtual RendererType getRendererType() const = 0;
 		// Set the clear color of this renderer
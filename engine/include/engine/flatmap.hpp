@@ -0,0 +1,401 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: flatmap.hpp
+*	Description: An open addressing hash map that stores its entries in a single flat
+*	array. Lookups probe groups of 16 control bytes at a time, one byte per slot holding
+*	7 bits of the hash of its key, so most misses never touch the entries themselves.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLAT_MAP_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// The number of control bytes probed at once
+#define FLAT_MAP_GROUP_SIZE 16
+// The smallest number of slots of a map that holds anything
+#define FLAT_MAP_MIN_CAPACITY 16
+
+namespace Morpheus {
+
+	namespace FlatMapCtrl {
+		// Control bytes of slots without an entry are negative, full slots hold the
+		// low 7 bits of the hash of their key
+		constexpr int8_t EMPTY = -128;
+		constexpr int8_t DELETED = -2;
+
+		// returns: A bit mask with bit i set if control byte i of the group equals h.
+		inline uint32_t match(const int8_t* group, int8_t h) {
+#ifdef FLAT_MAP_USE_SSE
+			__m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+			return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h)));
+#else
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < FLAT_MAP_GROUP_SIZE; ++i)
+				mask |= (uint32_t)(group[i] == h) << i;
+			return mask;
+#endif
+		}
+
+		// returns: A bit mask with bit i set if slot i of the group has no entry.
+		inline uint32_t matchFree(const int8_t* group) {
+#ifdef FLAT_MAP_USE_SSE
+			// Both EMPTY and DELETED have their sign bit set
+			__m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+			return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+			uint32_t mask = 0;
+			for (uint32_t i = 0; i < FLAT_MAP_GROUP_SIZE; ++i)
+				mask |= (uint32_t)(group[i] < 0) << i;
+			return mask;
+#endif
+		}
+
+		inline uint32_t lowestBit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+			return (uint32_t)__builtin_ctz(mask);
+#else
+			uint32_t i = 0;
+			while (!(mask & 1u)) {
+				mask >>= 1;
+				++i;
+			}
+			return i;
+#endif
+		}
+
+		// Spreads the bits of a hash, std::hash of integers is the identity and would
+		// leave the 7 bits kept in the control bytes all but constant.
+		inline uint64_t mix(uint64_t hash) {
+			hash ^= hash >> 33;
+			hash *= 0xff51afd7ed558ccdull;
+			hash ^= hash >> 33;
+			return hash;
+		}
+	}
+
+	// A hash map with open addressing. Entries live in one array, so iteration is a
+	// linear scan and erasing leaves a tombstone instead of moving other entries. Unlike
+	// std::unordered_map, references and iterators are invalidated by any insertion that
+	// grows the map, but never by erasing.
+	// K: The key type.
+	// V: The value type.
+	// Hash: The hash function of the keys.
+	template <typename K, typename V, typename Hash = std::hash<K>>
+	class FlatHashMap {
+	public:
+		typedef std::pair<K, V> value_type;
+
+	private:
+		// mCapacity + FLAT_MAP_GROUP_SIZE - 1 control bytes, the first group is cloned
+		// past the end so that any slot can start a group load
+		int8_t* mCtrl;
+		value_type* mSlots;
+		size_t mCapacity;
+		size_t mSize;
+		// The number of insertions into empty slots left before the map has to grow
+		size_t mGrowthLeft;
+		Hash mHash;
+
+		static inline size_t maxLoad(size_t capacity) {
+			return capacity - capacity / 8;
+		}
+
+		inline void setCtrl(size_t i, int8_t h) {
+			mCtrl[i] = h;
+			if (i < FLAT_MAP_GROUP_SIZE - 1)
+				mCtrl[mCapacity + i] = h;
+		}
+
+		inline uint64_t hashOf(const K& key) const {
+			return FlatMapCtrl::mix((uint64_t)mHash(key));
+		}
+
+		// returns: The slot holding key, or mCapacity if there is none.
+		size_t findSlot(const K& key, uint64_t hash) const {
+			if (mSize == 0)
+				return mCapacity;
+
+			int8_t h2 = (int8_t)(hash & 0x7F);
+			size_t mask = mCapacity - 1;
+			size_t pos = (size_t)(hash >> 7) & mask;
+
+			for (size_t step = FLAT_MAP_GROUP_SIZE;; step += FLAT_MAP_GROUP_SIZE) {
+				const int8_t* group = mCtrl + pos;
+				for (uint32_t m = FlatMapCtrl::match(group, h2); m; m &= m - 1) {
+					size_t i = (pos + FlatMapCtrl::lowestBit(m)) & mask;
+					if (mSlots[i].first == key)
+						return i;
+				}
+				if (FlatMapCtrl::match(group, FlatMapCtrl::EMPTY))
+					return mCapacity;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		// returns: The first slot without an entry on the probe sequence of hash.
+		size_t findFree(uint64_t hash) const {
+			size_t mask = mCapacity - 1;
+			size_t pos = (size_t)(hash >> 7) & mask;
+
+			for (size_t step = FLAT_MAP_GROUP_SIZE;; step += FLAT_MAP_GROUP_SIZE) {
+				uint32_t m = FlatMapCtrl::matchFree(mCtrl + pos);
+				if (m)
+					return (pos + FlatMapCtrl::lowestBit(m)) & mask;
+				pos = (pos + step) & mask;
+			}
+		}
+
+		void allocate(size_t capacity) {
+			mCapacity = capacity;
+			mCtrl = new int8_t[capacity + FLAT_MAP_GROUP_SIZE - 1];
+			std::memset(mCtrl, FlatMapCtrl::EMPTY, capacity + FLAT_MAP_GROUP_SIZE - 1);
+			mSlots = static_cast<value_type*>(::operator new(sizeof(value_type) * capacity));
+			mGrowthLeft = maxLoad(capacity);
+		}
+
+		void destroySlots() {
+			for (size_t i = 0; i < mCapacity; ++i)
+				if (mCtrl[i] >= 0)
+					mSlots[i].~value_type();
+		}
+
+		void release() {
+			if (mCapacity > 0) {
+				destroySlots();
+				delete[] mCtrl;
+				::operator delete(mSlots);
+			}
+			mCtrl = nullptr;
+			mSlots = nullptr;
+			mCapacity = 0;
+			mSize = 0;
+			mGrowthLeft = 0;
+		}
+
+		// Moves every entry into a table of the given capacity, dropping tombstones.
+		void rehash(size_t capacity) {
+			int8_t* oldCtrl = mCtrl;
+			value_type* oldSlots = mSlots;
+			size_t oldCapacity = mCapacity;
+
+			allocate(capacity);
+
+			for (size_t i = 0; i < oldCapacity; ++i) {
+				if (oldCtrl[i] >= 0) {
+					uint64_t hash = hashOf(oldSlots[i].first);
+					size_t slot = findFree(hash);
+					new (&mSlots[slot]) value_type(std::move(oldSlots[i]));
+					setCtrl(slot, (int8_t)(hash & 0x7F));
+					oldSlots[i].~value_type();
+				}
+			}
+			mGrowthLeft -= mSize;
+
+			if (oldCapacity > 0) {
+				delete[] oldCtrl;
+				::operator delete(oldSlots);
+			}
+		}
+
+		// Makes room for one more entry in an empty slot.
+		void prepareInsert() {
+			if (mCapacity == 0)
+				rehash(FLAT_MAP_MIN_CAPACITY);
+			else if (mGrowthLeft == 0) {
+				// Reclaim tombstones in place if they make up much of the table
+				if (mSize * 2 < maxLoad(mCapacity))
+					rehash(mCapacity);
+				else
+					rehash(mCapacity * 2);
+			}
+		}
+
+	public:
+		template <bool bConst>
+		class IteratorBase {
+		private:
+			typedef typename std::conditional<bConst, const FlatHashMap, FlatHashMap>::type map_type;
+			typedef typename std::conditional<bConst, const value_type, value_type>::type entry_type;
+
+			map_type* mMap;
+			size_t mIndex;
+
+			// Skips free slots a group at a time, bytes past the end are clones of the
+			// first group and stop the scan at mCapacity
+			inline void skipFree() {
+				while (mIndex < mMap->mCapacity) {
+					uint32_t full = ~FlatMapCtrl::matchFree(mMap->mCtrl + mIndex) & 0xFFFFu;
+					if (full) {
+						mIndex = std::min(mIndex + FlatMapCtrl::lowestBit(full), mMap->mCapacity);
+						return;
+					}
+					mIndex += FLAT_MAP_GROUP_SIZE;
+				}
+				mIndex = mMap->mCapacity;
+			}
+
+		public:
+			inline IteratorBase(map_type* map, size_t index) : mMap(map), mIndex(index) { }
+
+			inline entry_type& operator*() const { return mMap->mSlots[mIndex]; }
+			inline entry_type* operator->() const { return &mMap->mSlots[mIndex]; }
+			inline IteratorBase& operator++() {
+				++mIndex;
+				skipFree();
+				return *this;
+			}
+			inline bool operator==(const IteratorBase& other) const { return mIndex == other.mIndex; }
+			inline bool operator!=(const IteratorBase& other) const { return mIndex != other.mIndex; }
+
+			friend class FlatHashMap;
+		};
+
+		typedef IteratorBase<false> iterator;
+		typedef IteratorBase<true> const_iterator;
+
+		inline FlatHashMap() : mCtrl(nullptr), mSlots(nullptr),
+			mCapacity(0), mSize(0), mGrowthLeft(0) { }
+
+		FlatHashMap(const FlatHashMap& other) : FlatHashMap() {
+			*this = other;
+		}
+
+		FlatHashMap(FlatHashMap&& other) noexcept : FlatHashMap() {
+			swap(other);
+		}
+
+		FlatHashMap& operator=(const FlatHashMap& other) {
+			if (this != &other) {
+				clear();
+				reserve(other.mSize);
+				for (auto& entry : other)
+					(*this)[entry.first] = entry.second;
+			}
+			return *this;
+		}
+
+		FlatHashMap& operator=(FlatHashMap&& other) noexcept {
+			if (this != &other) {
+				release();
+				swap(other);
+			}
+			return *this;
+		}
+
+		~FlatHashMap() {
+			release();
+		}
+
+		inline void swap(FlatHashMap& other) noexcept {
+			std::swap(mCtrl, other.mCtrl);
+			std::swap(mSlots, other.mSlots);
+			std::swap(mCapacity, other.mCapacity);
+			std::swap(mSize, other.mSize);
+			std::swap(mGrowthLeft, other.mGrowthLeft);
+			std::swap(mHash, other.mHash);
+		}
+
+		inline iterator begin() {
+			iterator it(this, 0);
+			it.skipFree();
+			return it;
+		}
+		inline iterator end() { return iterator(this, mCapacity); }
+		inline const_iterator begin() const {
+			const_iterator it(this, 0);
+			it.skipFree();
+			return it;
+		}
+		inline const_iterator end() const { return const_iterator(this, mCapacity); }
+
+		inline size_t size() const { return mSize; }
+		inline bool empty() const { return mSize == 0; }
+		inline size_t capacity() const { return mCapacity; }
+
+		inline iterator find(const K& key) { return iterator(this, findSlot(key, hashOf(key))); }
+		inline const_iterator find(const K& key) const { return const_iterator(this, findSlot(key, hashOf(key))); }
+		inline size_t count(const K& key) const { return findSlot(key, hashOf(key)) == mCapacity ? 0 : 1; }
+
+		// Inserts an entry if there is none for the key yet.
+		// key: The key of the entry.
+		// args: The arguments to construct the value from.
+		// returns: The entry of the key and whether it was inserted.
+		template <typename... Args>
+		std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+			uint64_t hash = hashOf(key);
+			size_t slot = findSlot(key, hash);
+			if (slot != mCapacity)
+				return std::make_pair(iterator(this, slot), false);
+
+			prepareInsert();
+			slot = findFree(hash);
+			if (mCtrl[slot] == FlatMapCtrl::EMPTY)
+				--mGrowthLeft;
+			new (&mSlots[slot]) value_type(std::piecewise_construct,
+				std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+			setCtrl(slot, (int8_t)(hash & 0x7F));
+			++mSize;
+			return std::make_pair(iterator(this, slot), true);
+		}
+
+		inline std::pair<iterator, bool> insert(const value_type& entry) {
+			return try_emplace(entry.first, entry.second);
+		}
+
+		inline V& operator[](const K& key) {
+			return try_emplace(key).first->second;
+		}
+
+		// Erases an entry. Other iterators stay valid.
+		// it: The entry to erase.
+		// returns: An iterator to the next entry.
+		iterator erase(iterator it) {
+			mSlots[it.mIndex].~value_type();
+			setCtrl(it.mIndex, FlatMapCtrl::DELETED);
+			--mSize;
+			++it;
+			return it;
+		}
+
+		size_t erase(const K& key) {
+			size_t slot = findSlot(key, hashOf(key));
+			if (slot == mCapacity)
+				return 0;
+			erase(iterator(this, slot));
+			return 1;
+		}
+
+		// Erases every entry but keeps the memory of the table.
+		void clear() {
+			if (mCapacity == 0)
+				return;
+			destroySlots();
+			std::memset(mCtrl, FlatMapCtrl::EMPTY, mCapacity + FLAT_MAP_GROUP_SIZE - 1);
+			mSize = 0;
+			mGrowthLeft = maxLoad(mCapacity);
+		}
+
+		// Grows the table so that count entries fit without another rehash.
+		void reserve(size_t count) {
+			size_t capacity = FLAT_MAP_MIN_CAPACITY;
+			while (maxLoad(capacity) < count)
+				capacity *= 2;
+			if (capacity > mCapacity)
+				rehash(capacity);
+		}
+	};
+}
@@ -13,14 +13,23 @@
 #include <engine/gui.hpp>
 #include <engine/blit.hpp>
 #include <engine/skybox.hpp>
+#include <engine/rendertargetpool.hpp>
+#include <engine/dynamicresolution.hpp>
+#include <engine/occlusion.hpp>
 namespace Morpheus {
 	struct StaticMeshRenderInstance {
 		StaticMesh* mStaticMesh;
 		Transform* mTransform;
 	};
 
+	struct OccluderRenderInstance {
+		Occluder* mOccluder;
+		Transform* mTransform;
+	};
+
 	struct ForwardRenderQueue {
 		RenderQueue<StaticMeshRenderInstance> mStaticMeshes;
+		RenderQueue<OccluderRenderInstance> mOccluders;
 		RenderQueue<GuiBase*> mGuis;
 	};
 
@@ -37,9 +46,28 @@ namespace Morpheus {
 		Skybox* mSkybox;
 	};
 
+	// Estimate of the memory traffic of a single render pass.
+	struct RenderPassBandwidth {
+		const char* mName;
+		size_t mBytesRead;
+		size_t mBytesWritten;
+	};
+
+	// Estimated memory traffic of every pass in the last frame. Estimates assume every
+	// pixel is shaded once and ignore texture reads and framebuffer compression.
+	struct FrameBandwidthStats {
+		std::vector<RenderPassBandwidth> mPasses;
+
+		size_t bytesRead() const;
+		size_t bytesWritten() const;
+		void print(std::ostream& os) const;
+	};
+
 	struct ForwardRenderDrawParams {
 		Camera* mRenderCamera;
 		Skybox* mSkybox;
+		// Offscreen output, nullptr for the back buffer
+		Framebuffer* mOutput;
 	};
 
 	class ForwardRenderer : public IRenderer {
@@ -60,13 +88,26 @@ namespace Morpheus {
 
 		Shader* mPostProcessor;
 		BlitShaderView mPostProcessorBlitView;
+		ShaderUniform<glm::vec2> mPostProcessorUVScale;
+		ShaderUniform<glm::vec2> mPostProcessorTexelSize;
+		ShaderUniform<float> mPostProcessorSharpness;
+
+		// Dynamic resolution
+		GpuTimer mFrameTimer;
+		DynamicResolutionController mDynamicResolution;
+
+		// CPU occlusion culling, nullptr if disabled
+		SoftwareOcclusionCuller* mOcclusionCuller;
+
+		// Number of mesh triangles submitted last frame, after LOD selection
+		size_t mTrianglesDrawn;
 
 		Sampler* mTextureSampler;
 		Sampler* mCubemapSampler;
 
-		// Framebuffer
-		Framebuffer* mMultisampleTargetBuffer;
-		Framebuffer* mTargetBuffer;
+		// Transient render targets for all passes
+		RenderTargetPool mTargetPool;
+		FrameBandwidthStats mBandwidth;
 
 		void collectRecursive(INodeOwner* current, ForwardRenderCollectParams& params);
 		void collect(INodeOwner* start, ForwardRenderCollectParams& params);
@@ -87,6 +128,7 @@ namespace Morpheus {
 		void init() override;
 		void postGlfwRequests() override;
 		void draw(INodeOwner* scene) override;
+		void draw(INodeOwner* scene, Framebuffer* output) override;
 		void setClearColorEx(float r, float g, float b) override;
 
 		void blitEx(Texture* texture,
@@ -95,6 +137,12 @@ namespace Morpheus {
 			Shader* shader,
 			BlitShaderView* shaderView) override;
 
+		inline RenderTargetPool* targetPool() { return &mTargetPool; }
+		inline const FrameBandwidthStats& bandwidth() const { return mBandwidth; }
+		inline const DynamicResolutionStats& dynamicResolution() const { return mDynamicResolution.stats(); }
+		inline SoftwareOcclusionCuller* occlusionCuller() { return mOcclusionCuller; }
+		inline size_t trianglesDrawn() const { return mTrianglesDrawn; }
+
 		friend class Engine;
 	};
 	SET_BASE_TYPE(ForwardRenderer, IRenderer);
@@ -74,6 +74,8 @@ namespace Morpheus {
 
 		void bind();
 		void blit(Framebuffer* target, GLbitfield copyComponents);
+		// Blit only the lower left width x height region of this framebuffer.
+		void blit(Framebuffer* target, GLbitfield copyComponents, uint width, uint height);
 		void blitToBackBuffer(GLbitfield copyComponents);
 
 		Framebuffer* toFramebuffer() override;
@@ -151,6 +153,7 @@ namespace Morpheus {
 			uint samples=1);
 
 		void unload(INodeOwner* ref) override;
+		ContentSize measure(INodeOwner* ref) const override;
 		
 		~ContentFactory();
 
@@ -10,6 +10,10 @@
 #pragma once
 
 #include <engine/content.hpp>
+#include <engine/cookedgeometry.hpp>
+#include <engine/meshopt.hpp>
+#include <engine/simplify.hpp>
+#include <engine/vertexformat.hpp>
 
 #include <glad/glad.h>
 
@@ -20,6 +24,14 @@ namespace Assimp {
 namespace Morpheus {
 
 	class HalfEdgeGeometry;
+	class Geometry;
+
+	// A coarser level of detail that was loaded together with a geometry.
+	struct GeometryLod {
+		Geometry* mGeometry;
+		// Object space distance between this level and the full resolution geometry
+		float mError;
+	};
 
 	// A piece of OpenGL geometry data in the engine.
 	class Geometry : public INodeOwner {
@@ -31,14 +43,19 @@ namespace Morpheus {
 		GLsizei mElementCount;
 		GLenum mIndexType;
 		BoundingBox mAabb;
+		// Maps stored (possibly quantized) positions into object space
+		glm::mat4 mPositionDecode;
+		// Levels of detail from a cooked file, owned by this geometry
+		std::vector<GeometryLod> mLods;
 
-		inline Geometry() : INodeOwner(NodeType::GEOMETRY) { }
+		inline Geometry() : INodeOwner(NodeType::GEOMETRY),
+			mPositionDecode(glm::identity<glm::mat4>()) { }
 		inline Geometry(GLuint vao, GLuint vbo, GLuint ibo,
 			GLenum elementType, GLsizei elementCount, GLenum indexType,
 			BoundingBox aabb) :
 			INodeOwner(NodeType::GEOMETRY), mVao(vao), mVbo(vbo), mIbo(ibo), mElementType(elementType),
 			mElementCount(elementCount), mIndexType(indexType),
-			mAabb(aabb) { }
+			mAabb(aabb), mPositionDecode(glm::identity<glm::mat4>()) { }
 
 	public:
 		Geometry* toGeometry() override;
@@ -50,11 +67,46 @@ namespace Morpheus {
 		inline GLenum elementType() const { return mElementType; }
 		inline GLsizei elementCount() const { return mElementCount; }
 		inline GLenum indexType() const { return mIndexType; }
+		// Must be applied before the world matrix when drawing, i.e., world * positionDecode().
+		inline const glm::mat4& positionDecode() const { return mPositionDecode; }
+		// Levels of detail that were cooked together with this geometry, finest first.
+		inline const std::vector<GeometryLod>& lods() const { return mLods; }
 
 		friend class ContentFactory<Geometry>;
 	};
 	SET_NODE_ENUM(Geometry, GEOMETRY);
 
+	// Controls how index and vertex buffers are reordered before they are uploaded.
+	template <>
+	struct ContentExtParams<Geometry> {
+		// Reorder triangles for the post-transform vertex cache
+		bool bOptimizeVertexCache;
+		// Reorder clusters of triangles so that outward facing ones are drawn first
+		bool bOptimizeOverdraw;
+		// Factor by which overdraw optimization may worsen the vertex cache miss ratio
+		float mOverdrawThreshold;
+		// Reorder vertices in the order that the triangles use them
+		bool bOptimizeVertexFetch;
+		// Log vertex cache statistics before and after optimization, at info level
+		bool bLogStatistics;
+		// Storage format of the vertices, nullptr for the format of the factory
+		const VertexFormat* mVertexFormat;
+
+		ContentExtParams(bool optimizeVertexCache = true,
+			bool optimizeOverdraw = true,
+			bool optimizeVertexFetch = true,
+			float overdrawThreshold = OVERDRAW_DEFAULT_THRESHOLD,
+			bool logStatistics = false,
+			const VertexFormat* vertexFormat = nullptr) :
+			bOptimizeVertexCache(optimizeVertexCache),
+			bOptimizeOverdraw(optimizeOverdraw),
+			mOverdrawThreshold(overdrawThreshold),
+			bOptimizeVertexFetch(optimizeVertexFetch),
+			bLogStatistics(logStatistics),
+			mVertexFormat(vertexFormat) {
+		}
+	};
+
 	// Used for converting HalfEdgeGeometry into renderable Geometry
 	struct HalfEdgeAttributes {
 		GLint mPositionAttribute;
@@ -65,6 +117,29 @@ namespace Morpheus {
 
 		static HalfEdgeAttributes defaults();
 	};
+
+	// Controls what is written into a cooked geometry file.
+	struct GeometryCookParameters {
+		// Optimizations applied to every level
+		ContentExtParams<Geometry> mOptimize;
+		// The vertex format to pack into, must match the format used at runtime
+		VertexFormat mFormat;
+		// Number of simplified levels of detail to generate, 0 for none
+		uint32_t mLodLevels;
+		// Fraction of the triangles of the previous level that each level keeps
+		float mLodRatio;
+		SimplifyParameters mSimplify;
+		// Store a bounding volume hierarchy over the triangles of the full geometry
+		bool bBuildBvh;
+
+		static GeometryCookParameters defaults();
+		// Reads the "vertex_format" and "cook" blocks of the engine config.
+		static GeometryCookParameters fromConfig(const nlohmann::json& config);
+
+		// returns: A description of everything that affects the cooked result, for
+		// use as the parameters of a DerivedDataCache key.
+		std::string cacheParameters() const;
+	};
 	
 	// A factory for loading Geometry using the open asset
 	// import library.
@@ -72,17 +147,36 @@ namespace Morpheus {
 	class ContentFactory<Geometry> : public IContentFactory {
 	private:
 		Assimp::Importer* mImporter;
+		VertexFormat mVertexFormat;
+		GeometryCookParameters mCookParameters;
+
+		Geometry* loadInternal(const std::string& source, const ContentExtParams<Geometry>& params);
+		Geometry* loadCooked(const std::string& path, const VertexFormat* requiredFormat);
+		static bool importBuffers(Assimp::Importer* importer, const std::string& source,
+			const ContentExtParams<Geometry>& params, GeometryBuffers* output);
+		static void makeBuffers(const HalfEdgeGeometry* geo, const HalfEdgeAttributes& attrib,
+			const ContentExtParams<Geometry>& params, GeometryBuffers* output);
+		static Geometry* uploadGeometry(const void* vertices, size_t vertexSize, uint32_t vertexStride,
+			const std::vector<PackedVertexAttribute>& attributes, const void* indices, size_t indexSize,
+			uint32_t indexCount, GLenum indexType, const BoundingBox& aabb, const glm::mat4& positionDecode);
+		static Geometry* uploadGeometry(const CookedGeometryLevel& level);
+		static void destroyGeometry(Geometry* geo);
 
 	public:
 		ContentFactory();
 		~ContentFactory();
 
 		INodeOwner* load(const std::string& source, Node loadInto) override;
+		INodeOwner* loadEx(const std::string& source, Node loadInto, const void* extParams) override;
 		void unload(INodeOwner* ref) override;
+		ContentSize measure(INodeOwner* ref) const override;
 		
 		Geometry* makeGeometryUnmanaged(GLuint vao, GLuint vbo, GLuint ibo,
 			GLenum elementType, GLsizei elementCount, GLenum indexType,
 			BoundingBox aabb) const;
+		Geometry* makeGeometryUnmanaged(const HalfEdgeGeometry* geo,
+			const HalfEdgeAttributes& attrib,
+			const ContentExtParams<Geometry>& params) const;
 		Geometry* makeGeometryUnmanaged(const HalfEdgeGeometry* geo,
 			const HalfEdgeAttributes& attrib) const;
 		Geometry* makeGeometryUnmanaged(const HalfEdgeGeometry* geo) const;
@@ -93,6 +187,10 @@ namespace Morpheus {
 		Geometry* makeGeometry(GLuint vao, GLuint vbo, GLuint ibo,
 			GLenum elementType, GLsizei elementCount, GLenum indexType,
 			BoundingBox aab) const;
+		Geometry* makeGeometry(const HalfEdgeGeometry* geo,
+			const HalfEdgeAttributes& attrib,
+			const ContentExtParams<Geometry>& params,
+			const std::string& source) const;
 		Geometry* makeGeometry(const HalfEdgeGeometry* geo, 
 			const HalfEdgeAttributes& attrib,
 			const std::string& source) const;
@@ -103,5 +201,25 @@ namespace Morpheus {
 			const std::string& source) const;
 	
 		std::string getContentTypeString() const override;
+
+		// Imports a mesh through assimp and writes it as a cooked file, which load prefers
+		// over the source from then on as long as it is newer than the source. Does not
+		// touch any OpenGL or content manager state, so it is safe to call from several
+		// threads at once.
+		// source: The mesh to import.
+		// destination: The cooked file to write, usually cookedGeometryPath(source).
+		// params: The levels of detail, BVH and vertex format to cook.
+		// returns: Whether the cooked file was written.
+		bool cook(const std::string& source, const std::string& destination,
+			const GeometryCookParameters& params) const;
+
+		// The format that geometry is stored in unless overridden by load parameters.
+		// Shaders must be compiled with the matching defines, see VertexFormat::addDefines.
+		inline const VertexFormat& vertexFormat() const { return mVertexFormat; }
+		inline void setVertexFormat(const VertexFormat& format) { mVertexFormat = format; }
+
+		// The parameters that entries of the derived data cache are expected to be cooked with.
+		inline const GeometryCookParameters& cookParameters() const { return mCookParameters; }
+		inline void setCookParameters(const GeometryCookParameters& params) { mCookParameters = params; }
 	};
 }
\ No newline at end of file
@@ -0,0 +1,60 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: gldelete.hpp
+*	Description: Collects the names of OpenGL objects that are being destroyed so
+*	that they can be deleted with one call per object type, instead of one call
+*	per object, when a lot of content is unloaded at once.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace Morpheus {
+
+	// Defers the deletion of OpenGL objects while a batch is open. Outside of a batch,
+	// objects are deleted immediately. Should only be used from the thread which owns
+	// the OpenGL context.
+	class GLDeleteQueue {
+	private:
+		std::vector<GLuint> mTextures;
+		std::vector<GLuint> mBuffers;
+		std::vector<GLuint> mVertexArrays;
+		std::vector<GLuint> mFramebuffers;
+		std::vector<GLuint> mSamplers;
+		std::vector<GLuint> mPrograms;
+		uint32_t mBatchDepth;
+
+		void defer(std::vector<GLuint>* queue, GLsizei count, const GLuint* names);
+
+	public:
+		GLDeleteQueue();
+
+		// Opens a batch, batches may be nested. Deletions are issued when the
+		// outermost batch is closed.
+		void beginBatch();
+		// Closes a batch, and flushes the queue if it was the outermost one.
+		void endBatch();
+		// Deletes everything in the queue now.
+		void flush();
+
+		inline bool isBatching() const {
+			return mBatchDepth > 0;
+		}
+
+		void deleteTextures(GLsizei count, const GLuint* names);
+		void deleteBuffers(GLsizei count, const GLuint* names);
+		void deleteVertexArrays(GLsizei count, const GLuint* names);
+		void deleteFramebuffers(GLsizei count, const GLuint* names);
+		void deleteSamplers(GLsizei count, const GLuint* names);
+		void deletePrograms(GLsizei count, const GLuint* names);
+	};
+
+	// returns: The deletion queue that content factories delete their objects through.
+	GLDeleteQueue* glDeleteQueue();
+}
@@ -287,6 +287,13 @@ namespace Morpheus {
 
 		BoundingBox aabb;
 
+		// Creates the vertices, half edges and faces of the mesh from a face list.
+		// Vertex attributes must already be set.
+		// faceIndices: The vertex indices of all faces, one face after another.
+		// faceSizes: The number of vertices in each face.
+		void buildTopology(const std::vector<uint32_t>& faceIndices,
+			const std::vector<uint32_t>& faceSizes);
+
 	public:
 		explicit HalfEdgeGeometry() : INodeOwner(NodeType::HALF_EDGE_GEOMETRY) {}
 		explicit HalfEdgeGeometry(const HalfEdgeGeometry& geo);
@@ -408,6 +415,9 @@ namespace Morpheus {
 
 		friend HalfEdgeGeometry* loadBinary(const std::string& path);
 		friend HalfEdgeGeometry* loadJson(const std::string& path);
+		friend HalfEdgeGeometry* makeHalfEdgeGeometry(const std::vector<vec3type>& positions,
+			const std::vector<uint32_t>& faceIndices,
+			const std::vector<uint32_t>& faceSizes);
 
 		friend class ContentFactory<HalfEdgeGeometry>;
 	};
@@ -415,6 +425,17 @@ namespace Morpheus {
 	HalfEdgeGeometry* loadBinary(const std::string& path);
 	HalfEdgeGeometry* loadJson(const std::string& path);
 
+	// Creates a half edge geometry from an indexed face list. Faces must be consistently
+	// oriented and the mesh must be manifold. Other attributes can be added afterwards
+	// through createUVs, createNormals, etc.
+	// positions: The positions of the vertices.
+	// faceIndices: The vertex indices of all faces, one face after another.
+	// faceSizes: The number of vertices in each face.
+	// returns: A new unmanaged half edge geometry.
+	HalfEdgeGeometry* makeHalfEdgeGeometry(const std::vector<vec3type>& positions,
+		const std::vector<uint32_t>& faceIndices,
+		const std::vector<uint32_t>& faceSizes);
+
 	inline vec3type* Vertex::ptrPosition() {
 		return &geo_->vertexPositions[id_];
 	}
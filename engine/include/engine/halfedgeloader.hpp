@@ -30,6 +30,7 @@ namespace Morpheus {
 
 		INodeOwner* load(const std::string& source, Node loadInto) override;
 		void unload(INodeOwner* ref) override;
+		ContentSize measure(INodeOwner* ref) const override;
 
 		std::string getContentTypeString() const override;
 
@@ -0,0 +1,126 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: log.hpp
+*	Description: A leveled logger that writes messages to the console and optionally
+*	to a file on a background thread, so that logging does not stall the frame on
+*	synchronous writes to stdout.
+*/
+
+#pragma once
+
+#include <engine/json.hpp>
+#include <engine/threadpool.hpp>
+
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+namespace Morpheus {
+
+	enum class LogLevel {
+		// Per-object detail, i.e., every node that garbage collection looks at
+		VERBOSE,
+		INFO,
+		WARNING,
+		CRITICAL,
+		// Only used as a threshold, disables all output
+		NONE
+	};
+
+	class Logger {
+	private:
+		LogLevel mLevel;
+		bool bConsole;
+		std::ofstream mFile;
+		std::mutex mFileMutex;
+		// A single worker keeps the messages in order
+		ThreadPool mWriter;
+
+	public:
+		Logger();
+		~Logger();
+
+		// Reads the "log" block of the engine config.
+		// config: The engine config.
+		void configure(const nlohmann::json& config);
+
+		// Writes all output to a file as well as to the console.
+		// path: The file to write to, it is truncated. Pass an empty string to stop.
+		// returns: Whether the file could be opened.
+		bool setFile(const std::string& path);
+
+		inline void setLevel(LogLevel level) {
+			mLevel = level;
+		}
+		inline LogLevel level() const {
+			return mLevel;
+		}
+		inline void setConsole(bool value) {
+			bConsole = value;
+		}
+
+		// returns: Whether messages of the given level are written anywhere.
+		inline bool enabled(LogLevel level) const {
+			return level >= mLevel && level != LogLevel::NONE;
+		}
+
+		// Queues a message to be written. Messages below the level are dropped.
+		// level: The level of the message.
+		// message: The message, without a trailing newline.
+		void write(LogLevel level, std::string&& message);
+
+		// Blocks until every queued message has been written.
+		void flush();
+	};
+
+	// returns: The logger that the engine writes to.
+	Logger* logger();
+
+	// Collects a message with operator<< and hands it to the logger when it goes out
+	// of scope. Nothing is formatted if the level is disabled.
+	class LogMessage {
+	private:
+		LogLevel mLevel;
+		bool bEnabled;
+		std::ostringstream mStream;
+
+	public:
+		inline LogMessage(LogLevel level) : mLevel(level), bEnabled(logger()->enabled(level)) {
+		}
+
+		// Returned by value through copy elision only, a moved-from message would be written twice
+		LogMessage(const LogMessage&) = delete;
+		LogMessage& operator=(const LogMessage&) = delete;
+
+		inline ~LogMessage() {
+			if (bEnabled)
+				logger()->write(mLevel, mStream.str());
+		}
+
+		template <typename T>
+		inline LogMessage& operator<<(const T& value) {
+			if (bEnabled)
+				mStream << value;
+			return *this;
+		}
+	};
+
+	inline LogMessage logVerbose() {
+		return LogMessage(LogLevel::VERBOSE);
+	}
+
+	inline LogMessage logInfo() {
+		return LogMessage(LogLevel::INFO);
+	}
+
+	inline LogMessage logWarning() {
+		return LogMessage(LogLevel::WARNING);
+	}
+
+	inline LogMessage logError() {
+		return LogMessage(LogLevel::CRITICAL);
+	}
+}
@@ -0,0 +1,41 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: mappedfile.hpp
+*	Description: Read-only memory mapping of files, so that binary content can be
+*	handed to OpenGL straight from the page cache.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Morpheus {
+
+	// A read-only view of an entire file, mapped into memory.
+	class MappedFile {
+	private:
+		void* mData;
+		size_t mSize;
+
+	public:
+		inline MappedFile() : mData(nullptr), mSize(0) { }
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		// Maps a file into memory, closing any file that was previously mapped.
+		// path: The file to map.
+		// returns: Whether the file was mapped successfully.
+		bool open(const std::string& path);
+		void close();
+
+		inline bool isOpen() const { return mData != nullptr; }
+		inline const uint8_t* data() const { return static_cast<const uint8_t*>(mData); }
+		inline size_t size() const { return mSize; }
+	};
+}
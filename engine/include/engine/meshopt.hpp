@@ -0,0 +1,77 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: meshopt.hpp
+*	Description: Reordering of triangle lists for the post-transform vertex cache,
+*	for reduced overdraw and for vertex fetch locality.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Size of the LRU cache modelled by optimizeVertexCache
+#define VERTEX_CACHE_OPTIMIZE_SIZE 32
+// Size of the FIFO cache used to measure cache efficiency
+#define VERTEX_CACHE_ANALYZE_SIZE 16
+// Overdraw optimization may raise the ACMR by at most this factor
+#define OVERDRAW_DEFAULT_THRESHOLD 1.05f
+
+namespace Morpheus {
+
+	struct VertexCacheStats {
+		// Average cache miss ratio, i.e., transformed vertices per triangle
+		double mACMR;
+		// Average transform to vertex ratio, 1 is optimal
+		double mATVR;
+
+		void print(std::ostream& os) const;
+	};
+
+	// Measures how well a triangle list uses a FIFO post-transform cache.
+	// indices: Three indices per triangle.
+	// indexCount: The number of indices.
+	// vertexCount: The number of vertices referenced by the indices.
+	// cacheSize: The number of entries in the simulated cache.
+	// returns: The cache statistics of the triangle list.
+	VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount,
+		size_t vertexCount, uint32_t cacheSize = VERTEX_CACHE_ANALYZE_SIZE);
+
+	// Reorders triangles so that vertices are reused while still in the post-transform
+	// cache, using the greedy scoring of Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+	// destination: Receives the reordered indices, may not be the same as indices.
+	// indices: Three indices per triangle.
+	// indexCount: The number of indices.
+	// vertexCount: The number of vertices referenced by the indices.
+	void optimizeVertexCache(uint32_t* destination, const uint32_t* indices,
+		size_t indexCount, size_t vertexCount);
+
+	// Reorders clusters of a cache optimized triangle list so that triangles which face
+	// outwards are drawn first, which lets the depth test reject more of the later ones
+	// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+	// destination: Receives the reordered indices, may not be the same as indices.
+	// indices: Three indices per triangle, ideally already passed through optimizeVertexCache.
+	// indexCount: The number of indices.
+	// positions: Pointer to the position of the first vertex.
+	// positionStride: The distance between two positions in bytes.
+	// vertexCount: The number of vertices referenced by the indices.
+	// threshold: The factor by which the cache miss ratio of a cluster may be worse than
+	// that of the input. Larger values give smaller clusters and less overdraw.
+	void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+		const float* positions, size_t positionStride, size_t vertexCount,
+		float threshold = OVERDRAW_DEFAULT_THRESHOLD);
+
+	// Reorders vertices in the order in which they are first used by the triangle list,
+	// so that vertex fetches walk through memory linearly. Unused vertices are removed.
+	// vertices: The vertex data, reordered in place.
+	// indices: Three indices per triangle, rewritten in place.
+	// indexCount: The number of indices.
+	// vertexCount: The number of vertices.
+	// vertexSize: The size of a vertex in bytes.
+	// returns: The number of vertices that remain.
+	size_t optimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount,
+		size_t vertexCount, size_t vertexSize);
+}
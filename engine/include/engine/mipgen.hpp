@@ -0,0 +1,85 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: mipgen.hpp
+*	Description: Generates mip chains on the CPU with a choice of filters, for cooked
+*	textures and for loading textures without relying on glGenerateTextureMipmap.
+*/
+
+#pragma once
+
+#include <engine/json.hpp>
+#include <engine/threadpool.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Rows of a level that a single job filters
+#define MIP_ROWS_PER_JOB 32
+
+namespace Morpheus {
+
+	enum class MipFilter {
+		// Averages 2x2 blocks, the same as most glGenerateMipmap implementations
+		BOX,
+		// Kaiser windowed sinc, sharp with little ringing
+		KAISER,
+		// Lanczos windowed sinc with three lobes, sharpest but rings around edges
+		LANCZOS
+	};
+
+	struct MipGenParameters {
+		MipFilter mFilter;
+		// Treat the color channels of 8 bit images as sRGB and filter them in linear space
+		bool bSRGB;
+		// Rescale the alpha of every level so that the fraction of texels passing the
+		// alpha test is the same as in level 0, keeps alpha tested foliage from thinning out
+		bool bPreserveAlphaCoverage;
+		// The alpha test reference that coverage is measured against
+		float mAlphaReference;
+
+		static MipGenParameters defaults();
+		// Reads the "mip_generation" block of the engine config.
+		static MipGenParameters fromConfig(const nlohmann::json& config);
+
+		// returns: A description of everything that affects the generated levels, for
+		// use as the parameters of a DerivedDataCache key.
+		std::string cacheParameters() const;
+	};
+
+	// A level of a generated mip chain, tightly packed with the same component count
+	// and component type as the image it was generated from.
+	struct MipLevel {
+		uint32_t mWidth;
+		uint32_t mHeight;
+		std::vector<uint8_t> mData;
+	};
+
+	// Generates mip chains on a pool of worker threads. Levels are filtered one after
+	// the other from the previous level, with the rows of every pass split across the
+	// workers. Alpha coverage and conversion back to the source type are done for all
+	// levels at once afterwards.
+	class MipGenerator {
+	private:
+		ThreadPool mWorkers;
+
+	public:
+		// threadCount: The number of worker threads, 0 to do all work on the calling thread.
+		MipGenerator(uint32_t threadCount);
+
+		// Generates the full mip chain of an image, including a copy of level 0.
+		// pixels: The image, tightly packed rows from top to bottom.
+		// width: The width of the image.
+		// height: The height of the image.
+		// components: The number of components per pixel, 1 to 4.
+		// bFloat: Whether components are 32 bit floats rather than 8 bit unsigned normalized.
+		// params: The filter and color space to generate with.
+		// levels: Receives the levels, finest first.
+		void generate(const void* pixels, uint32_t width, uint32_t height, uint32_t components,
+			bool bFloat, const MipGenParameters& params, std::vector<MipLevel>* levels);
+
+		inline uint32_t threadCount() const { return mWorkers.threadCount(); }
+	};
+}
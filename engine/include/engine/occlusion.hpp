@@ -0,0 +1,180 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: occlusion.hpp
+*	Description: CPU occlusion culling. A small set of occluder meshes is
+*	rasterized into a low resolution depth buffer on worker threads, and the
+*	bounding boxes of draws are then tested against it before being submitted.
+*/
+
+#pragma once
+
+#include <engine/core.hpp>
+#include <engine/threadpool.hpp>
+
+#include <glm/glm.hpp>
+
+#include <ostream>
+#include <vector>
+
+#define OCCLUSION_TILE_WIDTH 32
+#define OCCLUSION_TILE_HEIGHT 16
+#define OCCLUSION_DEFAULT_WIDTH 256
+#define OCCLUSION_DEFAULT_HEIGHT 128
+
+namespace Morpheus {
+
+	class Texture;
+
+	// A mesh that is only used to hide other objects. Occluders are never drawn, they
+	// are rasterized on the CPU by the SoftwareOcclusionCuller. They should be simple and
+	// lie inside of the visible geometry they stand in for, otherwise objects which are
+	// actually visible may be culled.
+	class Occluder : public INodeOwner {
+	private:
+		std::vector<glm::vec3> mPositions;
+		std::vector<uint32_t> mIndices;
+		BoundingBox mAabb;
+
+		void updateBoundingBox();
+
+	public:
+		// Creates an occluder from a triangle list.
+		// positions: The vertex positions of the occluder.
+		// indices: Three indices per triangle.
+		Occluder(const std::vector<glm::vec3>& positions,
+			const std::vector<uint32_t>& indices);
+
+		// Creates an occluder from a half edge geometry, triangulating all faces.
+		// geo: The geometry to create the occluder from.
+		Occluder(const HalfEdgeGeometry* geo);
+
+		// Creates a box occluder.
+		// box: The box to fill.
+		Occluder(const BoundingBox& box);
+
+		Occluder* toOccluder() override;
+
+		inline const std::vector<glm::vec3>& positions() const { return mPositions; }
+		inline const std::vector<uint32_t>& indices() const { return mIndices; }
+		inline uint32_t triangleCount() const { return (uint32_t)(mIndices.size() / 3); }
+
+		BoundingBox computeBoundingBox() const override;
+		bool hasBoundingBox() const override;
+	};
+	SET_NODE_ENUM(Occluder, OCCLUDER);
+
+	struct OcclusionStats {
+		// Number of occluder triangles submitted this frame
+		uint64_t mOccluderTriangles;
+		// Number of occluder triangles that made it through clipping and were rasterized
+		uint64_t mRasterizedTriangles;
+		// Number of bounding boxes tested this frame
+		uint64_t mTested;
+		// Number of boxes rejected because they were outside of the view frustum
+		uint64_t mFrustumRejected;
+		// Number of boxes rejected because they were hidden behind occluders
+		uint64_t mOcclusionRejected;
+		// Time spent binning and rasterizing occluders, in milliseconds
+		double mRasterizeTime;
+		// Time spent testing bounding boxes, in milliseconds
+		double mTestTime;
+
+		// The percentage of tested draws that were rejected.
+		double rejectedPercentage() const;
+		void print(std::ostream& os) const;
+	};
+
+	// Software occlusion culler. The depth buffer is split into screen tiles. Occluder
+	// triangles are transformed and binned to tiles in parallel, then every tile is
+	// rasterized by a single worker so that no two threads ever touch the same pixel.
+	// Each tile keeps the farthest depth it contains, which gives a one level Hi-Z that
+	// lets most tests finish without looking at individual pixels. Depths are stored as
+	// normalized device z, with the buffer cleared to the far plane.
+	class SoftwareOcclusionCuller {
+	private:
+		struct OccluderInstance {
+			const Occluder* mOccluder;
+			glm::mat4 mWorld;
+		};
+
+		// A triangle after projection, in pixel coordinates
+		struct ScreenTriangle {
+			// Edge functions a * x + b * y + c, positive inside
+			float mEdgeA[3];
+			float mEdgeB[3];
+			float mEdgeC[3];
+			// Depth plane z = a * x + b * y + c
+			float mDepthA;
+			float mDepthB;
+			float mDepthC;
+			int mMinX;
+			int mMinY;
+			int mMaxX;
+			int mMaxY;
+		};
+
+		// Triangles set up by one binning job and the tiles that they touch
+		struct Bin {
+			std::vector<ScreenTriangle> mTriangles;
+			std::vector<std::vector<uint32_t>> mTiles;
+		};
+
+		uint32_t mWidth;
+		uint32_t mHeight;
+		uint32_t mTilesX;
+		uint32_t mTilesY;
+		std::vector<float> mDepth;
+		std::vector<float> mTileMaxDepth;
+		std::vector<OccluderInstance> mOccluders;
+		std::vector<Bin> mBins;
+		glm::mat4 mViewProjection;
+		ThreadPool mWorkers;
+		OcclusionStats mStats;
+
+		std::vector<uint8_t> mDebugPixels;
+		Texture* mDebugTexture;
+
+		void binTriangles(Bin* bin, uint64_t first, uint64_t last);
+		void setupTriangle(Bin* bin, const glm::vec4& v0, const glm::vec4& v1, const glm::vec4& v2);
+		void rasterizeTile(uint32_t tile);
+
+	public:
+		// Creates a new occlusion culler.
+		// width: The width of the depth buffer, rounded up to a multiple of the tile width.
+		// height: The height of the depth buffer, rounded up to a multiple of the tile height.
+		// threadCount: The number of worker threads, 0 to do everything on the calling thread.
+		SoftwareOcclusionCuller(uint32_t width = OCCLUSION_DEFAULT_WIDTH,
+			uint32_t height = OCCLUSION_DEFAULT_HEIGHT, uint32_t threadCount = 2);
+		~SoftwareOcclusionCuller();
+
+		// Start a new frame. Clears all occluders and resets statistics.
+		// viewProjection: The view projection matrix of the camera.
+		void beginFrame(const glm::mat4& viewProjection);
+
+		// Add an occluder to rasterize this frame.
+		// occluder: The occluder, must stay alive until rasterize has been called.
+		// world: The world transform of the occluder.
+		void addOccluder(const Occluder* occluder, const glm::mat4& world);
+
+		// Rasterize all occluders added this frame into the depth buffer.
+		void rasterize();
+
+		// Conservatively test whether a bounding box may be visible.
+		// box: The bounding box in object space.
+		// world: The world transform of the object.
+		// returns: False if the box is certainly outside of the frustum or hidden.
+		bool isVisible(const BoundingBox& box, const glm::mat4& world);
+
+		// Uploads the depth buffer into a texture for viewing with IRenderer::blit.
+		// Depths are remapped so that the nearest occluder is white and the far plane black.
+		// returns: A texture owned by the culler.
+		Texture* debugTexture();
+
+		inline uint32_t width() const { return mWidth; }
+		inline uint32_t height() const { return mHeight; }
+		inline const float* depth() const { return &mDepth[0]; }
+		inline const OcclusionStats& stats() const { return mStats; }
+	};
+}
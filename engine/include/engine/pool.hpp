@@ -1,35 +1,51 @@
 #ifndef POOL_H_
 #define POOL_H_
 
-#include "mapcpy.hpp"
-
-#include <stack>
 #include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+// The number of objects in a chunk of a pool, must be a power of two
+#define POOL_CHUNK_SIZE 256
+#define POOL_CHUNK_SHIFT 8
+// Marks the end of the free list and offsets that have no slot
+#define POOL_INVALID_OFFSET 0xFFFFFFFFu
 
 namespace Morpheus {
-	
+
 	template <typename T>
 	class Pool;
 	template <typename T>
 	class PoolHandle;
+	template <typename T>
+	class PoolRemap;
 
-	// A handle to an object in a pool.
+	// A handle to an object in a pool. The generation tells the handle apart from
+	// handles to objects that occupied the same slot before, see Pool::isValid.
 	template <typename T>
 	class PoolHandle {
 	private:
 		Pool<T>* mPoolPtr;
 		uint32_t mOffset;
+		uint32_t mGeneration;
 
 	public:
-		inline PoolHandle(Pool<T>* ptr, uint32_t offset);
-		inline PoolHandle() { }
+		inline PoolHandle(Pool<T>* ptr, uint32_t offset, uint32_t generation);
+		inline PoolHandle() : mPoolPtr(nullptr), mOffset(POOL_INVALID_OFFSET), mGeneration(0) { }
 
 		inline T* operator->();
 		inline T* get() const;
 		inline Pool<T>* getPool();
+		inline uint32_t offset() const { return mOffset; }
+		inline uint32_t generation() const { return mGeneration; }
 		inline bool operator==(const PoolHandle& other);
 
 		friend class Pool<T>;
+		friend class PoolRemap<T>;
 		friend class PoolHandle<void>;
 	};
 
@@ -38,142 +54,305 @@ namespace Morpheus {
 	public:
 		void* mPoolPtr;
 		uint32_t mOffset;
+		uint32_t mGeneration;
 
-		inline PoolHandle(void* poolPtr, uint32_t offset) : mPoolPtr(poolPtr), mOffset(offset) { }
+		inline PoolHandle(void* poolPtr, uint32_t offset, uint32_t generation) :
+			mPoolPtr(poolPtr), mOffset(offset), mGeneration(generation) { }
 		template <typename T>
 		inline PoolHandle(const PoolHandle<T>& handle);
-		inline PoolHandle() { }
+		inline PoolHandle() : mPoolPtr(nullptr), mOffset(POOL_INVALID_OFFSET), mGeneration(0) { }
 		template <typename T>
 		inline PoolHandle<T> reinterpret() const {
-			return PoolHandle<T>((Pool<T>*)mPoolPtr, mOffset);
+			return PoolHandle<T>((Pool<T>*)mPoolPtr, mOffset, mGeneration);
 		}
 	};
 
-	// A resizing pool for managing memory and mantaining memory coherence.
+	// Where Pool::compress moved every object, indexed by the old offset.
+	template <typename T>
+	class PoolRemap {
+	private:
+		Pool<T>* mPool;
+		// The new handle of the object at every old offset, or an invalid handle if
+		// the slot was free
+		std::vector<PoolHandle<T>> mHandles;
+		// The generations of the objects at the old offsets
+		std::vector<uint32_t> mOldGenerations;
+
+	public:
+		// Translates a handle from before the compress.
+		// h: The old handle.
+		// returns: The handle of the same object, or an invalid handle if h was stale.
+		inline PoolHandle<T> apply(const PoolHandle<T>& h) const {
+			if (h.mOffset >= mHandles.size() || mOldGenerations[h.mOffset] != h.mGeneration)
+				return PoolHandle<T>();
+			return mHandles[h.mOffset];
+		}
+
+		// returns: Whether compress moved any object.
+		inline bool empty() const {
+			for (uint32_t i = 0; i < mHandles.size(); ++i)
+				if (mHandles[i].mOffset != POOL_INVALID_OFFSET && mHandles[i].mOffset != i)
+					return false;
+			return true;
+		}
+
+		friend class Pool<T>;
+	};
+
+	// A pool of objects that never moves them. Memory is allocated in chunks of
+	// POOL_CHUNK_SIZE objects, so pointers into the pool stay valid while it grows.
+	// Free slots form an intrusive list, alloc and dealloc are O(1) and do not allocate
+	// unless a new chunk is needed. Every slot has a generation that is bumped whenever
+	// it is allocated or freed, so stale handles can be detected.
 	// T: The object type.
 	template <typename T>
 	class Pool {
 	private:
-		T* mData;
-		std::stack<uint32_t> mFreeIndices;
+		struct Chunk {
+			alignas(T) unsigned char mStorage[POOL_CHUNK_SIZE * sizeof(T)];
+			// Odd while the slot holds an object
+			uint32_t mGenerations[POOL_CHUNK_SIZE];
+			uint32_t mNextFree[POOL_CHUNK_SIZE];
+			// Whether the object was created with create, and so is destroyed by the pool
+			bool bConstructed[POOL_CHUNK_SIZE];
+		};
+
+		std::vector<Chunk*> mChunks;
+		// The first free slot that has been used before
+		uint32_t mFirstFree;
+		// Slots from here on have never been used
 		uint32_t mFreeBlockStart;
-		uint32_t mDataSize;
+		uint32_t mCount;
+		// Generations that new chunks start from, above those of any released chunk
+		uint32_t mGenerationBase;
 		double mRescaleFactor;
 
+		inline uint32_t capacity() const {
+			return (uint32_t)mChunks.size() * POOL_CHUNK_SIZE;
+		}
+		inline Chunk* chunkOf(uint32_t offset) const {
+			return mChunks[offset >> POOL_CHUNK_SHIFT];
+		}
+		static inline uint32_t slotOf(uint32_t offset) {
+			return offset & (POOL_CHUNK_SIZE - 1);
+		}
+		inline uint32_t& generation(uint32_t offset) {
+			return chunkOf(offset)->mGenerations[slotOf(offset)];
+		}
+		inline T* slot(uint32_t offset) const {
+			return reinterpret_cast<T*>(chunkOf(offset)->mStorage) + slotOf(offset);
+		}
+		inline bool isAlive(uint32_t offset) const {
+			return (chunkOf(offset)->mGenerations[slotOf(offset)] & 1u) != 0;
+		}
+
+		void addChunk() {
+			auto chunk = new Chunk;
+			for (uint32_t i = 0; i < POOL_CHUNK_SIZE; ++i) {
+				chunk->mGenerations[i] = mGenerationBase;
+				chunk->bConstructed[i] = false;
+			}
+			mChunks.push_back(chunk);
+		}
+
+		void releaseChunk() {
+			auto chunk = mChunks.back();
+			// Stale handles into this chunk must not match objects in a later chunk
+			for (uint32_t i = 0; i < POOL_CHUNK_SIZE; ++i)
+				mGenerationBase = std::max(mGenerationBase, (chunk->mGenerations[i] + 2u) & ~1u);
+			delete chunk;
+			mChunks.pop_back();
+		}
+
+		// Moves the object at from into the free slot to.
+		void move(uint32_t from, uint32_t to) {
+			auto fromChunk = chunkOf(from);
+			auto toChunk = chunkOf(to);
+			bool bConstructed = fromChunk->bConstructed[slotOf(from)];
+			if (bConstructed) {
+				new (slot(to)) T(std::move(*slot(from)));
+				slot(from)->~T();
+			}
+			else
+				std::memcpy(static_cast<void*>(slot(to)), slot(from), sizeof(T));
+
+			toChunk->bConstructed[slotOf(to)] = bConstructed;
+			fromChunk->bConstructed[slotOf(from)] = false;
+			++toChunk->mGenerations[slotOf(to)];
+			++fromChunk->mGenerations[slotOf(from)];
+		}
+
 	public:
-		Pool() : mFreeBlockStart(0), mRescaleFactor(2.0) {
-			resize(0);
+		Pool() : mFirstFree(POOL_INVALID_OFFSET), mFreeBlockStart(0), mCount(0),
+			mGenerationBase(0), mRescaleFactor(2.0) {
 		}
 
 		Pool(const uint32_t initialSize, const double rescaleFactor = 2.0) :
-			mFreeBlockStart(0), mRescaleFactor(rescaleFactor) 
+			mFirstFree(POOL_INVALID_OFFSET), mFreeBlockStart(0), mCount(0),
+			mGenerationBase(0), mRescaleFactor(rescaleFactor)
 		{
 			resize(initialSize);
 		}
 
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
 		~Pool() {
-			delete[] mData;
+			for (uint32_t i = 0; i < mFreeBlockStart; ++i)
+				if (chunkOf(i)->bConstructed[slotOf(i)])
+					slot(i)->~T();
+			for (auto chunk : mChunks)
+				delete chunk;
 		}
 
 		inline T* at(const uint32_t offset) {
-			return &mData[offset];
+			return slot(offset);
 		}
 
-		void resize(const uint32_t newSize) {
-			// Resize pool
-			auto old = mData;
-			if (newSize > 0)
-				mData = new T[newSize];
-			else
-				mData = nullptr;
-			
-			if (old) {
-				std::memcpy(mData, old, mDataSize * sizeof(T));
-				delete[] old;
-			}
+		// returns: The number of objects in the pool.
+		inline uint32_t count() const {
+			return mCount;
+		}
 
-			mDataSize = newSize;
-			mFreeBlockStart = std::min(mDataSize, mFreeBlockStart);
+		// returns: Whether a handle refers to an object that is still in the pool.
+		inline bool isValid(const PoolHandle<T>& h) const {
+			return h.mPoolPtr == this && h.mOffset < mFreeBlockStart &&
+				chunkOf(h.mOffset)->mGenerations[slotOf(h.mOffset)] == h.mGeneration;
 		}
 
-		
-		// Compresses the pool to save memory space.
-		// bTight: Whether or not to make the compression tight, if set to true, 
-		// any additional alloc will require a resize.
-		void compress(const bool bTight = false) {
-			uint32_t* map = new uint32_t[mFreeBlockStart];
-			char* cull = new char[mFreeBlockStart];
-			memset(cull, 0, sizeof(char) * mFreeBlockStart);
+		// returns: The object of a handle, or nullptr if the handle is stale.
+		inline T* tryGet(const PoolHandle<T>& h) const {
+			return isValid(h) ? slot(h.mOffset) : nullptr;
+		}
 
-			while (!mFreeIndices.empty()) {
-				cull[mFreeIndices.top()] = true;
-				mFreeIndices.pop();
+		// Makes sure that the pool has room for a number of objects. Only ever grows
+		// the pool, objects are never moved.
+		// newSize: The number of objects.
+		void resize(const uint32_t newSize) {
+			while (capacity() < newSize)
+				addChunk();
+		}
+
+		// Moves objects from the end of the pool into free slots so that all objects
+		// are packed at the start, then releases the chunks that are left empty.
+		// Objects created with create are moved with their move constructor, objects
+		// from alloc are moved bytewise. Every outstanding handle and pointer to a moved
+		// object is invalidated, translate handles with the returned remap.
+		// bTight: Whether or not to make the compression tight, if set to true,
+		// any additional alloc will require a new chunk.
+		// returns: Where every object went.
+		PoolRemap<T> compress(const bool bTight = false) {
+			PoolRemap<T> remap;
+			remap.mPool = this;
+			remap.mHandles.resize(mFreeBlockStart);
+			remap.mOldGenerations.resize(mFreeBlockStart);
+			for (uint32_t i = 0; i < mFreeBlockStart; ++i) {
+				remap.mOldGenerations[i] = generation(i);
+				if (isAlive(i))
+					remap.mHandles[i] = PoolHandle<T>(this, i, generation(i));
 			}
-			
-			uint32_t new_i = 0;
-			for (uint32_t i = 0; i < mFreeBlockStart; ++i)
-				if (!cull[i])
-					map[i] = new_i++;
-				else
-					map[i] = -1;
-
-			uint32_t newSize = (uint32_t)(new_i * mRescaleFactor);
-			auto old = mData;
-			mData = new T[newSize];
-			mapcpy(mData, old, map, mFreeBlockStart);
-			mDataSize = newSize;
-			delete[] old;
-			delete[] cull;
-			delete[] map;
-		}
-
-		
+
+			// Fill holes from the front with objects from the back
+			uint32_t lo = 0;
+			uint32_t hi = mFreeBlockStart;
+			while (true) {
+				while (lo < hi && isAlive(lo))
+					++lo;
+				while (hi > lo && !isAlive(hi - 1))
+					--hi;
+				// lo is free and hi - 1 holds an object unless they met
+				if (lo >= hi)
+					break;
+				move(hi - 1, lo);
+				remap.mHandles[hi - 1] = PoolHandle<T>(this, lo, generation(lo));
+				--hi;
+			}
+
+			mFreeBlockStart = mCount;
+			mFirstFree = POOL_INVALID_OFFSET;
+
+			// Keep some room to grow into unless asked not to
+			uint32_t keep = bTight ? mCount : (uint32_t)(mCount * mRescaleFactor);
+			uint32_t keepChunks = (keep + POOL_CHUNK_SIZE - 1) / POOL_CHUNK_SIZE;
+			while (mChunks.size() > keepChunks)
+				releaseChunk();
+
+			return remap;
+		}
+
 		// Allocate an object from the pool. Note the constructor of the object will not be called.
-		// returns: A new object. 
+		// returns: A new object.
 		PoolHandle<T> alloc() {
-			size_t cnt = mFreeIndices.size();
-			if (cnt > 0) {
-				uint32_t of = mFreeIndices.top();
-				mFreeIndices.pop();
-				return PoolHandle<T>(this, of);
-			}
-			else if (mFreeBlockStart == mDataSize) {
-				if (mDataSize == 0)
-					mDataSize = 50;
-				resize((uint32_t)(mDataSize * mRescaleFactor));
-				uint32_t of = mFreeBlockStart++;
-				return PoolHandle<T>(this, of);
+			uint32_t of;
+			if (mFirstFree != POOL_INVALID_OFFSET) {
+				of = mFirstFree;
+				mFirstFree = chunkOf(of)->mNextFree[slotOf(of)];
 			}
 			else {
-				uint32_t of = mFreeBlockStart++;
-				return PoolHandle<T>(this, of);
+				if (mFreeBlockStart == capacity())
+					addChunk();
+				of = mFreeBlockStart++;
 			}
+
+			++mCount;
+			return PoolHandle<T>(this, of, ++generation(of));
+		}
+
+		// Allocate an object and construct it in place. The pool destroys objects that
+		// are still alive when it is destroyed.
+		// args: The arguments of the constructor.
+		// returns: The new object.
+		template <typename... Args>
+		PoolHandle<T> create(Args&&... args) {
+			auto h = alloc();
+			new (slot(h.mOffset)) T(std::forward<Args>(args)...);
+			chunkOf(h.mOffset)->bConstructed[slotOf(h.mOffset)] = true;
+			return h;
 		}
 
-		// Frees an object in the pool.
+		// Frees an object in the pool. Objects from create are destroyed first.
 		// h: Handle to the object to free
 		void dealloc(PoolHandle<T>& h) {
-			mFreeIndices.push(h.mOffset);
+			assert(isValid(h));
+			auto chunk = chunkOf(h.mOffset);
+			auto i = slotOf(h.mOffset);
+			if (chunk->bConstructed[i]) {
+				slot(h.mOffset)->~T();
+				chunk->bConstructed[i] = false;
+			}
+
+			++chunk->mGenerations[i];
+			chunk->mNextFree[i] = mFirstFree;
+			mFirstFree = h.mOffset;
+			--mCount;
+		}
+
+		// Same as dealloc, named to pair with create.
+		inline void destroy(PoolHandle<T>& h) {
+			dealloc(h);
 		}
 
 		friend class PoolHandle<T>;
 	};
 
 	template<typename T>
-	inline PoolHandle<T>::PoolHandle(Pool<T>* ptr, uint32_t offset) 
-		: mPoolPtr(ptr), mOffset(offset)
+	inline PoolHandle<T>::PoolHandle(Pool<T>* ptr, uint32_t offset, uint32_t generation)
+		: mPoolPtr(ptr), mOffset(offset), mGeneration(generation)
 	{
 	}
 
 	template<typename T>
 	inline T* PoolHandle<T>::operator->()
 	{
-		return &mPoolPtr->mData[mOffset];
+		return get();
 	}
 	template<typename T>
 	inline T* PoolHandle<T>::get() const
 	{
-		return &mPoolPtr->mData[mOffset];
+#ifdef _DEBUG
+		assert(mPoolPtr->isValid(*this));
+#endif
+		return mPoolPtr->slot(mOffset);
 	}
 	template<typename T>
 	inline Pool<T>* PoolHandle<T>::getPool() {
@@ -181,12 +360,13 @@ namespace Morpheus {
 	}
 	template<typename T>
 	inline bool PoolHandle<T>::operator==(const PoolHandle& other) {
-		return mPoolPtr == other.mPoolPtr && mOffset == other.mOffset;
+		return mPoolPtr == other.mPoolPtr && mOffset == other.mOffset && mGeneration == other.mGeneration;
 	}
 
 	template <typename T>
-	PoolHandle<void>::PoolHandle(const PoolHandle<T>& handle) : mPoolPtr(handle.mPoolPtr), mOffset(handle.mOffset) {
+	PoolHandle<void>::PoolHandle(const PoolHandle<T>& handle) :
+		mPoolPtr(handle.mPoolPtr), mOffset(handle.mOffset), mGeneration(handle.mGeneration) {
 	}
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,163 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: readback.hpp
+*	Description: Asynchronous GPU -> CPU readback through a ring of pixel pack
+*	buffers. Requests are fenced and resolved on later frames so that reading
+*	back a texture does not drain the GPU pipeline.
+*/
+
+#pragma once
+
+#include <engine/threadpool.hpp>
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace Morpheus {
+
+	class Texture;
+	class Framebuffer;
+
+	struct ReadbackResult {
+		uint32_t mWidth;
+		uint32_t mHeight;
+		uint32_t mDepth;
+		GLenum mFormat;
+		GLenum mType;
+		std::vector<uint8_t> mData;
+	};
+
+	struct ReadbackStats {
+		// Number of requests that have been issued
+		uint64_t mRequests;
+		// Number of requests that have been resolved
+		uint64_t mCompleted;
+		// Number of times a request had to wait on the GPU because every slot was in flight
+		uint64_t mStalls;
+		// Number of bytes read back from the GPU
+		uint64_t mBytes;
+	};
+
+	// Asynchronous readback queue. Every request is copied into a pixel pack buffer
+	// and fenced, then resolved by poll() once the GPU has finished with it. Completed
+	// requests fulfil the future that was handed out when the request was made. Should
+	// only be used from the thread which owns the OpenGL context.
+	class ReadbackQueue {
+	private:
+		struct Slot {
+			GLuint mBuffer;
+			size_t mCapacity;
+			GLsync mFence;
+			bool bInFlight;
+			ReadbackResult mHeader;
+			std::function<void(ReadbackResult&&)> mOnComplete;
+		};
+
+		std::vector<Slot> mSlots;
+		uint32_t mNext;
+		ThreadPool mWorkers;
+		ReadbackStats mStats;
+
+		Slot* acquire(size_t size);
+		Slot* copyTexture(const Texture* tex, GLint level, GLenum format, GLenum type,
+			GLint zoffset, GLsizei depth, ReadbackResult* header);
+		Slot* copyFramebuffer(const Framebuffer* framebuffer, uint32_t attachment,
+			GLsizei width, GLsizei height, GLenum format, GLenum type, ReadbackResult* header);
+		// Blocks until the fence of a slot is signaled.
+		// returns: Whether the slot can be resolved. If the wait failed the slot is dropped
+		// along with its callback, so the future of the request reports a broken promise.
+		bool wait(Slot* slot);
+		void resolve(Slot* slot);
+		void submit(Slot* slot, const ReadbackResult& header,
+			std::function<void(ReadbackResult&&)>&& onComplete);
+
+	public:
+		// Creates a new readback queue.
+		// ringSize: The number of pixel pack buffers that can be in flight at once.
+		// workerThreads: The number of threads used for encoding completed readbacks.
+		ReadbackQueue(uint32_t ringSize = 3, uint32_t workerThreads = 1);
+		~ReadbackQueue();
+
+		// Reads back a region of a texture level asynchronously.
+		// tex: The texture to read from.
+		// level: The mip level to read.
+		// format: The pixel format to read, i.e., GL_RGBA.
+		// type: The pixel type to read, i.e., GL_UNSIGNED_BYTE.
+		// zoffset: The first layer (or cube map face) to read.
+		// depth: The number of layers (or cube map faces) to read.
+		// returns: A future that becomes ready once the data has arrived on the CPU.
+		std::future<ReadbackResult> readTexture(const Texture* tex, GLint level,
+			GLenum format, GLenum type, GLint zoffset = 0, GLsizei depth = 1);
+
+		// Reads back a color attachment of a framebuffer asynchronously.
+		// framebuffer: The framebuffer to read from, nullptr for the back buffer.
+		// attachment: The index of the color attachment.
+		// width: The width of the region to read.
+		// height: The height of the region to read.
+		// format: The pixel format to read, i.e., GL_RGBA.
+		// type: The pixel type to read, i.e., GL_UNSIGNED_BYTE.
+		// returns: A future that becomes ready once the data has arrived on the CPU.
+		std::future<ReadbackResult> readFramebuffer(const Framebuffer* framebuffer,
+			uint32_t attachment, GLsizei width, GLsizei height,
+			GLenum format, GLenum type);
+
+		// Reads back the base level of a texture as floats, with the same layout
+		// as readTextureBaseLevel in samplefunction.hpp.
+		// tex: The texture to read from.
+		// element_length: The number of channels to read.
+		// layer: The layer (or cube map face) to read.
+		// returns: A future that becomes ready once the data has arrived on the CPU.
+		std::future<std::vector<float>> readBaseLevel(const Texture* tex,
+			uint32_t element_length, GLint layer = 0);
+
+		// Saves the base level of a 2D texture or cube map to png. The readback is
+		// performed asynchronously and encoding happens on a worker thread.
+		// tex: The texture to save.
+		// path: The path to save to. Cube map faces are suffixed as in Texture::savepng.
+		// returns: A future that becomes ready once the file has been written.
+		std::future<void> savepng(const Texture* tex, const std::string& path);
+
+		// Saves the color contents of a framebuffer to png asynchronously.
+		// framebuffer: The framebuffer to save, nullptr for the back buffer.
+		// width: The width of the region to save.
+		// height: The height of the region to save.
+		// path: The path to save to.
+		// returns: A future that becomes ready once the file has been written.
+		std::future<void> savepng(const Framebuffer* framebuffer, GLsizei width,
+			GLsizei height, const std::string& path);
+
+		// Resolves every request whose fence has been signaled. Does not block.
+		// Should be called once per frame.
+		void poll();
+
+		// Blocks until every request in flight has been resolved and every
+		// encoding job has finished.
+		void flush();
+
+		// Blocks until the oldest request in flight has been resolved, leaving newer
+		// requests in flight. Does not wait on encoding jobs.
+		// returns: Whether there was a request in flight.
+		bool waitOldest();
+
+		// The number of requests currently in flight.
+		uint32_t inFlight() const;
+
+		inline const ReadbackStats& stats() const { return mStats; }
+	};
+
+	// Encodes 8-bit RGBA rows read back from OpenGL (bottom-up) as a png (top-down).
+	// path: The file to write.
+	// data: The pixel data.
+	// width: The width of the image.
+	// height: The height of the image.
+	// bFlip: Whether to flip the image vertically before writing.
+	void encodepng(const std::string& path, const uint8_t* data,
+		uint32_t width, uint32_t height, bool bFlip);
+}
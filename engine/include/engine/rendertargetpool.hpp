@@ -0,0 +1,129 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: rendertargetpool.hpp
+*	Description: Pool of transient render targets. Passes acquire targets by
+*	description for as long as they need them during a frame and release them
+*	afterwards, so targets whose lifetimes do not overlap share memory.
+*/
+
+#pragma once
+
+#include <engine/framebuffer.hpp>
+
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace Morpheus {
+
+	struct RenderTargetDesc {
+		uint mWidth;
+		uint mHeight;
+		GLenum mColorFormat;
+		GLenum mDepthStencilFormat;
+		uint mSamples;
+
+		inline bool operator==(const RenderTargetDesc& other) const {
+			return mWidth == other.mWidth &&
+				mHeight == other.mHeight &&
+				mColorFormat == other.mColorFormat &&
+				mDepthStencilFormat == other.mDepthStencilFormat &&
+				mSamples == other.mSamples;
+		}
+
+		// The number of bytes of GPU memory a target with this description uses.
+		size_t byteSize() const;
+	};
+
+	struct RenderTargetDescHash {
+		inline size_t operator()(const RenderTargetDesc& desc) const {
+			size_t h = desc.mWidth;
+			h = h * 31 + desc.mHeight;
+			h = h * 31 + desc.mColorFormat;
+			h = h * 31 + desc.mDepthStencilFormat;
+			h = h * 31 + desc.mSamples;
+			return h;
+		}
+	};
+
+	struct RenderTargetPoolStats {
+		// Number of targets currently allocated, in use or not
+		uint mTargets;
+		// Number of targets currently acquired
+		uint mTargetsInUse;
+		// GPU memory of all allocated targets
+		size_t mBytesAllocated;
+		// GPU memory of the acquired targets
+		size_t mBytesInUse;
+		// Highest value of mBytesInUse seen so far
+		size_t mPeakBytesInUse;
+		// Memory that would be needed if every acquire this frame got its own target
+		size_t mBytesRequestedThisFrame;
+		// Number of times a new target had to be created
+		uint64_t mAllocations;
+		// Number of times an acquire was satisfied by an existing target
+		uint64_t mReuses;
+
+		void print(std::ostream& os) const;
+	};
+
+	// Pool of transient render targets keyed by (size, format, samples). Targets are
+	// created through ContentFactory<Framebuffer> and are owned by the pool. A target
+	// that has not been acquired for a number of frames is freed.
+	class RenderTargetPool {
+	private:
+		struct Entry {
+			Framebuffer* mFramebuffer;
+			RenderTargetDesc mDesc;
+			size_t mByteSize;
+			uint64_t mLastUsedFrame;
+			bool bInUse;
+		};
+
+		std::unordered_map<RenderTargetDesc, std::vector<Entry*>, RenderTargetDescHash> mFree;
+		std::unordered_map<Framebuffer*, Entry*> mEntries;
+		RenderTargetPoolStats mStats;
+		uint64_t mFrame;
+		uint mMaxIdleFrames;
+
+		void destroy(Entry* entry);
+
+	public:
+		// maxIdleFrames: The number of frames a target can go unused before it is freed.
+		RenderTargetPool(uint maxIdleFrames = 4);
+		~RenderTargetPool();
+
+		// Acquire a render target. The contents of the target are undefined.
+		// desc: The description of the target.
+		// returns: A framebuffer matching the description.
+		Framebuffer* acquire(const RenderTargetDesc& desc);
+
+		// Acquire a render target.
+		// width: The width of the target.
+		// height: The height of the target.
+		// colorFormat: The internal format of the color attachment, 0 for none.
+		// depthStencilFormat: The internal format of the depth stencil attachment, 0 for none.
+		// samples: The number of samples of the target.
+		// returns: A framebuffer matching the description.
+		inline Framebuffer* acquire(uint width, uint height, GLenum colorFormat,
+			GLenum depthStencilFormat = 0, uint samples = 1) {
+			return acquire(RenderTargetDesc{ width, height, colorFormat,
+				depthStencilFormat, samples });
+		}
+
+		// Release a render target so that a later pass can alias it.
+		// framebuffer: A framebuffer returned by acquire.
+		void release(Framebuffer* framebuffer);
+
+		// Starts a new frame. Frees every target that has been idle for too long.
+		void beginFrame();
+
+		// Frees every target that is not currently acquired.
+		void releaseUnused();
+
+		inline const RenderTargetPoolStats& stats() const { return mStats; }
+		inline uint64_t frame() const { return mFrame; }
+	};
+}
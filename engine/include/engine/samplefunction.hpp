@@ -16,6 +16,7 @@ namespace Morpheus {
 	void writeCubemapSideBaseLevel(Texture* tex, size_t i_side, GLenum format, const std::vector<float>& mData);
 	void writeTextureBaseLevel(Texture* tex, GLenum format, const std::vector<float>& mData);
 
+	// Synchronous readbacks, see ReadbackQueue::readBaseLevel for an asynchronous alternative.
 	void readCubemapSideBaseLevel(Texture* tex, size_t i_side, uint32_t element_length, std::vector<float>* mData);
 	void readTextureBaseLevel(Texture* tex, uint32_t element_length, std::vector<float>* mData);
 
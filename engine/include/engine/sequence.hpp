@@ -0,0 +1,165 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: sequence.hpp
+*	Description: Offline rendering of frame sequences along a camera path.
+*	Frames are rendered back-to-back into an offscreen framebuffer, read back
+*	asynchronously and streamed to disk or to a pipe.
+*/
+
+#pragma once
+
+#include <engine/core.hpp>
+#include <engine/json.hpp>
+#include <engine/readback.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Morpheus {
+
+	class Camera;
+	class Framebuffer;
+
+	struct CameraKeyframe {
+		double mTime;
+		glm::vec3 mPosition;
+		glm::vec3 mLookAt;
+		glm::vec3 mUp;
+		float mFieldOfView;
+	};
+
+	// A camera path given by a list of keyframes. Positions and look at targets are
+	// interpolated with Catmull-Rom splines, everything else linearly.
+	class CameraPath {
+	private:
+		std::vector<CameraKeyframe> mKeyframes;
+		bool bLoop;
+
+	public:
+		inline CameraPath() : bLoop(false) { }
+
+		// Reads a camera path from JSON of the form
+		// { "loop": false, "keyframes": [ { "time": 0.0, "position": [x, y, z],
+		//   "look_at": [x, y, z], "up": [x, y, z], "fov": 0.78 }, ... ] }
+		// Alternatively, { "orbit": { "center": [x, y, z], "radius": r,
+		//   "height": h, "duration": d } } creates a turntable path.
+		// j: The JSON to read.
+		void readJson(const nlohmann::json& j);
+
+		// Loads a camera path from a JSON file.
+		// path: The file to load.
+		void load(const std::string& path);
+
+		// Creates a path that orbits around a point once.
+		// center: The point to orbit around and look at.
+		// radius: The radius of the orbit.
+		// height: The height of the camera above the center.
+		// duration: The time it takes to complete the orbit.
+		// keyframeCount: The number of keyframes used to approximate the circle.
+		static CameraPath makeOrbit(const glm::vec3& center, float radius, float height,
+			double duration, uint32_t keyframeCount = 16);
+
+		// Adds a keyframe, keyframes must be added in order of time.
+		void addKeyframe(const CameraKeyframe& keyframe);
+
+		// Evaluates the camera path at a given time.
+		// time: The time to evaluate at, clamped (or wrapped if looping) to the path.
+		// returns: The interpolated keyframe.
+		CameraKeyframe evaluate(double time) const;
+
+		// Applies the camera path to a camera.
+		// camera: The camera to modify.
+		// time: The time to evaluate at.
+		void apply(Camera* camera, double time) const;
+
+		inline double duration() const {
+			return mKeyframes.empty() ? 0.0 : mKeyframes.back().mTime;
+		}
+		inline const std::vector<CameraKeyframe>& keyframes() const { return mKeyframes; }
+		inline bool loop() const { return bLoop; }
+		inline void setLoop(bool value) { bLoop = value; }
+	};
+
+	enum class SequenceOutputFormat {
+		// One binary .ppm file per frame, the output path may contain a printf-style
+		// frame number, i.e., frame_%05d.ppm
+		PPM_SEQUENCE,
+		// A single YUV4MPEG2 stream (4:4:4), which can be piped into ffmpeg
+		Y4M,
+		// Raw RGB24 frames back-to-back
+		RAW_RGB
+	};
+
+	struct SequenceRenderParams {
+		// Output file, or "-" for stdout
+		std::string mOutput;
+		SequenceOutputFormat mFormat;
+		// Frames per second of the output sequence
+		double mFrameRate;
+		// Number of frames to render, 0 to cover the entire camera path
+		uint32_t mFrameCount;
+		// Maximum number of frames read back but not yet written
+		uint32_t mMaxFramesInFlight;
+
+		inline SequenceRenderParams() :
+			mOutput("-"),
+			mFormat(SequenceOutputFormat::Y4M),
+			mFrameRate(30.0),
+			mFrameCount(0),
+			mMaxFramesInFlight(4) {
+		}
+	};
+
+	struct SequenceRenderStats {
+		uint32_t mFrames;
+		// Wall clock time of the whole sequence
+		double mTotalSeconds;
+		double mFramesPerSecond;
+		// Time spent applying the camera path and collecting / submitting draw calls
+		double mDrawSeconds;
+		// Time the render thread spent blocked waiting on readbacks or the writer
+		double mWaitSeconds;
+		// Time the writer thread spent converting and writing frames
+		double mWriteSeconds;
+		uint64_t mBytesWritten;
+
+		void print(std::ostream& os) const;
+	};
+
+	// Renders a scene along a camera path into an offscreen framebuffer and streams the
+	// results out. The render thread never waits for the GPU unless too many frames are
+	// in flight, and conversion / disk IO happens on a dedicated writer thread.
+	class SequenceRenderer {
+	private:
+		ReadbackQueue mReadback;
+		ThreadPool mWriter;
+		Framebuffer* mOutput;
+		FILE* mStream;
+		std::mutex mStatsMutex;
+		SequenceRenderStats mStats;
+
+		void open(const SequenceRenderParams& params, uint32_t width, uint32_t height);
+		void close();
+		void write(const SequenceRenderParams& params, uint32_t frame, ReadbackResult&& result);
+
+	public:
+		SequenceRenderer(uint32_t readbackRingSize = 4);
+		~SequenceRenderer();
+
+		// Renders a sequence. The size of the frames is the size of the window framebuffer.
+		// scene: The scene to render.
+		// camera: The camera to move along the path, should be the camera used by the scene.
+		// path: The camera path.
+		// params: Output parameters.
+		// returns: Timing statistics for the sequence.
+		SequenceRenderStats render(INodeOwner* scene, Camera* camera,
+			const CameraPath& path, const SequenceRenderParams& params);
+	};
+}
@@ -0,0 +1,63 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: simplify.hpp
+*	Description: Quadric error metric mesh simplification of HalfEdgeGeometry
+*	and generation of LOD chains.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace Morpheus {
+
+	class HalfEdgeGeometry;
+
+	struct SimplifyParameters {
+		// Stop once the mesh has at most this many triangles, 0 to use mTargetRatio instead
+		uint32_t mTargetTriangleCount;
+		// Fraction of the triangles to keep if no target triangle count is given
+		float mTargetRatio;
+		// Skip collapses whose RMS error estimate is larger than this, in object space units
+		float mMaxError;
+		// Weight of texture coordinate differences in the error, relative to positions
+		float mUVWeight;
+		// Weight of normal differences in the error, relative to positions
+		float mNormalWeight;
+		// Weight of the planes that hold boundary edges (holes and seams) in place
+		float mBoundaryWeight;
+
+		static SimplifyParameters defaults();
+	};
+
+	// Simplifies a mesh by repeatedly collapsing the edge with the lowest quadric error
+	// (Garland and Heckbert). Quadrics are taken over positions, texture coordinates and
+	// normals, so collapses that would distort UVs or shading are delayed. Collapses move
+	// one endpoint onto the other, so the output only contains vertices (and attributes)
+	// of the input. Collapses that would make the mesh non-manifold or flip a triangle are
+	// skipped. Faces with more than three vertices are triangulated.
+	// geo: The mesh to simplify.
+	// params: The simplification parameters.
+	// error: If not nullptr, receives an object space error estimate, the largest over all
+	// collapses of the root of the area weighted mean of the quadric errors (an RMS
+	// distance). It is not a bound, parts of the surface may deviate further.
+	// returns: A new unmanaged triangle mesh.
+	HalfEdgeGeometry* simplify(const HalfEdgeGeometry* geo,
+		const SimplifyParameters& params, float* error = nullptr);
+
+	// Generates a chain of successively simplified meshes. Each level is simplified
+	// from the previous one, generation stops early if a level cannot be simplified.
+	// geo: The full resolution mesh, i.e., LOD 0.
+	// levelCount: The number of levels to generate, not including LOD 0.
+	// ratio: The fraction of triangles kept from one level to the next.
+	// params: Simplification parameters, the triangle targets are ignored.
+	// lods: Receives the new unmanaged meshes, coarser levels last.
+	// errors: Receives the object space error estimate of each level relative to geo, the
+	// sum of the RMS estimates of simplify along the chain. Not a bound.
+	void generateLodChain(const HalfEdgeGeometry* geo, uint32_t levelCount, float ratio,
+		const SimplifyParameters& params, std::vector<HalfEdgeGeometry*>* lods,
+		std::vector<float>* errors);
+}
@@ -4,11 +4,22 @@
 #include <engine/material.hpp>
 #include <engine/geometry.hpp>
 
+#include <vector>
+
 namespace Morpheus {
+	// A simplified version of the geometry of a static mesh.
+	struct StaticMeshLod {
+		Geometry* mGeometry;
+		// Object space distance between this level and the full resolution geometry
+		float mError;
+	};
+
 	class StaticMesh : public INodeOwner {
 	private:
 		Geometry* mGeometry;
 		Material* mMaterial;
+		// Coarser levels of detail, LOD 0 is mGeometry
+		std::vector<StaticMeshLod> mLods;
 
 	public:
 		inline StaticMesh() : INodeOwner(NodeType::STATIC_MESH), mGeometry(nullptr), mMaterial(nullptr) {
@@ -34,6 +45,36 @@ namespace Morpheus {
 			return mMaterial;
 		}
 
+		// Adds a coarser level of detail. Levels must be added from finest to coarsest.
+		// geo: The simplified geometry, which becomes a child of this mesh.
+		// error: The object space error of the level relative to the full geometry.
+		void addLod(Geometry* geo, float error);
+
+		// returns: The number of levels of detail, including the full geometry.
+		inline uint32_t lodCount() const {
+			return (uint32_t)mLods.size() + 1;
+		}
+
+		inline Geometry* getLod(uint32_t lod) {
+			return lod == 0 ? mGeometry : mLods[lod - 1].mGeometry;
+		}
+
+		inline const Geometry* getLod(uint32_t lod) const {
+			return lod == 0 ? mGeometry : mLods[lod - 1].mGeometry;
+		}
+
+		inline float lodError(uint32_t lod) const {
+			return lod == 0 ? 0.0f : mLods[lod - 1].mError;
+		}
+
+		// Picks the coarsest level whose projected error is small enough. Level errors from
+		// generateLodChain are RMS estimates, so the threshold is a target for the typical
+		// deviation, not a bound on the worst one.
+		// errorScale: Converts object space error into screen space error, i.e., pixels per unit.
+		// threshold: The acceptable screen space error.
+		// returns: The level of detail to draw.
+		uint32_t selectLod(float errorScale, float threshold) const;
+
 		friend class ContentFactory<StaticMesh>;
 	};
 	SET_NODE_ENUM(StaticMesh, STATIC_MESH);
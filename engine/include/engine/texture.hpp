@@ -3,6 +3,11 @@
 #include <glad/glad.h>
 
 #include <engine/content.hpp>
+#include <engine/mipgen.hpp>
+#include <engine/blockcompress.hpp>
+#include <engine/texturestreamer.hpp>
+
+#define TEXTURE_CACHE_EXTENSION ".ktx"
 
 namespace Morpheus {
 
@@ -14,6 +19,11 @@ namespace Morpheus {
 		return 1 + std::floor(std::log2(std::max(width, std::max(height, depth))));
 	}
 
+	// The number of bytes a single texel (or sample) of an internal format takes up.
+	// Returns 0 for compressed or unknown formats.
+	uint internalFormatSize(GLenum internalFormat);
+	bool isSRGBFormat(GLenum internalFormat);
+
 	enum class TextureType {
 		TEXTURE_1D,
 		TEXTURE_1D_ARRAY,
@@ -73,10 +83,26 @@ namespace Morpheus {
 			glBindImageTexture(unit, mId, level, false, 0, access, mFormat);
 		}
 
+		// Save the texture to png. This stalls until the GPU has finished with the
+		// texture, see ReadbackQueue::savepng for an asynchronous alternative.
 		void savepng(const std::string& path) const;
 		void genMipmaps();
 
+		// Uploads a precomputed mip chain, one glTexSubImage2D per level. The texture
+		// must be a 2D texture with storage for at least as many levels.
+		// levels: The levels to upload, finest first.
+		// format: The pixel format of the data, i.e., GL_RGBA.
+		// type: The component type of the data, i.e., GL_UNSIGNED_BYTE.
+		void uploadMips(const std::vector<MipLevel>& levels, GLenum format, GLenum type);
+		// Uploads a precomputed chain of block compressed levels, in the format of the texture.
+		void uploadCompressedMips(const std::vector<MipLevel>& levels);
+
+		// returns: The number of bytes of video memory that the storage of the texture
+		// takes up, over all levels, faces and samples.
+		size_t gpuSize() const;
+
 		friend class ContentFactory<Texture>;
+		friend class TextureStreamer;
 	};
 	SET_NODE_ENUM(Texture, TEXTURE);
 
@@ -101,11 +127,26 @@ namespace Morpheus {
 	class ContentFactory<Texture> : public IContentFactory {
 	private:
 		std::unordered_map<std::string, TextureLoader> mExtensionToLoader;
+		MipGenParameters mMipParameters;
+		// Generates mips of loaded images on the CPU, nullptr to use glGenerateTextureMipmap
+		MipGenerator* mMipGenerator;
+		BlockCompressParameters mCompressParameters;
+		bool bCompressOnCook;
+		// Compresses loaded images, nullptr to upload them uncompressed
+		BlockCompressor* mCompressor;
+		// Streams the levels of KTX and DDS textures, nullptr to load them whole
+		TextureStreamer* mStreamer;
+
+		Texture* makeTextureFromImage(const void* pixels, uint width, uint height, uint components,
+			bool bFloat, GLenum internalFormat, GLenum format, bool bAllowCompression);
 
 		template <bool overrideFormat>
 		Texture* loadGliInternal(const std::string& source,
 			GLenum internalFormat);
 		template <bool overrideFormat>
+		Texture* loadStreamedInternal(const std::string& source,
+			GLenum internalFormat);
+		template <bool overrideFormat>
 		Texture* loadPngInternal(const std::string& source,
 			GLenum internalFormat);
 		template <bool overrideFormat>
@@ -132,6 +173,55 @@ namespace Morpheus {
 		Texture* loadStbUnmanaged(const std::string& source,
 			GLenum internalFormat);
 		void unload(INodeOwner* ref) override;
+		ContentSize measure(INodeOwner* ref) const override;
+
+		// Decodes an image, generates its full mip chain on the CPU, block compresses it if
+		// compressOnCook is set and writes the result into a KTX file, which then loads
+		// without any decoding, mip generation or compression. Does not touch
+		// any OpenGL state, so it is safe to call from several threads at once.
+		// source: The image to cook, must be loaded through stb or lodepng.
+		// destination: The KTX file to write, or a DDS file if it ends in .dds.
+		// returns: Whether the file was written.
+		bool cook(const std::string& source, const std::string& destination) const;
+
+		// returns: A description of how cook generates textures, for use as the
+		// parameters of a DerivedDataCache key.
+		std::string cacheParameters() const;
+
+		// The filter that CPU mip generation uses, both for cooking and loading.
+		inline const MipGenParameters& mipParameters() const { return mMipParameters; }
+		inline void setMipParameters(const MipGenParameters& params) { mMipParameters = params; }
+
+		// Generate the mips of images loaded through stb or lodepng on the CPU instead
+		// of with glGenerateTextureMipmap.
+		// threadCount: The number of worker threads to generate with.
+		void enableCpuMips(uint32_t threadCount);
+		void disableCpuMips();
+
+		// The block compression that cook and compressed loading use.
+		inline const BlockCompressParameters& compressParameters() const { return mCompressParameters; }
+		inline void setCompressParameters(const BlockCompressParameters& params) { mCompressParameters = params; }
+		// Whether cook writes block compressed levels. HDR images are never compressed.
+		inline bool compressOnCook() const { return bCompressOnCook; }
+		inline void setCompressOnCook(bool value) { bCompressOnCook = value; }
+
+		// Block compress 8 bit images loaded through stb or lodepng before uploading them.
+		// This is slow, prefer cooking. Implies CPU mips, images loaded with an explicit
+		// internal format other than sRGB stay uncompressed.
+		// threadCount: The number of worker threads to compress with.
+		void enableCompressionOnLoad(uint32_t threadCount);
+		void disableCompressionOnLoad();
+
+		// Load KTX and DDS textures, including cooked textures from the derived data
+		// cache, with only their smallest levels resident and stream in the rest as the
+		// renderer requests them. Textures loaded with an explicit internal format and
+		// textures that are not 2D are always loaded whole.
+		// params: The budget and upload limits to stream with.
+		void enableStreaming(const TextureStreamingParameters& params);
+		// Stops streaming, textures that were streamed keep the levels they have.
+		void disableStreaming();
+		// returns: The streamer, or nullptr if streaming is disabled.
+		inline TextureStreamer* streamer() { return mStreamer; }
 
 		Texture* loadTextureUnmanaged(const std::string& source);
 		Texture* loadTextureUnmanaged(const std::string& source, 
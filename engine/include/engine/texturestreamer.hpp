@@ -0,0 +1,186 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: texturestreamer.hpp
+*	Description: Streams the mip levels of KTX/DDS textures in and out of video memory.
+*	Textures load with only their smallest levels resident, the renderer requests the
+*	levels it needs every frame and finer levels are uploaded through a ring of pixel
+*	unpack buffers, or dropped again when the streamer goes over its budget.
+*/
+
+#pragma once
+
+#include <engine/json.hpp>
+#include <engine/threadpool.hpp>
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Morpheus {
+
+	class Texture;
+
+	struct TextureStreamingParameters {
+		// The number of bytes of video memory that streamed textures may use
+		size_t mBudget;
+		// Levels whose width and height are both at most this size are always resident
+		uint32_t mMinResidentSize;
+		// The number of threads that read levels from disk
+		uint32_t mThreads;
+		// The number of pixel unpack buffers that uploads rotate through
+		uint32_t mStagingBuffers;
+		// Textures that have not been requested for this many frames drop to their resident levels
+		uint32_t mEvictFrames;
+		// The maximum number of bytes uploaded per frame, 0 for no limit
+		size_t mUploadBytesPerFrame;
+		// Added to every requested level, positive values trade sharpness for memory
+		float mLodBias;
+
+		static TextureStreamingParameters defaults();
+		// Reads the "texture_streaming" block of the engine config.
+		static TextureStreamingParameters fromConfig(const nlohmann::json& config);
+	};
+
+	struct TextureStreamingStats {
+		// The number of textures being streamed
+		uint32_t mTextures;
+		// The number of bytes of video memory that streamed textures use
+		size_t mResidentBytes;
+		// The number of bytes streamed textures would use if every requested level were resident
+		size_t mRequestedBytes;
+		// The number of textures whose levels are being read from disk
+		uint32_t mPendingLoads;
+		// The number of levels waiting for a staging buffer
+		uint32_t mPendingUploads;
+		// The number of levels that have been uploaded
+		uint64_t mLevelsStreamedIn;
+		// The number of levels that have been dropped, either unused or over budget
+		uint64_t mLevelsDropped;
+		// The number of bytes that have been uploaded
+		uint64_t mUploadedBytes;
+	};
+
+	// Keeps the mip chains of streamed textures partially resident. Only the levels from
+	// a texture's finest resident level downwards have storage, GL_TEXTURE_BASE_LEVEL
+	// clamps sampling to the levels whose data has arrived. Should only be used from the
+	// thread which owns the OpenGL context.
+	class TextureStreamer {
+	private:
+		struct LevelData {
+			uint32_t mLevel;
+			std::vector<uint8_t> mData;
+		};
+
+		struct StreamedTexture {
+			Texture* mTexture;
+			std::string mSource;
+			// Distinguishes this record from an earlier texture at the same address
+			uint64_t mSerial;
+			GLenum mInternalFormat;
+			GLenum mExternalFormat;
+			GLenum mType;
+			GLint mSwizzles[4];
+			bool bCompressed;
+			// Extents of level 0 and the number of levels in the full chain
+			uint32_t mWidth;
+			uint32_t mHeight;
+			uint32_t mLevelCount;
+			std::vector<size_t> mLevelSizes;
+			// The finest level that is always resident
+			uint32_t mResidentLevel;
+			// The finest level that the texture has storage for
+			uint32_t mAllocatedLevel;
+			// The finest level whose data has been uploaded
+			uint32_t mValidLevel;
+			// The finest level requested since the last update
+			uint32_t mRequestedLevel;
+			// The finest level the streamer is working towards
+			uint32_t mWantedLevel;
+			uint64_t mLastRequestFrame;
+			bool bLoading;
+			// Levels read from disk that wait for a staging buffer, coarsest first
+			std::vector<LevelData> mPendingUploads;
+		};
+
+		struct LoadResult {
+			Texture* mTexture;
+			uint64_t mSerial;
+			bool bSuccess;
+			// Coarsest first
+			std::vector<LevelData> mLevels;
+		};
+
+		struct StagingBuffer {
+			GLuint mBuffer;
+			size_t mCapacity;
+			GLsync mFence;
+		};
+
+		TextureStreamingParameters mParameters;
+		std::unordered_map<const Texture*, StreamedTexture> mTextures;
+		std::vector<StagingBuffer> mStaging;
+		uint32_t mNextStaging;
+		uint64_t mFrame;
+		uint64_t mNextSerial;
+		TextureStreamingStats mStats;
+
+		ThreadPool mWorkers;
+		std::mutex mResultMutex;
+		std::vector<LoadResult> mResults;
+
+		size_t residentSize(const StreamedTexture& record, uint32_t finestLevel) const;
+		void reallocate(StreamedTexture* record, uint32_t finestLevel);
+		void setBaseLevel(StreamedTexture* record);
+		void submitLoad(StreamedTexture* record);
+		StagingBuffer* acquireStaging(size_t size, bool bWait);
+		void upload(StreamedTexture* record, const LevelData& level, StagingBuffer* staging);
+		void applyResults();
+		void chooseLevels();
+		void uploadPending(bool bWait);
+
+	public:
+		TextureStreamer(const TextureStreamingParameters& params);
+		~TextureStreamer();
+
+		// Loads a texture with only the levels at most mMinResidentSize texels across.
+		// source: A KTX or DDS file with a full mip chain.
+		// returns: The texture, or nullptr if the file could not be loaded or is not
+		// a 2D texture, in which case it should be loaded without streaming.
+		Texture* load(const std::string& source);
+
+		// Stops streaming a texture, must be called before the texture is deleted.
+		void remove(const Texture* texture);
+
+		// returns: Whether the texture is managed by this streamer.
+		bool isStreamed(const Texture* texture) const;
+
+		// Requests the level that covers a given number of screen pixels, assuming the
+		// UV range [0, 1] is stretched across that many pixels. Textures that are not
+		// streamed are ignored.
+		// texture: The texture that is about to be sampled.
+		// screenSize: The size of the surface that samples the texture, in pixels.
+		void request(const Texture* texture, float screenSize);
+
+		// Requests a level directly, i.e., from screen-space UV derivatives.
+		// texture: The texture that is about to be sampled.
+		// level: The finest level that should become resident.
+		void requestLevel(const Texture* texture, uint32_t level);
+
+		// Applies finished loads, picks the levels every texture should have within the
+		// budget, drops and loads levels and issues uploads. Should be called once per frame.
+		void update();
+
+		// Blocks until every load has finished and uploads all of them.
+		void flush();
+
+		inline void setBudget(size_t bytes) { mParameters.mBudget = bytes; }
+		inline const TextureStreamingParameters& parameters() const { return mParameters; }
+		inline const TextureStreamingStats& stats() const { return mStats; }
+	};
+}
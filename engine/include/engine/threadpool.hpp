@@ -0,0 +1,49 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: threadpool.hpp
+*	Description: A small pool of worker threads for CPU-side engine work
+*	(i.e., encoding readbacks or rasterizing occluders).
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Morpheus {
+
+	// Small pool of worker threads used to run CPU-side work off of the render thread.
+	class ThreadPool {
+	private:
+		std::vector<std::thread> mThreads;
+		std::deque<std::function<void()>> mJobs;
+		std::mutex mMutex;
+		std::condition_variable mWake;
+		std::condition_variable mIdle;
+		uint32_t mBusy;
+		bool bExit;
+
+		void run();
+
+	public:
+		ThreadPool(uint32_t threadCount);
+		~ThreadPool();
+
+		// Queue a job to be run on a worker thread. If there are no worker
+		// threads, the job is run immediately on the calling thread.
+		// job: The job to run.
+		void submit(std::function<void()>&& job);
+
+		// Blocks until all submitted jobs have completed.
+		void wait();
+
+		inline uint32_t threadCount() const { return (uint32_t)mThreads.size(); }
+	};
+}
@@ -0,0 +1,133 @@
+/*
+*	Morpheus Graphics Engine
+*	Author: Philip Etter
+*
+*	File: vertexformat.hpp
+*	Description: Compressed vertex formats for Geometry. Interleaved float vertex
+*	data is packed into smaller types before upload, positions are quantized
+*	relative to the bounding box and normals are octahedral encoded.
+*/
+
+#pragma once
+
+#include <engine/geobase.hpp>
+#include <engine/json.hpp>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Morpheus {
+
+	struct GLSLPreprocessorConfig;
+
+	enum class VertexPositionFormat {
+		// 3 x 32 bit float
+		FLOAT,
+		// 3 x 16 bit float, relative to the center of the bounding box
+		HALF,
+		// 3 x 16 bit normalized integer, relative to the bounding box
+		SNORM16
+	};
+
+	enum class VertexNormalFormat {
+		// 3 x 32 bit float
+		FLOAT,
+		// 2 x 16 bit normalized octahedral encoding, applies to tangents as well
+		OCTAHEDRAL
+	};
+
+	enum class VertexUVFormat {
+		// 2 x 32 bit float
+		FLOAT,
+		// 2 x 16 bit float
+		HALF
+	};
+
+	// How the vertex and index buffers of a Geometry are stored on the GPU.
+	struct VertexFormat {
+		VertexPositionFormat mPositions;
+		VertexNormalFormat mNormals;
+		VertexUVFormat mUVs;
+		// Use 16 bit indices for meshes with at most 65536 vertices
+		bool bShortIndices;
+
+		// Full precision vertices with 16 bit indices where possible.
+		static VertexFormat defaults();
+		// 16 bit normalized positions, octahedral normals and half float UVs.
+		static VertexFormat compressed();
+		// Reads the "vertex_format" block of the engine config, if there is one.
+		static VertexFormat fromConfig(const nlohmann::json& config);
+
+		// Adds the defines that vertex shaders use to decode this format.
+		// config: The preprocessor configuration to add to.
+		void addDefines(GLSLPreprocessorConfig* config) const;
+
+		inline bool operator==(const VertexFormat& other) const {
+			return mPositions == other.mPositions && mNormals == other.mNormals &&
+				mUVs == other.mUVs && bShortIndices == other.bShortIndices;
+		}
+		inline bool operator!=(const VertexFormat& other) const {
+			return !(*this == other);
+		}
+	};
+
+	VertexPositionFormat positionFormatFromString(const std::string& str);
+	VertexNormalFormat normalFormatFromString(const std::string& str);
+	VertexUVFormat uvFormatFromString(const std::string& str);
+
+	enum class VertexAttributeKind {
+		POSITION,
+		UV,
+		NORMAL,
+		COLOR
+	};
+
+	// An attribute of an interleaved float vertex buffer that should be packed.
+	struct VertexAttributeSource {
+		// Shader location of the attribute
+		GLint mLocation;
+		VertexAttributeKind mKind;
+		// Offset into the vertex in floats
+		uint32_t mOffset;
+		uint32_t mComponents;
+	};
+
+	// An attribute of a packed vertex buffer, i.e., the arguments of glVertexAttribPointer.
+	struct PackedVertexAttribute {
+		GLint mLocation;
+		GLint mComponents;
+		GLenum mType;
+		GLboolean bNormalized;
+		// Offset into the vertex in bytes
+		uint32_t mOffset;
+	};
+
+	struct PackedVertexBuffer {
+		std::vector<uint8_t> mData;
+		std::vector<PackedVertexAttribute> mAttributes;
+		// Size of a packed vertex in bytes
+		uint32_t mStride;
+		// Transforms packed positions back into object space
+		glm::mat4 mPositionDecode;
+	};
+
+	// Packs interleaved float vertex data into the given format.
+	// vertices: The interleaved float vertex data.
+	// vertexCount: The number of vertices.
+	// stride: The number of floats per vertex.
+	// attributes: The attributes to pack.
+	// format: The format to pack into.
+	// aabb: The bounding box of the positions, used for quantization.
+	// output: Receives the packed vertices.
+	void packVertices(const float* vertices, uint32_t vertexCount, uint32_t stride,
+		const std::vector<VertexAttributeSource>& attributes, const VertexFormat& format,
+		const BoundingBox& aabb, PackedVertexBuffer* output);
+
+	// Encodes a unit vector into two components in [-1, 1] with an octahedral mapping.
+	glm::vec2 octahedralEncode(const glm::vec3& n);
+	glm::vec3 octahedralDecode(const glm::vec2& e);
+}
@@ -13,9 +13,36 @@ uniform float gamma     = 2.2;
 uniform float exposure  = 1.0;
 uniform float pureWhite = 1.0;
 
+// Portion of blitTexture that contains the image, less than 1 under dynamic resolution
+uniform vec2 uvScale    = vec2(1.0, 1.0);
+// Size of a texel of blitTexture
+uniform vec2 texelSize  = vec2(0.0, 0.0);
+// Strength of the sharpening filter applied when upscaling
+uniform float sharpness = 0.0;
+
+vec3 fetch(vec2 coord) {
+	// Never filter in texels outside of the rendered region
+	return texture(blitTexture, clamp(coord, 0.5 * texelSize, uvScale - 0.5 * texelSize)).rgb;
+}
+
 void main()
 {
-	vec3 color = texture(blitTexture, uv).rgb * exposure;
+	vec2 coord = uv * uvScale;
+	vec3 color = fetch(coord);
+
+	if (sharpness > 0.0) {
+		// Unsharp mask over the 4-neighbourhood, clamped to the neighbourhood
+		// range to avoid ringing around edges
+		vec3 n = fetch(coord + vec2(0.0, texelSize.y));
+		vec3 s = fetch(coord - vec2(0.0, texelSize.y));
+		vec3 e = fetch(coord + vec2(texelSize.x, 0.0));
+		vec3 w = fetch(coord - vec2(texelSize.x, 0.0));
+		vec3 minColor = min(color, min(min(n, s), min(e, w)));
+		vec3 maxColor = max(color, max(max(n, s), max(e, w)));
+		color = clamp(color + sharpness * (4.0 * color - n - s - e - w), minColor, maxColor);
+	}
+
+	color *= exposure;
 
 	// Reinhard tonemapping operator.
 	// see: "Photographic Tone Reproduction for Digital Images", eq. 4
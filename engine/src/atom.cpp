@@ -0,0 +1,78 @@
+#include <engine/atom.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+namespace Morpheus {
+	AtomTable::AtomTable() {
+		// Atom 0 is the empty string
+		intern("");
+	}
+
+	Atom AtomTable::intern(std::string_view s) {
+		{
+			std::shared_lock<std::shared_mutex> lock(mMutex);
+			auto it = mIds.find(s);
+			if (it != mIds.end())
+				return Atom{ it->second };
+		}
+
+		std::unique_lock<std::shared_mutex> lock(mMutex);
+		// Another thread may have interned it in between
+		auto it = mIds.find(s);
+		if (it != mIds.end())
+			return Atom{ it->second };
+
+		uint32_t id = (uint32_t)mEntries.size();
+		mEntries.push_back(Entry{ std::string(s), std::hash<std::string_view>()(s) });
+		mIds[std::string_view(mEntries.back().mString)] = id;
+		return Atom{ id };
+	}
+
+	Atom AtomTable::internPath(std::string_view path) {
+		if (path.find('\\') == std::string_view::npos)
+			return intern(path);
+
+		std::string normalized(path);
+		std::replace(normalized.begin(), normalized.end(), '\\', '/');
+		return intern(normalized);
+	}
+
+	bool AtomTable::tryFind(std::string_view s, Atom* out) const {
+		std::shared_lock<std::shared_mutex> lock(mMutex);
+		auto it = mIds.find(s);
+		if (it == mIds.end())
+			return false;
+		*out = Atom{ it->second };
+		return true;
+	}
+
+	bool AtomTable::tryFindPath(std::string_view path, Atom* out) const {
+		if (path.find('\\') == std::string_view::npos)
+			return tryFind(path, out);
+
+		std::string normalized(path);
+		std::replace(normalized.begin(), normalized.end(), '\\', '/');
+		return tryFind(normalized, out);
+	}
+
+	const std::string& AtomTable::str(Atom atom) const {
+		std::shared_lock<std::shared_mutex> lock(mMutex);
+		return mEntries[atom.mId].mString;
+	}
+
+	uint64_t AtomTable::hash(Atom atom) const {
+		std::shared_lock<std::shared_mutex> lock(mMutex);
+		return mEntries[atom.mId].mHash;
+	}
+
+	size_t AtomTable::size() const {
+		std::shared_lock<std::shared_mutex> lock(mMutex);
+		return mEntries.size();
+	}
+
+	AtomTable* atoms() {
+		static AtomTable instance;
+		return &instance;
+	}
+}
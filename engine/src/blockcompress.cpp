@@ -0,0 +1,663 @@
+#include <engine/blockcompress.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// Power iterations used to find the principal axis of a block
+#define BLOCK_PCA_ITERATIONS 8
+
+namespace Morpheus {
+
+	BlockCompressParameters BlockCompressParameters::defaults() {
+		BlockCompressParameters params;
+		params.mFormat = BlockFormat::AUTO;
+		params.mQuality = BlockQuality::NORMAL;
+		params.bSRGB = false;
+		return params;
+	}
+
+	BlockCompressParameters BlockCompressParameters::fromConfig(const nlohmann::json& config) {
+		BlockCompressParameters params = defaults();
+
+		if (config.contains("texture_compression")) {
+			auto& compressConfig = config["texture_compression"];
+
+			std::string format = compressConfig.value("format", std::string("auto"));
+			if (format == "bc1")
+				params.mFormat = BlockFormat::BC1;
+			else if (format == "bc3")
+				params.mFormat = BlockFormat::BC3;
+			else if (format == "bc4")
+				params.mFormat = BlockFormat::BC4;
+			else if (format == "bc5")
+				params.mFormat = BlockFormat::BC5;
+			else if (format == "bc7")
+				params.mFormat = BlockFormat::BC7;
+			else if (format != "auto")
+				std::cout << "Warning: unknown texture compression format " << format << ", using auto." << std::endl;
+
+			std::string quality = compressConfig.value("quality", std::string("normal"));
+			if (quality == "fast")
+				params.mQuality = BlockQuality::FAST;
+			else if (quality == "high")
+				params.mQuality = BlockQuality::HIGH;
+			else if (quality != "normal")
+				std::cout << "Warning: unknown texture compression quality " << quality << ", using normal." << std::endl;
+
+			params.bSRGB = compressConfig.value("srgb", params.bSRGB);
+		}
+
+		return params;
+	}
+
+	std::string BlockCompressParameters::cacheParameters() const {
+		std::stringstream ss;
+		ss << "bcn " << (int)mFormat << " " << (int)mQuality << " " << bSRGB;
+		return ss.str();
+	}
+
+	BlockFormat resolveBlockFormat(BlockFormat format, uint32_t components) {
+		if (format != BlockFormat::AUTO)
+			return format;
+
+		switch (components) {
+		case 1:
+			return BlockFormat::BC4;
+		case 2:
+			return BlockFormat::BC5;
+		case 3:
+			return BlockFormat::BC1;
+		default:
+			return BlockFormat::BC7;
+		}
+	}
+
+	uint32_t blockSize(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC1:
+		case BlockFormat::BC4:
+			return 8;
+		default:
+			return 16;
+		}
+	}
+
+	// A block with its channels stored separately, so that four texels fit in a register
+	struct BlockChannels {
+		alignas(16) float mValues[4][16];
+	};
+
+	// Writes fields of a block from the least significant bit up.
+	struct BitWriter {
+		uint8_t* mData;
+		uint32_t mPosition;
+
+		inline void write(uint32_t value, uint32_t bits) {
+			for (uint32_t i = 0; i < bits; ++i, ++mPosition)
+				if ((value >> i) & 1)
+					mData[mPosition >> 3] |= (uint8_t)(1 << (mPosition & 7));
+		}
+	};
+
+	// Picks the nearest palette entry for every texel.
+	// block: The texels.
+	// palette: The palette, four channels per entry.
+	// count: The number of palette entries.
+	// indices: Receives the index of the nearest entry of every texel.
+	// returns: The total squared error.
+	float fitIndices(const BlockChannels& block, const float (*palette)[4], int count, uint8_t indices[16]) {
+		float total = 0.0f;
+#ifdef BLOCK_USE_SSE
+		for (int i = 0; i < 16; i += 4) {
+			__m128 r = _mm_load_ps(&block.mValues[0][i]);
+			__m128 g = _mm_load_ps(&block.mValues[1][i]);
+			__m128 b = _mm_load_ps(&block.mValues[2][i]);
+			__m128 a = _mm_load_ps(&block.mValues[3][i]);
+			__m128 best = _mm_set1_ps(FLT_MAX);
+			__m128i bestIndex = _mm_setzero_si128();
+
+			for (int k = 0; k < count; ++k) {
+				__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette[k][0]));
+				__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette[k][1]));
+				__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette[k][2]));
+				__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette[k][3]));
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)),
+					_mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+				__m128i nearer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+				best = _mm_min_ps(dist, best);
+				bestIndex = _mm_or_si128(_mm_and_si128(nearer, _mm_set1_epi32(k)),
+					_mm_andnot_si128(nearer, bestIndex));
+			}
+
+			alignas(16) int32_t laneIndex[4];
+			alignas(16) float laneError[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(laneIndex), bestIndex);
+			_mm_store_ps(laneError, best);
+			for (int j = 0; j < 4; ++j) {
+				indices[i + j] = (uint8_t)laneIndex[j];
+				total += laneError[j];
+			}
+		}
+#else
+		for (int i = 0; i < 16; ++i) {
+			float best = FLT_MAX;
+			for (int k = 0; k < count; ++k) {
+				float dist = 0.0f;
+				for (int c = 0; c < 4; ++c) {
+					float d = block.mValues[c][i] - palette[k][c];
+					dist += d * d;
+				}
+				if (dist < best) {
+					best = dist;
+					indices[i] = (uint8_t)k;
+				}
+			}
+			total += best;
+		}
+#endif
+		return total;
+	}
+
+	// Finds the endpoints of a block along its principal axis, or its bounding box for FAST.
+	void findEndpoints(const BlockChannels& block, int channels, bool bBoundingBox, float* low, float* high) {
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float minimum[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+		float maximum[4] = { -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (int c = 0; c < channels; ++c) {
+			for (int i = 0; i < 16; ++i) {
+				mean[c] += block.mValues[c][i];
+				minimum[c] = std::min(minimum[c], block.mValues[c][i]);
+				maximum[c] = std::max(maximum[c], block.mValues[c][i]);
+			}
+			mean[c] /= 16.0f;
+		}
+
+		if (bBoundingBox) {
+			// Inset slightly, the extremes are rarely worth an endpoint of their own
+			for (int c = 0; c < channels; ++c) {
+				float inset = (maximum[c] - minimum[c]) / 16.0f;
+				low[c] = minimum[c] + inset;
+				high[c] = maximum[c] - inset;
+			}
+			return;
+		}
+
+		float covariance[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+			for (int c0 = 0; c0 < channels; ++c0)
+				for (int c1 = 0; c1 < channels; ++c1)
+					covariance[c0][c1] += (block.mValues[c0][i] - mean[c0]) * (block.mValues[c1][i] - mean[c1]);
+
+		float axis[4];
+		for (int c = 0; c < channels; ++c)
+			axis[c] = maximum[c] - minimum[c];
+
+		for (int iteration = 0; iteration < BLOCK_PCA_ITERATIONS; ++iteration) {
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float length = 0.0f;
+			for (int c0 = 0; c0 < channels; ++c0) {
+				for (int c1 = 0; c1 < channels; ++c1)
+					next[c0] += covariance[c0][c1] * axis[c1];
+				length = std::max(length, std::abs(next[c0]));
+			}
+			if (length < 1e-6f)
+				break;
+			for (int c = 0; c < channels; ++c)
+				axis[c] = next[c] / length;
+		}
+
+		float minProjection = FLT_MAX;
+		float maxProjection = -FLT_MAX;
+		float axisLength2 = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			axisLength2 += axis[c] * axis[c];
+
+		if (axisLength2 < 1e-12f) {
+			for (int c = 0; c < channels; ++c)
+				low[c] = high[c] = mean[c];
+			return;
+		}
+
+		for (int i = 0; i < 16; ++i) {
+			float projection = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				projection += (block.mValues[c][i] - mean[c]) * axis[c];
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+
+		for (int c = 0; c < channels; ++c) {
+			low[c] = std::clamp(mean[c] + axis[c] * minProjection / axisLength2, 0.0f, 255.0f);
+			high[c] = std::clamp(mean[c] + axis[c] * maxProjection / axisLength2, 0.0f, 255.0f);
+		}
+	}
+
+	// Solves for the endpoints that best reproduce the block given its indices.
+	// weights: The weight of the second endpoint for every palette index.
+	// returns: Whether the system could be solved.
+	bool refineEndpoints(const BlockChannels& block, int channels, const uint8_t indices[16],
+		const float* weights, float* first, float* second) {
+		float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+		float alphaX[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float betaX[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+		for (int i = 0; i < 16; ++i) {
+			float beta = weights[indices[i]];
+			float alpha = 1.0f - beta;
+			alpha2 += alpha * alpha;
+			beta2 += beta * beta;
+			alphaBeta += alpha * beta;
+			for (int c = 0; c < channels; ++c) {
+				alphaX[c] += alpha * block.mValues[c][i];
+				betaX[c] += beta * block.mValues[c][i];
+			}
+		}
+
+		float det = alpha2 * beta2 - alphaBeta * alphaBeta;
+		if (std::abs(det) < 1e-6f)
+			return false;
+
+		for (int c = 0; c < channels; ++c) {
+			first[c] = std::clamp((alphaX[c] * beta2 - betaX[c] * alphaBeta) / det, 0.0f, 255.0f);
+			second[c] = std::clamp((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / det, 0.0f, 255.0f);
+		}
+		return true;
+	}
+
+	inline uint16_t packColor565(const float* color) {
+		uint32_t r = (uint32_t)std::lround(color[0] * 31.0f / 255.0f);
+		uint32_t g = (uint32_t)std::lround(color[1] * 63.0f / 255.0f);
+		uint32_t b = (uint32_t)std::lround(color[2] * 31.0f / 255.0f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	inline void unpackColor565(uint16_t packed, float* color) {
+		uint32_t r = (packed >> 11) & 31;
+		uint32_t g = (packed >> 5) & 63;
+		uint32_t b = packed & 31;
+		color[0] = (float)((r << 3) | (r >> 2));
+		color[1] = (float)((g << 2) | (g >> 4));
+		color[2] = (float)((b << 3) | (b >> 2));
+		color[3] = 0.0f;
+	}
+
+	// Encodes a BC1 block from two endpoints.
+	// returns: The squared error of the encoded block.
+	float encodeColorEndpoints(const BlockChannels& block, const float* first, const float* second,
+		uint8_t output[8], uint8_t indices[16]) {
+		uint16_t c0 = packColor565(first);
+		uint16_t c1 = packColor565(second);
+		// The four color mode requires c0 > c1
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		float palette[4][4];
+		unpackColor565(c0, palette[0]);
+		unpackColor565(c1, palette[1]);
+		for (int c = 0; c < 4; ++c) {
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		float error;
+		if (c0 == c1) {
+			std::fill(indices, indices + 16, 0);
+			error = 0.0f;
+			for (int i = 0; i < 16; ++i)
+				for (int c = 0; c < 3; ++c)
+					error += (block.mValues[c][i] - palette[0][c]) * (block.mValues[c][i] - palette[0][c]);
+		}
+		else
+			error = fitIndices(block, palette, 4, indices);
+
+		uint32_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (uint32_t)indices[i] << (2 * i);
+
+		output[0] = (uint8_t)(c0 & 0xFF);
+		output[1] = (uint8_t)(c0 >> 8);
+		output[2] = (uint8_t)(c1 & 0xFF);
+		output[3] = (uint8_t)(c1 >> 8);
+		std::memcpy(&output[4], &bits, sizeof(bits));
+		return error;
+	}
+
+	void compressColorBlock(const BlockChannels& rgba, BlockQuality quality, uint8_t output[8]) {
+		// Alpha is not part of the color fit
+		BlockChannels block = rgba;
+		std::fill(block.mValues[3], block.mValues[3] + 16, 0.0f);
+
+		// Weight of the second endpoint for palette indices 0 to 3
+		static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+		float low[4], high[4];
+		findEndpoints(block, 3, quality == BlockQuality::FAST, low, high);
+
+		uint8_t indices[16];
+		float bestError = encodeColorEndpoints(block, high, low, output, indices);
+
+		int refinements = quality == BlockQuality::FAST ? 0 : (quality == BlockQuality::NORMAL ? 1 : 4);
+		for (int iteration = 0; iteration < refinements; ++iteration) {
+			float first[4], second[4];
+			uint8_t candidate[8];
+			uint8_t candidateIndices[16];
+
+			// The encoder may have swapped the endpoints, so solve for what was written
+			uint16_t c0 = output[0] | (output[1] << 8);
+			uint16_t c1 = output[2] | (output[3] << 8);
+			if (c0 == c1 || !refineEndpoints(block, 3, indices, weights, first, second))
+				break;
+
+			float error = encodeColorEndpoints(block, first, second, candidate, candidateIndices);
+			if (error >= bestError)
+				break;
+			bestError = error;
+			std::memcpy(output, candidate, sizeof(candidate));
+			std::memcpy(indices, candidateIndices, sizeof(candidateIndices));
+		}
+
+		if (quality == BlockQuality::HIGH) {
+			// The bounding box is sometimes the better start, i.e., for blocks with two clusters
+			findEndpoints(block, 3, true, low, high);
+			uint8_t candidate[8];
+			float error = encodeColorEndpoints(block, high, low, candidate, indices);
+			if (error < bestError)
+				std::memcpy(output, candidate, sizeof(candidate));
+		}
+	}
+
+	// Encodes a BC4 block from two endpoints.
+	// returns: The squared error of the encoded block.
+	float encodeAlphaEndpoints(const BlockChannels& block, int e0, int e1, uint8_t output[8]) {
+		float palette[8][4] = {};
+		palette[0][0] = (float)e0;
+		palette[1][0] = (float)e1;
+		if (e0 > e1) {
+			for (int i = 2; i < 8; ++i)
+				palette[i][0] = (float)(((8 - i) * e0 + (i - 1) * e1) / 7);
+		}
+		else {
+			for (int i = 2; i < 6; ++i)
+				palette[i][0] = (float)(((6 - i) * e0 + (i - 1) * e1) / 5);
+			palette[6][0] = 0.0f;
+			palette[7][0] = 255.0f;
+		}
+
+		uint8_t indices[16];
+		float error = fitIndices(block, palette, 8, indices);
+
+		uint64_t bits = 0;
+		for (int i = 0; i < 16; ++i)
+			bits |= (uint64_t)indices[i] << (3 * i);
+
+		output[0] = (uint8_t)e0;
+		output[1] = (uint8_t)e1;
+		for (int i = 0; i < 6; ++i)
+			output[2 + i] = (uint8_t)(bits >> (8 * i));
+		return error;
+	}
+
+	// Encodes a single channel of a block as BC4.
+	void compressAlphaBlock(const BlockChannels& rgba, int channel, BlockQuality quality, uint8_t output[8]) {
+		BlockChannels block = {};
+		std::memcpy(block.mValues[0], rgba.mValues[channel], sizeof(block.mValues[0]));
+
+		int minimum = 255, maximum = 0;
+		int innerMinimum = 255, innerMaximum = 0;
+		for (int i = 0; i < 16; ++i) {
+			int value = (int)block.mValues[0][i];
+			minimum = std::min(minimum, value);
+			maximum = std::max(maximum, value);
+			if (value != 0 && value != 255) {
+				innerMinimum = std::min(innerMinimum, value);
+				innerMaximum = std::max(innerMaximum, value);
+			}
+		}
+
+		float bestError = encodeAlphaEndpoints(block, maximum, minimum, output);
+		if (quality == BlockQuality::FAST || bestError == 0.0f)
+			return;
+
+		// Pull the endpoints in, which trades the extremes for finer steps in between
+		int search = quality == BlockQuality::NORMAL ? 2 : 6;
+		uint8_t candidate[8];
+		for (int d0 = 0; d0 <= search; ++d0) {
+			for (int d1 = 0; d1 <= search; ++d1) {
+				int e0 = maximum - d0;
+				int e1 = minimum + d1;
+				if (e0 <= e1 || (d0 == 0 && d1 == 0))
+					continue;
+				float error = encodeAlphaEndpoints(block, e0, e1, candidate);
+				if (error < bestError) {
+					bestError = error;
+					std::memcpy(output, candidate, sizeof(candidate));
+				}
+			}
+		}
+
+		// The six value mode has exact 0 and 255, good for blocks with hard cutouts
+		if (quality == BlockQuality::HIGH && innerMinimum <= innerMaximum) {
+			float error = encodeAlphaEndpoints(block, innerMinimum, innerMaximum, candidate);
+			if (error < bestError)
+				std::memcpy(output, candidate, sizeof(candidate));
+		}
+	}
+
+	// BC7 interpolation weights for 4 bit indices, out of 64
+	static const int gBC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	// Quantizes an endpoint to 7 bits per channel and a shared p-bit.
+	void quantizeBC7Endpoint(const float* endpoint, uint32_t quantized[4], uint32_t* pbit) {
+		float bestError = FLT_MAX;
+		for (uint32_t p = 0; p < 2; ++p) {
+			uint32_t candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c) {
+				candidate[c] = (uint32_t)std::clamp((int)std::lround((endpoint[c] - p) / 2.0f), 0, 127);
+				float d = (float)((candidate[c] << 1) | p) - endpoint[c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				std::memcpy(quantized, candidate, sizeof(candidate));
+				*pbit = p;
+			}
+		}
+	}
+
+	// Encodes a BC7 mode 6 block, one RGBA subset with 4 bit indices.
+	// returns: The squared error of the encoded block.
+	float encodeBC7Mode6(const BlockChannels& block, const float* first, const float* second,
+		uint8_t output[16], uint8_t indices[16]) {
+		uint32_t q0[4], q1[4], p0, p1;
+		quantizeBC7Endpoint(first, q0, &p0);
+		quantizeBC7Endpoint(second, q1, &p1);
+
+		float palette[16][4];
+		for (int k = 0; k < 16; ++k) {
+			for (int c = 0; c < 4; ++c) {
+				int e0 = (int)((q0[c] << 1) | p0);
+				int e1 = (int)((q1[c] << 1) | p1);
+				palette[k][c] = (float)(((64 - gBC7Weights4[k]) * e0 + gBC7Weights4[k] * e1 + 32) >> 6);
+			}
+		}
+
+		float error = fitIndices(block, palette, 16, indices);
+
+		// The most significant bit of the first index is implied to be 0
+		if (indices[0] >= 8) {
+			std::swap(q0, q1);
+			std::swap(p0, p1);
+			for (int i = 0; i < 16; ++i)
+				indices[i] = 15 - indices[i];
+		}
+
+		std::memset(output, 0, 16);
+		BitWriter writer{ output, 0 };
+		writer.write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c) {
+			writer.write(q0[c], 7);
+			writer.write(q1[c], 7);
+		}
+		writer.write(p0, 1);
+		writer.write(p1, 1);
+		writer.write(indices[0], 3);
+		for (int i = 1; i < 16; ++i)
+			writer.write(indices[i], 4);
+		return error;
+	}
+
+	void compressBC7Block(const BlockChannels& block, BlockQuality quality, uint8_t output[16]) {
+		static const float weights[16] = {
+			0.0f / 64, 4.0f / 64, 9.0f / 64, 13.0f / 64, 17.0f / 64, 21.0f / 64, 26.0f / 64, 30.0f / 64,
+			34.0f / 64, 38.0f / 64, 43.0f / 64, 47.0f / 64, 51.0f / 64, 55.0f / 64, 60.0f / 64, 64.0f / 64 };
+
+		int refinements = quality == BlockQuality::FAST ? 0 : (quality == BlockQuality::NORMAL ? 1 : 4);
+		int starts = quality == BlockQuality::HIGH ? 2 : 1;
+		float bestError = FLT_MAX;
+
+		for (int start = 0; start < starts; ++start) {
+			float low[4], high[4];
+			findEndpoints(block, 4, quality == BlockQuality::FAST || start == 1, low, high);
+
+			uint8_t candidate[16];
+			uint8_t indices[16];
+			float error = encodeBC7Mode6(block, low, high, candidate, indices);
+			if (error < bestError) {
+				bestError = error;
+				std::memcpy(output, candidate, sizeof(candidate));
+			}
+
+			for (int iteration = 0; iteration < refinements; ++iteration) {
+				float first[4], second[4];
+				if (!refineEndpoints(block, 4, indices, weights, first, second))
+					break;
+				error = encodeBC7Mode6(block, first, second, candidate, indices);
+				if (error >= bestError)
+					break;
+				bestError = error;
+				std::memcpy(output, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	void compressBlock(const uint8_t rgba[64], BlockFormat format, BlockQuality quality, uint8_t* output) {
+		BlockChannels block;
+		for (int i = 0; i < 16; ++i)
+			for (int c = 0; c < 4; ++c)
+				block.mValues[c][i] = (float)rgba[i * 4 + c];
+
+		switch (format) {
+		case BlockFormat::BC1:
+			compressColorBlock(block, quality, output);
+			break;
+		case BlockFormat::BC3:
+			compressAlphaBlock(block, 3, quality, output);
+			compressColorBlock(block, quality, output + 8);
+			break;
+		case BlockFormat::BC4:
+			compressAlphaBlock(block, 0, quality, output);
+			break;
+		case BlockFormat::BC5:
+			compressAlphaBlock(block, 0, quality, output);
+			compressAlphaBlock(block, 1, quality, output + 8);
+			break;
+		case BlockFormat::BC7:
+			compressBC7Block(block, quality, output);
+			break;
+		case BlockFormat::AUTO:
+			throw std::runtime_error("Block format must be resolved before compressing!");
+		}
+	}
+
+	// Gathers a 4x4 block of an image as RGBA8, clamping at the edges of the image.
+	void fetchBlock(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t components,
+		uint32_t blockX, uint32_t blockY, uint8_t rgba[64]) {
+		for (uint32_t y = 0; y < 4; ++y) {
+			uint32_t py = std::min(blockY * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; ++x) {
+				uint32_t px = std::min(blockX * 4 + x, width - 1);
+				const uint8_t* src = &pixels[((size_t)py * width + px) * components];
+				uint8_t* dest = &rgba[(y * 4 + x) * 4];
+
+				switch (components) {
+				case 1:
+					dest[0] = dest[1] = dest[2] = src[0];
+					dest[3] = 255;
+					break;
+				case 2:
+					dest[0] = src[0];
+					dest[1] = src[1];
+					dest[2] = 0;
+					dest[3] = 255;
+					break;
+				case 3:
+					dest[0] = src[0];
+					dest[1] = src[1];
+					dest[2] = src[2];
+					dest[3] = 255;
+					break;
+				default:
+					std::memcpy(dest, src, 4);
+					break;
+				}
+			}
+		}
+	}
+
+	BlockCompressor::BlockCompressor(uint32_t threadCount) : mWorkers(threadCount) {
+	}
+
+	void BlockCompressor::submit(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t components,
+		BlockFormat format, BlockQuality quality, uint8_t* output) {
+		uint32_t blocksX = (width + 3) / 4;
+		uint32_t blocksY = (height + 3) / 4;
+		uint32_t size = blockSize(format);
+
+		for (uint32_t first = 0; first < blocksY; first += BLOCK_ROWS_PER_JOB) {
+			uint32_t last = std::min(first + BLOCK_ROWS_PER_JOB, blocksY);
+			mWorkers.submit([=]() {
+				uint8_t rgba[64];
+				for (uint32_t by = first; by < last; ++by) {
+					for (uint32_t bx = 0; bx < blocksX; ++bx) {
+						fetchBlock(pixels, width, height, components, bx, by, rgba);
+						compressBlock(rgba, format, quality, &output[((size_t)by * blocksX + bx) * size]);
+					}
+				}
+			});
+		}
+	}
+
+	void BlockCompressor::compress(const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t components,
+		BlockFormat format, BlockQuality quality, std::vector<uint8_t>* output) {
+		output->resize((size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize(format));
+		submit(pixels, width, height, components, format, quality, output->data());
+		mWorkers.wait();
+	}
+
+	void BlockCompressor::compress(std::vector<MipLevel>* levels, uint32_t components,
+		BlockFormat format, BlockQuality quality) {
+		std::vector<std::vector<uint8_t>> compressed(levels->size());
+
+		// Jobs of every level are queued at once, small levels would not keep the workers busy
+		for (size_t level = 0; level < levels->size(); ++level) {
+			const MipLevel& source = (*levels)[level];
+			compressed[level].resize((size_t)((source.mWidth + 3) / 4) * ((source.mHeight + 3) / 4) * blockSize(format));
+			submit(source.mData.data(), source.mWidth, source.mHeight, components, format, quality,
+				compressed[level].data());
+		}
+		mWorkers.wait();
+
+		for (size_t level = 0; level < levels->size(); ++level)
+			(*levels)[level].mData = std::move(compressed[level]);
+	}
+}
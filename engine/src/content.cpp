@@ -8,6 +8,12 @@
 #include <engine/texture.hpp>
 #include <engine/sampler.hpp>
 #include <engine/framebuffer.hpp>
+#include <engine/engine.hpp>
+#include <engine/gldelete.hpp>
+#include <engine/log.hpp>
+
+#include <chrono>
+#include <thread>
 
 namespace Morpheus {
 
@@ -18,6 +24,27 @@ namespace Morpheus {
 		throw std::runtime_error("loadEx not implemented for this factory type!");
 	}
 
+	ContentSize IContentFactory::measure(INodeOwner* ref) const {
+		return ContentSize{0, 0};
+	}
+
+	GarbageCollectionParameters GarbageCollectionParameters::defaults() {
+		GarbageCollectionParameters params;
+		params.bIncremental = true;
+		params.mBudget = 1.0;
+		return params;
+	}
+
+	GarbageCollectionParameters GarbageCollectionParameters::fromConfig(const nlohmann::json& config) {
+		auto params = defaults();
+		if (config.contains("garbage_collection")) {
+			auto& collectConfig = config["garbage_collection"];
+			params.bIncremental = collectConfig.value("incremental", params.bIncremental);
+			params.mBudget = collectConfig.value("budget_ms", params.mBudget);
+		}
+		return params;
+	}
+
 	void ContentManager::init() {
 		// Make shader factory
 		mShaderFactory = addFactory<Shader>();
@@ -36,44 +63,163 @@ namespace Morpheus {
 		// Make the Framebuffer factory
 		mFramebufferFactory = addFactory<Framebuffer>();
 
-		mSources = graph()->createTwoWayVertexLookup<std::string>("__content__");
+		// Read the vertex format from the config and let shaders know how to decode it
+		auto engineConfig = config();
+		auto cookParameters = GeometryCookParameters::fromConfig(*engineConfig);
+		auto& vertexFormat = cookParameters.mFormat;
+		mGeometryFactory->setVertexFormat(vertexFormat);
+		mGeometryFactory->setCookParameters(cookParameters);
+		vertexFormat.addDefines(mShaderFactory->preprocessor()->config());
+
+		// CPU mip generation is also used by morpheus-cook, so its filter is always read
+		mTextureFactory->setMipParameters(MipGenParameters::fromConfig(*engineConfig));
+		if (engineConfig->contains("mip_generation")) {
+			auto& mipConfig = (*engineConfig)["mip_generation"];
+			if (mipConfig.value("enabled", false))
+				mTextureFactory->enableCpuMips(mipConfig.value("threads", std::thread::hardware_concurrency()));
+		}
+
+		// Block compression of cooked textures must match morpheus-cook as well
+		mTextureFactory->setCompressParameters(BlockCompressParameters::fromConfig(*engineConfig));
+		if (engineConfig->contains("texture_compression")) {
+			auto& compressConfig = (*engineConfig)["texture_compression"];
+			mTextureFactory->setCompressOnCook(compressConfig.value("cook", true));
+			if (compressConfig.value("on_load", false))
+				mTextureFactory->enableCompressionOnLoad(compressConfig.value("threads", std::thread::hardware_concurrency()));
+		}
+
+		if (engineConfig->contains("texture_streaming")) {
+			auto& streamingConfig = (*engineConfig)["texture_streaming"];
+			if (streamingConfig.value("enabled", false))
+				mTextureFactory->enableStreaming(TextureStreamingParameters::fromConfig(*engineConfig));
+		}
+
+		// Cooked content is looked up in the derived data cache, see morpheus-cook
+		if (engineConfig->contains("derived_data_cache")) {
+			auto& cacheConfig = (*engineConfig)["derived_data_cache"];
+			if (cacheConfig.value("enabled", true))
+				mDerivedCache = new DerivedDataCache(cacheConfig.value("path", std::string("ddc")));
+		}
+
+		// Released content is kept around for scene transitions that load it again
+		if (engineConfig->contains("content_cache")) {
+			auto& contentCacheConfig = (*engineConfig)["content_cache"];
+			mCacheBudget = (size_t)(contentCacheConfig.value("budget_mb", 0.0) * (1 << 20));
+		}
+
+		mCollectParameters = GarbageCollectionParameters::fromConfig(*engineConfig);
+
+		mSources = graph()->createTwoWayVertexLookup<Atom>("__content__");
+
+		// Content is queued for collection as soon as it loses a user
+		graph()->setReleaseListener([this](INodeOwner* node) {
+			onRelease(node);
+		});
 	}
 
-	ContentManager::ContentManager() : INodeOwner(NodeType::CONTENT_MANAGER) {
+	ContentManager::ContentManager() : INodeOwner(NodeType::CONTENT_MANAGER),
+		mCacheBudget(0),
+		mCacheStats{0, 0, 0, 0, 0},
+		mCollectParameters(GarbageCollectionParameters::defaults()),
+		mDerivedCache(nullptr) {
 	}
 
 	ContentManager::~ContentManager() {
+		// Everything goes, there is nothing left to collect
+		graph()->setReleaseListener(nullptr);
+		mCollectQueue.clear();
+		mQueued.clear();
+
+		glDeleteQueue()->beginBatch();
 		unloadAll();
+		glDeleteQueue()->endBatch();
 
 		for (auto& factory : mFactories)
 			delete factory;
 		mFactories.clear();
 		mTypeToFactory.clear();
 
+		delete mDerivedCache;
+
 		graph()->destroyLookup(mSources);
 	}
 
-	void ContentManager::unloadMarked() {
-		while (!mMarkedNodes.empty()) {
+	void ContentManager::onRelease(INodeOwner* node) {
+		// Only collect what the content manager is the last user of
+		if (node->inDegree() != 1 || node->getParent(0) != this)
+			return;
+
+		markForUnload(node);
+	}
+
+	void ContentManager::markForUnload(INodeOwner* node) {
+		if (mQueued.emplace(node).second)
+			mCollectQueue.push_back(node);
+	}
+
+	uint32_t ContentManager::drainCollectQueue(double budget) {
+		auto start = std::chrono::high_resolution_clock::now();
+		uint32_t processed = 0;
+
+		glDeleteQueue()->beginBatch();
 
-			auto top = *mMarkedNodes.begin();
-			mMarkedNodes.erase(top);
+		while (!mCollectQueue.empty()) {
+			if (budget >= 0.0 && processed > 0) {
+				std::chrono::duration<double, std::milli> elapsed =
+					std::chrono::high_resolution_clock::now() - start;
+				if (elapsed.count() >= budget)
+					break;
+			}
+
+			auto top = mCollectQueue.front();
+			mCollectQueue.pop_front();
+
+			// Unloaded since it was queued
+			if (mQueued.erase(top) == 0)
+				continue;
 
-			auto type = top->getType();
-			
-			if (top->parentCount() <= 1) {
-				// Check if children of this node need to be collected too
-				for (auto it = top->children(); it.valid(); it.next()) {
-					mMarkedNodes.emplace(it());
-				}
+			++processed;
 
-				// Collect garbage
-				unload(top);
+			// Picked up a new user since it was queued
+			if (top->parentCount() > 1)
+				continue;
+
+			// Keep it loaded in case it is needed again soon
+			if (cacheRelease(top)) {
+				trimCache();
+				continue;
 			}
+
+			logVerbose() << "Collecting " << nodeTypeString(top->getType());
+
+			// Deleting the node releases its children, which queues them
+			unload(top);
 		}
+
+		glDeleteQueue()->endBatch();
+		return processed;
+	}
+
+	void ContentManager::unloadMarked() {
+		drainCollectQueue(-1.0);
+	}
+
+	void ContentManager::collectIncremental() {
+		if (!mCollectQueue.empty())
+			drainCollectQueue(mCollectParameters.mBudget);
 	}
 
 	void ContentManager::unload(INodeOwner* node) {
+		mQueued.erase(node);
+
+		auto cached = mCacheEntries.find(node);
+		if (cached != mCacheEntries.end()) {
+			mCacheStats.mBytes -= cached->second.mSize.total();
+			--mCacheStats.mEntries;
+			mCacheOrder.erase(cached->second.mPosition);
+			mCacheEntries.erase(cached);
+		}
+
 		graph()->deleteVertex(node->node());
 
 		if (node->isContent()) {
@@ -83,13 +229,13 @@ namespace Morpheus {
 			if (factory) {
 				factory->unload(node);
 
-				std::string src;
+				Atom src;
 				if (mSources.tryFind(node->node(), &src))
-					std::cout << "Unloading " << src << " (" << 
-						factory->getContentTypeString() << ")..." << std::endl;
+					logInfo() << "Unloading " << src.str() << " (" << 
+						factory->getContentTypeString() << ")...";
 				else
-					std::cout << "Unloading [UNNAMED] (" << 
-						factory->getContentTypeString()  << ")..." << std::endl;
+					logInfo() << "Unloading [UNNAMED] (" << 
+						factory->getContentTypeString()  << ")...";
 			}
 			else {
 				throw std::runtime_error("Could not find factory for object!");
@@ -111,39 +257,113 @@ namespace Morpheus {
 	}
 	
 	void ContentManager::collectGarbage() {
-		std::set<INodeOwner*> toCollect;
-
-		// Iterate through children and calculate degrees
+		// Content that never had a user is not released by the graph, so look for it
 		for (auto it = children(); it.valid(); it.next()) {
-			auto degree = it()->inDegree();
-
 			// The only parent of this object is the content manager, collect it
-			if (degree == 1)
-				toCollect.emplace(it());
+			if (it()->inDegree() == 1)
+				markForUnload(it());
 		}
-		
-		// Repeatedly collect until there is nothing to collect
-		while (!toCollect.empty()) {
-
-			auto top = *toCollect.begin();
-			toCollect.erase(top);
-
-			auto type = top->getType();
-			std::cout << "Collecting " << nodeTypeString(type) << std::endl;
-
-			// Check if children of this node need to be collected too
-			for (auto it = top->children(); it.valid(); it.next()) {
-				auto child = it();
-				auto newDegree = child->inDegree() - 1;
-				if (newDegree <= 1)
-					toCollect.emplace(it());
-			}
 
-			// Collect garbage
-			unload(top);
+		drainCollectQueue(-1.0);
+	}
+
+	bool ContentManager::cacheRelease(INodeOwner* node) {
+		if (mCacheBudget == 0 || !node->isContent())
+			return false;
+
+		// Already cached, collection does not count as a use
+		if (mCacheEntries.find(node) != mCacheEntries.end())
+			return true;
+
+		// Content without a source can never be loaded again
+		Atom src;
+		if (!mSources.tryFind(node->node(), &src))
+			return false;
+
+		ContentSize size = sizeOf(node);
+		if (size.total() > mCacheBudget)
+			return false;
+
+		mCacheOrder.push_front(node);
+		mCacheEntries[node] = CacheEntry{ mCacheOrder.begin(), size };
+		mCacheStats.mBytes += size.total();
+		++mCacheStats.mEntries;
+		return true;
+	}
+
+	void ContentManager::cacheRevive(INodeOwner* node) {
+		auto cached = mCacheEntries.find(node);
+		if (cached == mCacheEntries.end())
+			return;
+
+		mCacheStats.mBytes -= cached->second.mSize.total();
+		--mCacheStats.mEntries;
+		++mCacheStats.mHits;
+		mCacheOrder.erase(cached->second.mPosition);
+		mCacheEntries.erase(cached);
+	}
+
+	void ContentManager::trimCache() {
+		while (mCacheStats.mBytes > mCacheBudget && !mCacheOrder.empty()) {
+			// Children that the evicted node was the last user of are queued by the graph
+			++mCacheStats.mEvictions;
+			unload(mCacheOrder.back());
+		}
+	}
+
+	void ContentManager::setCacheBudget(size_t bytes) {
+		mCacheBudget = bytes;
+
+		glDeleteQueue()->beginBatch();
+		trimCache();
+		glDeleteQueue()->endBatch();
+		unloadMarked();
+	}
+
+	void ContentManager::clearCache() {
+		size_t budget = mCacheBudget;
+		setCacheBudget(0);
+		mCacheBudget = budget;
+	}
+
+	ContentSize ContentManager::sizeOf(INodeOwner* node) {
+		if (!node->isContent())
+			return ContentSize{0, 0};
+
+		auto factory = mTypeToFactory.find(node->getType());
+		if (factory == mTypeToFactory.end() || !factory->second)
+			return ContentSize{0, 0};
+
+		return factory->second->measure(node);
+	}
+
+	std::map<std::string, ContentResidency> ContentManager::residency() {
+		std::map<std::string, ContentResidency> result;
+
+		for (auto it = children(); it.valid(); it.next()) {
+			auto node = it();
+			if (!node->isContent())
+				continue;
+
+			auto factory = mTypeToFactory.find(node->getType());
+			if (factory == mTypeToFactory.end() || !factory->second)
+				continue;
+
+			auto entry = result.find(factory->second->getContentTypeString());
+			if (entry == result.end())
+				entry = result.emplace(factory->second->getContentTypeString(),
+					ContentResidency{0, ContentSize{0, 0}, 0, ContentSize{0, 0}}).first;
+
+			ContentSize size = factory->second->measure(node);
+			++entry->second.mCount;
+			entry->second.mSize += size;
+
+			if (mCacheEntries.find(node) != mCacheEntries.end()) {
+				++entry->second.mCachedCount;
+				entry->second.mCachedSize += size;
+			}
 		}
 
-		// All marked nodes have been dealt with
-		mMarkedNodes = std::set<INodeOwner*>();
+		return result;
 	}
 }
\ No newline at end of file
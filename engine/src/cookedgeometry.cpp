@@ -0,0 +1,358 @@
+#include <engine/cookedgeometry.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace Morpheus {
+
+	void packGeometryLevel(const GeometryBuffers& buffers, const VertexFormat& format,
+		float error, CookedGeometryLevel* output) {
+
+		packVertices(buffers.mVertices.empty() ? nullptr : &buffers.mVertices[0],
+			buffers.mVertexCount, buffers.mStride, buffers.mAttributes, format,
+			buffers.mAabb, &output->mVertices);
+
+		output->mVertexCount = buffers.mVertexCount;
+		output->mIndexCount = (uint32_t)buffers.mIndices.size();
+		output->mAabb = buffers.mAabb;
+		output->mError = error;
+
+		if (format.bShortIndices && buffers.mVertexCount <= 65536) {
+			output->mIndexType = GL_UNSIGNED_SHORT;
+			output->mIndices.resize(buffers.mIndices.size() * sizeof(uint16_t));
+			auto dest = reinterpret_cast<uint16_t*>(output->mIndices.data());
+			for (size_t i = 0; i < buffers.mIndices.size(); ++i)
+				dest[i] = static_cast<uint16_t>(buffers.mIndices[i]);
+		}
+		else {
+			output->mIndexType = GL_UNSIGNED_INT;
+			output->mIndices.resize(buffers.mIndices.size() * sizeof(uint32_t));
+			if (!buffers.mIndices.empty())
+				std::memcpy(output->mIndices.data(), &buffers.mIndices[0], output->mIndices.size());
+		}
+	}
+
+	struct BVHBuilder {
+		std::vector<BoundingBox> mTriangleBoxes;
+		std::vector<glm::vec3> mCentroids;
+		std::vector<CookedBVHNode>* mNodes;
+		std::vector<uint32_t>* mTriangles;
+		uint32_t mMaxLeafSize;
+
+		uint32_t build(uint32_t first, uint32_t count) {
+			uint32_t id = (uint32_t)mNodes->size();
+			mNodes->emplace_back();
+
+			BoundingBox box = BoundingBox::empty();
+			BoundingBox centroidBox = BoundingBox::empty();
+			for (uint32_t i = first; i < first + count; ++i) {
+				auto tri = (*mTriangles)[i];
+				box.mLower = glm::min(box.mLower, mTriangleBoxes[tri].mLower);
+				box.mUpper = glm::max(box.mUpper, mTriangleBoxes[tri].mUpper);
+				centroidBox.mergeInPlace(mCentroids[tri]);
+			}
+
+			(*mNodes)[id].mAabb = box;
+
+			if (count <= mMaxLeafSize) {
+				(*mNodes)[id].mFirst = first;
+				(*mNodes)[id].mCount = count;
+				return id;
+			}
+
+			// Split at the median centroid along the longest axis
+			glm::vec3 extent = centroidBox.mUpper - centroidBox.mLower;
+			int axis = 0;
+			if (extent.y > extent[axis])
+				axis = 1;
+			if (extent.z > extent[axis])
+				axis = 2;
+
+			auto begin = mTriangles->begin() + first;
+			uint32_t half = count / 2;
+			std::nth_element(begin, begin + half, begin + count,
+				[this, axis](uint32_t a, uint32_t b) {
+				return mCentroids[a][axis] < mCentroids[b][axis];
+			});
+
+			// The left child is always the next node
+			build(first, half);
+			uint32_t right = build(first + half, count - half);
+
+			(*mNodes)[id].mFirst = right;
+			(*mNodes)[id].mCount = 0;
+			return id;
+		}
+	};
+
+	void buildTriangleBVH(const GeometryBuffers& buffers, uint32_t maxLeafSize,
+		std::vector<CookedBVHNode>* nodes, std::vector<uint32_t>* triangles) {
+		nodes->clear();
+		triangles->clear();
+
+		uint32_t triangleCount = (uint32_t)(buffers.mIndices.size() / 3);
+		if (buffers.mPositionOffset < 0 || triangleCount == 0)
+			return;
+
+		BVHBuilder builder;
+		builder.mNodes = nodes;
+		builder.mTriangles = triangles;
+		builder.mMaxLeafSize = std::max(maxLeafSize, 1u);
+		builder.mTriangleBoxes.resize(triangleCount);
+		builder.mCentroids.resize(triangleCount);
+
+		auto position = [&buffers](uint32_t vertex) {
+			const float* p = &buffers.mVertices[(size_t)vertex * buffers.mStride + buffers.mPositionOffset];
+			return glm::vec3(p[0], p[1], p[2]);
+		};
+
+		for (uint32_t i = 0; i < triangleCount; ++i) {
+			auto v0 = position(buffers.mIndices[3 * i]);
+			auto v1 = position(buffers.mIndices[3 * i + 1]);
+			auto v2 = position(buffers.mIndices[3 * i + 2]);
+			builder.mTriangleBoxes[i] = BoundingBox(glm::min(v0, glm::min(v1, v2)),
+				glm::max(v0, glm::max(v1, v2)));
+			builder.mCentroids[i] = (v0 + v1 + v2) / 3.0f;
+		}
+
+		triangles->resize(triangleCount);
+		for (uint32_t i = 0; i < triangleCount; ++i)
+			(*triangles)[i] = i;
+
+		nodes->reserve(2 * (triangleCount / builder.mMaxLeafSize) + 1);
+		builder.build(0, triangleCount);
+	}
+
+	inline uint64_t alignOffset(uint64_t offset) {
+		return (offset + COOKED_GEOMETRY_ALIGNMENT - 1) / COOKED_GEOMETRY_ALIGNMENT * COOKED_GEOMETRY_ALIGNMENT;
+	}
+
+	bool writeCookedGeometry(const std::string& path, const CookedGeometry& geometry) {
+		if (geometry.mLevels.empty()) {
+			std::cout << "Error: cannot write " << path << " without any geometry!" << std::endl;
+			return false;
+		}
+
+		CookedGeometryHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.mMagic = COOKED_GEOMETRY_MAGIC;
+		header.mVersion = COOKED_GEOMETRY_VERSION;
+		header.mPositionFormat = (uint32_t)geometry.mFormat.mPositions;
+		header.mNormalFormat = (uint32_t)geometry.mFormat.mNormals;
+		header.mUVFormat = (uint32_t)geometry.mFormat.mUVs;
+		header.mShortIndices = geometry.mFormat.bShortIndices ? 1 : 0;
+		header.mLevelCount = (uint32_t)geometry.mLevels.size();
+		header.mBvhNodeCount = (uint32_t)geometry.mBvhNodes.size();
+		header.mBvhTriangleCount = geometry.mBvhTriangles.size();
+
+		// Lay out all sections before writing anything
+		uint64_t offset = alignOffset(sizeof(CookedGeometryHeader));
+		header.mLevelOffset = offset;
+		offset = alignOffset(offset + sizeof(CookedGeometryLevelHeader) * geometry.mLevels.size());
+
+		std::vector<CookedGeometryLevelHeader> levels(geometry.mLevels.size());
+		for (size_t i = 0; i < geometry.mLevels.size(); ++i) {
+			auto& level = geometry.mLevels[i];
+			auto& levelHeader = levels[i];
+			levelHeader.mReserved = 0;
+			levelHeader.mPositionDecode = level.mVertices.mPositionDecode;
+			levelHeader.mAabb = level.mAabb;
+			levelHeader.mError = level.mError;
+			levelHeader.mVertexCount = level.mVertexCount;
+			levelHeader.mVertexStride = level.mVertices.mStride;
+			levelHeader.mIndexCount = level.mIndexCount;
+			levelHeader.mIndexType = level.mIndexType;
+			levelHeader.mAttributeCount = (uint32_t)level.mVertices.mAttributes.size();
+
+			levelHeader.mAttributeOffset = offset;
+			offset = alignOffset(offset + sizeof(CookedVertexAttribute) * levelHeader.mAttributeCount);
+			levelHeader.mVertexOffset = offset;
+			levelHeader.mVertexSize = level.mVertices.mData.size();
+			offset = alignOffset(offset + levelHeader.mVertexSize);
+			levelHeader.mIndexOffset = offset;
+			levelHeader.mIndexSize = level.mIndices.size();
+			offset = alignOffset(offset + levelHeader.mIndexSize);
+		}
+
+		header.mBvhNodeOffset = offset;
+		offset = alignOffset(offset + sizeof(CookedBVHNode) * geometry.mBvhNodes.size());
+		header.mBvhTriangleOffset = offset;
+		offset = alignOffset(offset + sizeof(uint32_t) * geometry.mBvhTriangles.size());
+
+		std::vector<uint8_t> file(offset, 0);
+		auto put = [&file](uint64_t at, const void* data, size_t size) {
+			if (size > 0)
+				std::memcpy(&file[at], data, size);
+		};
+
+		put(0, &header, sizeof(header));
+		put(header.mLevelOffset, levels.data(), sizeof(CookedGeometryLevelHeader) * levels.size());
+
+		for (size_t i = 0; i < geometry.mLevels.size(); ++i) {
+			auto& level = geometry.mLevels[i];
+			auto& levelHeader = levels[i];
+
+			std::vector<CookedVertexAttribute> attributes(levelHeader.mAttributeCount);
+			for (size_t j = 0; j < attributes.size(); ++j) {
+				auto& attribute = level.mVertices.mAttributes[j];
+				attributes[j].mLocation = attribute.mLocation;
+				attributes[j].mComponents = attribute.mComponents;
+				attributes[j].mType = attribute.mType;
+				attributes[j].mNormalized = attribute.bNormalized ? 1 : 0;
+				attributes[j].mOffset = attribute.mOffset;
+			}
+
+			put(levelHeader.mAttributeOffset, attributes.data(), sizeof(CookedVertexAttribute) * attributes.size());
+			put(levelHeader.mVertexOffset, level.mVertices.mData.data(), level.mVertices.mData.size());
+			put(levelHeader.mIndexOffset, level.mIndices.data(), level.mIndices.size());
+		}
+
+		put(header.mBvhNodeOffset, geometry.mBvhNodes.data(), sizeof(CookedBVHNode) * geometry.mBvhNodes.size());
+		put(header.mBvhTriangleOffset, geometry.mBvhTriangles.data(), sizeof(uint32_t) * geometry.mBvhTriangles.size());
+
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		if (!f.is_open()) {
+			std::cout << "Error: failed to open " << path << " for writing!" << std::endl;
+			return false;
+		}
+		f.write(reinterpret_cast<const char*>(file.data()), file.size());
+		if (!f.good()) {
+			std::cout << "Error: failed to write " << path << "!" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::string cookedGeometryPath(const std::string& source) {
+		auto slash = source.find_last_of("\\/");
+		auto dot = source.find_last_of('.');
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return source + COOKED_GEOMETRY_EXTENSION;
+		return source.substr(0, dot) + COOKED_GEOMETRY_EXTENSION;
+	}
+
+	bool isCookedGeometryPath(const std::string& path) {
+		const std::string extension = COOKED_GEOMETRY_EXTENSION;
+		return path.length() >= extension.length() &&
+			path.compare(path.length() - extension.length(), extension.length(), extension) == 0;
+	}
+
+	bool isCookedGeometryFresh(const std::string& source, const std::string& cooked) {
+		std::error_code sourceError;
+		std::error_code cookedError;
+		auto sourceTime = std::filesystem::last_write_time(source, sourceError);
+		auto cookedTime = std::filesystem::last_write_time(cooked, cookedError);
+
+		// Without a source, any cooked file is better than nothing
+		if (cookedError)
+			return false;
+		if (sourceError)
+			return true;
+		return cookedTime >= sourceTime;
+	}
+
+	bool CookedGeometryFile::open(const std::string& path) {
+		close();
+
+		if (!mFile.open(path))
+			return false;
+
+		if (mFile.size() < sizeof(CookedGeometryHeader)) {
+			mFile.close();
+			return false;
+		}
+
+		mHeader = reinterpret_cast<const CookedGeometryHeader*>(mFile.data());
+		mLevels = reinterpret_cast<const CookedGeometryLevelHeader*>(mFile.data() + mHeader->mLevelOffset);
+
+		if (!validate()) {
+			std::cout << "Warning: " << path << " is not a valid cooked geometry file!" << std::endl;
+			close();
+			return false;
+		}
+
+		return true;
+	}
+
+	// returns: Whether every index is below the vertex count.
+	template <typename IndexType>
+	bool indicesInRange(const uint8_t* data, uint32_t indexCount, uint32_t vertexCount) {
+		auto indices = reinterpret_cast<const IndexType*>(data);
+		IndexType largest = 0;
+		for (uint32_t i = 0; i < indexCount; ++i)
+			largest = std::max(largest, indices[i]);
+		return indexCount == 0 || (uint64_t)largest < vertexCount;
+	}
+
+	bool CookedGeometryFile::validate() const {
+		if (mHeader->mMagic != COOKED_GEOMETRY_MAGIC || mHeader->mVersion != COOKED_GEOMETRY_VERSION)
+			return false;
+
+		const uint64_t size = mFile.size();
+		auto inFile = [size](uint64_t offset, uint64_t count, uint64_t elementSize) {
+			return offset % alignof(uint64_t) == 0 && offset <= size &&
+				(elementSize == 0 || count <= (size - offset) / elementSize);
+		};
+
+		if (mHeader->mLevelCount == 0 ||
+			!inFile(mHeader->mLevelOffset, mHeader->mLevelCount, sizeof(CookedGeometryLevelHeader)))
+			return false;
+
+		for (uint32_t i = 0; i < mHeader->mLevelCount; ++i) {
+			auto& level = mLevels[i];
+			uint64_t indexSize = level.mIndexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+			if (!inFile(level.mAttributeOffset, level.mAttributeCount, sizeof(CookedVertexAttribute)) ||
+				!inFile(level.mVertexOffset, level.mVertexSize, 1) ||
+				!inFile(level.mIndexOffset, level.mIndexSize, 1) ||
+				level.mVertexSize != (uint64_t)level.mVertexCount * level.mVertexStride ||
+				level.mIndexSize != (uint64_t)level.mIndexCount * indexSize ||
+				(level.mIndexType != GL_UNSIGNED_SHORT && level.mIndexType != GL_UNSIGNED_INT))
+				return false;
+
+			// Indices are uploaded as they are, an out of range index would make the GPU
+			// fetch past the end of the vertex buffer
+			const uint8_t* indices = mFile.data() + level.mIndexOffset;
+			bool bInRange = level.mIndexType == GL_UNSIGNED_SHORT ?
+				indicesInRange<uint16_t>(indices, level.mIndexCount, level.mVertexCount) :
+				indicesInRange<uint32_t>(indices, level.mIndexCount, level.mVertexCount);
+			if (!bInRange)
+				return false;
+		}
+
+		return inFile(mHeader->mBvhNodeOffset, mHeader->mBvhNodeCount, sizeof(CookedBVHNode)) &&
+			inFile(mHeader->mBvhTriangleOffset, mHeader->mBvhTriangleCount, sizeof(uint32_t));
+	}
+
+	void CookedGeometryFile::close() {
+		mFile.close();
+		mHeader = nullptr;
+		mLevels = nullptr;
+	}
+
+	VertexFormat CookedGeometryFile::format() const {
+		VertexFormat format;
+		format.mPositions = (VertexPositionFormat)mHeader->mPositionFormat;
+		format.mNormals = (VertexNormalFormat)mHeader->mNormalFormat;
+		format.mUVs = (VertexUVFormat)mHeader->mUVFormat;
+		format.bShortIndices = mHeader->mShortIndices != 0;
+		return format;
+	}
+
+	std::vector<PackedVertexAttribute> CookedGeometryFile::attributes(uint32_t level) const {
+		auto& levelHeader = mLevels[level];
+		auto cooked = reinterpret_cast<const CookedVertexAttribute*>(mFile.data() + levelHeader.mAttributeOffset);
+
+		std::vector<PackedVertexAttribute> result(levelHeader.mAttributeCount);
+		for (uint32_t i = 0; i < levelHeader.mAttributeCount; ++i) {
+			result[i].mLocation = cooked[i].mLocation;
+			result[i].mComponents = cooked[i].mComponents;
+			result[i].mType = cooked[i].mType;
+			result[i].bNormalized = cooked[i].mNormalized ? GL_TRUE : GL_FALSE;
+			result[i].mOffset = cooked[i].mOffset;
+		}
+		return result;
+	}
+}
@@ -41,6 +41,7 @@ namespace Morpheus {
 	TransformNode* INodeOwner::toTransform()			{ return nullptr; }
 	Skybox* INodeOwner::toSkybox()						{ return nullptr; }
 	Framebuffer* INodeOwner::toFramebuffer() 			{ return nullptr; }
+	Occluder* INodeOwner::toOccluder()					{ return nullptr; }
 
 	TransformNode* TransformNode::toTransform() 		{ return this; }
 
@@ -109,6 +110,7 @@ namespace Morpheus {
 			T_CASE(HALF_EDGE_GEOMETRY);
 			T_CASE(SAMPLER);
 			T_CASE(SKYBOX);
+			T_CASE(OCCLUDER);
 			T_CASE(END);
 		default:
 			return "UNKNOWN";
@@ -207,15 +209,62 @@ namespace Morpheus {
 
 	void NodeGraph::applyVertexMap(const int map[], const uint32_t mapLen, const uint32_t newSize) {
 
-		// Update all owners
+		// Update all owners, before the base moves them to their new slots. The registries
+		// hold owners and the back indices are vertex data, so both follow along.
 		for (uint32_t i = 0; i < mapLen; ++i) {
-			mOwners[i]->mNodeId = map[mOwners[i]->mNodeId];
+			if (map[i] >= 0 && mOwners[i])
+				mOwners[i]->mNodeId = map[i];
 		}
 
 		// Call base
 		Digraph::applyVertexMap(map, mapLen, newSize);
 	}
 
+	void NodeGraph::registerNode(INodeOwner* owner) {
+		int v = owner->mNodeId;
+		// The vertex may have been given another owner before
+		unregisterNode(v);
+
+		auto type = owner->getType();
+		if (type >= NodeType::END)
+			return;
+
+		auto& registry = mRegistry[(uint32_t)type];
+		mRegistrations[v] = NodeRegistration{ type, (uint32_t)registry.size() };
+		registry.push_back(owner);
+	}
+
+	void NodeGraph::unregisterNode(int v) {
+		auto registration = mRegistrations[v];
+		if (registration.mType == NodeType::END)
+			return;
+
+		// Swap the last node into the hole, the node being removed may already be deleted
+		// but the one being moved is still alive
+		auto& registry = mRegistry[(uint32_t)registration.mType];
+		if (registration.mIndex + 1 < registry.size()) {
+			INodeOwner* last = registry.back();
+			registry[registration.mIndex] = last;
+			mRegistrations[last->mNodeId].mIndex = registration.mIndex;
+		}
+		registry.pop_back();
+
+		mRegistrations[v] = NodeRegistration();
+	}
+
+	void NodeGraph::onVertexDeleted(int v) {
+		unregisterNode(v);
+	}
+
+	void NodeGraph::onEdgeDeleted(int tail, int head) {
+		if (!mReleaseListener)
+			return;
+
+		INodeOwner* owner = mOwners[head];
+		if (owner && owner->inDegree() <= 1)
+			mReleaseListener(owner);
+	}
+
 	void init(INodeOwner* node)
 	{
 		// Content doesn't belong to a scene and therefore shouldn't be initializable
@@ -259,7 +308,8 @@ namespace Morpheus {
 			}
 		}
 
-		if (bTopLevel)
+		// Otherwise the content manager collects marked content over the next frames
+		if (bTopLevel && !content()->collectParameters().bIncremental)
 			unloadMarked();
 	}
 
@@ -0,0 +1,130 @@
+#include <engine/derivedcache.hpp>
+#include <engine/mappedfile.hpp>
+#include <engine/log.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+namespace Morpheus {
+
+	inline uint64_t mixHash(uint64_t h) {
+		// Finalizer of MurmurHash3
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+		const uint64_t prime = 0x100000001b3ull;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t h = seed ^ 0xcbf29ce484222325ull ^ (size * prime);
+
+		// Eight bytes at a time, then the remainder
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, sizeof(word));
+			h = (h ^ mixHash(word)) * prime;
+		}
+
+		uint64_t tail = 0;
+		if (size > i)
+			std::memcpy(&tail, bytes + i, size - i);
+		h = (h ^ mixHash(tail)) * prime;
+
+		return mixHash(h);
+	}
+
+	bool hashFile(const std::string& path, uint64_t* hash) {
+		MappedFile file;
+		if (file.open(path)) {
+			*hash = hashBytes(file.data(), file.size());
+			return true;
+		}
+
+		// Empty files cannot be mapped
+		std::ifstream f(path, std::ios::binary);
+		if (!f.is_open())
+			return false;
+		*hash = hashBytes(nullptr, 0);
+		return true;
+	}
+
+	std::string toHex(uint64_t value) {
+		std::stringstream ss;
+		ss << std::hex << std::setw(16) << std::setfill('0') << value;
+		return ss.str();
+	}
+
+	DerivedDataCache::DerivedDataCache(const std::string& root) : mRoot(root) {
+		if (!mRoot.empty() && mRoot.back() != '/' && mRoot.back() != '\\')
+			mRoot += '/';
+	}
+
+	bool DerivedDataCache::makeKey(const std::string& source, const std::string& parameters,
+		std::string* key) const {
+		uint64_t sourceHash;
+		if (!hashFile(source, &sourceHash))
+			return false;
+
+		std::string versioned = parameters + "|" + std::to_string(DERIVED_DATA_VERSION);
+		uint64_t parameterHash = hashBytes(versioned.data(), versioned.size());
+
+		*key = toHex(sourceHash) + "-" + toHex(parameterHash);
+		return true;
+	}
+
+	std::string DerivedDataCache::path(const std::string& key, const std::string& extension) const {
+		// Fan out into subdirectories so that no single directory gets too large
+		return mRoot + key.substr(0, 2) + "/" + key + extension;
+	}
+
+	bool DerivedDataCache::find(const std::string& source, const std::string& parameters,
+		const std::string& extension, std::string* cachedPath) const {
+		std::string key;
+		if (!makeKey(source, parameters, &key))
+			return false;
+
+		std::string entry = path(key, extension);
+		std::ifstream f(entry, std::ios::binary);
+		if (!f.is_open())
+			return false;
+
+		*cachedPath = entry;
+		return true;
+	}
+
+	bool readContentJson(const std::string& source, const DerivedDataCache* cache, nlohmann::json* j) {
+		std::string cachedPath;
+		if (cache && cache->find(source, DERIVED_JSON_PARAMETERS, DERIVED_JSON_EXTENSION, &cachedPath)) {
+			MappedFile file;
+			if (file.open(cachedPath)) {
+				try {
+					*j = nlohmann::json::from_msgpack(file.data(), file.data() + file.size());
+					return true;
+				} catch (const nlohmann::json::exception& e) {
+					// A truncated or corrupt entry, drop it and read the source instead
+					logWarning() << cachedPath << " is not a valid cache entry (" << e.what() << "), removing it!";
+					file.close();
+					std::error_code err;
+					std::filesystem::remove(cachedPath, err);
+				}
+			}
+		}
+
+		std::ifstream f(source);
+		if (!f.is_open())
+			return false;
+
+		f >> *j;
+		f.close();
+		return true;
+	}
+}
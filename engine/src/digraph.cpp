@@ -1,5 +1,8 @@
 #include <engine/digraph.hpp>
 #include <engine/mapcpy.hpp>
+#include <engine/log.hpp>
+
+#include <algorithm>
 
 #define DEFAULT_GRAPH_VERTEX_COUNT 128
 #define DEFAULT_GRAPH_EDGE_COUNT 128
@@ -15,10 +18,10 @@ namespace Morpheus {
 		delete[] mVertices;
 		delete[] mEdges;
 
-		for (auto& data : mVertexDatas)
-			delete data.second;
-		for (auto& data : mEdgeDatas)
-			delete data.second;
+		for (auto data : mVertexDatas)
+			delete data;
+		for (auto data : mEdgeDatas)
+			delete data;
 		for (auto& lookup : mVertexLookups)
 			delete lookup.second;
 		for (auto& lookup : mEdgeLookups)
@@ -34,8 +37,14 @@ namespace Morpheus {
 		mEdgeCount(0),
 		mVertexCount(0),
 		mDatasCreated(0),
-		mLookupsCreated(0)
+		mLookupsCreated(0),
+		mVersion(0),
+		mMultiEdgePolicy(DigraphMultiEdgePolicy::ALLOW),
+		bEdgeIndex(false)
 	{
+		mFrozen.mVersion = 0;
+		mFrozen.bBuilt = false;
+
 		mVertices = new DigraphVertexRaw[reserveVertices];
 		mVertexReserve = reserveVertices;
 		mEdges = new DigraphEdgeRaw[reserveEdges];
@@ -49,8 +58,9 @@ namespace Morpheus {
 		mVertices = newMem;
 		mVertexReserve = newSize;
 
-		for (auto& data : mVertexDatas)
-			data.second->resize(newSize);
+		for (auto data : mVertexDatas)
+			if (data)
+				data->resize(newSize);
 	}
 
 	void Digraph::resizeEdges(uint32_t newSize) {
@@ -60,26 +70,58 @@ namespace Morpheus {
 		mEdges = newMem;
 		mEdgeReserve = newSize;
 
-		for (auto& data : mEdgeDatas)
-			data.second->resize(newSize);
+		for (auto data : mEdgeDatas)
+			if (data)
+				data->resize(newSize);
 	}
 
 	void Digraph::applyVertexMap(const int map[], const uint32_t mapLen, const uint32_t newSize) {
-		for (auto& data : mVertexDatas)
-			data.second->compress(map, mapLen, newSize);
+		for (auto data : mVertexDatas)
+			if (data)
+				data->compress(map, mapLen, newSize);
 
 		for (auto& lookup : mVertexLookups)
 			lookup.second->applyMap(map, mapLen);
 	}
 
 	void Digraph::applyEdgeMap(const int map[], const uint32_t mapLen, const uint32_t newSize) {
-		for (auto& data : mEdgeDatas)
-			data.second->compress(map, mapLen, newSize);
+		for (auto data : mEdgeDatas)
+			if (data)
+				data->compress(map, mapLen, newSize);
 
 		for (auto& lookup : mEdgeLookups)
 			lookup.second->applyMap(map, mapLen);
 	}
 
+	uint32_t Digraph::registerData(IDigraphData* data, std::vector<IDigraphData*>* datas,
+		FlatHashMap<uint64_t, uint32_t>* names) {
+		uint32_t index = (uint32_t)datas->size();
+		datas->push_back(data);
+		data->mIndex = index;
+
+		auto name = data->name();
+		auto it = names->find(digraphHash(name));
+		if (it != names->end()) {
+			auto existing = (*datas)[it->second];
+			if (existing && existing->name() != name)
+				logWarning() << "attachment names " << existing->name() << " and " <<
+					name << " have the same hash, " << existing->name() << " can only be accessed by handle!";
+		}
+		// A new attachment with the name of an existing one takes over the name
+		(*names)[digraphHash(name)] = index;
+		++mDatasCreated;
+		return index;
+	}
+
+	void Digraph::unregisterData(IDigraphData* data, std::vector<IDigraphData*>* datas,
+		FlatHashMap<uint64_t, uint32_t>* names) {
+		auto it = names->find(digraphHash(data->name()));
+		if (it != names->end() && it->second == data->mIndex)
+			names->erase(it);
+		// Indices are never reused, so a stale handle cannot alias a newer attachment
+		(*datas)[data->mIndex] = nullptr;
+	}
+
 	DigraphVertex Digraph::createVertex() {
 		if (mFirstUnusedVertex != -1) {
 			auto next = mVertices[mFirstUnusedVertex].mOutEdge;
@@ -87,9 +129,12 @@ namespace Morpheus {
 
 			mVertices[id].mInEdge = -1;
 			mVertices[id].mOutEdge = -1;
+			mVertices[id].mInDegree = 0;
+			mVertices[id].mOutDegree = 0;
 
 			mFirstUnusedVertex = next;
 			mVertexCount++;
+			++mVersion;
 			return DigraphVertex(this, id);
 		}
 		else {
@@ -99,13 +144,23 @@ namespace Morpheus {
 
 			mVertices[mVertexCount].mInEdge = -1;
 			mVertices[mVertexCount].mOutEdge = -1;
+			mVertices[mVertexCount].mInDegree = 0;
+			mVertices[mVertexCount].mOutDegree = 0;
 			mVertexActiveBlock++;
+			++mVersion;
 			return DigraphVertex(this, mVertexCount++);
 		}
 	}
 
 	DigraphEdge Digraph::createEdge(int tail, int head) {
 
+		DigraphEdgeIndexEntry* indexEntry = nullptr;
+		if (bEdgeIndex) {
+			indexEntry = &mEdgeIndex[edgeKey(tail, head)];
+			if (indexEntry->mCount > 0 && mMultiEdgePolicy == DigraphMultiEdgePolicy::UNIQUE)
+				return DigraphEdge(this, indexEntry->mEdge);
+		}
+
 		int id;
 		if (mFirstUnusedEdge != -1) {
 			auto next = mEdges[mFirstUnusedEdge].mNext;
@@ -135,17 +190,28 @@ namespace Morpheus {
 		if (oldEdge != -1)
 			mEdges[oldEdge].mDualPrev = id;
 		mVertices[head].mInEdge = id;
+		mVertices[tail].mOutDegree++;
+		mVertices[head].mInDegree++;
+
+		if (indexEntry) {
+			indexEntry->mEdge = id;
+			indexEntry->mCount++;
+		}
 
 		mEdgeCount++;
+		++mVersion;
 
 		return DigraphEdge(this, id);
 	}
 
 	void Digraph::deleteVertex(DigraphVertex v) {
+		onVertexDeleted(v.id());
+
+		// Nobody needs to hear about the vertex losing its parents
 		for (auto inIt = v.incomming(); inIt.valid(); ) {
 			auto e = inIt();
 			inIt.next();
-			deleteEdge(e);
+			unlinkEdge(e.id());
 		}
 
 		for (auto outIt = v.outgoing(); outIt.valid(); ) {
@@ -161,6 +227,7 @@ namespace Morpheus {
 		mFirstUnusedVertex = id;
 
 		--mVertexCount;
+		++mVersion;
 	}
 
 	void Digraph::deleteVertex(int v) {
@@ -169,7 +236,13 @@ namespace Morpheus {
 	}
 
 	void Digraph::deleteEdge(DigraphEdge e) {
-		auto id = e.id();
+		auto head = mEdges[e.id()].mHead;
+		auto tail = mEdges[e.id()].mTail;
+		unlinkEdge(e.id());
+		onEdgeDeleted(tail, head);
+	}
+
+	void Digraph::unlinkEdge(int id) {
 		auto head = mEdges[id].mHead;
 		auto tail = mEdges[id].mTail;
 
@@ -188,43 +261,228 @@ namespace Morpheus {
 		if (mEdges[id].mDualNext != -1)
 			mEdges[mEdges[id].mDualNext].mDualPrev = mEdges[id].mDualPrev;
 
+		mVertices[tail].mOutDegree--;
+		mVertices[head].mInDegree--;
+
 		// Send edge to graveyard
 		mEdges[id].mNext = mFirstUnusedEdge;
 		mEdges[id].mPrev = GRAVEYARD_FLAG;
 		mFirstUnusedEdge = id;
 
+		if (bEdgeIndex) {
+			auto it = mEdgeIndex.find(edgeKey(tail, head));
+			assert(it != mEdgeIndex.end());
+			if (--it->second.mCount == 0)
+				mEdgeIndex.erase(it);
+			else if (it->second.mEdge == id)
+				// Only multi-edges get here, the edge is already out of the lists
+				it->second.mEdge = scanEdge(tail, head);
+		}
+
 		--mEdgeCount;
+		++mVersion;
 	}
 
-	void Digraph::compress(bool bTight)
-	{
-		int* vmap = new int[mVertexActiveBlock];
-		int* emap = new int[mEdgeActiveBlock];
+	int Digraph::scanEdge(int tail, int head) const {
+		if (mVertices[tail].mOutDegree <= mVertices[head].mInDegree) {
+			for (int e = mVertices[tail].mOutEdge; e != -1; e = mEdges[e].mNext)
+				if (mEdges[e].mHead == head)
+					return e;
+		}
+		else {
+			for (int e = mVertices[head].mInEdge; e != -1; e = mEdges[e].mDualNext)
+				if (mEdges[e].mTail == tail)
+					return e;
+		}
+		return -1;
+	}
+
+	DigraphEdge Digraph::findEdge(int tail, int head) {
+		if (bEdgeIndex) {
+			auto it = mEdgeIndex.find(edgeKey(tail, head));
+			return DigraphEdge(this, it == mEdgeIndex.end() ? -1 : it->second.mEdge);
+		}
+		return DigraphEdge(this, scanEdge(tail, head));
+	}
+
+	bool Digraph::deleteEdge(int tail, int head) {
+		auto e = findEdge(tail, head);
+		if (e.id() == -1)
+			return false;
+		deleteEdge(e);
+		return true;
+	}
+
+	void Digraph::rebuildEdgeIndex() {
+		mEdgeIndex.clear();
+		mEdgeIndex.reserve(mEdgeCount);
+		for (uint32_t e = 0; e < mEdgeActiveBlock; ++e) {
+			if (mEdges[e].mPrev == GRAVEYARD_FLAG)
+				continue;
+			auto& entry = mEdgeIndex[edgeKey(mEdges[e].mTail, mEdges[e].mHead)];
+			entry.mEdge = (int)e;
+			entry.mCount++;
+		}
+	}
+
+	void Digraph::enableEdgeIndex(DigraphMultiEdgePolicy policy) {
+		mMultiEdgePolicy = policy;
+		if (!bEdgeIndex) {
+			bEdgeIndex = true;
+			rebuildEdgeIndex();
+		}
+	}
+
+	void Digraph::disableEdgeIndex() {
+		bEdgeIndex = false;
+		mMultiEdgePolicy = DigraphMultiEdgePolicy::ALLOW;
+		mEdgeIndex = FlatHashMap<uint64_t, DigraphEdgeIndexEntry>();
+	}
 
-		uint32_t new_v = 0;
+	void Digraph::compress(bool bTight) {
+		compress(DigraphOrder::ID, std::vector<int>(), bTight);
+	}
+
+	void Digraph::orderVertices(DigraphOrder order, const std::vector<int>& roots, int vmap[]) {
+		for (uint32_t v = 0; v < mVertexActiveBlock; ++v)
+			vmap[v] = -1;
+
+		int new_v = 0;
+		if (order == DigraphOrder::ID) {
+			for (uint32_t v = 0; v < mVertexActiveBlock; ++v) {
+				if (mVertices[v].mInEdge != GRAVEYARD_FLAG)
+					vmap[v] = new_v++;
+			}
+			return;
+		}
+
+		std::vector<int> work;
+		std::vector<int> children;
+
+		auto visit = [&](int start) {
+			if (vmap[start] != -1)
+				return;
+
+			if (order == DigraphOrder::DEPTH_FIRST) {
+				work.push_back(start);
+				while (!work.empty()) {
+					int v = work.back();
+					work.pop_back();
+					if (vmap[v] != -1)
+						continue;
+					vmap[v] = new_v++;
+
+					// Push in reverse so that the first child is visited first
+					children.clear();
+					for (int e = mVertices[v].mOutEdge; e != -1; e = mEdges[e].mNext)
+						children.push_back(mEdges[e].mHead);
+					for (auto it = children.rbegin(); it != children.rend(); ++it) {
+						if (vmap[*it] == -1)
+							work.push_back(*it);
+					}
+				}
+			}
+			else {
+				// Here the work list is a queue that only ever grows
+				size_t front = work.size();
+				vmap[start] = new_v++;
+				work.push_back(start);
+				while (front < work.size()) {
+					int v = work[front++];
+					for (int e = mVertices[v].mOutEdge; e != -1; e = mEdges[e].mNext) {
+						int child = mEdges[e].mHead;
+						if (vmap[child] == -1) {
+							vmap[child] = new_v++;
+							work.push_back(child);
+						}
+					}
+				}
+			}
+		};
+
+		for (int root : roots) {
+			assert(root >= 0 && (uint32_t)root < mVertexActiveBlock);
+			assert(mVertices[root].mInEdge != GRAVEYARD_FLAG);
+			visit(root);
+		}
+
+		// Everything that the roots do not reach keeps its subtrees together as well
 		for (uint32_t v = 0; v < mVertexActiveBlock; ++v) {
 			if (mVertices[v].mInEdge != GRAVEYARD_FLAG)
-				vmap[v] = new_v++;
-			else
-				vmap[v] = -1;
+				visit(v);
 		}
+	}
 
-		uint32_t new_e = 0;
-		for (uint32_t e = 0; e < mEdgeActiveBlock; ++e) {
-			if (mEdges[e].mPrev != GRAVEYARD_FLAG)
+	void Digraph::orderEdges(DigraphOrder order, const int vmap[], int emap[]) {
+		for (uint32_t e = 0; e < mEdgeActiveBlock; ++e)
+			emap[e] = -1;
+
+		int new_e = 0;
+		if (order == DigraphOrder::ID) {
+			for (uint32_t e = 0; e < mEdgeActiveBlock; ++e) {
+				if (mEdges[e].mPrev != GRAVEYARD_FLAG)
+					emap[e] = new_e++;
+			}
+			return;
+		}
+
+		// Walk the tails in their new order, each edge list in its own order
+		std::vector<int> inverse(mVertexCount);
+		for (uint32_t v = 0; v < mVertexActiveBlock; ++v) {
+			if (vmap[v] != -1)
+				inverse[vmap[v]] = v;
+		}
+
+		for (int tail : inverse) {
+			for (int e = mVertices[tail].mOutEdge; e != -1; e = mEdges[e].mNext)
 				emap[e] = new_e++;
-			else
-				emap[e] = -1;
 		}
+	}
+
+	void Digraph::compress(DigraphOrder order, const std::vector<int>& roots, bool bTight)
+	{
+		uint32_t oldVertexActiveBlock = mVertexActiveBlock;
+		uint32_t oldEdgeActiveBlock = mEdgeActiveBlock;
+
+		int* vmap = new int[oldVertexActiveBlock];
+		int* emap = new int[oldEdgeActiveBlock];
+
+		orderVertices(order, roots, vmap);
+		orderEdges(order, vmap, emap);
 
-		uint32_t newEdgeReserve = bTight ? new_e : (uint32_t)(new_e * mRescaleFactor);
-		uint32_t newVertexReserve = bTight ? new_v : (uint32_t)(new_v * mRescaleFactor); 
+		// Keep room for at least one of each, so that growing by the rescale factor works
+		uint32_t newEdgeReserve = std::max(bTight ? mEdgeCount : (uint32_t)(mEdgeCount * mRescaleFactor), 1u);
+		uint32_t newVertexReserve = std::max(bTight ? mVertexCount : (uint32_t)(mVertexCount * mRescaleFactor), 1u); 
 
 		auto new_vdata = new DigraphVertexRaw[newVertexReserve];
 		auto new_edata = new DigraphEdgeRaw[newEdgeReserve];
 
-		mapcpy(new_vdata, mVertices, vmap, mVertexActiveBlock);
-		mapcpy(new_edata, mEdges, emap, mEdgeActiveBlock);
+		auto remapEdge = [emap](int e) {
+			return e < 0 ? e : emap[e];
+		};
+
+		// Move everything to its new slot and relabel the links between them
+		for (uint32_t v = 0; v < oldVertexActiveBlock; ++v) {
+			if (vmap[v] == -1)
+				continue;
+			auto& dest = new_vdata[vmap[v]];
+			dest = mVertices[v];
+			dest.mInEdge = remapEdge(dest.mInEdge);
+			dest.mOutEdge = remapEdge(dest.mOutEdge);
+		}
+
+		for (uint32_t e = 0; e < oldEdgeActiveBlock; ++e) {
+			if (emap[e] == -1)
+				continue;
+			auto& dest = new_edata[emap[e]];
+			dest = mEdges[e];
+			dest.mHead = vmap[dest.mHead];
+			dest.mTail = vmap[dest.mTail];
+			dest.mNext = remapEdge(dest.mNext);
+			dest.mPrev = remapEdge(dest.mPrev);
+			dest.mDualNext = remapEdge(dest.mDualNext);
+			dest.mDualPrev = remapEdge(dest.mDualPrev);
+		}
 
 		delete[] mVertices;
 		delete[] mEdges;
@@ -238,14 +496,65 @@ namespace Morpheus {
 		mEdgeActiveBlock = mEdgeCount;
 		mVertexActiveBlock = mVertexCount;
 
+		// Everything dead has been dropped
+		mFirstUnusedEdge = -1;
+		mFirstUnusedVertex = -1;
+
+		// Every key has changed
+		if (bEdgeIndex)
+			rebuildEdgeIndex();
+
+		++mVersion;
+
 		// Relabel vertices as necessary and update data and lookups
-		applyVertexMap(vmap, mVertexActiveBlock, newVertexReserve);
-		applyEdgeMap(emap, mEdgeActiveBlock, newEdgeReserve);
+		applyVertexMap(vmap, oldVertexActiveBlock, newVertexReserve);
+		applyEdgeMap(emap, oldEdgeActiveBlock, newEdgeReserve);
 
 		delete[] vmap;
 		delete[] emap;
 	}
 
+	void Digraph::freeze() {
+		if (isFrozen())
+			return;
+
+		auto& csr = mFrozen;
+		csr.mChildOffsets.resize(mVertexActiveBlock + 1);
+		csr.mParentOffsets.resize(mVertexActiveBlock + 1);
+		csr.mChildren.resize(mEdgeCount);
+		csr.mParents.resize(mEdgeCount);
+
+		// The degrees are already known, so the offsets are a prefix sum
+		uint32_t childOffset = 0;
+		uint32_t parentOffset = 0;
+		for (uint32_t v = 0; v < mVertexActiveBlock; ++v) {
+			csr.mChildOffsets[v] = childOffset;
+			csr.mParentOffsets[v] = parentOffset;
+			if (mVertices[v].mInEdge == GRAVEYARD_FLAG)
+				continue;
+			childOffset += mVertices[v].mOutDegree;
+			parentOffset += mVertices[v].mInDegree;
+		}
+		csr.mChildOffsets[mVertexActiveBlock] = childOffset;
+		csr.mParentOffsets[mVertexActiveBlock] = parentOffset;
+
+		for (uint32_t v = 0; v < mVertexActiveBlock; ++v) {
+			if (mVertices[v].mInEdge == GRAVEYARD_FLAG)
+				continue;
+
+			int* child = &csr.mChildren[csr.mChildOffsets[v]];
+			for (int e = mVertices[v].mOutEdge; e != -1; e = mEdges[e].mNext)
+				*child++ = mEdges[e].mHead;
+
+			int* parent = &csr.mParents[csr.mParentOffsets[v]];
+			for (int e = mVertices[v].mInEdge; e != -1; e = mEdges[e].mDualNext)
+				*parent++ = mEdges[e].mTail;
+		}
+
+		csr.mVersion = mVersion;
+		csr.bBuilt = true;
+	}
+
 	DigraphBreadthFirstSearch::DigraphBreadthFirstSearch(DigraphVertex& start) {
 		digraph = start.graph();
 		mVisited = digraph->createVertexData<bool>();
@@ -0,0 +1,132 @@
+#include <engine/dynamicresolution.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#define FRAME_TIME_SMOOTHING 0.2
+
+namespace Morpheus {
+
+	GpuTimer::GpuTimer() : mCurrent(0), bInitialized(false) {
+		for (uint32_t i = 0; i < GPU_TIMER_QUERY_COUNT; ++i)
+			bPending[i] = false;
+	}
+
+	GpuTimer::~GpuTimer() {
+		if (bInitialized)
+			glDeleteQueries(GPU_TIMER_QUERY_COUNT, mQueries);
+	}
+
+	void GpuTimer::begin() {
+		if (!bInitialized) {
+			glGenQueries(GPU_TIMER_QUERY_COUNT, mQueries);
+			bInitialized = true;
+		}
+
+		// If the result in this slot never arrived, just drop it
+		bPending[mCurrent] = false;
+		glBeginQuery(GL_TIME_ELAPSED, mQueries[mCurrent]);
+	}
+
+	void GpuTimer::end() {
+		glEndQuery(GL_TIME_ELAPSED);
+		bPending[mCurrent] = true;
+		mCurrent = (mCurrent + 1) % GPU_TIMER_QUERY_COUNT;
+	}
+
+	bool GpuTimer::tryRead(double* milliseconds) {
+		bool bFound = false;
+
+		// Walk from oldest to newest so that we end on the most recent result
+		for (uint32_t i = 0; i < GPU_TIMER_QUERY_COUNT; ++i) {
+			uint32_t slot = (mCurrent + i) % GPU_TIMER_QUERY_COUNT;
+			if (!bPending[slot])
+				continue;
+
+			GLint available = 0;
+			glGetQueryObjectiv(mQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(mQueries[slot], GL_QUERY_RESULT, &elapsed);
+			bPending[slot] = false;
+
+			*milliseconds = (double)elapsed / 1.0e6;
+			bFound = true;
+		}
+
+		return bFound;
+	}
+
+	void DynamicResolutionStats::print(std::ostream& os) const {
+		os << "Resolution scale: " << mScale << ", GPU: " << mGpuFrameTime
+			<< " ms (avg " << mAverageGpuFrameTime << " ms), " << mScaleChanges
+			<< " scale changes" << std::endl;
+	}
+
+	DynamicResolutionController::DynamicResolutionController() :
+		mFramesOver(0),
+		mFramesUnder(0),
+		mTargetFrameTime(1000.0 / 60.0),
+		mMinScale(0.5f),
+		mMaxScale(1.0f),
+		mStep(0.05f),
+		mUpperThreshold(0.05),
+		mLowerThreshold(0.2),
+		mFramesBeforeDecrease(3),
+		mFramesBeforeIncrease(30) {
+		mStats.mScale = 1.0f;
+		mStats.mGpuFrameTime = 0.0;
+		mStats.mAverageGpuFrameTime = 0.0;
+		mStats.mScaleChanges = 0;
+	}
+
+	void DynamicResolutionController::reset() {
+		mStats.mScale = mMaxScale;
+		mStats.mAverageGpuFrameTime = 0.0;
+		mFramesOver = 0;
+		mFramesUnder = 0;
+	}
+
+	void DynamicResolutionController::update(double gpuFrameTime) {
+		mStats.mGpuFrameTime = gpuFrameTime;
+		if (mStats.mAverageGpuFrameTime <= 0.0)
+			mStats.mAverageGpuFrameTime = gpuFrameTime;
+		else
+			mStats.mAverageGpuFrameTime += FRAME_TIME_SMOOTHING * (gpuFrameTime - mStats.mAverageGpuFrameTime);
+
+		double average = mStats.mAverageGpuFrameTime;
+		float scale = mStats.mScale;
+
+		if (average > mTargetFrameTime * (1.0 + mUpperThreshold)) {
+			mFramesUnder = 0;
+			if (++mFramesOver >= mFramesBeforeDecrease) {
+				// GPU time is roughly proportional to pixel count, i.e., scale squared
+				float ideal = scale * (float)std::sqrt(mTargetFrameTime / average);
+				scale = std::min(std::floor(ideal / mStep) * mStep, scale - mStep);
+				mFramesOver = 0;
+			}
+		}
+		else if (average < mTargetFrameTime * (1.0 - mLowerThreshold)) {
+			mFramesOver = 0;
+			if (++mFramesUnder >= mFramesBeforeIncrease) {
+				// Creep back up slowly
+				scale += mStep;
+				mFramesUnder = 0;
+			}
+		}
+		else {
+			mFramesOver = 0;
+			mFramesUnder = 0;
+		}
+
+		scale = std::min(std::max(scale, mMinScale), mMaxScale);
+		if (scale != mStats.mScale) {
+			mStats.mScale = scale;
+			++mStats.mScaleChanges;
+			// The old average no longer reflects the new resolution
+			mStats.mAverageGpuFrameTime = 0.0;
+		}
+	}
+}
@@ -10,6 +10,9 @@
 #include <engine/input.hpp>
 #include <engine/scene.hpp>
 #include <engine/camera.hpp>
+#include <engine/readback.hpp>
+#include <engine/log.hpp>
+#include <engine/texturestreamer.hpp>
 
 using namespace std;
 
@@ -23,7 +26,7 @@ namespace Morpheus {
 		fprintf(stderr, "Error: %s\n", description);
 	}
 
-	Engine::Engine() : INodeOwner(NodeType::ENGINE), mWindow(nullptr), bValid(false) {
+	Engine::Engine() : INodeOwner(NodeType::ENGINE), mWindow(nullptr), mReadback(nullptr), bValid(false), bFreezeGraph(true) {
 		gEngine = this;
 		NodeMetadata::init();
 	}
@@ -62,6 +65,8 @@ namespace Morpheus {
 			f.close();
 		}
 
+		logger()->configure(mConfig);
+
 		// Create renderer
 		mRenderer = new ForwardRenderer();
 		createNode(mRenderer, this);
@@ -77,6 +82,10 @@ namespace Morpheus {
 			width = windowConfig.value("width", 800);
 			height = windowConfig.value("height", 600);
 			title = windowConfig.value("title", "Morpheus Engine");
+
+			// Offscreen tools (i.e., sequence rendering) can run without showing a window
+			if (!windowConfig.value("visible", true))
+				glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 		}
 
 		mWindow = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
@@ -103,6 +112,19 @@ namespace Morpheus {
 		mUpdater = new Updater();
 		createNode(mUpdater, this);
 
+		// Create the readback queue, read settings from config if available
+		uint32_t readbackRing = 3;
+		uint32_t readbackWorkers = 1;
+		if (mConfig.contains("readback")) {
+			auto& readbackConfig = mConfig["readback"];
+			readbackRing = readbackConfig.value("ring_size", readbackRing);
+			readbackWorkers = readbackConfig.value("worker_threads", readbackWorkers);
+		}
+		mReadback = new ReadbackQueue(readbackRing, readbackWorkers);
+
+		if (mConfig.contains("graph"))
+			bFreezeGraph = mConfig["graph"].value("freeze", bFreezeGraph);
+
 		// Set appropriate window callbacks
 		mInput.glfwRegister();
 
@@ -120,10 +142,20 @@ namespace Morpheus {
 	}
 
 	void Engine::render(INodeOwner* scene) {
+		// Only rebuilds the snapshot if the graph has changed since the last frame
+		if (bFreezeGraph)
+			mGraph.freeze();
+
 		mRenderer->draw(scene);
 	}
 
 	void Engine::present() {
+		// Once per frame, after every draw has made its requests. Uploads issued
+		// now are sampled from next frame on.
+		auto streamer = getFactory<Texture>()->streamer();
+		if (streamer)
+			streamer->update();
+
 		glfwSwapBuffers(mWindow);
 	}
 
@@ -133,16 +165,29 @@ namespace Morpheus {
 		return scene;
 	}
 
+	void Engine::compressGraph() {
+		mGraph.compress(DigraphOrder::DEPTH_FIRST, { node().id() });
+	}
+
 	void Engine::update() {
 		glfwPollEvents(); // Update window!
 
+		mReadback->poll(); // Resolve any readbacks that have arrived
+
 		mUpdater->updateChildren(); // Update everything else
+
+		if (mContent->collectParameters().bIncremental)
+			mContent->collectIncremental(); // Unload a little of whatever was released
 	}
 
 	void Engine::shutdown() {
 
 		mInput.glfwUnregster();
 
+		// Finish any outstanding readbacks while the context is still alive
+		delete mReadback;
+		mReadback = nullptr;
+
 		// Clean up anything disposable
 		for (auto it = children(); it.valid();) {
 			auto child = it();
@@ -158,6 +203,8 @@ namespace Morpheus {
 		glfwDestroyWindow(mWindow);
 
 		glfwTerminate();
+
+		logger()->flush();
 	}
 	
 	void Engine::exit()
@@ -8,6 +8,8 @@
 #include <engine/sampler.hpp>
 #include <engine/framebuffer.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <stack>
 #include <iostream>
 
@@ -63,39 +65,14 @@ namespace Morpheus {
 
 	void ForwardRenderer::initPostProcessor() {
 		mPostProcessor = makeBlitShader(this, "/internal/postprocessor.frag", &mPostProcessorBlitView);
+		mPostProcessorUVScale.find(mPostProcessor, "uvScale");
+		mPostProcessorTexelSize.find(mPostProcessor, "texelSize");
+		mPostProcessorSharpness.find(mPostProcessor, "sharpness");
 	}
 
 	void ForwardRenderer::resetFramebuffer() {
-		int width, height;
-		getFramebufferSize(&width, &height);
-
-		if (mTargetBuffer) {
-			mTargetBuffer->resize(width, height);
-		} else {
-			mTargetBuffer = getFactory<Framebuffer>()->makeFramebuffer(this, width, height, 
-				GL_RGB32F, GL_DEPTH24_STENCIL8, 1);
-		}
-
-		if (mCurrentSettings.mMSAASamples > 1) {
-			if (!mMultisampleTargetBuffer) {
-				mMultisampleTargetBuffer = getFactory<Framebuffer>()->makeFramebuffer(this, width, height, 
-					GL_RGB32F, GL_DEPTH24_STENCIL8, mCurrentSettings.mMSAASamples);
-			}
-			else {
-				mMultisampleTargetBuffer->resize(width, height, mCurrentSettings.mMSAASamples);
-			}
-		} else {
-			if (mMultisampleTargetBuffer) {
-				unload(mMultisampleTargetBuffer);
-				mMultisampleTargetBuffer = nullptr;
-			}
-		}
-
-		GL_ASSERT;
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		GL_ASSERT;
+		// Targets of the old size will never be requested again
+		mTargetPool.releaseUnused();
 	}
 
 	void ForwardRenderer::collectRecursive(INodeOwner* current, ForwardRenderCollectParams& params) {
@@ -140,6 +117,14 @@ namespace Morpheus {
 			params.mQueues->mStaticMeshes.push(inst);
 			break;
 		}
+		case NodeType::OCCLUDER:
+		{
+			OccluderRenderInstance inst;
+			inst.mTransform = params.mTransformStack->top();
+			inst.mOccluder = current->toOccluder();
+			params.mQueues->mOccluders.push(inst);
+			break;
+		}
 		case NodeType::NANOGUI_SCREEN:
 		{
 			// Found a GUI
@@ -182,6 +167,7 @@ namespace Morpheus {
 	void ForwardRenderer::collect(INodeOwner* start, ForwardRenderCollectParams& params) {
 		mQueues.mGuis.clear();
 		mQueues.mStaticMeshes.clear();
+		mQueues.mOccluders.clear();
 
 		params.mQueues = &mQueues;
 		params.mTransformStack = &mTransformStack;
@@ -197,21 +183,90 @@ namespace Morpheus {
 		assert(mIsStaticStack.empty());
 	}
 
+	GLenum hdrFormatFromString(const std::string& s) {
+		if (s == "R11F_G11F_B10F")
+			return GL_R11F_G11F_B10F;
+		else if (s == "RGBA16F")
+			return GL_RGBA16F;
+		else if (s == "RGB32F")
+			return GL_RGB32F;
+		else if (s == "RGBA32F")
+			return GL_RGBA32F;
+		std::cout << "Warning: HDR format " << s << " not recognized, defaulting to GL_RGB32F!" << std::endl;
+		return GL_RGB32F;
+	}
+
 	RenderSettings ForwardRenderer::readSetingsFromConfig(const nlohmann::json& config) {
 		RenderSettings result;
 		result.mAnisotropySamples = config.value("anisotropy_samples", 1);
 		result.mMSAASamples = config.value("msaa_samples", 1);
+		result.mHDRFormat = hdrFormatFromString(config.value("hdr_format", "RGB32F"));
+		result.bResolveDepth = config.value("resolve_depth", false);
+
+		result.bDynamicResolution = false;
+		result.mTargetFrameTime = 1000.0 / 60.0;
+		result.mMinResolutionScale = 0.5f;
+		result.mMaxResolutionScale = 1.0f;
+		result.mUpscaleSharpness = 0.0f;
+		if (config.contains("dynamic_resolution")) {
+			auto& dynamicConfig = config["dynamic_resolution"];
+			result.bDynamicResolution = dynamicConfig.value("enabled", true);
+			result.mTargetFrameTime = dynamicConfig.value("target_frame_time", result.mTargetFrameTime);
+			result.mMinResolutionScale = dynamicConfig.value("min_scale", result.mMinResolutionScale);
+			result.mMaxResolutionScale = dynamicConfig.value("max_scale", result.mMaxResolutionScale);
+			result.mUpscaleSharpness = dynamicConfig.value("sharpness", result.mUpscaleSharpness);
+		}
+
+		result.bOcclusionCulling = false;
+		result.mOcclusionBufferWidth = OCCLUSION_DEFAULT_WIDTH;
+		result.mOcclusionBufferHeight = OCCLUSION_DEFAULT_HEIGHT;
+		result.mOcclusionThreads = 2;
+		result.bOcclusionDebug = false;
+		if (config.contains("occlusion_culling")) {
+			auto& occlusionConfig = config["occlusion_culling"];
+			result.bOcclusionCulling = occlusionConfig.value("enabled", true);
+			result.mOcclusionBufferWidth = occlusionConfig.value("width", result.mOcclusionBufferWidth);
+			result.mOcclusionBufferHeight = occlusionConfig.value("height", result.mOcclusionBufferHeight);
+			result.mOcclusionThreads = occlusionConfig.value("threads", result.mOcclusionThreads);
+			result.bOcclusionDebug = occlusionConfig.value("debug", result.bOcclusionDebug);
+		}
+
+		result.mLodErrorThreshold = config.value("lod_error_threshold", 1.0f);
 		return result;
 	}
 
+	size_t FrameBandwidthStats::bytesRead() const {
+		size_t result = 0;
+		for (auto& pass : mPasses)
+			result += pass.mBytesRead;
+		return result;
+	}
+
+	size_t FrameBandwidthStats::bytesWritten() const {
+		size_t result = 0;
+		for (auto& pass : mPasses)
+			result += pass.mBytesWritten;
+		return result;
+	}
+
+	void FrameBandwidthStats::print(std::ostream& os) const {
+		const double mb = 1024.0 * 1024.0;
+		for (auto& pass : mPasses) {
+			os << pass.mName << ": " << pass.mBytesRead / mb << " MB read, "
+				<< pass.mBytesWritten / mb << " MB written" << std::endl;
+		}
+		os << "Total: " << bytesRead() / mb << " MB read, "
+			<< bytesWritten() / mb << " MB written" << std::endl;
+	}
+
 	ForwardRenderer::ForwardRenderer() : 
 		mCubemapSampler(nullptr), 
 		mTextureSampler(nullptr),
 		mDebugBlitSampler(nullptr),
 		mBlitGeometry(nullptr),
 		mTextureBlitShader(nullptr),
-		mMultisampleTargetBuffer(nullptr),
-		mTargetBuffer(nullptr) {
+		mOcclusionCuller(nullptr),
+		mTrianglesDrawn(0) {
 
 		mOnFramebufferResize = [this](GLFWwindow* window, int width, int height) {
 			this->resetFramebuffer();
@@ -226,6 +281,7 @@ namespace Morpheus {
 	ForwardRenderer::~ForwardRenderer() {
 		input()->unbindFramebufferSizeEvent(this);
 		input()->unregisterTarget(this);
+		delete mOcclusionCuller;
 	}
 
 	void ForwardRenderer::setRenderSettings(const RenderSettings& settings) {
@@ -247,6 +303,24 @@ namespace Morpheus {
 			mTextureSampler->setAnisotropy(settings.mAnisotropySamples);
 		}
 
+		mDynamicResolution.mTargetFrameTime = settings.mTargetFrameTime;
+		mDynamicResolution.mMinScale = settings.mMinResolutionScale;
+		mDynamicResolution.mMaxScale = settings.mMaxResolutionScale;
+		mDynamicResolution.reset();
+
+		// The culler has to be recreated whenever its buffer or thread count changes
+		bool bRecreateCuller = !settings.bOcclusionCulling || !mOcclusionCuller ||
+			settings.mOcclusionBufferWidth != mCurrentSettings.mOcclusionBufferWidth ||
+			settings.mOcclusionBufferHeight != mCurrentSettings.mOcclusionBufferHeight ||
+			settings.mOcclusionThreads != mCurrentSettings.mOcclusionThreads;
+		if (bRecreateCuller) {
+			delete mOcclusionCuller;
+			mOcclusionCuller = nullptr;
+			if (settings.bOcclusionCulling)
+				mOcclusionCuller = new SoftwareOcclusionCuller(settings.mOcclusionBufferWidth,
+					settings.mOcclusionBufferHeight, settings.mOcclusionThreads);
+		}
+
 		mCurrentSettings = settings;
 	}
 
@@ -262,17 +336,55 @@ namespace Morpheus {
 
 		GL_ASSERT;
 
-		Framebuffer* renderTarget = mTargetBuffer;
-		if (mMultisampleTargetBuffer)
-			renderTarget = mMultisampleTargetBuffer;
+		mTargetPool.beginFrame();
+
+		// Feed the controller whatever GPU timings have arrived since last frame
+		double gpuFrameTime;
+		if (mCurrentSettings.bDynamicResolution && mFrameTimer.tryRead(&gpuFrameTime))
+			mDynamicResolution.update(gpuFrameTime);
+
+		// Targets stay at full size, the scene is rendered into the lower left corner
+		// so that changing the scale never reallocates anything
+		float scale = mCurrentSettings.bDynamicResolution ? mDynamicResolution.scale() : 1.0f;
+		int renderWidth = std::max((int)std::round(width * scale), 1);
+		int renderHeight = std::max((int)std::round(height * scale), 1);
+
+		if (mCurrentSettings.bDynamicResolution)
+			mFrameTimer.begin();
+
+		const GLenum depthStencilFormat = GL_DEPTH24_STENCIL8;
+		const GLenum hdrFormat = mCurrentSettings.mHDRFormat;
+		const uint samples = std::max(mCurrentSettings.mMSAASamples, 1u);
+		const bool bMultisample = samples > 1;
+
+		// The resolve target only needs depth if a later pass reads it
+		const bool bResolveDepth = bMultisample && mCurrentSettings.bResolveDepth;
+
+		Framebuffer* resolveTarget = mTargetPool.acquire(width, height, hdrFormat,
+			bMultisample && !bResolveDepth ? 0 : depthStencilFormat);
+		Framebuffer* multisampleTarget = nullptr;
+		if (bMultisample)
+			multisampleTarget = mTargetPool.acquire(width, height,
+				hdrFormat, depthStencilFormat, samples);
+
+		const size_t pixels = (size_t)renderWidth * (size_t)renderHeight;
+		const size_t colorBytes = internalFormatSize(hdrFormat);
+		const size_t depthBytes = internalFormatSize(depthStencilFormat);
+		mBandwidth.mPasses.clear();
+
+		Framebuffer* renderTarget = multisampleTarget ? multisampleTarget : resolveTarget;
 		renderTarget->bind();
 		GL_ASSERT;
 
-		glViewport(0, 0, width, height);
+		glViewport(0, 0, renderWidth, renderHeight);
+		// Clears ignore the viewport, only clear the region we render to
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, 0, renderWidth, renderHeight);
 		if (params.mSkybox)
 			glClear(GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 		else
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		glDisable(GL_SCISSOR_TEST);
 
 		mat4 view = identity<mat4>();
 		mat4 projection = identity<mat4>();
@@ -291,23 +403,72 @@ namespace Morpheus {
 		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 		glDisable(GL_BLEND);
 
+		// Rasterize occluders on the CPU so that hidden draws are never submitted
+		const bool bOcclusionCull = mOcclusionCuller && params.mRenderCamera;
+		if (bOcclusionCull) {
+			mOcclusionCuller->beginFrame(projection * view);
+			for (auto occluderPtr = queue->mOccluders.begin(); occluderPtr != queue->mOccluders.end(); ++occluderPtr)
+				mOcclusionCuller->addOccluder(occluderPtr->mOccluder, occluderPtr->mTransform->mCache);
+			mOcclusionCuller->rasterize();
+		}
+
+		// Converts an object space length at unit distance into pixels, orthographic
+		// projections do not shrink with distance
+		const bool bPerspective = projection[3][3] == 0.0f;
+		const float pixelsPerUnit = 0.5f * (float)renderHeight * std::abs(projection[1][1]);
+		mTrianglesDrawn = 0;
+
+		auto streamer = getFactory<Texture>()->streamer();
+
 		// Draw static meshes
 		for (auto meshPtr = queue->mStaticMeshes.begin(); meshPtr != queue->mStaticMeshes.end(); ++meshPtr) {
-			auto material = meshPtr->mStaticMesh->getMaterial();
+			auto mesh = meshPtr->mStaticMesh;
+			auto material = mesh->getMaterial();
 			auto transform = meshPtr->mTransform;
-			auto geo = meshPtr->mStaticMesh->getGeometry();
+			auto geo = mesh->getGeometry();
+
+			mat4 world = transform->mCache;
+			if (bOcclusionCull && !mOcclusionCuller->isVisible(geo->boundingBox(), world))
+				continue;
+
+			if (mesh->lodCount() > 1 || streamer) {
+				BoundingBox aabb = geo->boundingBox();
+				float worldScale = std::max(glm::length(vec3(world[0])),
+					std::max(glm::length(vec3(world[1])), glm::length(vec3(world[2]))));
+				vec3 center = vec3(world * vec4(0.5f * (aabb.mLower + aabb.mUpper), 1.0f));
+				float diameter = glm::length(aabb.mUpper - aabb.mLower);
+				float radius = 0.5f * worldScale * diameter;
+
+				float errorScale = worldScale * pixelsPerUnit;
+				if (bPerspective) {
+					// Measure from the nearest point of the bounding sphere
+					float distance = std::max(glm::length(center - eye) - radius, 1e-3f);
+					errorScale /= distance;
+				}
+
+				// Pick the coarsest LOD whose error projects to less than the threshold
+				if (mesh->lodCount() > 1)
+					geo = mesh->getLod(mesh->selectLod(errorScale, mCurrentSettings.mLodErrorThreshold));
+
+				// Request texture levels as if the UV range were stretched once across the
+				// bounding sphere, tiled textures should use a LOD bias
+				if (streamer) {
+					for (auto& binding : material->samplerAssignments().mBindings)
+						streamer->request(binding.mTexture, diameter * errorScale);
+				}
+			}
 
 			GL_ASSERT;
 
 			auto shader = material->shader();
 			auto& shaderRenderView = shader->renderView();
 
-			mat4 world = transform->mCache;
 			mat4 worldInvTranspose = glm::transpose(glm::inverse(world));
 
 			// Set renderer related things
 			shader->bind();
-			shaderRenderView.mWorld.set(world);
+			// Quantized positions are decoded by the world matrix, normals are unaffected
+			shaderRenderView.mWorld.set(world * geo->positionDecode());
 			shaderRenderView.mView.set(view);
 			shaderRenderView.mProjection.set(projection);
 			shaderRenderView.mWorldInverseTranspose.set(worldInvTranspose);
@@ -327,10 +488,28 @@ namespace Morpheus {
 			glDrawElements(geo->elementType(), geo->elementCount(),
 				geo->indexType(), nullptr);
 			GL_ASSERT;
+
+			if (geo->elementType() == GL_TRIANGLES)
+				mTrianglesDrawn += geo->elementCount() / 3;
 		}
 
+		// Clear + opaque geometry: depth is tested and written, color written once
+		RenderPassBandwidth scenePass;
+		scenePass.mName = "scene";
+		scenePass.mBytesRead = queue->mStaticMeshes.size() > 0 ? pixels * samples * depthBytes : 0;
+		scenePass.mBytesWritten = pixels * samples * (depthBytes +
+			(params.mSkybox ? 0 : colorBytes) +
+			(queue->mStaticMeshes.size() > 0 ? colorBytes : 0));
+		mBandwidth.mPasses.push_back(scenePass);
+
 		// Draw skybox
 		if (params.mSkybox) {
+			RenderPassBandwidth skyboxPass;
+			skyboxPass.mName = "skybox";
+			skyboxPass.mBytesRead = pixels * samples * depthBytes;
+			skyboxPass.mBytesWritten = pixels * samples * colorBytes;
+			mBandwidth.mPasses.push_back(skyboxPass);
+
 			params.mSkybox->prepare(view, projection, eye);
 			GL_ASSERT;
 			glBindVertexArray(mBlitGeometry->vertexArray());
@@ -342,16 +521,57 @@ namespace Morpheus {
 		}
 
 		// Resolve multisample buffer
-		if (mMultisampleTargetBuffer) {
-			renderTarget->blit(mTargetBuffer, GL_COLOR_BUFFER_BIT | 
-				GL_DEPTH_BUFFER_BIT | 
-				GL_STENCIL_BUFFER_BIT);
+		if (multisampleTarget) {
+			GLbitfield resolveBits = GL_COLOR_BUFFER_BIT;
+			if (bResolveDepth)
+				resolveBits |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+			multisampleTarget->blit(resolveTarget, resolveBits, renderWidth, renderHeight);
+			mTargetPool.release(multisampleTarget);
+
+			size_t resolvedBytes = colorBytes + (bResolveDepth ? depthBytes : 0);
+			RenderPassBandwidth resolvePass;
+			resolvePass.mName = "resolve";
+			resolvePass.mBytesRead = pixels * samples * resolvedBytes;
+			resolvePass.mBytesWritten = pixels * resolvedBytes;
+			mBandwidth.mPasses.push_back(resolvePass);
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (params.mOutput)
+			params.mOutput->bind();
+		else
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-		// Blit the target buffer to screen with the post processor
-		blit(mTargetBuffer->getColor(), mPostProcessor, &mPostProcessorBlitView);
+		glViewport(0, 0, width, height);
+
+		// Blit the target buffer to screen with the post processor, upscaling if necessary
+		mPostProcessor->bind();
+		mPostProcessorUVScale.set(glm::vec2((float)renderWidth / (float)width,
+			(float)renderHeight / (float)height));
+		mPostProcessorTexelSize.set(glm::vec2(1.0f / (float)width, 1.0f / (float)height));
+		mPostProcessorSharpness.set(scale < 1.0f ? mCurrentSettings.mUpscaleSharpness : 0.0f);
+		blit(resolveTarget->getColor(), glm::vec2(0.0f, 0.0f), glm::vec2((float)width, (float)height),
+			mPostProcessor, &mPostProcessorBlitView);
+		mTargetPool.release(resolveTarget);
+
+		if (mCurrentSettings.bDynamicResolution)
+			mFrameTimer.end();
+
+		RenderPassBandwidth postPass;
+		postPass.mName = "postprocess";
+		postPass.mBytesRead = pixels * colorBytes;
+		postPass.mBytesWritten = (size_t)width * (size_t)height * 4;
+		mBandwidth.mPasses.push_back(postPass);
+
+		// GUIs only go to the screen
+		if (params.mOutput) {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			return;
+		}
+
+		if (bOcclusionCull && mCurrentSettings.bOcclusionDebug) {
+			blit(mOcclusionCuller->debugTexture(), glm::vec2(0.0f, 0.0f),
+				glm::vec2((float)mOcclusionCuller->width(), (float)mOcclusionCuller->height()));
+		}
 
 		// Just draw GUIs last for now
 		glBindVertexArray(0);
@@ -364,6 +584,10 @@ namespace Morpheus {
 	}
 
 	void ForwardRenderer::draw(INodeOwner* scene) {
+		draw(scene, nullptr);
+	}
+
+	void ForwardRenderer::draw(INodeOwner* scene, Framebuffer* output) {
 		ForwardRenderCollectParams collectParams;
 		collectParams.mQueues = &mQueues;
 		collectParams.mIsStaticStack = &mIsStaticStack;
@@ -375,6 +599,7 @@ namespace Morpheus {
 
 		drawParams.mRenderCamera = collectParams.mRenderCamera;
 		drawParams.mSkybox = collectParams.mSkybox;
+		drawParams.mOutput = output;
 
 		draw(&mQueues, drawParams);
 	}
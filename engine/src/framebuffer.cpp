@@ -1,4 +1,5 @@
 #include <engine/framebuffer.hpp>
+#include <engine/gldelete.hpp>
 
 #include <GLFW/glfw3.h>
 
@@ -60,8 +61,12 @@ namespace Morpheus {
 	}
 
 	void Framebuffer::blit(Framebuffer* target, GLbitfield copyComponents) {
-		uint copy_width = std::min(target->width(), width());
-		uint copy_height = std::min(target->height(), height());
+		blit(target, copyComponents, width(), height());
+	}
+
+	void Framebuffer::blit(Framebuffer* target, GLbitfield copyComponents, uint width, uint height) {
+		uint copy_width = std::min(std::min(target->width(), mWidth), width);
+		uint copy_height = std::min(std::min(target->height(), mHeight), height);
 
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, mId);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->mId);
@@ -309,6 +314,25 @@ namespace Morpheus {
 		}
 	}
 
+	ContentSize ContentFactory<Framebuffer>::measure(INodeOwner* ref) const {
+		auto framebuffer = ref->toFramebuffer();
+		ContentSize size{0, 0};
+
+		for (auto it : framebuffer->mColorAttachments)
+			size.mGpuBytes += it->gpuSize();
+
+		if (framebuffer->mDepthAttachment)
+			size.mGpuBytes += framebuffer->mDepthAttachment->gpuSize();
+
+		if (framebuffer->mStencilAttachment)
+			size.mGpuBytes += framebuffer->mStencilAttachment->gpuSize();
+
+		if (framebuffer->mDepthStencilAttachment)
+			size.mGpuBytes += framebuffer->mDepthStencilAttachment->gpuSize();
+
+		return size;
+	}
+
 	void ContentFactory<Framebuffer>::unload(INodeOwner* ref) {
 		auto framebuffer = ref->toFramebuffer();
 		auto textureFactory = getFactory<Texture>();
@@ -325,7 +349,7 @@ namespace Morpheus {
 		if (framebuffer->mDepthStencilAttachment)
 			textureFactory->unload(framebuffer->mDepthStencilAttachment);
 
-		glDeleteFramebuffers(1, &framebuffer->mId);
+		glDeleteQueue()->deleteFramebuffers(1, &framebuffer->mId);
 		delete framebuffer;
 	}
 
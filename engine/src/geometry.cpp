@@ -1,7 +1,13 @@
 #include <engine/geometry.hpp>
 #include <engine/halfedge.hpp>
+#include <engine/halfedgeloader.hpp>
+#include <engine/gldelete.hpp>
+#include <engine/log.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <vector>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -17,20 +23,215 @@ namespace Morpheus {
 		return this;
 	}
 
-	ContentFactory<Geometry>::ContentFactory() {
+	// Reorders the index and vertex buffers of a triangle list for the GPU.
+	// vertices: Interleaved float vertex data, reordered in place.
+	// indices: Three indices per triangle, reordered in place.
+	// vertexCount: The number of vertices, receives the new vertex count.
+	// indexCount: The number of indices.
+	// stride: The number of floats per vertex.
+	// positionOffset: Offset of the position in floats, -1 if there are no positions.
+	// params: Which optimizations to apply.
+	// name: Name of the mesh for logging.
+	void optimizeBuffers(float* vertices, uint32_t* indices, uint32_t* vertexCount,
+		uint32_t indexCount, uint32_t stride, int positionOffset,
+		const ContentExtParams<Geometry>& params, const std::string& name) {
+
+		if (indexCount == 0)
+			return;
+
+		VertexCacheStats before;
+		if (params.bLogStatistics)
+			before = analyzeVertexCache(indices, indexCount, *vertexCount);
+
+		if (params.bOptimizeVertexCache) {
+			vector<uint32_t> reordered(indexCount);
+			optimizeVertexCache(&reordered[0], indices, indexCount, *vertexCount);
+
+			if (params.bOptimizeOverdraw && positionOffset >= 0)
+				optimizeOverdraw(indices, &reordered[0], indexCount, vertices + positionOffset,
+					stride * sizeof(float), *vertexCount, params.mOverdrawThreshold);
+			else
+				std::copy(reordered.begin(), reordered.end(), indices);
+		}
+
+		if (params.bOptimizeVertexFetch)
+			*vertexCount = static_cast<uint32_t>(optimizeVertexFetch(vertices, indices, indexCount,
+				*vertexCount, stride * sizeof(float)));
+
+		if (params.bLogStatistics) {
+			auto after = analyzeVertexCache(indices, indexCount, *vertexCount);
+			logInfo() << "Vertex cache " << (name.length() > 0 ? name : "(unnamed)") << ": ACMR " <<
+				before.mACMR << " -> " << after.mACMR << ", ATVR " <<
+				before.mATVR << " -> " << after.mATVR;
+		}
+	}
+
+	// Uploads packed vertex and index data into a new vertex array.
+	// vertices: The packed vertex data.
+	// vertexSize: The size of the vertex data in bytes.
+	// vertexStride: The size of a packed vertex in bytes.
+	// attributes: The layout of a packed vertex.
+	// indices: The index data, three indices per triangle.
+	// indexSize: The size of the index data in bytes.
+	// indexCount: The number of indices.
+	// indexType: GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+	// aabb: The object space bounding box of the vertex positions.
+	// positionDecode: Maps packed positions into object space.
+	// returns: A new unmanaged geometry.
+	Geometry* ContentFactory<Geometry>::uploadGeometry(const void* vertices, size_t vertexSize, uint32_t vertexStride,
+		const std::vector<PackedVertexAttribute>& attributes, const void* indices, size_t indexSize,
+		uint32_t indexCount, GLenum indexType, const BoundingBox& aabb, const glm::mat4& positionDecode) {
+
+		GLuint bufs[2];
+		glGenBuffers(2, bufs);
+
+		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
+		glBufferData(GL_ARRAY_BUFFER, vertexSize, vertices, GL_STATIC_DRAW);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize, indices, GL_STATIC_DRAW);
+
+		GLuint vao;
+
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
+
+		for (auto& attribute : attributes) {
+			glEnableVertexAttribArray(attribute.mLocation);
+			glVertexAttribPointer(attribute.mLocation, attribute.mComponents, attribute.mType,
+				attribute.bNormalized, vertexStride, (void*)(size_t)attribute.mOffset);
+		}
+
+		Geometry* geo = new Geometry();
+		geo->mAabb = aabb;
+		geo->mVbo = bufs[0];
+		geo->mIbo = bufs[1];
+		geo->mVao = vao;
+		geo->mElementCount = indexCount;
+		geo->mElementType = GL_TRIANGLES;
+		geo->mIndexType = indexType;
+		geo->mPositionDecode = positionDecode;
+		return geo;
+	}
+
+	Geometry* ContentFactory<Geometry>::uploadGeometry(const CookedGeometryLevel& level) {
+		return uploadGeometry(level.mVertices.mData.data(), level.mVertices.mData.size(),
+			level.mVertices.mStride, level.mVertices.mAttributes,
+			level.mIndices.data(), level.mIndices.size(), level.mIndexCount, level.mIndexType,
+			level.mAabb, level.mVertices.mPositionDecode);
+	}
+
+	void ContentFactory<Geometry>::destroyGeometry(Geometry* geo) {
+		for (auto& lod : geo->mLods)
+			destroyGeometry(lod.mGeometry);
+
+		GLuint bufs[2] = { geo->mVbo, geo->mIbo };
+		GLuint vao = geo->mVao;
+		glDeleteQueue()->deleteBuffers(2, bufs);
+		glDeleteQueue()->deleteVertexArrays(1, &vao);
+		delete geo;
+	}
+
+	ContentFactory<Geometry>::ContentFactory() : mVertexFormat(VertexFormat::defaults()),
+		mCookParameters(GeometryCookParameters::defaults()) {
 		mImporter = new Importer();
 	}
 
 	INodeOwner* ContentFactory<Geometry>::load(const std::string& source, Node loadInto) {
+		return loadInternal(source, ContentExtParams<Geometry>());
+	}
+
+	INodeOwner* ContentFactory<Geometry>::loadEx(const std::string& source, Node loadInto, const void* extParams) {
+		const auto params = reinterpret_cast<const ContentExtParams<Geometry>*>(extParams);
+		return loadInternal(source, *params);
+	}
+
+	Geometry* ContentFactory<Geometry>::loadInternal(const std::string& source,
+		const ContentExtParams<Geometry>& params) {
+		const VertexFormat& format = params.mVertexFormat ? *params.mVertexFormat : mVertexFormat;
+
+		// Cooked files can also be loaded directly
+		if (isCookedGeometryPath(source))
+			return loadCooked(source, nullptr);
+
+		// Prefer the cooked version of the source as long as it is up to date
+		std::string cooked = cookedGeometryPath(source);
+		if (isCookedGeometryFresh(source, cooked)) {
+			Geometry* geo = loadCooked(cooked, &format);
+			if (geo)
+				return geo;
+		}
+
+		// Then an entry of the derived data cache that was cooked with the same parameters
+		auto cache = content()->derivedCache();
+		if (cache) {
+			GeometryCookParameters cacheParams = mCookParameters;
+			cacheParams.mOptimize = params;
+			cacheParams.mFormat = format;
+
+			std::string cachedPath;
+			if (cache->find(source, cacheParams.cacheParameters(), COOKED_GEOMETRY_EXTENSION, &cachedPath)) {
+				Geometry* geo = loadCooked(cachedPath, &format);
+				if (geo)
+					return geo;
+			}
+		}
+
 		cout << "Loading geometry " << source << "..." << endl;
 
-		const aiScene* pScene = mImporter->ReadFile(source.c_str(),
+		GeometryBuffers buffers;
+		if (!importBuffers(mImporter, source, params, &buffers))
+			return nullptr;
+
+		CookedGeometryLevel level;
+		packGeometryLevel(buffers, format, 0.0f, &level);
+		return uploadGeometry(level);
+	}
+
+	Geometry* ContentFactory<Geometry>::loadCooked(const std::string& path,
+		const VertexFormat* requiredFormat) {
+		cout << "Loading cooked geometry " << path << "..." << endl;
+
+		CookedGeometryFile file;
+		if (!file.open(path)) {
+			cout << "Error: failed to load " << path << endl;
+			return nullptr;
+		}
+
+		if (requiredFormat && file.format() != *requiredFormat) {
+			cout << "Warning: " << path << " was cooked with a different vertex format, ignoring it!" << endl;
+			return nullptr;
+		}
+
+		// Buffers are uploaded straight from the mapped pages
+		Geometry* geo = nullptr;
+		for (uint32_t i = 0; i < file.levelCount(); ++i) {
+			auto& level = file.level(i);
+			Geometry* levelGeo = uploadGeometry(file.vertices(i), level.mVertexSize, level.mVertexStride,
+				file.attributes(i), file.indices(i), level.mIndexSize, level.mIndexCount, level.mIndexType,
+				level.mAabb, level.mPositionDecode);
+
+			if (i == 0)
+				geo = levelGeo;
+			else
+				geo->mLods.push_back({ levelGeo, level.mError });
+		}
+
+		return geo;
+	}
+
+	bool ContentFactory<Geometry>::importBuffers(Importer* importer, const std::string& source,
+		const ContentExtParams<Geometry>& params, GeometryBuffers* output) {
+
+		const aiScene* pScene = importer->ReadFile(source.c_str(),
 			aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices |
 			aiProcess_GenUVCoords | aiProcess_CalcTangentSpace | aiProcessPreset_TargetRealtime_Quality);
 
 		if (!pScene) {
 			cout << "Error: failed to load " << source << endl;
-			return nullptr;
+			return false;
 		}
 
 		uint32_t nVerts;
@@ -38,7 +239,7 @@ namespace Morpheus {
 
 		if (!pScene->HasMeshes()) {
 			cout << "Error: " << source << " has no meshes!" << endl;
-			return nullptr;
+			return false;
 		}
 
 		if (pScene->mNumMeshes > 1) {
@@ -52,10 +253,12 @@ namespace Morpheus {
 
 		uint32_t stride = 3 + 2 + 3 + 3;
 
-		float* vert_buffer = new float[nVerts * stride];
-		uint32_t* indx_buffer = new uint32_t[nIndices];
+		output->mVertices.resize((size_t)nVerts * stride);
+		output->mIndices.resize(nIndices);
+		float* vert_buffer = output->mVertices.data();
+		uint32_t* indx_buffer = output->mIndices.data();
 
-		BoundingBox aabb;
+		BoundingBox& aabb = output->mAabb;
 		aabb.mLower = glm::vec3(std::numeric_limits<float>::infinity(),
 			std::numeric_limits<float>::infinity(),
 			std::numeric_limits<float>::infinity());
@@ -113,52 +316,42 @@ namespace Morpheus {
 			indx_buffer[i++] = mesh->mFaces[i_face].mIndices[2];
 		}
 
-		GLuint bufs[2];
-		glGenBuffers(2, bufs);
+		optimizeBuffers(vert_buffer, indx_buffer, &nVerts, nIndices, stride, 0, params, source);
 
-		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * nVerts * stride, vert_buffer, GL_STATIC_DRAW);
+		output->mVertices.resize((size_t)nVerts * stride);
+		output->mStride = stride;
+		output->mVertexCount = nVerts;
+		output->mPositionOffset = 0;
+		output->mAttributes = {
+			{ 0, VertexAttributeKind::POSITION, 0, 3 },
+			{ 1, VertexAttributeKind::UV, 3, 2 },
+			{ 2, VertexAttributeKind::NORMAL, 5, 3 },
+			{ 3, VertexAttributeKind::NORMAL, 8, 3 }
+		};
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * nIndices, indx_buffer, GL_STATIC_DRAW);
-
-		GLuint vao;
+		return true;
+	}
 
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), 0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(3 * sizeof(float)));
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(5 * sizeof(float)));
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride * sizeof(float), (void*)(8 * sizeof(float)));
+	void ContentFactory<Geometry>::unload(INodeOwner* ref) {
+		destroyGeometry(ref->toGeometry());
+	}
 
-		Geometry* geo = new Geometry();
-		geo->mAabb = aabb;
-		geo->mVbo = bufs[0];
-		geo->mIbo = bufs[1];
-		geo->mVao = vao;
-		geo->mElementCount = nIndices;
-		geo->mElementType = GL_TRIANGLES;
-		geo->mIndexType = GL_UNSIGNED_INT;
+	ContentSize ContentFactory<Geometry>::measure(INodeOwner* ref) const {
+		auto geo = ref->toGeometry();
+		ContentSize size{0, 0};
 
-		delete[] vert_buffer;
-		delete[] indx_buffer;
+		GLint bufferSize = 0;
+		glGetNamedBufferParameteriv(geo->mVbo, GL_BUFFER_SIZE, &bufferSize);
+		size.mGpuBytes += bufferSize;
+		bufferSize = 0;
+		glGetNamedBufferParameteriv(geo->mIbo, GL_BUFFER_SIZE, &bufferSize);
+		size.mGpuBytes += bufferSize;
 
-		return geo;
-	}
+		// Levels of detail have buffers of their own
+		for (auto& lod : geo->mLods)
+			size += measure(lod.mGeometry);
 
-	void ContentFactory<Geometry>::unload(INodeOwner* ref) {
-		auto r = ref->toGeometry();
-		GLuint bufs[2] = { r->mVbo, r->mIbo };
-		GLuint vao = r->mVao;
-		glDeleteBuffers(2, bufs);
-		glDeleteVertexArrays(1, &vao);
-		delete r;
+		return size;
 	}
 
 	ContentFactory<Geometry>::~ContentFactory() {
@@ -179,6 +372,12 @@ namespace Morpheus {
 
 	Geometry* ContentFactory<Geometry>::makeGeometryUnmanaged(const HalfEdgeGeometry* geo,
 		const HalfEdgeAttributes& attrib) const {
+		return makeGeometryUnmanaged(geo, attrib, ContentExtParams<Geometry>());
+	}
+
+	void ContentFactory<Geometry>::makeBuffers(const HalfEdgeGeometry* geo,
+		const HalfEdgeAttributes& attrib, const ContentExtParams<Geometry>& params,
+		GeometryBuffers* output) {
 		uint32_t current_off = 0;
 		uint32_t position_off = 0;
 		uint32_t uv_off = 0;
@@ -216,15 +415,12 @@ namespace Morpheus {
 			nIndices += 3 * (vCount - 2);
 		}
 
-		uint32_t vert_buffer_size = nVerts * stride;
-		float* vert_buffer = new float[vert_buffer_size];
-
-		for (uint32_t i = 0; i < vert_buffer_size; ++i)
-			vert_buffer[i] = 0.0;
+		output->mVertices.assign((size_t)nVerts * stride, 0.0f);
+		output->mIndices.resize(nIndices);
+		float* vert_buffer = output->mVertices.data();
+		uint32_t* indx_buffer = output->mIndices.data();
 
-		uint32_t* indx_buffer = new uint32_t[nIndices];
-
-		BoundingBox aabb;
+		BoundingBox& aabb = output->mAabb;
 		aabb.mLower = glm::vec3(std::numeric_limits<float>::infinity(),
 			std::numeric_limits<float>::infinity(),
 			std::numeric_limits<float>::infinity());
@@ -311,68 +507,46 @@ namespace Morpheus {
 			vertIt.next();
 
 			// Triangulate face if necessary
-			for (int current_i = vertIt().id(); vertIt.valid(); vertIt.next(), last_i = current_i) {
+			for (; vertIt.valid(); vertIt.next()) {
+				int current_i = vertIt().id();
 				indx_buffer[j++] = static_cast<uint32_t>(start_i);
 				indx_buffer[j++] = static_cast<uint32_t>(last_i);
 				indx_buffer[j++] = static_cast<uint32_t>(current_i);
+				last_i = current_i;
 			}
 		}
 
-		GLuint bufs[2];
-		glGenBuffers(2, bufs);
-
-		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vert_buffer_size, vert_buffer, GL_STATIC_DRAW);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * nIndices, indx_buffer, GL_STATIC_DRAW);
-
-		GLuint vao;
-
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, bufs[0]);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufs[1]);
-
-		if (attrib.mPositionAttribute != -1) {
-			glEnableVertexAttribArray(attrib.mPositionAttribute);
-			glVertexAttribPointer(attrib.mPositionAttribute, 3, GL_FLOAT, GL_FALSE,
-				stride * sizeof(float), (void*)(position_off * sizeof(float)));
-		}
-		if (attrib.mUVAttribute != -1) {
-			glEnableVertexAttribArray(attrib.mUVAttribute);
-			glVertexAttribPointer(attrib.mUVAttribute, 2, GL_FLOAT, GL_FALSE,
-				stride * sizeof(float), (void*)(uv_off * sizeof(float)));
-		}
-		if (attrib.mNormalAttribute != -1) {
-			glEnableVertexAttribArray(attrib.mNormalAttribute);
-			glVertexAttribPointer(attrib.mNormalAttribute, 3, GL_FLOAT, GL_FALSE,
-				stride * sizeof(float), (void*)(normal_off * sizeof(float)));
-		}
-		if (attrib.mTangentAttribute != -1) {
-			glEnableVertexAttribArray(attrib.mTangentAttribute);
-			glVertexAttribPointer(attrib.mTangentAttribute, 3, GL_FLOAT, GL_FALSE,
-				stride * sizeof(float), (void*)(tangent_off * sizeof(float)));
-		}
-		if (attrib.mColorAttribute != -1) {
-			glEnableVertexAttribArray(attrib.mColorAttribute);
-			glVertexAttribPointer(attrib.mColorAttribute, 3, GL_FLOAT, GL_FALSE,
-				stride * sizeof(float), (void*)(color_off * sizeof(float)));
-		}
-
-		Geometry* result = new Geometry();
-		result->mAabb = aabb;
-		result->mVbo = bufs[0];
-		result->mIbo = bufs[1];
-		result->mVao = vao;
-		result->mElementCount = nIndices;
-		result->mElementType = GL_TRIANGLES;
-		result->mIndexType = GL_UNSIGNED_INT;
+		int positionOffset = attrib.mPositionAttribute != -1 && geo->hasPositions() ? (int)position_off : -1;
+		optimizeBuffers(vert_buffer, indx_buffer, &nVerts, nIndices, stride, positionOffset, params, "");
+
+		output->mVertices.resize((size_t)nVerts * stride);
+		output->mStride = stride;
+		output->mVertexCount = nVerts;
+		output->mPositionOffset = positionOffset;
+
+		auto& attributes = output->mAttributes;
+		attributes.clear();
+		if (attrib.mPositionAttribute != -1)
+			attributes.push_back({ attrib.mPositionAttribute, VertexAttributeKind::POSITION, position_off, 3 });
+		if (attrib.mUVAttribute != -1)
+			attributes.push_back({ attrib.mUVAttribute, VertexAttributeKind::UV, uv_off, 2 });
+		if (attrib.mNormalAttribute != -1)
+			attributes.push_back({ attrib.mNormalAttribute, VertexAttributeKind::NORMAL, normal_off, 3 });
+		if (attrib.mTangentAttribute != -1)
+			attributes.push_back({ attrib.mTangentAttribute, VertexAttributeKind::NORMAL, tangent_off, 3 });
+		if (attrib.mColorAttribute != -1)
+			attributes.push_back({ attrib.mColorAttribute, VertexAttributeKind::COLOR, color_off, 3 });
+	}
 
-		delete[] vert_buffer;
-		delete[] indx_buffer;
+	Geometry* ContentFactory<Geometry>::makeGeometryUnmanaged(const HalfEdgeGeometry* geo,
+		const HalfEdgeAttributes& attrib,
+		const ContentExtParams<Geometry>& params) const {
+		GeometryBuffers buffers;
+		makeBuffers(geo, attrib, params, &buffers);
 
-		return result;
+		CookedGeometryLevel level;
+		packGeometryLevel(buffers, params.mVertexFormat ? *params.mVertexFormat : mVertexFormat, 0.0f, &level);
+		return uploadGeometry(level);
 	}
 
 	Geometry* ContentFactory<Geometry>::makeGeometry(GLuint vao, GLuint vbo, GLuint ibo,
@@ -420,8 +594,15 @@ namespace Morpheus {
 	Geometry* ContentFactory<Geometry>::makeGeometry(const HalfEdgeGeometry* geo,
 		const HalfEdgeAttributes& attrib,
 		const std::string& source) const {
+		return makeGeometry(geo, attrib, ContentExtParams<Geometry>(), source);
+	}
 
-		auto result = makeGeometryUnmanaged(geo, attrib);
+	Geometry* ContentFactory<Geometry>::makeGeometry(const HalfEdgeGeometry* geo,
+		const HalfEdgeAttributes& attrib,
+		const ContentExtParams<Geometry>& params,
+		const std::string& source) const {
+
+		auto result = makeGeometryUnmanaged(geo, attrib, params);
 
 		// Add geometry to content
 		if (source.length() > 0)
@@ -432,6 +613,95 @@ namespace Morpheus {
 		return result;
 	}
 
+	bool ContentFactory<Geometry>::cook(const std::string& source, const std::string& destination,
+		const GeometryCookParameters& params) const {
+		cout << "Cooking geometry " << source << " into " << destination << "..." << endl;
+
+		// Use importers of our own so that several meshes can be cooked at once
+		Importer importer;
+		GeometryBuffers buffers;
+		if (!importBuffers(&importer, source, params.mOptimize, &buffers))
+			return false;
+
+		CookedGeometry cooked;
+		cooked.mFormat = params.mFormat;
+		cooked.mLevels.emplace_back();
+		packGeometryLevel(buffers, params.mFormat, 0.0f, &cooked.mLevels.back());
+
+		if (params.bBuildBvh)
+			buildTriangleBVH(buffers, COOKED_BVH_MAX_LEAF_SIZE, &cooked.mBvhNodes, &cooked.mBvhTriangles);
+
+		if (params.mLodLevels > 0) {
+			// Do not weld vertices, so that UV and normal seams stay intact as boundaries
+			HalfEdgeLoadParameters loadParams;
+			loadParams.mRelativeJoinEpsilon = 0.0f;
+
+			ContentFactory<HalfEdgeGeometry> halfEdgeFactory;
+			auto halfEdge = halfEdgeFactory.loadUnmanaged(source, loadParams);
+
+			if (halfEdge) {
+				std::vector<HalfEdgeGeometry*> lods;
+				std::vector<float> errors;
+				generateLodChain(halfEdge, params.mLodLevels, params.mLodRatio, params.mSimplify, &lods, &errors);
+
+				for (uint32_t i = 0; i < lods.size(); ++i) {
+					GeometryBuffers lodBuffers;
+					makeBuffers(lods[i], HalfEdgeAttributes::defaults(), params.mOptimize, &lodBuffers);
+					cooked.mLevels.emplace_back();
+					packGeometryLevel(lodBuffers, params.mFormat, errors[i], &cooked.mLevels.back());
+
+					halfEdgeFactory.unload(lods[i]);
+				}
+
+				halfEdgeFactory.unload(halfEdge);
+			}
+			else {
+				cout << "Warning: failed to generate levels of detail for " << source << endl;
+			}
+		}
+
+		return writeCookedGeometry(destination, cooked);
+	}
+
+	GeometryCookParameters GeometryCookParameters::defaults() {
+		GeometryCookParameters params;
+		params.mFormat = VertexFormat::defaults();
+		params.mLodLevels = 0;
+		params.mLodRatio = 0.5f;
+		params.mSimplify = SimplifyParameters::defaults();
+		params.bBuildBvh = true;
+		return params;
+	}
+
+	GeometryCookParameters GeometryCookParameters::fromConfig(const nlohmann::json& config) {
+		GeometryCookParameters params = defaults();
+		params.mFormat = VertexFormat::fromConfig(config);
+
+		if (config.contains("cook") && config["cook"].contains("geometry")) {
+			auto& geometryConfig = config["cook"]["geometry"];
+			params.mLodLevels = geometryConfig.value("lod_levels", params.mLodLevels);
+			params.mLodRatio = geometryConfig.value("lod_ratio", params.mLodRatio);
+			params.mSimplify.mUVWeight = geometryConfig.value("uv_weight", params.mSimplify.mUVWeight);
+			params.mSimplify.mNormalWeight = geometryConfig.value("normal_weight", params.mSimplify.mNormalWeight);
+			params.bBuildBvh = geometryConfig.value("bvh", params.bBuildBvh);
+		}
+
+		return params;
+	}
+
+	std::string GeometryCookParameters::cacheParameters() const {
+		std::stringstream ss;
+		ss << "geometry " << COOKED_GEOMETRY_VERSION <<
+			" format " << (int)mFormat.mPositions << " " << (int)mFormat.mNormals << " " <<
+			(int)mFormat.mUVs << " " << mFormat.bShortIndices <<
+			" optimize " << mOptimize.bOptimizeVertexCache << " " << mOptimize.bOptimizeOverdraw << " " <<
+			mOptimize.mOverdrawThreshold << " " << mOptimize.bOptimizeVertexFetch <<
+			" lods " << mLodLevels << " " << mLodRatio << " " << mSimplify.mMaxError << " " <<
+			mSimplify.mUVWeight << " " << mSimplify.mNormalWeight << " " << mSimplify.mBoundaryWeight <<
+			" bvh " << bBuildBvh;
+		return ss.str();
+	}
+
 	HalfEdgeAttributes HalfEdgeAttributes::defaults()
 	{
 		HalfEdgeAttributes attrib;
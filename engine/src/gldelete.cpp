@@ -0,0 +1,100 @@
+#include <engine/gldelete.hpp>
+
+namespace Morpheus {
+
+	GLDeleteQueue::GLDeleteQueue() : mBatchDepth(0) {
+	}
+
+	void GLDeleteQueue::defer(std::vector<GLuint>* queue, GLsizei count, const GLuint* names) {
+		for (GLsizei i = 0; i < count; ++i) {
+			// Zero is silently ignored by OpenGL anyway
+			if (names[i])
+				queue->push_back(names[i]);
+		}
+	}
+
+	void GLDeleteQueue::beginBatch() {
+		++mBatchDepth;
+	}
+
+	void GLDeleteQueue::endBatch() {
+		if (mBatchDepth == 0)
+			return;
+
+		if (--mBatchDepth == 0)
+			flush();
+	}
+
+	void GLDeleteQueue::flush() {
+		if (!mTextures.empty())
+			glDeleteTextures((GLsizei)mTextures.size(), mTextures.data());
+		if (!mBuffers.empty())
+			glDeleteBuffers((GLsizei)mBuffers.size(), mBuffers.data());
+		if (!mVertexArrays.empty())
+			glDeleteVertexArrays((GLsizei)mVertexArrays.size(), mVertexArrays.data());
+		if (!mFramebuffers.empty())
+			glDeleteFramebuffers((GLsizei)mFramebuffers.size(), mFramebuffers.data());
+		if (!mSamplers.empty())
+			glDeleteSamplers((GLsizei)mSamplers.size(), mSamplers.data());
+		// Programs have no batched delete
+		for (auto program : mPrograms)
+			glDeleteProgram(program);
+
+		mTextures.clear();
+		mBuffers.clear();
+		mVertexArrays.clear();
+		mFramebuffers.clear();
+		mSamplers.clear();
+		mPrograms.clear();
+	}
+
+	void GLDeleteQueue::deleteTextures(GLsizei count, const GLuint* names) {
+		if (isBatching())
+			defer(&mTextures, count, names);
+		else
+			glDeleteTextures(count, names);
+	}
+
+	void GLDeleteQueue::deleteBuffers(GLsizei count, const GLuint* names) {
+		if (isBatching())
+			defer(&mBuffers, count, names);
+		else
+			glDeleteBuffers(count, names);
+	}
+
+	void GLDeleteQueue::deleteVertexArrays(GLsizei count, const GLuint* names) {
+		if (isBatching())
+			defer(&mVertexArrays, count, names);
+		else
+			glDeleteVertexArrays(count, names);
+	}
+
+	void GLDeleteQueue::deleteFramebuffers(GLsizei count, const GLuint* names) {
+		if (isBatching())
+			defer(&mFramebuffers, count, names);
+		else
+			glDeleteFramebuffers(count, names);
+	}
+
+	void GLDeleteQueue::deleteSamplers(GLsizei count, const GLuint* names) {
+		if (isBatching())
+			defer(&mSamplers, count, names);
+		else
+			glDeleteSamplers(count, names);
+	}
+
+	void GLDeleteQueue::deletePrograms(GLsizei count, const GLuint* names) {
+		if (isBatching()) {
+			defer(&mPrograms, count, names);
+			return;
+		}
+
+		for (GLsizei i = 0; i < count; ++i)
+			glDeleteProgram(names[i]);
+	}
+
+	GLDeleteQueue* glDeleteQueue() {
+		static GLDeleteQueue queue;
+		return &queue;
+	}
+}
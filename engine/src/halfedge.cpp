@@ -3,10 +3,20 @@
 
 #include <iostream>
 #include <fstream>
+#include <unordered_map>
 
 using namespace std;
 using namespace nlohmann;
 
+struct pair_hash
+{
+	template <class T1, class T2>
+	std::size_t operator() (const std::pair<T1, T2>& pair) const
+	{
+		return std::hash<T1>()(pair.first) ^ std::hash<T2>()(pair.second);
+	}
+};
+
 namespace Morpheus {
 	HalfEdgeGeometry* loadBinary(const std::string& path)
 	{
@@ -398,6 +408,117 @@ namespace Morpheus {
 
 
 
+	void HalfEdgeGeometry::buildTopology(const std::vector<uint32_t>& faceIndices,
+		const std::vector<uint32_t>& faceSizes) {
+		unordered_map<pair<int, int>, int, pair_hash> vertexToEdgeMap;
+
+		edges.reserve(edges.size() + faceIndices.size());
+		faces.reserve(faces.size() + faceSizes.size());
+
+		// Make faces and half edges
+		for (size_t i = 0, start = 0; i < faceSizes.size(); start += faceSizes[i], ++i) {
+			const uint32_t* face = &faceIndices[start];
+			const uint32_t faceSize = faceSizes[i];
+			RawFace f;
+			int faceId = static_cast<int>(faces.size());
+			int newEdgesIdStart = static_cast<int>(edges.size());
+
+			for (uint32_t vi = 1; vi <= faceSize; ++vi) {
+				unsigned int headId = vi == faceSize ? face[0] : face[vi];
+				unsigned int tailId = face[vi - 1];
+
+				int newEdgeId = static_cast<int>(edges.size());
+
+				f.edge = newEdgeId;
+				vertexToEdgeMap[make_pair(tailId, headId)] = newEdgeId;
+
+				RawEdge e;
+				e.face = faceId;
+				e.head = headId;
+				e.next = vi == faceSize ? newEdgesIdStart : newEdgeId + 1;
+				e.opposite = -1;
+
+				edges.push_back(e);
+			}
+
+			faces.push_back(f);
+		}
+
+		vector<int> unlinkedEdges;
+
+		vertices.resize(vertexPositions.size());
+
+		// Link half edges
+		for (auto& item : vertexToEdgeMap) {
+			// Link tail vertex to this edge
+			vertices[item.first.first].edge = item.second;
+
+			if (edges[item.second].opposite == -1) {
+				auto reverse = make_pair(item.first.second, item.first.first);
+
+				auto it = vertexToEdgeMap.find(reverse);
+				if (it != vertexToEdgeMap.end()) {
+					edges[item.second].opposite = it->second;
+					edges[it->second].opposite = item.second;
+				}
+				else
+					unlinkedEdges.push_back(item.second);
+			}
+		}
+
+		vector<int> dummyEdges;
+
+		// Create dummy edges for unlinked half edges
+		for (auto edgeId : unlinkedEdges) {
+			auto& edge = edges[edgeId];
+
+			int newEdgeId = static_cast<int>(edges.size());
+			edge.opposite = newEdgeId;
+
+			Edge oldEdge(this, this, edgeId);
+			Edge lastEdge = oldEdge;
+			for (auto eIt = oldEdge.edgesOnFace(); !eIt.done(); eIt.next())
+				lastEdge = eIt();
+
+			// Circle around the face to get the tail
+			RawEdge e;
+			e.face = -1;
+			e.opposite = edgeId;
+			e.next = -1;
+			e.head = lastEdge.head().id();
+
+			edges.push_back(e);
+			dummyEdges.push_back(newEdgeId);
+		}
+
+		// Link up dummy edges
+		// NOTE Mesh cannot have a vertex adjacent to multiple holes!
+		for (auto edgeId : dummyEdges) {
+			auto traverseEdgeId = edges[edgeId].opposite;
+			assert(traverseEdgeId != -1);
+
+			while (edges[traverseEdgeId].face != -1) {
+				traverseEdgeId = edges[traverseEdgeId].next;
+				traverseEdgeId = edges[traverseEdgeId].opposite;
+			}
+
+			edges[traverseEdgeId].next = edgeId;
+
+			// Link vertices if they haven't already been
+			vertices[edges[traverseEdgeId].head].edge = edgeId;
+		}
+	}
+
+	HalfEdgeGeometry* makeHalfEdgeGeometry(const std::vector<vec3type>& positions,
+		const std::vector<uint32_t>& faceIndices,
+		const std::vector<uint32_t>& faceSizes) {
+		auto geo = new HalfEdgeGeometry();
+		geo->vertexPositions = positions;
+		geo->buildTopology(faceIndices, faceSizes);
+		geo->updateBoundingBox();
+		return geo;
+	}
+
 	HalfEdgeGeometry::HalfEdgeGeometry(const HalfEdgeGeometry& geo) : INodeOwner(NodeType::HALF_EDGE_GEOMETRY) {
 		geo.copyTo(this);
 	}
@@ -16,15 +16,6 @@ using namespace glm;
 
 #define DEFAULT_RELATIVE_JOIN_EPSILON 0.0001f
 
-struct pair_hash
-{
-	template <class T1, class T2>
-	std::size_t operator() (const std::pair<T1, T2>& pair) const
-	{
-		return std::hash<T1>()(pair.first) ^ std::hash<T2>()(pair.second);
-	}
-};
-
 namespace Morpheus {
 
 	vec3type conv(const aiVector3D& vec) {
@@ -122,7 +113,7 @@ namespace Morpheus {
 
 		if (bTangents)
 			for (uint32_t i = 0; i < nVerts; ++i)
-				geo->vertexUVs.push_back(conv(mesh->mTangents[i]));
+				geo->vertexTangents.push_back(conv(mesh->mTangents[i]));
 
 		vector<vec3*> posPtrs;
 		posPtrs.reserve(geo->vertexPositions.size());
@@ -239,99 +230,19 @@ namespace Morpheus {
 				srcToCompressedMap[i] = i;
 		}
 
-		unordered_map<pair<int, int>, int, pair_hash> vertexToEdgeMap;
-
 		// Make faces and half edges
+		vector<uint32_t> faceIndices;
+		vector<uint32_t> faceSizes;
+		faceIndices.reserve(nIndicesGuess);
+		faceSizes.reserve(nFaces);
 		for (uint32_t i = 0; i < nFaces; ++i) {
 			auto& face = mesh->mFaces[i];
-			RawFace f;
-			int faceId = static_cast<int>(geo->faces.size());
-			int newEdgesIdStart = static_cast<int>(geo->edges.size());
-
-			for (uint32_t vi = 1; vi <= face.mNumIndices; ++vi) {
-				unsigned int headId = srcToCompressedMap[vi == face.mNumIndices ? face.mIndices[0] : face.mIndices[vi]];
-				unsigned int tailId = srcToCompressedMap[face.mIndices[vi - 1]];
-
-				int newEdgeId = static_cast<int>(geo->edges.size());
-
-				f.edge = newEdgeId;
-				vertexToEdgeMap[make_pair(tailId, headId)] = newEdgeId;
-
-				RawEdge e;
-				e.face = faceId;
-				e.head = headId;
-				e.next = vi == face.mNumIndices ? newEdgesIdStart : newEdgeId + 1;
-				e.opposite = -1;
-
-				geo->edges.push_back(e);
-			}
-
-			geo->faces.push_back(f);
+			for (uint32_t vi = 0; vi < face.mNumIndices; ++vi)
+				faceIndices.push_back(srcToCompressedMap[face.mIndices[vi]]);
+			faceSizes.push_back(face.mNumIndices);
 		}
 
-		vector<int> unlinkedEdges;
-
-		geo->vertices.resize(geo->vertexPositions.size());
-
-		// Link half edges
-		for (auto& item : vertexToEdgeMap) {
-			// Link tail vertex to this edge
-			geo->vertices[item.first.first].edge = item.second;
-
-			if (geo->edges[item.second].opposite == -1) {
-				auto reverse = make_pair(item.first.second, item.first.first);
-
-				auto it = vertexToEdgeMap.find(reverse);
-				if (it != vertexToEdgeMap.end()) {
-					geo->edges[item.second].opposite = it->second;
-					geo->edges[it->second].opposite = item.second;
-				}
-				else
-					unlinkedEdges.push_back(item.second);
-			}
-		}
-
-		vector<int> dummyEdges;
-
-		// Create dummy edges for unlinked half edges
-		for (auto edgeId : unlinkedEdges) {
-			auto& edge = geo->edges[edgeId];
-
-			int newEdgeId = static_cast<int>(geo->edges.size());
-			edge.opposite = newEdgeId;
-
-			Edge oldEdge(geo, geo, edgeId);
-			Edge lastEdge = oldEdge;
-			for (auto eIt = oldEdge.edgesOnFace(); !eIt.done(); eIt.next())
-				lastEdge = eIt();
-
-			// Circle around the face to get the tail
-			RawEdge e;
-			e.face = -1;
-			e.opposite = edgeId;
-			e.next = -1;
-			e.head = lastEdge.head().id();
-
-			geo->edges.push_back(e);
-			dummyEdges.push_back(newEdgeId);
-		}
-
-		// Link up dummy edges
-		// NOTE Mesh cannot have a vertex adjacent to multiple holes!
-		for (auto edgeId : dummyEdges) {
-			auto traverseEdgeId = geo->edges[edgeId].opposite;
-			assert(traverseEdgeId != -1);
-
-			while (geo->edges[traverseEdgeId].face != -1) {
-				traverseEdgeId = geo->edges[traverseEdgeId].next;
-				traverseEdgeId = geo->edges[traverseEdgeId].opposite;
-			}
-
-			geo->edges[traverseEdgeId].next = edgeId;
-
-			// Link vertices if they haven't already been
-			geo->vertices[geo->edges[traverseEdgeId].head].edge = edgeId;
-		}
+		geo->buildTopology(faceIndices, faceSizes);
 
 		return geo;
 	}
@@ -344,6 +255,20 @@ namespace Morpheus {
 		delete ref;
 	}
 
+	ContentSize ContentFactory<HalfEdgeGeometry>::measure(INodeOwner* ref) const {
+		auto geo = ref->toHalfEdgeGeometry();
+		ContentSize size{0, 0};
+		size.mCpuBytes += geo->vertexPositions.capacity() * sizeof(vec3type);
+		size.mCpuBytes += geo->vertexUVs.capacity() * sizeof(vec2type);
+		size.mCpuBytes += geo->vertexNormals.capacity() * sizeof(vec3type);
+		size.mCpuBytes += geo->vertexTangents.capacity() * sizeof(vec3type);
+		size.mCpuBytes += geo->vertexColors.capacity() * sizeof(vec3type);
+		size.mCpuBytes += geo->vertices.capacity() * sizeof(RawVertex);
+		size.mCpuBytes += geo->edges.capacity() * sizeof(RawEdge);
+		size.mCpuBytes += geo->faces.capacity() * sizeof(RawFace);
+		return size;
+	}
+
 	ContentFactory<HalfEdgeGeometry>::~ContentFactory() {
 		delete mImporter;
 	}
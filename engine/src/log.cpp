@@ -0,0 +1,93 @@
+#include <engine/log.hpp>
+
+#include <iostream>
+
+namespace Morpheus {
+
+	LogLevel logLevelFromString(const std::string& str) {
+		if (str == "verbose")
+			return LogLevel::VERBOSE;
+		else if (str == "info")
+			return LogLevel::INFO;
+		else if (str == "warning")
+			return LogLevel::WARNING;
+		else if (str == "error")
+			return LogLevel::CRITICAL;
+		else if (str == "none")
+			return LogLevel::NONE;
+
+		std::cout << "Warning: unknown log level " << str << ", using info." << std::endl;
+		return LogLevel::INFO;
+	}
+
+	Logger::Logger() : mLevel(LogLevel::INFO),
+		bConsole(true),
+		mWriter(1) {
+	}
+
+	Logger::~Logger() {
+		flush();
+	}
+
+	void Logger::configure(const nlohmann::json& config) {
+		if (!config.contains("log"))
+			return;
+
+		auto& logConfig = config["log"];
+		setLevel(logLevelFromString(logConfig.value("level", std::string("info"))));
+		setConsole(logConfig.value("console", true));
+
+		std::string path = logConfig.value("file", std::string(""));
+		if (!path.empty() && !setFile(path))
+			std::cout << "Warning: could not open log file " << path << "!" << std::endl;
+	}
+
+	bool Logger::setFile(const std::string& path) {
+		// Let queued messages reach the old file first
+		mWriter.wait();
+
+		std::lock_guard<std::mutex> lock(mFileMutex);
+		if (mFile.is_open())
+			mFile.close();
+		if (path.empty())
+			return true;
+
+		mFile.open(path, std::ios::trunc);
+		return mFile.is_open();
+	}
+
+	void Logger::write(LogLevel level, std::string&& message) {
+		if (!enabled(level))
+			return;
+
+		const char* prefix = "";
+		if (level == LogLevel::WARNING)
+			prefix = "Warning: ";
+		else if (level == LogLevel::CRITICAL)
+			prefix = "Error: ";
+
+		bool bToConsole = bConsole;
+		mWriter.submit([this, prefix, bToConsole, message = std::move(message)]() {
+			if (bToConsole)
+				std::cout << prefix << message << '\n';
+
+			std::lock_guard<std::mutex> lock(mFileMutex);
+			if (mFile.is_open())
+				mFile << prefix << message << '\n';
+		});
+	}
+
+	void Logger::flush() {
+		mWriter.wait();
+
+		std::cout.flush();
+		std::lock_guard<std::mutex> lock(mFileMutex);
+		if (mFile.is_open())
+			mFile.flush();
+	}
+
+	Logger* logger() {
+		static Logger instance;
+		return &instance;
+	}
+}
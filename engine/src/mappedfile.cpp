@@ -0,0 +1,49 @@
+#include <engine/mappedfile.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Morpheus {
+
+	MappedFile::~MappedFile() {
+		close();
+	}
+
+	bool MappedFile::open(const std::string& path) {
+		close();
+
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fd, &info) != 0 || info.st_size == 0) {
+			::close(fd);
+			return false;
+		}
+
+		void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps its own reference to the file
+		::close(fd);
+
+		if (data == MAP_FAILED)
+			return false;
+
+		// Content is read front to back once, usually straight into glBufferData
+		madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+		mData = data;
+		mSize = (size_t)info.st_size;
+		return true;
+	}
+
+	void MappedFile::close() {
+		if (mData) {
+			munmap(mData, mSize);
+			mData = nullptr;
+			mSize = 0;
+		}
+	}
+}
@@ -20,17 +20,12 @@ namespace Morpheus {
         
         cout << "Loading material " << source << "..." << endl;
 
-        ifstream f(source);
-
-        if (!f.is_open()) {
+        json j;
+        if (!readContentJson(source, content()->derivedCache(), &j)) {
             cout << "Error: failed to open " << source << "!" << endl;
             return nullptr;
         }
 
-        json j;
-        f >> j;
-        f.close();
-
         string shaderSrc;
         j["shader"].get_to(shaderSrc);
 
@@ -0,0 +1,336 @@
+#include <engine/meshopt.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Scoring constants from Forsyth
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+using namespace std;
+
+namespace Morpheus {
+
+	void VertexCacheStats::print(std::ostream& os) const {
+		os << "ACMR: " << mACMR << ", ATVR: " << mATVR << std::endl;
+	}
+
+	VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount,
+		size_t vertexCount, uint32_t cacheSize) {
+		// A vertex is in the FIFO if it was pushed less than cacheSize pushes ago
+		std::vector<size_t> pushedAt(vertexCount, 0);
+		std::vector<bool> bUsed(vertexCount, false);
+		size_t pushes = 0;
+		size_t uniqueVertices = 0;
+
+		for (size_t i = 0; i < indexCount; ++i) {
+			uint32_t v = indices[i];
+			if (!bUsed[v]) {
+				bUsed[v] = true;
+				++uniqueVertices;
+			}
+			else if (pushes - pushedAt[v] < cacheSize)
+				continue;
+
+			pushedAt[v] = pushes++;
+		}
+
+		VertexCacheStats stats;
+		size_t triangleCount = indexCount / 3;
+		stats.mACMR = triangleCount > 0 ? (double)pushes / (double)triangleCount : 0.0;
+		stats.mATVR = uniqueVertices > 0 ? (double)pushes / (double)uniqueVertices : 0.0;
+		return stats;
+	}
+
+	inline float forsythVertexScore(int cachePosition, uint32_t remainingTriangles) {
+		// No triangles left to draw, nothing to gain
+		if (remainingTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// The vertices of the last triangle get a fixed score, so that the next
+			// triangle does not simply reuse the same edge over and over
+			if (cachePosition < 3)
+				score = FORSYTH_LAST_TRIANGLE_SCORE;
+			else {
+				const float scale = 1.0f / (VERTEX_CACHE_OPTIMIZE_SIZE - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+			}
+		}
+
+		// Favour vertices with few triangles left, so that they are finished off
+		score += FORSYTH_VALENCE_BOOST_SCALE *
+			std::pow((float)remainingTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+		return score;
+	}
+
+	void optimizeVertexCache(uint32_t* destination, const uint32_t* indices,
+		size_t indexCount, size_t vertexCount) {
+		size_t triangleCount = indexCount / 3;
+
+		// Triangle adjacency of every vertex, in compressed row form
+		std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < indexCount; ++i)
+			++adjacencyOffsets[indices[i] + 1];
+		for (size_t v = 0; v < vertexCount; ++v)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+
+		std::vector<uint32_t> adjacency(indexCount);
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+			adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+		std::vector<uint32_t> remaining(vertexCount);
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v) {
+			remaining[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+			vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+		}
+
+		std::vector<bool> bEmitted(triangleCount, false);
+
+		// The cache holds three extra entries for the triangle being added
+		uint32_t cache[VERTEX_CACHE_OPTIMIZE_SIZE + 3];
+		uint32_t newCache[VERTEX_CACHE_OPTIMIZE_SIZE + 3];
+		uint32_t cacheCount = 0;
+
+		size_t scanCursor = 0;
+		int64_t bestTriangle = -1;
+		size_t outputCursor = 0;
+
+		while (outputCursor < indexCount) {
+			// Nothing in the cache touches an unemitted triangle, start somewhere new
+			if (bestTriangle < 0) {
+				while (scanCursor < triangleCount && bEmitted[scanCursor])
+					++scanCursor;
+				if (scanCursor == triangleCount)
+					break;
+				bestTriangle = (int64_t)scanCursor;
+			}
+
+			size_t t = (size_t)bestTriangle;
+			bEmitted[t] = true;
+
+			uint32_t newCacheCount = 0;
+			for (uint32_t i = 0; i < 3; ++i) {
+				uint32_t v = indices[3 * t + i];
+				destination[outputCursor++] = v;
+				newCache[newCacheCount++] = v;
+
+				// Remove the triangle from the adjacency of its vertices
+				uint32_t* begin = &adjacency[adjacencyOffsets[v]];
+				uint32_t* end = begin + remaining[v];
+				*std::find(begin, end, (uint32_t)t) = *(end - 1);
+				--remaining[v];
+			}
+
+			// Move the triangle's vertices to the front of the LRU cache
+			for (uint32_t i = 0; i < cacheCount; ++i) {
+				uint32_t v = cache[i];
+				if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+					newCache[newCacheCount++] = v;
+			}
+
+			for (uint32_t i = 0; i < newCacheCount; ++i) {
+				uint32_t v = newCache[i];
+				cachePosition[v] = i < VERTEX_CACHE_OPTIMIZE_SIZE ? (int)i : -1;
+				vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+			}
+
+			// Rescore the triangles around cached vertices and take the best one
+			float bestScore = -1.0f;
+			bestTriangle = -1;
+			for (uint32_t i = 0; i < newCacheCount; ++i) {
+				uint32_t v = newCache[i];
+				for (uint32_t j = 0; j < remaining[v]; ++j) {
+					uint32_t tri = adjacency[adjacencyOffsets[v] + j];
+					float score = vertexScore[indices[3 * tri]] +
+						vertexScore[indices[3 * tri + 1]] + vertexScore[indices[3 * tri + 2]];
+					if (score > bestScore) {
+						bestScore = score;
+						bestTriangle = tri;
+					}
+				}
+			}
+
+			cacheCount = std::min(newCacheCount, (uint32_t)VERTEX_CACHE_OPTIMIZE_SIZE);
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+	}
+
+	void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount,
+		const float* positions, size_t positionStride, size_t vertexCount, float threshold) {
+		size_t triangleCount = indexCount / 3;
+		if (triangleCount == 0)
+			return;
+
+		auto position = [positions, positionStride](uint32_t v) {
+			return reinterpret_cast<const float*>(
+				reinterpret_cast<const uint8_t*>(positions) + v * positionStride);
+		};
+
+		// FIFO cache simulation, a vertex is cached if it was pushed at most
+		// VERTEX_CACHE_ANALYZE_SIZE pushes ago. Everything starts out stale.
+		std::vector<size_t> pushedAt(vertexCount, 0);
+		size_t pushes = VERTEX_CACHE_ANALYZE_SIZE + 1;
+		auto triangleMisses = [&](size_t t) {
+			uint32_t result = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = indices[3 * t + k];
+				if (pushes - pushedAt[v] > VERTEX_CACHE_ANALYZE_SIZE) {
+					pushedAt[v] = pushes++;
+					++result;
+				}
+			}
+			return result;
+		};
+		auto flushCache = [&]() {
+			pushes += VERTEX_CACHE_ANALYZE_SIZE + 1;
+		};
+
+		// Triangles that miss on every vertex are where the cache optimizer restarted,
+		// clusters can be reordered freely at these points
+		std::vector<size_t> hardBoundaries;
+		for (size_t t = 0; t < triangleCount; ++t)
+			if (triangleMisses(t) == 3)
+				hardBoundaries.push_back(t);
+		hardBoundaries.push_back(triangleCount);
+
+		// Split hard clusters further wherever the miss ratio of the cluster so far, starting
+		// from an empty cache, is already within the threshold of the whole cluster
+		std::vector<size_t> clusters;
+		for (size_t c = 0; c + 1 < hardBoundaries.size(); ++c) {
+			size_t begin = hardBoundaries[c];
+			size_t end = hardBoundaries[c + 1];
+
+			flushCache();
+			size_t clusterMisses = 0;
+			for (size_t t = begin; t < end; ++t)
+				clusterMisses += triangleMisses(t);
+			double limit = threshold * (double)clusterMisses / (double)(end - begin);
+
+			flushCache();
+			clusters.push_back(begin);
+			size_t runningMisses = 0;
+			size_t runningTriangles = 0;
+			for (size_t t = begin; t < end; ++t) {
+				runningMisses += triangleMisses(t);
+				++runningTriangles;
+				if (t + 1 < end && (double)runningMisses / (double)runningTriangles <= limit) {
+					flushCache();
+					clusters.push_back(t + 1);
+					runningMisses = 0;
+					runningTriangles = 0;
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+
+		// Mesh centroid, weighted by area
+		double meshCenter[3] = { 0.0, 0.0, 0.0 };
+		double meshArea = 0.0;
+		std::vector<float> triangleNormals(triangleCount * 3);
+		std::vector<float> triangleCenters(triangleCount * 3);
+		std::vector<float> triangleAreas(triangleCount);
+		for (size_t t = 0; t < triangleCount; ++t) {
+			const float* p0 = position(indices[3 * t]);
+			const float* p1 = position(indices[3 * t + 1]);
+			const float* p2 = position(indices[3 * t + 2]);
+
+			float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			float* n = &triangleNormals[3 * t];
+			n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+			float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			triangleAreas[t] = area;
+
+			for (uint32_t k = 0; k < 3; ++k) {
+				triangleCenters[3 * t + k] = (p0[k] + p1[k] + p2[k]) / 3.0f;
+				meshCenter[k] += area * triangleCenters[3 * t + k];
+			}
+			meshArea += area;
+		}
+		if (meshArea > 0.0)
+			for (uint32_t k = 0; k < 3; ++k)
+				meshCenter[k] /= meshArea;
+
+		// Clusters that face away from the center are on the outside and should go first
+		size_t clusterCount = clusters.size() - 1;
+		std::vector<std::pair<float, size_t>> order(clusterCount);
+		for (size_t c = 0; c < clusterCount; ++c) {
+			double center[3] = { 0.0, 0.0, 0.0 };
+			double normal[3] = { 0.0, 0.0, 0.0 };
+			double area = 0.0;
+
+			for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+				for (uint32_t k = 0; k < 3; ++k) {
+					center[k] += triangleAreas[t] * triangleCenters[3 * t + k];
+					// The cross product already carries twice the area
+					normal[k] += triangleNormals[3 * t + k];
+				}
+				area += triangleAreas[t];
+			}
+
+			double normalLength = std::sqrt(normal[0] * normal[0] +
+				normal[1] * normal[1] + normal[2] * normal[2]);
+
+			float key = 0.0f;
+			if (area > 0.0 && normalLength > 0.0) {
+				for (uint32_t k = 0; k < 3; ++k)
+					key += (float)((center[k] / area - meshCenter[k]) * normal[k] / normalLength);
+			}
+
+			order[c] = std::make_pair(-key, c);
+		}
+
+		std::stable_sort(order.begin(), order.end(),
+			[](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) {
+			return a.first < b.first;
+		});
+
+		size_t outputCursor = 0;
+		for (auto& item : order) {
+			size_t c = item.second;
+			size_t begin = 3 * clusters[c];
+			size_t end = 3 * clusters[c + 1];
+			std::copy(indices + begin, indices + end, destination + outputCursor);
+			outputCursor += end - begin;
+		}
+	}
+
+	size_t optimizeVertexFetch(void* vertices, uint32_t* indices, size_t indexCount,
+		size_t vertexCount, size_t vertexSize) {
+		const uint32_t unused = (uint32_t)-1;
+		std::vector<uint32_t> remap(vertexCount, unused);
+		uint32_t next = 0;
+
+		for (size_t i = 0; i < indexCount; ++i) {
+			uint32_t& target = remap[indices[i]];
+			if (target == unused)
+				target = next++;
+			indices[i] = target;
+		}
+
+		if (vertexCount == 0)
+			return 0;
+
+		std::vector<uint8_t> copy(vertexCount * vertexSize);
+		std::memcpy(&copy[0], vertices, vertexCount * vertexSize);
+
+		uint8_t* vertexBytes = reinterpret_cast<uint8_t*>(vertices);
+		for (size_t v = 0; v < vertexCount; ++v)
+			if (remap[v] != unused)
+				std::memcpy(vertexBytes + remap[v] * vertexSize, &copy[v * vertexSize], vertexSize);
+
+		return next;
+	}
+}
@@ -0,0 +1,377 @@
+#include <engine/mipgen.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPGEN_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// Support of the windowed sinc filters in destination texels
+#define MIP_SINC_RADIUS 3.0f
+#define MIP_KAISER_ALPHA 4.0f
+// Binary search steps and largest alpha scale when preserving alpha coverage
+#define MIP_COVERAGE_ITERATIONS 16
+#define MIP_COVERAGE_MAX_SCALE 8.0f
+
+namespace Morpheus {
+
+	MipGenParameters MipGenParameters::defaults() {
+		MipGenParameters params;
+		params.mFilter = MipFilter::KAISER;
+		params.bSRGB = false;
+		params.bPreserveAlphaCoverage = false;
+		params.mAlphaReference = 0.5f;
+		return params;
+	}
+
+	MipGenParameters MipGenParameters::fromConfig(const nlohmann::json& config) {
+		MipGenParameters params = defaults();
+
+		if (config.contains("mip_generation")) {
+			auto& mipConfig = config["mip_generation"];
+			std::string filter = mipConfig.value("filter", std::string("kaiser"));
+			if (filter == "box")
+				params.mFilter = MipFilter::BOX;
+			else if (filter == "lanczos")
+				params.mFilter = MipFilter::LANCZOS;
+			else if (filter == "kaiser")
+				params.mFilter = MipFilter::KAISER;
+			else
+				std::cout << "Warning: unknown mip filter " << filter << ", using kaiser." << std::endl;
+
+			params.bSRGB = mipConfig.value("srgb", params.bSRGB);
+			params.bPreserveAlphaCoverage = mipConfig.value("preserve_alpha_coverage", params.bPreserveAlphaCoverage);
+			params.mAlphaReference = mipConfig.value("alpha_reference", params.mAlphaReference);
+		}
+
+		return params;
+	}
+
+	std::string MipGenParameters::cacheParameters() const {
+		std::stringstream ss;
+		ss << "mips " << (int)mFilter << " " << bSRGB << " " << bPreserveAlphaCoverage << " " << mAlphaReference;
+		return ss.str();
+	}
+
+	inline float sinc(float x) {
+		if (std::abs(x) < 1e-5f)
+			return 1.0f;
+		x *= 3.14159265358979f;
+		return std::sin(x) / x;
+	}
+
+	// Modified Bessel function of the first kind of order 0
+	inline float besselI0(float x) {
+		float sum = 1.0f;
+		float term = 1.0f;
+		float halfX = x / 2.0f;
+		for (int k = 1; k < 32 && term > sum * 1e-8f; ++k) {
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	// t: Distance from the destination texel center in destination texels.
+	float evaluateFilter(MipFilter filter, float t) {
+		t = std::abs(t);
+		switch (filter) {
+		case MipFilter::BOX:
+			return t <= 0.5f ? 1.0f : 0.0f;
+		case MipFilter::LANCZOS:
+			return t < MIP_SINC_RADIUS ? sinc(t) * sinc(t / MIP_SINC_RADIUS) : 0.0f;
+		case MipFilter::KAISER:
+		{
+			if (t >= MIP_SINC_RADIUS)
+				return 0.0f;
+			float r = t / MIP_SINC_RADIUS;
+			return sinc(t) * besselI0(MIP_KAISER_ALPHA * std::sqrt(1.0f - r * r)) / besselI0(MIP_KAISER_ALPHA);
+		}
+		}
+		return 0.0f;
+	}
+
+	struct FilterTap {
+		uint32_t mIndex;
+		float mWeight;
+	};
+
+	// The taps of every destination texel along one axis. The taps of texel i are
+	// mTaps[mOffsets[i]] to mTaps[mOffsets[i + 1]].
+	struct FilterTable {
+		std::vector<uint32_t> mOffsets;
+		std::vector<FilterTap> mTaps;
+	};
+
+	void buildFilterTable(MipFilter filter, uint32_t srcSize, uint32_t destSize, FilterTable* table) {
+		float scale = (float)srcSize / (float)destSize;
+		float radius = (filter == MipFilter::BOX ? 0.5f : MIP_SINC_RADIUS) * scale;
+
+		table->mOffsets.resize(destSize + 1);
+		table->mTaps.clear();
+
+		for (uint32_t i = 0; i < destSize; ++i) {
+			table->mOffsets[i] = (uint32_t)table->mTaps.size();
+
+			float center = ((float)i + 0.5f) * scale;
+			int first = (int)std::floor(center - radius);
+			int last = (int)std::ceil(center + radius);
+
+			float total = 0.0f;
+			for (int s = first; s <= last; ++s) {
+				float weight = evaluateFilter(filter, ((float)s + 0.5f - center) / scale);
+				if (weight == 0.0f)
+					continue;
+
+				// Clamp to the edge, merging taps that land on the same texel
+				uint32_t index = (uint32_t)std::clamp(s, 0, (int)srcSize - 1);
+				if (table->mTaps.size() > table->mOffsets[i] && table->mTaps.back().mIndex == index)
+					table->mTaps.back().mWeight += weight;
+				else
+					table->mTaps.push_back(FilterTap{ index, weight });
+				total += weight;
+			}
+
+			for (size_t t = table->mOffsets[i]; t < table->mTaps.size(); ++t)
+				table->mTaps[t].mWeight /= total;
+		}
+
+		table->mOffsets[destSize] = (uint32_t)table->mTaps.size();
+	}
+
+	inline float srgbToLinear(float c) {
+		return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+	}
+
+	inline float linearToSrgb(float c) {
+		return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Filters rows of src horizontally. Every pixel is four floats.
+	void filterRows(const float* src, uint32_t srcWidth, float* dest, uint32_t destWidth,
+		const FilterTable& table, uint32_t firstRow, uint32_t lastRow) {
+		for (uint32_t y = firstRow; y < lastRow; ++y) {
+			const float* srcRow = &src[(size_t)y * srcWidth * 4];
+			float* destRow = &dest[(size_t)y * destWidth * 4];
+
+			for (uint32_t x = 0; x < destWidth; ++x) {
+				const FilterTap* tap = &table.mTaps[table.mOffsets[x]];
+				const FilterTap* end = &table.mTaps[0] + table.mOffsets[x + 1];
+#ifdef MIPGEN_USE_SSE
+				__m128 sum = _mm_setzero_ps();
+				for (; tap != end; ++tap)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tap->mWeight),
+						_mm_loadu_ps(&srcRow[tap->mIndex * 4])));
+				_mm_storeu_ps(&destRow[x * 4], sum);
+#else
+				float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+				for (; tap != end; ++tap)
+					for (int c = 0; c < 4; ++c)
+						sum[c] += tap->mWeight * srcRow[tap->mIndex * 4 + c];
+				std::memcpy(&destRow[x * 4], sum, sizeof(sum));
+#endif
+			}
+		}
+	}
+
+	// Filters columns of src vertically, one whole row at a time, and clamps the result
+	// to [0, maxValue] to remove ringing below zero or above the representable range.
+	void filterColumns(const float* src, float* dest, uint32_t width,
+		const FilterTable& table, uint32_t firstRow, uint32_t lastRow, float maxValue) {
+		size_t rowFloats = (size_t)width * 4;
+
+		for (uint32_t y = firstRow; y < lastRow; ++y) {
+			const FilterTap* first = &table.mTaps[table.mOffsets[y]];
+			const FilterTap* end = &table.mTaps[0] + table.mOffsets[y + 1];
+			float* destRow = &dest[y * rowFloats];
+
+#ifdef MIPGEN_USE_SSE
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 maxV = _mm_set1_ps(maxValue);
+			for (size_t i = 0; i < rowFloats; i += 4) {
+				__m128 sum = zero;
+				for (auto tap = first; tap != end; ++tap)
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(tap->mWeight),
+						_mm_loadu_ps(&src[tap->mIndex * rowFloats + i])));
+				_mm_storeu_ps(&destRow[i], _mm_min_ps(_mm_max_ps(sum, zero), maxV));
+			}
+#else
+			std::fill(destRow, destRow + rowFloats, 0.0f);
+			for (auto tap = first; tap != end; ++tap) {
+				const float* srcRow = &src[tap->mIndex * rowFloats];
+				for (size_t i = 0; i < rowFloats; ++i)
+					destRow[i] += tap->mWeight * srcRow[i];
+			}
+			for (size_t i = 0; i < rowFloats; ++i)
+				destRow[i] = std::clamp(destRow[i], 0.0f, maxValue);
+#endif
+		}
+	}
+
+	// returns: The fraction of texels whose scaled alpha passes the alpha test.
+	float alphaCoverage(const std::vector<float>& level, float scale, float reference) {
+		size_t count = level.size() / 4;
+		size_t passed = 0;
+		for (size_t i = 0; i < count; ++i)
+			if (std::min(level[i * 4 + 3] * scale, 1.0f) > reference)
+				++passed;
+		return (float)passed / (float)count;
+	}
+
+	// returns: The alpha scale that brings the coverage of a level closest to the target.
+	float findCoverageScale(const std::vector<float>& level, float targetCoverage, float reference) {
+		float low = 0.0f;
+		float high = MIP_COVERAGE_MAX_SCALE;
+		float best = 1.0f;
+		float bestError = std::abs(alphaCoverage(level, 1.0f, reference) - targetCoverage);
+
+		for (int i = 0; i < MIP_COVERAGE_ITERATIONS; ++i) {
+			float scale = (low + high) / 2.0f;
+			float coverage = alphaCoverage(level, scale, reference);
+			float error = std::abs(coverage - targetCoverage);
+			if (error < bestError) {
+				best = scale;
+				bestError = error;
+			}
+
+			if (coverage < targetCoverage)
+				low = scale;
+			else if (coverage > targetCoverage)
+				high = scale;
+			else
+				break;
+		}
+
+		return best;
+	}
+
+	MipGenerator::MipGenerator(uint32_t threadCount) : mWorkers(threadCount) {
+	}
+
+	void MipGenerator::generate(const void* pixels, uint32_t width, uint32_t height, uint32_t components,
+		bool bFloat, const MipGenParameters& params, std::vector<MipLevel>* levels) {
+		uint32_t levelCount = 1 + (uint32_t)std::floor(std::log2(std::max(width, height)));
+		uint32_t componentSize = bFloat ? sizeof(float) : sizeof(uint8_t);
+		// Alpha lives in the last component of RGBA images only
+		uint32_t colorComponents = components == 4 ? 3 : components;
+		bool bSRGB = params.bSRGB && !bFloat;
+		bool bCoverage = params.bPreserveAlphaCoverage && components == 4;
+		float maxValue = bFloat ? FLT_MAX : 1.0f;
+
+		levels->resize(levelCount);
+		std::vector<std::vector<float>> linear(levelCount);
+
+		float decode[256];
+		for (int i = 0; i < 256; ++i)
+			decode[i] = bSRGB ? srgbToLinear(i / 255.0f) : i / 255.0f;
+
+		auto submitRows = [this](uint32_t rows, std::function<void(uint32_t, uint32_t)> job) {
+			for (uint32_t first = 0; first < rows; first += MIP_ROWS_PER_JOB) {
+				uint32_t last = std::min(first + MIP_ROWS_PER_JOB, rows);
+				mWorkers.submit([job, first, last]() { job(first, last); });
+			}
+		};
+
+		// Level 0 is copied as is, and expanded to linear RGBA floats for filtering
+		auto& level0 = (*levels)[0];
+		level0.mWidth = width;
+		level0.mHeight = height;
+		level0.mData.resize((size_t)width * height * components * componentSize);
+		std::memcpy(level0.mData.data(), pixels, level0.mData.size());
+
+		linear[0].resize((size_t)width * height * 4);
+		submitRows(height, [&](uint32_t first, uint32_t last) {
+			for (size_t i = (size_t)first * width; i < (size_t)last * width; ++i) {
+				float* out = &linear[0][i * 4];
+				out[0] = out[1] = out[2] = 0.0f;
+				out[3] = 1.0f;
+				for (uint32_t c = 0; c < components; ++c) {
+					if (bFloat)
+						out[c] = static_cast<const float*>(pixels)[i * components + c];
+					else {
+						uint8_t value = static_cast<const uint8_t*>(pixels)[i * components + c];
+						out[c] = c < colorComponents ? decode[value] : value / 255.0f;
+					}
+				}
+			}
+		});
+		mWorkers.wait();
+
+		// Each level is filtered from the previous one, horizontally then vertically
+		std::vector<float> temp;
+		FilterTable horizontal;
+		FilterTable vertical;
+		for (uint32_t level = 1; level < levelCount; ++level) {
+			uint32_t srcWidth = (*levels)[level - 1].mWidth;
+			uint32_t srcHeight = (*levels)[level - 1].mHeight;
+			uint32_t destWidth = std::max(srcWidth / 2, 1u);
+			uint32_t destHeight = std::max(srcHeight / 2, 1u);
+			(*levels)[level].mWidth = destWidth;
+			(*levels)[level].mHeight = destHeight;
+
+			buildFilterTable(params.mFilter, srcWidth, destWidth, &horizontal);
+			buildFilterTable(params.mFilter, srcHeight, destHeight, &vertical);
+
+			const float* src = linear[level - 1].data();
+			temp.resize((size_t)destWidth * srcHeight * 4);
+			linear[level].resize((size_t)destWidth * destHeight * 4);
+
+			submitRows(srcHeight, [&](uint32_t first, uint32_t last) {
+				filterRows(src, srcWidth, temp.data(), destWidth, horizontal, first, last);
+			});
+			mWorkers.wait();
+
+			submitRows(destHeight, [&, level](uint32_t first, uint32_t last) {
+				filterColumns(temp.data(), linear[level].data(), destWidth, vertical, first, last, maxValue);
+			});
+			mWorkers.wait();
+		}
+
+		// Levels are independent from here on, so all of them are processed at once
+		std::vector<float> alphaScale(levelCount, 1.0f);
+		if (bCoverage) {
+			float targetCoverage = alphaCoverage(linear[0], 1.0f, params.mAlphaReference);
+			for (uint32_t level = 1; level < levelCount; ++level) {
+				mWorkers.submit([&, level]() {
+					alphaScale[level] = findCoverageScale(linear[level], targetCoverage, params.mAlphaReference);
+				});
+			}
+			mWorkers.wait();
+		}
+
+		for (uint32_t level = 1; level < levelCount; ++level) {
+			auto& output = (*levels)[level];
+			output.mData.resize((size_t)output.mWidth * output.mHeight * components * componentSize);
+
+			submitRows(output.mHeight, [&, level](uint32_t first, uint32_t last) {
+				auto& output = (*levels)[level];
+				const float* src = linear[level].data();
+				float scale = alphaScale[level];
+
+				for (size_t i = (size_t)first * output.mWidth; i < (size_t)last * output.mWidth; ++i) {
+					for (uint32_t c = 0; c < components; ++c) {
+						float value = src[i * 4 + c];
+						if (c == 3)
+							value = std::min(value * scale, maxValue);
+
+						if (bFloat) {
+							reinterpret_cast<float*>(output.mData.data())[i * components + c] = value;
+						}
+						else {
+							if (bSRGB && c < colorComponents)
+								value = linearToSrgb(value);
+							output.mData[i * components + c] = (uint8_t)(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+						}
+					}
+				}
+			});
+		}
+		mWorkers.wait();
+	}
+}
@@ -0,0 +1,468 @@
+#include <engine/occlusion.hpp>
+#include <engine/halfedge.hpp>
+#include <engine/texture.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_USE_SSE
+#include <emmintrin.h>
+#endif
+
+// Occluder triangles are binned in jobs of at least this many triangles
+#define OCCLUSION_MIN_BIN_JOB_SIZE 256
+
+namespace Morpheus {
+
+	Occluder::Occluder(const std::vector<glm::vec3>& positions,
+		const std::vector<uint32_t>& indices) :
+		INodeOwner(NodeType::OCCLUDER),
+		mPositions(positions),
+		mIndices(indices) {
+		updateBoundingBox();
+	}
+
+	Occluder::Occluder(const HalfEdgeGeometry* geo) :
+		INodeOwner(NodeType::OCCLUDER) {
+		mPositions.reserve(geo->vertexCount());
+		for (auto v = geo->constGetVertex(0); v.valid(); v = v.nextById())
+			mPositions.emplace_back(v.position());
+
+		// Triangulate faces as fans
+		for (auto face = geo->constGetFace(0); face.valid(); face = face.nextById()) {
+			auto vertIt = face.vertices();
+			uint32_t first = (uint32_t)vertIt().id();
+			vertIt.next();
+			uint32_t last = (uint32_t)vertIt().id();
+			vertIt.next();
+
+			for (; vertIt.valid(); vertIt.next()) {
+				uint32_t current = (uint32_t)vertIt().id();
+				mIndices.push_back(first);
+				mIndices.push_back(last);
+				mIndices.push_back(current);
+				last = current;
+			}
+		}
+
+		updateBoundingBox();
+	}
+
+	Occluder::Occluder(const BoundingBox& box) :
+		INodeOwner(NodeType::OCCLUDER) {
+		for (uint32_t i = 0; i < 8; ++i) {
+			mPositions.emplace_back(
+				(i & 1) ? box.mUpper.x : box.mLower.x,
+				(i & 2) ? box.mUpper.y : box.mLower.y,
+				(i & 4) ? box.mUpper.z : box.mLower.z);
+		}
+
+		// Two triangles for each face of the box
+		const uint32_t faces[6][4] = {
+			{ 0, 2, 3, 1 }, { 4, 5, 7, 6 },
+			{ 0, 1, 5, 4 }, { 2, 6, 7, 3 },
+			{ 0, 4, 6, 2 }, { 1, 3, 7, 5 }
+		};
+		for (auto& face : faces) {
+			mIndices.insert(mIndices.end(), { face[0], face[1], face[2] });
+			mIndices.insert(mIndices.end(), { face[0], face[2], face[3] });
+		}
+
+		mAabb = box;
+	}
+
+	void Occluder::updateBoundingBox() {
+		mAabb = BoundingBox::empty();
+		for (auto& p : mPositions)
+			mAabb.mergeInPlace(p);
+	}
+
+	Occluder* Occluder::toOccluder() {
+		return this;
+	}
+
+	BoundingBox Occluder::computeBoundingBox() const {
+		return mAabb;
+	}
+
+	bool Occluder::hasBoundingBox() const {
+		return true;
+	}
+
+	double OcclusionStats::rejectedPercentage() const {
+		if (mTested == 0)
+			return 0.0;
+		return 100.0 * (double)(mFrustumRejected + mOcclusionRejected) / (double)mTested;
+	}
+
+	void OcclusionStats::print(std::ostream& os) const {
+		os << "Occlusion: " << mRasterizedTriangles << " / " << mOccluderTriangles
+			<< " occluder triangles rasterized in " << mRasterizeTime << " ms, "
+			<< mTested << " draws tested in " << mTestTime << " ms, "
+			<< mFrustumRejected << " outside frustum, " << mOcclusionRejected << " occluded ("
+			<< rejectedPercentage() << "% rejected)" << std::endl;
+	}
+
+	SoftwareOcclusionCuller::SoftwareOcclusionCuller(uint32_t width, uint32_t height,
+		uint32_t threadCount) :
+		mViewProjection(1.0f),
+		mWorkers(threadCount),
+		mStats{ 0, 0, 0, 0, 0, 0.0, 0.0 },
+		mDebugTexture(nullptr) {
+		mTilesX = std::max((width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH, 1u);
+		mTilesY = std::max((height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT, 1u);
+		mWidth = mTilesX * OCCLUSION_TILE_WIDTH;
+		mHeight = mTilesY * OCCLUSION_TILE_HEIGHT;
+
+		mDepth.resize((size_t)mWidth * mHeight, 1.0f);
+		mTileMaxDepth.resize((size_t)mTilesX * mTilesY, 1.0f);
+		mBins.resize(std::max(mWorkers.threadCount(), 1u));
+	}
+
+	SoftwareOcclusionCuller::~SoftwareOcclusionCuller() {
+		if (mDebugTexture)
+			getFactory<Texture>()->unload(mDebugTexture);
+	}
+
+	void SoftwareOcclusionCuller::beginFrame(const glm::mat4& viewProjection) {
+		mViewProjection = viewProjection;
+		mOccluders.clear();
+		mStats = OcclusionStats{ 0, 0, 0, 0, 0, 0.0, 0.0 };
+
+		std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+		std::fill(mTileMaxDepth.begin(), mTileMaxDepth.end(), 1.0f);
+	}
+
+	void SoftwareOcclusionCuller::addOccluder(const Occluder* occluder, const glm::mat4& world) {
+		mOccluders.push_back(OccluderInstance{ occluder, world });
+		mStats.mOccluderTriangles += occluder->triangleCount();
+	}
+
+	void SoftwareOcclusionCuller::setupTriangle(Bin* bin, const glm::vec4& v0,
+		const glm::vec4& v1, const glm::vec4& v2) {
+		glm::vec3 p[3];
+		const glm::vec4* v[3] = { &v0, &v1, &v2 };
+		for (uint32_t i = 0; i < 3; ++i) {
+			float invW = 1.0f / v[i]->w;
+			p[i].x = (v[i]->x * invW * 0.5f + 0.5f) * (float)mWidth;
+			p[i].y = (v[i]->y * invW * 0.5f + 0.5f) * (float)mHeight;
+			p[i].z = v[i]->z * invW;
+		}
+
+		// Entirely behind the far plane, would not change anything
+		if (p[0].z > 1.0f && p[1].z > 1.0f && p[2].z > 1.0f)
+			return;
+
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+		if (std::abs(area) < 1e-8f)
+			return;
+
+		// Occluders are rasterized from both sides, make the winding counter clockwise
+		if (area < 0.0f) {
+			std::swap(p[1], p[2]);
+			area = -area;
+		}
+
+		// Pixels whose centers are inside the bounds of the triangle
+		int minX = (int)std::ceil(std::min(std::min(p[0].x, p[1].x), p[2].x) - 0.5f);
+		int minY = (int)std::ceil(std::min(std::min(p[0].y, p[1].y), p[2].y) - 0.5f);
+		int maxX = (int)std::floor(std::max(std::max(p[0].x, p[1].x), p[2].x) - 0.5f);
+		int maxY = (int)std::floor(std::max(std::max(p[0].y, p[1].y), p[2].y) - 0.5f);
+		minX = std::max(minX, 0);
+		minY = std::max(minY, 0);
+		maxX = std::min(maxX, (int)mWidth - 1);
+		maxY = std::min(maxY, (int)mHeight - 1);
+		if (minX > maxX || minY > maxY)
+			return;
+
+		ScreenTriangle tri;
+		for (uint32_t i = 0; i < 3; ++i) {
+			const glm::vec3& a = p[i];
+			const glm::vec3& b = p[(i + 1) % 3];
+			tri.mEdgeA[i] = a.y - b.y;
+			tri.mEdgeB[i] = b.x - a.x;
+			tri.mEdgeC[i] = -tri.mEdgeA[i] * a.x - tri.mEdgeB[i] * a.y;
+		}
+
+		glm::vec3 d1 = p[1] - p[0];
+		glm::vec3 d2 = p[2] - p[0];
+		tri.mDepthA = (d1.z * d2.y - d1.y * d2.z) / area;
+		tri.mDepthB = (d1.x * d2.z - d1.z * d2.x) / area;
+		tri.mDepthC = p[0].z - tri.mDepthA * p[0].x - tri.mDepthB * p[0].y;
+		tri.mMinX = minX;
+		tri.mMinY = minY;
+		tri.mMaxX = maxX;
+		tri.mMaxY = maxY;
+
+		uint32_t index = (uint32_t)bin->mTriangles.size();
+		bin->mTriangles.push_back(tri);
+
+		for (int ty = minY / OCCLUSION_TILE_HEIGHT; ty <= maxY / OCCLUSION_TILE_HEIGHT; ++ty)
+			for (int tx = minX / OCCLUSION_TILE_WIDTH; tx <= maxX / OCCLUSION_TILE_WIDTH; ++tx)
+				bin->mTiles[ty * mTilesX + tx].push_back(index);
+	}
+
+	void SoftwareOcclusionCuller::binTriangles(Bin* bin, uint64_t first, uint64_t last) {
+		uint64_t base = 0;
+		for (auto& instance : mOccluders) {
+			const Occluder* occluder = instance.mOccluder;
+			uint64_t count = occluder->triangleCount();
+			if (base + count <= first) {
+				base += count;
+				continue;
+			}
+			if (base >= last)
+				break;
+
+			glm::mat4 worldViewProjection = mViewProjection * instance.mWorld;
+			auto& positions = occluder->positions();
+			auto& indices = occluder->indices();
+
+			uint64_t begin = std::max(first, base) - base;
+			uint64_t end = std::min(last, base + count) - base;
+			for (uint64_t t = begin; t < end; ++t) {
+				glm::vec4 in[3];
+				for (uint32_t i = 0; i < 3; ++i)
+					in[i] = worldViewProjection * glm::vec4(positions[indices[3 * t + i]], 1.0f);
+
+				// Clip against the near plane z >= -w, which can turn the triangle into a quad
+				glm::vec4 out[4];
+				uint32_t outCount = 0;
+				for (uint32_t i = 0; i < 3; ++i) {
+					const glm::vec4& a = in[i];
+					const glm::vec4& b = in[(i + 1) % 3];
+					float da = a.z + a.w;
+					float db = b.z + b.w;
+					if (da >= 0.0f)
+						out[outCount++] = a;
+					if ((da >= 0.0f) != (db >= 0.0f))
+						out[outCount++] = a + (b - a) * (da / (da - db));
+				}
+
+				for (uint32_t i = 2; i < outCount; ++i)
+					setupTriangle(bin, out[0], out[i - 1], out[i]);
+			}
+
+			base += count;
+		}
+	}
+
+	void SoftwareOcclusionCuller::rasterizeTile(uint32_t tile) {
+		const int tileX = (int)(tile % mTilesX) * OCCLUSION_TILE_WIDTH;
+		const int tileY = (int)(tile / mTilesX) * OCCLUSION_TILE_HEIGHT;
+
+		for (auto& bin : mBins) {
+			for (auto index : bin.mTiles[tile]) {
+				const ScreenTriangle& tri = bin.mTriangles[index];
+
+				// Tiles start on multiples of four, so whole groups of four never leave the tile
+				int minX = std::max(tri.mMinX, tileX) & ~3;
+				int maxX = std::min(tri.mMaxX, tileX + OCCLUSION_TILE_WIDTH - 1);
+				int minY = std::max(tri.mMinY, tileY);
+				int maxY = std::min(tri.mMaxY, tileY + OCCLUSION_TILE_HEIGHT - 1);
+
+				for (int y = minY; y <= maxY; ++y) {
+					float py = (float)y + 0.5f;
+					float rowE0 = tri.mEdgeB[0] * py + tri.mEdgeC[0];
+					float rowE1 = tri.mEdgeB[1] * py + tri.mEdgeC[1];
+					float rowE2 = tri.mEdgeB[2] * py + tri.mEdgeC[2];
+					float rowZ = tri.mDepthB * py + tri.mDepthC;
+					float* row = &mDepth[(size_t)y * mWidth];
+
+#ifdef OCCLUSION_USE_SSE
+					const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+					const __m128 zero = _mm_setzero_ps();
+					const __m128 a0 = _mm_set1_ps(tri.mEdgeA[0]);
+					const __m128 a1 = _mm_set1_ps(tri.mEdgeA[1]);
+					const __m128 a2 = _mm_set1_ps(tri.mEdgeA[2]);
+					const __m128 az = _mm_set1_ps(tri.mDepthA);
+					const __m128 e0 = _mm_set1_ps(rowE0);
+					const __m128 e1 = _mm_set1_ps(rowE1);
+					const __m128 e2 = _mm_set1_ps(rowE2);
+					const __m128 ez = _mm_set1_ps(rowZ);
+
+					for (int x = minX; x <= maxX; x += 4) {
+						__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+						__m128 inside = _mm_and_ps(
+							_mm_and_ps(
+								_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero),
+								_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero)),
+							_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero));
+						if (_mm_movemask_ps(inside) == 0)
+							continue;
+
+						__m128 z = _mm_add_ps(_mm_mul_ps(az, px), ez);
+						__m128 old = _mm_loadu_ps(&row[x]);
+						__m128 nearer = _mm_min_ps(old, z);
+						_mm_storeu_ps(&row[x], _mm_or_ps(_mm_and_ps(inside, nearer),
+							_mm_andnot_ps(inside, old)));
+					}
+#else
+					for (int x = minX; x <= maxX; ++x) {
+						float px = (float)x + 0.5f;
+						if (tri.mEdgeA[0] * px + rowE0 >= 0.0f &&
+							tri.mEdgeA[1] * px + rowE1 >= 0.0f &&
+							tri.mEdgeA[2] * px + rowE2 >= 0.0f)
+							row[x] = std::min(row[x], tri.mDepthA * px + rowZ);
+					}
+#endif
+				}
+			}
+		}
+
+		// Farthest depth in the tile
+		float maxDepth = 0.0f;
+		for (int y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; ++y) {
+			const float* row = &mDepth[(size_t)y * mWidth + tileX];
+			for (int x = 0; x < OCCLUSION_TILE_WIDTH; ++x)
+				maxDepth = std::max(maxDepth, row[x]);
+		}
+		mTileMaxDepth[tile] = maxDepth;
+	}
+
+	void SoftwareOcclusionCuller::rasterize() {
+		auto start = std::chrono::high_resolution_clock::now();
+
+		uint64_t triangles = mStats.mOccluderTriangles;
+		uint32_t tileCount = mTilesX * mTilesY;
+
+		// Don't bother splitting tiny occluder sets between threads
+		uint64_t jobs = std::min<uint64_t>(mBins.size(),
+			std::max<uint64_t>(triangles / OCCLUSION_MIN_BIN_JOB_SIZE, 1));
+
+		for (auto& bin : mBins) {
+			bin.mTriangles.clear();
+			bin.mTiles.resize(tileCount);
+			for (auto& tile : bin.mTiles)
+				tile.clear();
+		}
+
+		for (uint64_t i = 0; i < jobs; ++i) {
+			Bin* bin = &mBins[i];
+			uint64_t first = triangles * i / jobs;
+			uint64_t last = triangles * (i + 1) / jobs;
+			mWorkers.submit([this, bin, first, last]() {
+				binTriangles(bin, first, last);
+			});
+		}
+		mWorkers.wait();
+
+		for (auto& bin : mBins)
+			mStats.mRasterizedTriangles += bin.mTriangles.size();
+
+		for (uint32_t tile = 0; tile < tileCount; ++tile)
+			mWorkers.submit([this, tile]() { rasterizeTile(tile); });
+		mWorkers.wait();
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mStats.mRasterizeTime += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	bool SoftwareOcclusionCuller::isVisible(const BoundingBox& box, const glm::mat4& world) {
+		auto start = std::chrono::high_resolution_clock::now();
+		++mStats.mTested;
+
+		glm::mat4 worldViewProjection = mViewProjection * world;
+
+		// Bit i is set while every corner is outside of frustum plane i
+		uint32_t outside = 0x3F;
+		bool bCrossesNear = false;
+		glm::vec3 lower(std::numeric_limits<float>::infinity());
+		glm::vec3 upper(-std::numeric_limits<float>::infinity());
+
+		for (uint32_t i = 0; i < 8; ++i) {
+			glm::vec4 corner = worldViewProjection * glm::vec4(
+				(i & 1) ? box.mUpper.x : box.mLower.x,
+				(i & 2) ? box.mUpper.y : box.mLower.y,
+				(i & 4) ? box.mUpper.z : box.mLower.z, 1.0f);
+
+			uint32_t code = 0;
+			code |= (corner.x < -corner.w) ? 0x01 : 0;
+			code |= (corner.x > corner.w) ? 0x02 : 0;
+			code |= (corner.y < -corner.w) ? 0x04 : 0;
+			code |= (corner.y > corner.w) ? 0x08 : 0;
+			code |= (corner.z < -corner.w) ? 0x10 : 0;
+			code |= (corner.z > corner.w) ? 0x20 : 0;
+			outside &= code;
+
+			if (corner.z < -corner.w || corner.w <= 0.0f) {
+				bCrossesNear = true;
+				continue;
+			}
+
+			glm::vec3 ndc = glm::vec3(corner) / corner.w;
+			lower = glm::min(lower, ndc);
+			upper = glm::max(upper, ndc);
+		}
+
+		bool bVisible = true;
+		if (outside) {
+			++mStats.mFrustumRejected;
+			bVisible = false;
+		}
+		// Boxes through the near plane cover an unbounded area of the screen
+		else if (!bCrossesNear && !mOccluders.empty()) {
+			int minX = std::max((int)std::floor((lower.x * 0.5f + 0.5f) * mWidth), 0);
+			int minY = std::max((int)std::floor((lower.y * 0.5f + 0.5f) * mHeight), 0);
+			int maxX = std::min((int)std::floor((upper.x * 0.5f + 0.5f) * mWidth), (int)mWidth - 1);
+			int maxY = std::min((int)std::floor((upper.y * 0.5f + 0.5f) * mHeight), (int)mHeight - 1);
+			float nearest = lower.z;
+
+			bVisible = false;
+			for (int ty = minY / OCCLUSION_TILE_HEIGHT; ty <= maxY / OCCLUSION_TILE_HEIGHT && !bVisible; ++ty) {
+				for (int tx = minX / OCCLUSION_TILE_WIDTH; tx <= maxX / OCCLUSION_TILE_WIDTH && !bVisible; ++tx) {
+					// Everything in this tile is in front of the box
+					if (nearest >= mTileMaxDepth[ty * mTilesX + tx])
+						continue;
+
+					int x0 = std::max(minX, tx * OCCLUSION_TILE_WIDTH);
+					int x1 = std::min(maxX, (tx + 1) * OCCLUSION_TILE_WIDTH - 1);
+					int y0 = std::max(minY, ty * OCCLUSION_TILE_HEIGHT);
+					int y1 = std::min(maxY, (ty + 1) * OCCLUSION_TILE_HEIGHT - 1);
+					for (int y = y0; y <= y1 && !bVisible; ++y) {
+						const float* row = &mDepth[(size_t)y * mWidth];
+						for (int x = x0; x <= x1; ++x) {
+							if (nearest < row[x]) {
+								bVisible = true;
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			if (!bVisible)
+				++mStats.mOcclusionRejected;
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		mStats.mTestTime += std::chrono::duration<double, std::milli>(end - start).count();
+		return bVisible;
+	}
+
+	Texture* SoftwareOcclusionCuller::debugTexture() {
+		if (!mDebugTexture)
+			mDebugTexture = getFactory<Texture>()->makeTexture2DUnmanaged(mWidth, mHeight, GL_RGBA8, 1);
+
+		float nearest = 1.0f;
+		for (auto d : mDepth)
+			nearest = std::min(nearest, d);
+		float range = std::max(1.0f - nearest, 1e-6f);
+
+		mDebugPixels.resize(4 * mDepth.size());
+		for (size_t i = 0; i < mDepth.size(); ++i) {
+			float v = std::min(std::max((1.0f - mDepth[i]) / range, 0.0f), 1.0f);
+			uint8_t grey = (uint8_t)(255.0f * v);
+			mDebugPixels[4 * i] = grey;
+			mDebugPixels[4 * i + 1] = grey;
+			mDebugPixels[4 * i + 2] = grey;
+			mDebugPixels[4 * i + 3] = 255;
+		}
+
+		glTextureSubImage2D(mDebugTexture->id(), 0, 0, 0, mWidth, mHeight,
+			GL_RGBA, GL_UNSIGNED_BYTE, &mDebugPixels[0]);
+		return mDebugTexture;
+	}
+}
@@ -0,0 +1,407 @@
+#include <engine/readback.hpp>
+#include <engine/texture.hpp>
+#include <engine/framebuffer.hpp>
+#include <engine/log.hpp>
+
+#include <lodepng/lodepng.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#define READBACK_WAIT_TIMEOUT_NS 1000000000ull
+
+namespace Morpheus {
+
+	uint32_t componentCount(GLenum format) {
+		switch (format) {
+		case GL_RED:
+		case GL_GREEN:
+		case GL_BLUE:
+		case GL_ALPHA:
+		case GL_RED_INTEGER:
+		case GL_DEPTH_COMPONENT:
+		case GL_STENCIL_INDEX:
+			return 1;
+		case GL_RG:
+		case GL_RG_INTEGER:
+		case GL_DEPTH_STENCIL:
+			return 2;
+		case GL_RGB:
+		case GL_BGR:
+		case GL_RGB_INTEGER:
+			return 3;
+		case GL_RGBA:
+		case GL_BGRA:
+		case GL_RGBA_INTEGER:
+			return 4;
+		}
+		throw std::runtime_error("Readback format not supported!");
+	}
+
+	uint32_t componentSize(GLenum type) {
+		switch (type) {
+		case GL_UNSIGNED_BYTE:
+		case GL_BYTE:
+			return 1;
+		case GL_UNSIGNED_SHORT:
+		case GL_SHORT:
+		case GL_HALF_FLOAT:
+			return 2;
+		case GL_UNSIGNED_INT:
+		case GL_INT:
+		case GL_FLOAT:
+			return 4;
+		}
+		throw std::runtime_error("Readback type not supported!");
+	}
+
+	void encodepng(const std::string& path, const uint8_t* data,
+		uint32_t width, uint32_t height, bool bFlip) {
+		std::vector<uint8_t> flipped;
+		if (bFlip) {
+			size_t rowSize = 4 * (size_t)width;
+			flipped.resize(rowSize * height);
+			for (uint32_t y = 0; y < height; ++y)
+				std::memcpy(&flipped[rowSize * (height - y - 1)], &data[rowSize * y], rowSize);
+			data = &flipped[0];
+		}
+
+		auto error = lodepng::encode(path, data, width, height);
+		if (error) {
+			std::cout << "Encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+			throw std::runtime_error(lodepng_error_text(error));
+		}
+	}
+
+	ReadbackQueue::ReadbackQueue(uint32_t ringSize, uint32_t workerThreads) :
+		mNext(0), mWorkers(workerThreads), mStats{0, 0, 0, 0} {
+		mSlots.resize(std::max(ringSize, 1u));
+		for (auto& slot : mSlots) {
+			glCreateBuffers(1, &slot.mBuffer);
+			slot.mCapacity = 0;
+			slot.mFence = nullptr;
+			slot.bInFlight = false;
+		}
+	}
+
+	ReadbackQueue::~ReadbackQueue() {
+		flush();
+		for (auto& slot : mSlots)
+			glDeleteBuffers(1, &slot.mBuffer);
+	}
+
+	ReadbackQueue::Slot* ReadbackQueue::acquire(size_t size) {
+		Slot* slot = &mSlots[mNext];
+		mNext = (mNext + 1) % mSlots.size();
+
+		// Every buffer is in flight, we have no choice but to wait on the oldest
+		if (slot->bInFlight) {
+			if (wait(slot))
+				resolve(slot);
+			++mStats.mStalls;
+		}
+
+		if (slot->mCapacity < size) {
+			glNamedBufferData(slot->mBuffer, size, nullptr, GL_STREAM_READ);
+			slot->mCapacity = size;
+		}
+
+		return slot;
+	}
+
+	void ReadbackQueue::submit(Slot* slot, const ReadbackResult& header,
+		std::function<void(ReadbackResult&&)>&& onComplete) {
+		slot->mHeader = header;
+		slot->mOnComplete = std::move(onComplete);
+		slot->mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot->bInFlight = true;
+		++mStats.mRequests;
+		GL_ASSERT;
+	}
+
+	bool ReadbackQueue::wait(Slot* slot) {
+		GLenum status;
+		do {
+			status = glClientWaitSync(slot->mFence, GL_SYNC_FLUSH_COMMANDS_BIT, READBACK_WAIT_TIMEOUT_NS);
+		} while (status == GL_TIMEOUT_EXPIRED);
+
+		if (status == GL_WAIT_FAILED) {
+			logError() << "Waiting on a readback fence failed, dropping the readback!";
+			glDeleteSync(slot->mFence);
+			slot->mFence = nullptr;
+			slot->bInFlight = false;
+			slot->mOnComplete = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	void ReadbackQueue::resolve(Slot* slot) {
+		ReadbackResult result = std::move(slot->mHeader);
+		size_t size = (size_t)result.mWidth * result.mHeight * result.mDepth *
+			componentCount(result.mFormat) * componentSize(result.mType);
+
+		result.mData.resize(size);
+		void* mapped = glMapNamedBufferRange(slot->mBuffer, 0, size, GL_MAP_READ_BIT);
+		std::memcpy(&result.mData[0], mapped, size);
+		glUnmapNamedBuffer(slot->mBuffer);
+
+		glDeleteSync(slot->mFence);
+		slot->mFence = nullptr;
+		slot->bInFlight = false;
+
+		++mStats.mCompleted;
+		mStats.mBytes += size;
+
+		auto onComplete = std::move(slot->mOnComplete);
+		slot->mOnComplete = nullptr;
+		onComplete(std::move(result));
+	}
+
+	ReadbackQueue::Slot* ReadbackQueue::copyTexture(const Texture* tex, GLint level,
+		GLenum format, GLenum type, GLint zoffset, GLsizei depth, ReadbackResult* header) {
+		header->mWidth = std::max(tex->width() >> level, 1u);
+		header->mHeight = std::max(tex->height() >> level, 1u);
+		header->mDepth = depth;
+		header->mFormat = format;
+		header->mType = type;
+
+		size_t size = (size_t)header->mWidth * header->mHeight * header->mDepth *
+			componentCount(format) * componentSize(type);
+		auto slot = acquire(size);
+
+		GLint alignment;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->mBuffer);
+		glGetTextureSubImage(tex->id(), level, 0, 0, zoffset, header->mWidth, header->mHeight,
+			depth, format, type, (GLsizei)size, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+		return slot;
+	}
+
+	ReadbackQueue::Slot* ReadbackQueue::copyFramebuffer(const Framebuffer* framebuffer,
+		uint32_t attachment, GLsizei width, GLsizei height,
+		GLenum format, GLenum type, ReadbackResult* header) {
+		header->mWidth = width;
+		header->mHeight = height;
+		header->mDepth = 1;
+		header->mFormat = format;
+		header->mType = type;
+
+		size_t size = (size_t)width * height * componentCount(format) * componentSize(type);
+		auto slot = acquire(size);
+
+		GLint alignment;
+		GLint readFramebuffer;
+		glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+		if (framebuffer) {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer->id());
+			glReadBuffer(GL_COLOR_ATTACHMENT0 + attachment);
+		}
+		else {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			glReadBuffer(GL_BACK);
+		}
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->mBuffer);
+		glReadPixels(0, 0, width, height, format, type, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+		return slot;
+	}
+
+	std::future<ReadbackResult> ReadbackQueue::readTexture(const Texture* tex, GLint level,
+		GLenum format, GLenum type, GLint zoffset, GLsizei depth) {
+		ReadbackResult header;
+		auto slot = copyTexture(tex, level, format, type, zoffset, depth, &header);
+
+		auto promise = std::make_shared<std::promise<ReadbackResult>>();
+		submit(slot, header, [promise](ReadbackResult&& result) {
+			promise->set_value(std::move(result));
+		});
+		return promise->get_future();
+	}
+
+	std::future<ReadbackResult> ReadbackQueue::readFramebuffer(const Framebuffer* framebuffer,
+		uint32_t attachment, GLsizei width, GLsizei height,
+		GLenum format, GLenum type) {
+		ReadbackResult header;
+		auto slot = copyFramebuffer(framebuffer, attachment, width, height, format, type, &header);
+
+		auto promise = std::make_shared<std::promise<ReadbackResult>>();
+		submit(slot, header, [promise](ReadbackResult&& result) {
+			promise->set_value(std::move(result));
+		});
+		return promise->get_future();
+	}
+
+	std::future<std::vector<float>> ReadbackQueue::readBaseLevel(const Texture* tex,
+		uint32_t element_length, GLint layer) {
+		GLenum format = GL_INVALID_ENUM;
+		switch (element_length) {
+		case 1:
+			format = GL_RED;
+			break;
+		case 2:
+			format = GL_RG;
+			break;
+		case 3:
+			format = GL_RGB;
+			break;
+		case 4:
+			format = GL_RGBA;
+			break;
+		}
+
+		ReadbackResult header;
+		auto slot = copyTexture(tex, 0, format, GL_FLOAT, layer, 1, &header);
+
+		auto promise = std::make_shared<std::promise<std::vector<float>>>();
+		submit(slot, header, [promise](ReadbackResult&& result) {
+			std::vector<float> data(result.mData.size() / sizeof(float));
+			std::memcpy(&data[0], &result.mData[0], result.mData.size());
+			promise->set_value(std::move(data));
+		});
+		return promise->get_future();
+	}
+
+	std::future<void> ReadbackQueue::savepng(const Texture* tex, const std::string& path) {
+		auto promise = std::make_shared<std::promise<void>>();
+		auto future = promise->get_future();
+
+		GLsizei faces = 0;
+		switch (tex->textureType()) {
+		case TextureType::TEXTURE_2D:
+			faces = 1;
+			break;
+		case TextureType::CUBE_MAP:
+			faces = 6;
+			break;
+		default:
+			std::cout << "Texture type must be TEXTURE_2D or CUBE_MAP! Cannot save to png!" << std::endl;
+			promise->set_exception(std::make_exception_ptr(
+				std::runtime_error("Texture type must be TEXTURE_2D or CUBE_MAP! Cannot save to png!")));
+			return future;
+		}
+
+		ReadbackResult header;
+		auto slot = copyTexture(tex, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0, faces, &header);
+
+		submit(slot, header, [this, promise, path](ReadbackResult&& result) {
+			auto shared = std::make_shared<ReadbackResult>(std::move(result));
+			mWorkers.submit([promise, path, shared]() {
+				try {
+					if (shared->mDepth == 1) {
+						std::cout << "Saving texture2D " << path << "..." << std::endl;
+						encodepng(path, &shared->mData[0], shared->mWidth, shared->mHeight, false);
+					}
+					else {
+						// Same face naming as Texture::savepng
+						static const char* suffixes[] = { "_pos_x.png", "_neg_x.png",
+							"_pos_y.png", "_neg_y.png", "_pos_z.png", "_neg_z.png" };
+						size_t pos = path.rfind('.');
+						std::string base_path = pos == std::string::npos ? path : path.substr(0, pos);
+						size_t faceSize = 4 * (size_t)shared->mWidth * shared->mHeight;
+						for (uint32_t face = 0; face < 6; ++face) {
+							std::string face_path = base_path + suffixes[face];
+							std::cout << "Saving cubemap face " << face_path << "..." << std::endl;
+							encodepng(face_path, &shared->mData[faceSize * face],
+								shared->mWidth, shared->mHeight, false);
+						}
+					}
+					promise->set_value();
+				}
+				catch (...) {
+					promise->set_exception(std::current_exception());
+				}
+			});
+		});
+
+		return future;
+	}
+
+	std::future<void> ReadbackQueue::savepng(const Framebuffer* framebuffer, GLsizei width,
+		GLsizei height, const std::string& path) {
+		auto promise = std::make_shared<std::promise<void>>();
+		auto future = promise->get_future();
+
+		ReadbackResult header;
+		auto slot = copyFramebuffer(framebuffer, 0, width, height,
+			GL_RGBA, GL_UNSIGNED_BYTE, &header);
+
+		submit(slot, header, [this, promise, path](ReadbackResult&& result) {
+			auto shared = std::make_shared<ReadbackResult>(std::move(result));
+			mWorkers.submit([promise, path, shared]() {
+				try {
+					std::cout << "Saving framebuffer " << path << "..." << std::endl;
+					encodepng(path, &shared->mData[0], shared->mWidth, shared->mHeight, true);
+					promise->set_value();
+				}
+				catch (...) {
+					promise->set_exception(std::current_exception());
+				}
+			});
+		});
+
+		return future;
+	}
+
+	void ReadbackQueue::poll() {
+		// Fences signal in submission order, so resolve starting from the oldest slot
+		for (uint32_t i = 0; i < mSlots.size(); ++i) {
+			Slot* slot = &mSlots[(mNext + i) % mSlots.size()];
+			if (!slot->bInFlight)
+				continue;
+
+			GLenum status = glClientWaitSync(slot->mFence, 0, 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+				resolve(slot);
+			else
+				break;
+		}
+	}
+
+	void ReadbackQueue::flush() {
+		for (uint32_t i = 0; i < mSlots.size(); ++i) {
+			Slot* slot = &mSlots[(mNext + i) % mSlots.size()];
+			if (!slot->bInFlight)
+				continue;
+
+			if (wait(slot))
+				resolve(slot);
+		}
+		mWorkers.wait();
+	}
+
+	bool ReadbackQueue::waitOldest() {
+		// Slots are handed out in ring order, so the oldest is the first in flight from mNext
+		for (uint32_t i = 0; i < mSlots.size(); ++i) {
+			Slot* slot = &mSlots[(mNext + i) % mSlots.size()];
+			if (!slot->bInFlight)
+				continue;
+
+			if (wait(slot))
+				resolve(slot);
+			return true;
+		}
+		return false;
+	}
+
+	uint32_t ReadbackQueue::inFlight() const {
+		uint32_t count = 0;
+		for (auto& slot : mSlots)
+			if (slot.bInFlight)
+				++count;
+		return count;
+	}
+}
@@ -0,0 +1,113 @@
+#include <engine/rendertargetpool.hpp>
+
+#include <algorithm>
+
+namespace Morpheus {
+
+	size_t RenderTargetDesc::byteSize() const {
+		return (size_t)mWidth * mHeight * mSamples *
+			(internalFormatSize(mColorFormat) + internalFormatSize(mDepthStencilFormat));
+	}
+
+	void RenderTargetPoolStats::print(std::ostream& os) const {
+		const double mb = 1024.0 * 1024.0;
+		os << "Render targets: " << mTargetsInUse << " / " << mTargets << " in use, "
+			<< mBytesInUse / mb << " / " << mBytesAllocated / mb << " MB in use (peak "
+			<< mPeakBytesInUse / mb << " MB), " << mBytesRequestedThisFrame / mb
+			<< " MB requested this frame, " << mAllocations << " allocations, "
+			<< mReuses << " reuses" << std::endl;
+	}
+
+	RenderTargetPool::RenderTargetPool(uint maxIdleFrames) :
+		mStats{ 0, 0, 0, 0, 0, 0, 0, 0 },
+		mFrame(0),
+		mMaxIdleFrames(maxIdleFrames) {
+	}
+
+	RenderTargetPool::~RenderTargetPool() {
+		for (auto& it : mEntries) {
+			getFactory<Framebuffer>()->unload(it.second->mFramebuffer);
+			delete it.second;
+		}
+	}
+
+	void RenderTargetPool::destroy(Entry* entry) {
+		mStats.mBytesAllocated -= entry->mByteSize;
+		--mStats.mTargets;
+		mEntries.erase(entry->mFramebuffer);
+		getFactory<Framebuffer>()->unload(entry->mFramebuffer);
+		delete entry;
+	}
+
+	Framebuffer* RenderTargetPool::acquire(const RenderTargetDesc& desc) {
+		Entry* entry = nullptr;
+
+		auto it = mFree.find(desc);
+		if (it != mFree.end() && !it->second.empty()) {
+			entry = it->second.back();
+			it->second.pop_back();
+			++mStats.mReuses;
+		}
+		else {
+			entry = new Entry();
+			entry->mFramebuffer = getFactory<Framebuffer>()->makeFramebufferUnmanaged(
+				desc.mWidth, desc.mHeight, desc.mColorFormat, desc.mDepthStencilFormat, desc.mSamples);
+			entry->mDesc = desc;
+			entry->mByteSize = desc.byteSize();
+			mEntries[entry->mFramebuffer] = entry;
+
+			++mStats.mAllocations;
+			++mStats.mTargets;
+			mStats.mBytesAllocated += entry->mByteSize;
+		}
+
+		entry->bInUse = true;
+		entry->mLastUsedFrame = mFrame;
+
+		++mStats.mTargetsInUse;
+		mStats.mBytesInUse += entry->mByteSize;
+		mStats.mBytesRequestedThisFrame += entry->mByteSize;
+		mStats.mPeakBytesInUse = std::max(mStats.mPeakBytesInUse, mStats.mBytesInUse);
+
+		return entry->mFramebuffer;
+	}
+
+	void RenderTargetPool::release(Framebuffer* framebuffer) {
+		auto it = mEntries.find(framebuffer);
+		if (it == mEntries.end())
+			throw std::runtime_error("Framebuffer was not acquired from this pool!");
+
+		auto entry = it->second;
+		assert(entry->bInUse);
+		entry->bInUse = false;
+		mFree[entry->mDesc].push_back(entry);
+
+		--mStats.mTargetsInUse;
+		mStats.mBytesInUse -= entry->mByteSize;
+	}
+
+	void RenderTargetPool::beginFrame() {
+		++mFrame;
+		mStats.mBytesRequestedThisFrame = 0;
+
+		for (auto& it : mFree) {
+			auto& entries = it.second;
+			for (size_t i = 0; i < entries.size();) {
+				if (mFrame - entries[i]->mLastUsedFrame > mMaxIdleFrames) {
+					destroy(entries[i]);
+					entries[i] = entries.back();
+					entries.pop_back();
+				}
+				else
+					++i;
+			}
+		}
+	}
+
+	void RenderTargetPool::releaseUnused() {
+		for (auto& it : mFree)
+			for (auto entry : it.second)
+				destroy(entry);
+		mFree.clear();
+	}
+}
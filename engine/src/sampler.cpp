@@ -1,4 +1,5 @@
 #include <engine/sampler.hpp>
+#include <engine/gldelete.hpp>
 #include <unordered_map>
 
 namespace Morpheus {
@@ -104,7 +105,7 @@ namespace Morpheus {
 	void ContentFactory<Sampler>::unload(INodeOwner* ref)
 	{
 		auto sampler = ref->toSampler();
-		glDeleteSamplers(1, &sampler->mId);
+		glDeleteQueue()->deleteSamplers(1, &sampler->mId);
 		delete sampler;
 	}
 	
@@ -0,0 +1,392 @@
+#include <engine/sequence.hpp>
+#include <engine/engine.hpp>
+#include <engine/camera.hpp>
+#include <engine/framebuffer.hpp>
+#include <engine/log.hpp>
+
+#include <glm/gtc/constants.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+namespace Morpheus {
+
+	typedef std::chrono::high_resolution_clock sequence_clock_t;
+
+	inline double secondsSince(const sequence_clock_t::time_point& start) {
+		return std::chrono::duration<double>(sequence_clock_t::now() - start).count();
+	}
+
+	glm::vec3 readVec3(const nlohmann::json& j, const glm::vec3& defaultValue) {
+		if (!j.is_array() || j.size() != 3)
+			return defaultValue;
+		return glm::vec3(j[0].get<float>(), j[1].get<float>(), j[2].get<float>());
+	}
+
+	template <typename T>
+	T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t) {
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return 0.5f * ((2.0f * p1) + (-p0 + p2) * t +
+			(2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+			(-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+	}
+
+	void CameraPath::readJson(const nlohmann::json& j) {
+		mKeyframes.clear();
+		bLoop = j.value("loop", false);
+
+		if (j.contains("orbit")) {
+			auto& orbit = j["orbit"];
+			auto center = readVec3(orbit.value("center", nlohmann::json()), glm::vec3(0.0f, 0.0f, 0.0f));
+			*this = makeOrbit(center,
+				orbit.value("radius", 1.0f),
+				orbit.value("height", 0.0f),
+				orbit.value("duration", 1.0),
+				orbit.value("keyframes", 16u));
+			return;
+		}
+
+		CameraKeyframe last;
+		last.mTime = 0.0;
+		last.mPosition = glm::vec3(0.0f, 0.0f, -1.0f);
+		last.mLookAt = glm::vec3(0.0f, 0.0f, 0.0f);
+		last.mUp = glm::vec3(0.0f, 1.0f, 0.0f);
+		last.mFieldOfView = glm::pi<float>() / 4.0f;
+
+		// Any value not specified is inherited from the previous keyframe
+		for (auto& k : j["keyframes"]) {
+			CameraKeyframe keyframe;
+			keyframe.mTime = k.value("time", last.mTime);
+			keyframe.mPosition = readVec3(k.value("position", nlohmann::json()), last.mPosition);
+			keyframe.mLookAt = readVec3(k.value("look_at", nlohmann::json()), last.mLookAt);
+			keyframe.mUp = readVec3(k.value("up", nlohmann::json()), last.mUp);
+			keyframe.mFieldOfView = k.value("fov", last.mFieldOfView);
+			addKeyframe(keyframe);
+			last = keyframe;
+		}
+	}
+
+	void CameraPath::load(const std::string& path) {
+		std::ifstream f(path);
+		if (!f.is_open()) {
+			std::cout << "Failed to open camera path " << path << "!" << std::endl;
+			throw std::runtime_error("Failed to open camera path!");
+		}
+
+		nlohmann::json j;
+		f >> j;
+		f.close();
+
+		readJson(j);
+	}
+
+	CameraPath CameraPath::makeOrbit(const glm::vec3& center, float radius, float height,
+		double duration, uint32_t keyframeCount) {
+		CameraPath path;
+		path.bLoop = true;
+
+		keyframeCount = std::max(keyframeCount, 3u);
+		for (uint32_t i = 0; i <= keyframeCount; ++i) {
+			float angle = 2.0f * glm::pi<float>() * (float)i / (float)keyframeCount;
+
+			CameraKeyframe keyframe;
+			keyframe.mTime = duration * (double)i / (double)keyframeCount;
+			keyframe.mPosition = center + glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle));
+			keyframe.mLookAt = center;
+			keyframe.mUp = glm::vec3(0.0f, 1.0f, 0.0f);
+			keyframe.mFieldOfView = glm::pi<float>() / 4.0f;
+			path.addKeyframe(keyframe);
+		}
+		return path;
+	}
+
+	void CameraPath::addKeyframe(const CameraKeyframe& keyframe) {
+		assert(mKeyframes.empty() || mKeyframes.back().mTime <= keyframe.mTime);
+		mKeyframes.push_back(keyframe);
+	}
+
+	CameraKeyframe CameraPath::evaluate(double time) const {
+		if (mKeyframes.empty())
+			throw std::runtime_error("Camera path has no keyframes!");
+
+		if (mKeyframes.size() == 1)
+			return mKeyframes[0];
+
+		double start = mKeyframes.front().mTime;
+		double end = mKeyframes.back().mTime;
+		if (bLoop && end > start)
+			time = start + std::fmod(std::fmod(time - start, end - start) + (end - start), end - start);
+		time = std::min(std::max(time, start), end);
+
+		// Find the segment containing time
+		auto it = std::upper_bound(mKeyframes.begin(), mKeyframes.end(), time,
+			[](double t, const CameraKeyframe& k) { return t < k.mTime; });
+		int i1 = std::max((int)(it - mKeyframes.begin()) - 1, 0);
+		int i2 = std::min(i1 + 1, (int)mKeyframes.size() - 1);
+		int count = (int)mKeyframes.size();
+
+		// Neighbouring keyframes for the spline tangents
+		int i0;
+		int i3;
+		if (bLoop) {
+			// The last keyframe duplicates the first, so skip over it when wrapping
+			i0 = i1 > 0 ? i1 - 1 : count - 2;
+			i3 = i2 < count - 1 ? i2 + 1 : 1;
+		}
+		else {
+			i0 = std::max(i1 - 1, 0);
+			i3 = std::min(i2 + 1, count - 1);
+		}
+
+		auto& k0 = mKeyframes[i0];
+		auto& k1 = mKeyframes[i1];
+		auto& k2 = mKeyframes[i2];
+		auto& k3 = mKeyframes[i3];
+
+		double span = k2.mTime - k1.mTime;
+		float t = span > 0.0 ? (float)((time - k1.mTime) / span) : 0.0f;
+
+		CameraKeyframe result;
+		result.mTime = time;
+		result.mPosition = catmullRom(k0.mPosition, k1.mPosition, k2.mPosition, k3.mPosition, t);
+		result.mLookAt = catmullRom(k0.mLookAt, k1.mLookAt, k2.mLookAt, k3.mLookAt, t);
+		result.mUp = glm::normalize(glm::mix(k1.mUp, k2.mUp, t));
+		result.mFieldOfView = glm::mix(k1.mFieldOfView, k2.mFieldOfView, t);
+		return result;
+	}
+
+	void CameraPath::apply(Camera* camera, double time) const {
+		auto keyframe = evaluate(time);
+		camera->mPosition = keyframe.mPosition;
+		camera->mLookAt = keyframe.mLookAt;
+		camera->mUp = keyframe.mUp;
+		camera->mFieldOfView = keyframe.mFieldOfView;
+	}
+
+	void SequenceRenderStats::print(std::ostream& os) const {
+		double frames = std::max(mFrames, 1u);
+		os << "Rendered " << mFrames << " frames in " << mTotalSeconds << " s ("
+			<< mFramesPerSecond << " fps)" << std::endl;
+		os << "\tdraw:  " << 1000.0 * mDrawSeconds / frames << " ms / frame" << std::endl;
+		os << "\twait:  " << 1000.0 * mWaitSeconds / frames << " ms / frame" << std::endl;
+		os << "\twrite: " << 1000.0 * mWriteSeconds / frames << " ms / frame (writer thread)" << std::endl;
+		os << "\toutput: " << mBytesWritten / (1024.0 * 1024.0) << " MB" << std::endl;
+	}
+
+	SequenceRenderer::SequenceRenderer(uint32_t readbackRingSize) :
+		mReadback(readbackRingSize, 0),
+		mWriter(1),
+		mOutput(nullptr),
+		mStream(nullptr) {
+	}
+
+	SequenceRenderer::~SequenceRenderer() {
+		mWriter.wait();
+		close();
+		if (mOutput)
+			getFactory<Framebuffer>()->unload(mOutput);
+	}
+
+	void SequenceRenderer::open(const SequenceRenderParams& params, uint32_t width, uint32_t height) {
+		if (params.mFormat == SequenceOutputFormat::PPM_SEQUENCE)
+			return;
+
+		if (params.mOutput == "-")
+			mStream = stdout;
+		else
+			mStream = fopen(params.mOutput.c_str(), "wb");
+
+		if (!mStream) {
+			std::cout << "Failed to open " << params.mOutput << " for writing!" << std::endl;
+			throw std::runtime_error("Failed to open sequence output!");
+		}
+
+		if (params.mFormat == SequenceOutputFormat::Y4M) {
+			uint32_t rate = (uint32_t)std::round(params.mFrameRate * 1000.0);
+			fprintf(mStream, "YUV4MPEG2 W%u H%u F%u:1000 Ip A1:1 C444\n", width, height, rate);
+		}
+	}
+
+	void SequenceRenderer::close() {
+		if (mStream && mStream != stdout)
+			fclose(mStream);
+		else if (mStream)
+			fflush(mStream);
+		mStream = nullptr;
+	}
+
+	void SequenceRenderer::write(const SequenceRenderParams& params, uint32_t frame, ReadbackResult&& result) {
+		auto start = sequence_clock_t::now();
+
+		uint32_t width = result.mWidth;
+		uint32_t height = result.mHeight;
+		size_t pixels = (size_t)width * height;
+		std::vector<uint8_t> out;
+
+		// Frames come back bottom-up, every output format wants them top-down
+		if (params.mFormat == SequenceOutputFormat::Y4M) {
+			out.resize(3 * pixels);
+			uint8_t* y_plane = &out[0];
+			uint8_t* u_plane = &out[pixels];
+			uint8_t* v_plane = &out[2 * pixels];
+			for (uint32_t y = 0; y < height; ++y) {
+				const uint8_t* src = &result.mData[4 * (size_t)width * (height - y - 1)];
+				size_t row = (size_t)width * y;
+				for (uint32_t x = 0; x < width; ++x, src += 4) {
+					float r = src[0];
+					float g = src[1];
+					float b = src[2];
+					// BT.601 studio range
+					y_plane[row + x] = (uint8_t)(16.0f + (65.738f * r + 129.057f * g + 25.064f * b) / 256.0f + 0.5f);
+					u_plane[row + x] = (uint8_t)(128.0f + (-37.945f * r - 74.494f * g + 112.439f * b) / 256.0f + 0.5f);
+					v_plane[row + x] = (uint8_t)(128.0f + (112.439f * r - 94.154f * g - 18.285f * b) / 256.0f + 0.5f);
+				}
+			}
+		}
+		else {
+			out.resize(3 * pixels);
+			for (uint32_t y = 0; y < height; ++y) {
+				const uint8_t* src = &result.mData[4 * (size_t)width * (height - y - 1)];
+				uint8_t* dest = &out[3 * (size_t)width * y];
+				for (uint32_t x = 0; x < width; ++x, src += 4, dest += 3) {
+					dest[0] = src[0];
+					dest[1] = src[1];
+					dest[2] = src[2];
+				}
+			}
+		}
+
+		size_t written = 0;
+		switch (params.mFormat) {
+		case SequenceOutputFormat::Y4M:
+			written += fwrite("FRAME\n", 1, 6, mStream);
+			written += fwrite(&out[0], 1, out.size(), mStream);
+			break;
+		case SequenceOutputFormat::RAW_RGB:
+			written += fwrite(&out[0], 1, out.size(), mStream);
+			break;
+		case SequenceOutputFormat::PPM_SEQUENCE:
+		{
+			char path[1024];
+			snprintf(path, sizeof(path), params.mOutput.c_str(), frame);
+			FILE* f = fopen(path, "wb");
+			if (!f) {
+				std::cout << "Failed to open " << path << " for writing!" << std::endl;
+				break;
+			}
+			int header = fprintf(f, "P6\n%u %u\n255\n", width, height);
+			written += std::max(header, 0);
+			written += fwrite(&out[0], 1, out.size(), f);
+			fclose(f);
+			break;
+		}
+		}
+
+		std::unique_lock<std::mutex> lock(mStatsMutex);
+		mStats.mWriteSeconds += secondsSince(start);
+		mStats.mBytesWritten += written;
+	}
+
+	SequenceRenderStats SequenceRenderer::render(INodeOwner* scene, Camera* camera,
+		const CameraPath& path, const SequenceRenderParams& params) {
+		int width;
+		int height;
+		getFramebufferSize(&width, &height);
+
+		if (mOutput && (mOutput->width() != (uint)width || mOutput->height() != (uint)height))
+			mOutput->resize(width, height);
+		else if (!mOutput)
+			mOutput = getFactory<Framebuffer>()->makeFramebufferUnmanaged(width, height, GL_RGBA8);
+
+		uint32_t frameCount = params.mFrameCount;
+		if (frameCount == 0)
+			frameCount = (uint32_t)std::floor(path.duration() * params.mFrameRate) + (path.loop() ? 0 : 1);
+		frameCount = std::max(frameCount, 1u);
+
+		mStats = SequenceRenderStats{ 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0 };
+		open(params, width, height);
+
+		// Frames that have been submitted for readback but not handed to the writer
+		std::deque<std::pair<uint32_t, std::future<ReadbackResult>>> pending;
+		std::condition_variable writeDone;
+		uint32_t writesInFlight = 0;
+
+		auto hand_off = [&](uint32_t frame, ReadbackResult&& result) {
+			{
+				std::unique_lock<std::mutex> lock(mStatsMutex);
+				++writesInFlight;
+			}
+			auto shared = std::make_shared<ReadbackResult>(std::move(result));
+			mWriter.submit([this, &params, &writeDone, &writesInFlight, frame, shared]() {
+				write(params, frame, std::move(*shared));
+				std::unique_lock<std::mutex> lock(mStatsMutex);
+				--writesInFlight;
+				writeDone.notify_all();
+			});
+		};
+
+		auto drain_ready = [&]() {
+			while (!pending.empty() && pending.front().second.wait_for(
+				std::chrono::seconds(0)) == std::future_status::ready) {
+				try {
+					hand_off(pending.front().first, pending.front().second.get());
+				}
+				catch (const std::future_error&) {
+					logError() << "Frame " << pending.front().first << " could not be read back!";
+				}
+				pending.pop_front();
+			}
+		};
+
+		auto start = sequence_clock_t::now();
+
+		for (uint32_t frame = 0; frame < frameCount; ++frame) {
+			auto drawStart = sequence_clock_t::now();
+
+			path.apply(camera, (double)frame / params.mFrameRate);
+			renderer()->draw(scene, mOutput);
+			pending.emplace_back(frame, mReadback.readFramebuffer(mOutput, 0,
+				width, height, GL_RGBA, GL_UNSIGNED_BYTE));
+
+			// Make sure the driver starts on this frame while we set up the next one
+			glFlush();
+
+			mStats.mDrawSeconds += secondsSince(drawStart);
+
+			mReadback.poll();
+			drain_ready();
+
+			// Apply back pressure if the GPU or the writer has fallen behind
+			auto waitStart = sequence_clock_t::now();
+			// Only wait for the oldest frames, so the GPU keeps working on the newer ones
+			while (pending.size() > params.mMaxFramesInFlight && mReadback.waitOldest())
+				drain_ready();
+			{
+				std::unique_lock<std::mutex> lock(mStatsMutex);
+				writeDone.wait(lock, [&]() { return writesInFlight <= params.mMaxFramesInFlight; });
+			}
+			mStats.mWaitSeconds += secondsSince(waitStart);
+		}
+
+		auto waitStart = sequence_clock_t::now();
+		mReadback.flush();
+		drain_ready();
+		mWriter.wait();
+		mStats.mWaitSeconds += secondsSince(waitStart);
+
+		close();
+
+		mStats.mFrames = frameCount;
+		mStats.mTotalSeconds = secondsSince(start);
+		mStats.mFramesPerSecond = mStats.mTotalSeconds > 0.0 ? frameCount / mStats.mTotalSeconds : 0.0;
+
+		return mStats;
+	}
+}
@@ -1,4 +1,5 @@
 #include <engine/shader.hpp>
+#include <engine/gldelete.hpp>
 #include <engine/json.hpp>
 #include <engine/shader_rc.hpp>
 
@@ -635,7 +636,7 @@ namespace Morpheus {
 
 	void ContentFactory<Shader>::unload(INodeOwner* ref) {
 		Shader* shad = ref->toShader();
-		glDeleteProgram(shad->mId);
+		glDeleteQueue()->deletePrograms(1, &shad->mId);
 		delete shad;
 	}
 
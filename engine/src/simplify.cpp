@@ -0,0 +1,587 @@
+#include <engine/simplify.hpp>
+#include <engine/halfedge.hpp>
+#include <engine/log.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+// Positions, texture coordinates and normals
+#define SIMPLIFY_MAX_DIMENSION 8
+// Collapses may not rotate a triangle normal by more than about 75 degrees
+#define SIMPLIFY_MIN_NORMAL_COSINE 0.25f
+
+using namespace std;
+
+namespace Morpheus {
+
+	SimplifyParameters SimplifyParameters::defaults() {
+		SimplifyParameters params;
+		params.mTargetTriangleCount = 0;
+		params.mTargetRatio = 0.5f;
+		params.mMaxError = std::numeric_limits<float>::infinity();
+		params.mUVWeight = 1.0f;
+		params.mNormalWeight = 0.5f;
+		params.mBoundaryWeight = 10.0f;
+		return params;
+	}
+
+	// Quadrics are stored as the packed upper triangle of A, then b, c and the total
+	// weight of everything that was added, so that Q(x) = x^T A x + 2 b^T x + c.
+	inline uint32_t quadricStride(uint32_t dim) {
+		return dim * (dim + 1) / 2 + dim + 2;
+	}
+
+	void quadricAdd(double* q, const double* other, uint32_t dim) {
+		uint32_t stride = quadricStride(dim);
+		for (uint32_t i = 0; i < stride; ++i)
+			q[i] += other[i];
+	}
+
+	// Adds the squared distance to the plane of a triangle in dim dimensions.
+	void quadricAddTriangle(double* q, uint32_t dim, const double* p0,
+		const double* p1, const double* p2, double weight) {
+		double e1[SIMPLIFY_MAX_DIMENSION];
+		double e2[SIMPLIFY_MAX_DIMENSION];
+
+		double len1 = 0.0;
+		for (uint32_t i = 0; i < dim; ++i) {
+			e1[i] = p1[i] - p0[i];
+			len1 += e1[i] * e1[i];
+		}
+		len1 = std::sqrt(len1);
+		if (len1 < 1e-12)
+			return;
+
+		double proj = 0.0;
+		for (uint32_t i = 0; i < dim; ++i) {
+			e1[i] /= len1;
+			e2[i] = p2[i] - p0[i];
+			proj += e2[i] * e1[i];
+		}
+
+		double len2 = 0.0;
+		for (uint32_t i = 0; i < dim; ++i) {
+			e2[i] -= proj * e1[i];
+			len2 += e2[i] * e2[i];
+		}
+		len2 = std::sqrt(len2);
+		if (len2 < 1e-12)
+			return;
+
+		double pe1 = 0.0;
+		double pe2 = 0.0;
+		double pp = 0.0;
+		for (uint32_t i = 0; i < dim; ++i) {
+			e2[i] /= len2;
+			pe1 += p0[i] * e1[i];
+			pe2 += p0[i] * e2[i];
+			pp += p0[i] * p0[i];
+		}
+
+		// A = I - e1 e1^T - e2 e2^T
+		uint32_t k = 0;
+		for (uint32_t r = 0; r < dim; ++r)
+			for (uint32_t c = r; c < dim; ++c, ++k)
+				q[k] += weight * ((r == c ? 1.0 : 0.0) - e1[r] * e1[c] - e2[r] * e2[c]);
+
+		// b = (p.e1) e1 + (p.e2) e2 - p
+		for (uint32_t r = 0; r < dim; ++r, ++k)
+			q[k] += weight * (pe1 * e1[r] + pe2 * e2[r] - p0[r]);
+
+		q[k++] += weight * (pp - pe1 * pe1 - pe2 * pe2);
+		q[k] += weight;
+	}
+
+	// Adds the squared distance to a plane through the positional part of the point.
+	void quadricAddPlane(double* q, uint32_t dim, const glm::vec3& normal, double d, double weight) {
+		uint32_t k = 0;
+		for (uint32_t r = 0; r < dim; ++r)
+			for (uint32_t c = r; c < dim; ++c, ++k)
+				if (c < 3)
+					q[k] += weight * normal[r] * normal[c];
+
+		for (uint32_t r = 0; r < 3; ++r)
+			q[k + r] += weight * d * normal[r];
+		k += dim;
+
+		q[k] += weight * d * d;
+	}
+
+	double quadricEvaluate(const double* q, uint32_t dim, const double* x) {
+		double result = 0.0;
+		uint32_t k = 0;
+		for (uint32_t r = 0; r < dim; ++r)
+			for (uint32_t c = r; c < dim; ++c, ++k)
+				result += (r == c ? 1.0 : 2.0) * q[k] * x[r] * x[c];
+		for (uint32_t r = 0; r < dim; ++r, ++k)
+			result += 2.0 * q[k] * x[r];
+		result += q[k];
+		return result;
+	}
+
+	inline double quadricWeight(const double* q, uint32_t dim) {
+		return q[quadricStride(dim) - 1];
+	}
+
+	struct CollapseCandidate {
+		double mCost;
+		uint32_t mFrom;
+		uint32_t mTo;
+		uint32_t mFromStamp;
+		uint32_t mToStamp;
+
+		// Lowest cost on top of the heap
+		inline bool operator<(const CollapseCandidate& other) const {
+			return mCost > other.mCost;
+		}
+	};
+
+	class QuadricSimplifier {
+	private:
+		uint32_t mDim;
+		uint32_t mStride;
+		std::vector<double> mPoints;
+		std::vector<glm::vec3> mPositions;
+		std::vector<double> mQuadrics;
+		// Position only quadrics, used to report the geometric error
+		std::vector<double> mPositionQuadrics;
+
+		std::vector<uint32_t> mIndices;
+		std::vector<bool> bTriangleRemoved;
+		std::vector<std::vector<uint32_t>> mVertexTriangles;
+		std::vector<bool> bVertexRemoved;
+		std::vector<bool> bVertexBoundary;
+		std::vector<uint32_t> mStamps;
+		std::priority_queue<CollapseCandidate> mHeap;
+		uint32_t mTriangleCount;
+		double mMaxPositionError;
+
+		inline double* quadric(uint32_t v) { return &mQuadrics[(size_t)v * mStride]; }
+		inline double* positionQuadric(uint32_t v) { return &mPositionQuadrics[(size_t)v * quadricStride(3)]; }
+		inline const double* point(uint32_t v) const { return &mPoints[(size_t)v * mDim]; }
+
+		inline bool triangleContains(uint32_t t, uint32_t v) const {
+			return mIndices[3 * t] == v || mIndices[3 * t + 1] == v || mIndices[3 * t + 2] == v;
+		}
+
+		void neighbors(uint32_t v, std::vector<uint32_t>* result) const {
+			result->clear();
+			for (auto t : mVertexTriangles[v]) {
+				for (uint32_t i = 0; i < 3; ++i) {
+					uint32_t w = mIndices[3 * t + i];
+					if (w != v && std::find(result->begin(), result->end(), w) == result->end())
+						result->push_back(w);
+				}
+			}
+		}
+
+		uint32_t sharedTriangleCount(uint32_t a, uint32_t b) const {
+			uint32_t count = 0;
+			for (auto t : mVertexTriangles[a])
+				if (triangleContains(t, b))
+					++count;
+			return count;
+		}
+
+		double collapseCost(uint32_t from, uint32_t to) {
+			const double* qFrom = quadric(from);
+			const double* qTo = quadric(to);
+			double weight = quadricWeight(qFrom, mDim) + quadricWeight(qTo, mDim);
+			double error = quadricEvaluate(qFrom, mDim, point(to)) + quadricEvaluate(qTo, mDim, point(to));
+			return std::max(error, 0.0) / std::max(weight, 1e-12);
+		}
+
+		double positionError(uint32_t v) {
+			const double* q = positionQuadric(v);
+			double error = quadricEvaluate(q, 3, point(v));
+			return std::max(error, 0.0) / std::max(quadricWeight(q, 3), 1e-12);
+		}
+
+		void pushEdge(uint32_t a, uint32_t b) {
+			// Boundary vertices may only slide along the boundary
+			bool bBoundaryEdge = sharedTriangleCount(a, b) == 1;
+			bool bCanMoveA = !bVertexBoundary[a] || bBoundaryEdge;
+			bool bCanMoveB = !bVertexBoundary[b] || bBoundaryEdge;
+
+			CollapseCandidate candidate;
+			candidate.mCost = std::numeric_limits<double>::infinity();
+			if (bCanMoveA) {
+				candidate.mCost = collapseCost(a, b);
+				candidate.mFrom = a;
+				candidate.mTo = b;
+			}
+			if (bCanMoveB) {
+				double cost = collapseCost(b, a);
+				if (cost < candidate.mCost) {
+					candidate.mCost = cost;
+					candidate.mFrom = b;
+					candidate.mTo = a;
+				}
+			}
+			if (!bCanMoveA && !bCanMoveB)
+				return;
+
+			candidate.mFromStamp = mStamps[candidate.mFrom];
+			candidate.mToStamp = mStamps[candidate.mTo];
+			mHeap.push(candidate);
+		}
+
+		bool isValidCollapse(uint32_t from, uint32_t to, std::vector<uint32_t>* scratchA,
+			std::vector<uint32_t>* scratchB) {
+			uint32_t shared = sharedTriangleCount(from, to);
+			if (shared == 0 || shared > 2)
+				return false;
+			if (bVertexBoundary[from] && shared != 1)
+				return false;
+
+			// Link condition: the only common neighbors are the opposite vertices of the edge
+			neighbors(from, scratchA);
+			neighbors(to, scratchB);
+			uint32_t common = 0;
+			for (auto w : *scratchA)
+				if (std::find(scratchB->begin(), scratchB->end(), w) != scratchB->end())
+					++common;
+			if (common != shared)
+				return false;
+
+			// Reject collapses that flip or fold over any remaining triangle
+			const glm::vec3& target = mPositions[to];
+			for (auto t : mVertexTriangles[from]) {
+				if (triangleContains(t, to))
+					continue;
+
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (uint32_t i = 0; i < 3; ++i) {
+					uint32_t v = mIndices[3 * t + i];
+					p[i] = mPositions[v];
+					q[i] = v == from ? target : p[i];
+				}
+				glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				float lengths = glm::length(before) * glm::length(after);
+				if (glm::dot(before, after) <= SIMPLIFY_MIN_NORMAL_COSINE * lengths)
+					return false;
+			}
+
+			return true;
+		}
+
+		void removeTriangleFrom(uint32_t v, uint32_t t) {
+			auto& list = mVertexTriangles[v];
+			auto it = std::find(list.begin(), list.end(), t);
+			if (it != list.end()) {
+				*it = list.back();
+				list.pop_back();
+			}
+		}
+
+		void collapse(uint32_t from, uint32_t to) {
+			for (auto t : mVertexTriangles[from]) {
+				if (triangleContains(t, to)) {
+					bTriangleRemoved[t] = true;
+					--mTriangleCount;
+					for (uint32_t i = 0; i < 3; ++i) {
+						uint32_t v = mIndices[3 * t + i];
+						if (v != from)
+							removeTriangleFrom(v, t);
+					}
+				}
+				else {
+					for (uint32_t i = 0; i < 3; ++i)
+						if (mIndices[3 * t + i] == from)
+							mIndices[3 * t + i] = to;
+					mVertexTriangles[to].push_back(t);
+				}
+			}
+
+			mVertexTriangles[from].clear();
+			bVertexRemoved[from] = true;
+
+			quadricAdd(quadric(to), quadric(from), mDim);
+			quadricAdd(positionQuadric(to), positionQuadric(from), 3);
+			mMaxPositionError = std::max(mMaxPositionError, positionError(to));
+			++mStamps[to];
+		}
+
+	public:
+		QuadricSimplifier(const HalfEdgeGeometry* geo, const SimplifyParameters& params) :
+			mTriangleCount(0), mMaxPositionError(0.0) {
+			uint32_t vertexCount = (uint32_t)geo->vertexCount();
+			bool bUVs = geo->hasUVs() && params.mUVWeight > 0.0f;
+			bool bNormals = geo->hasNormals() && params.mNormalWeight > 0.0f;
+
+			mDim = 3 + (bUVs ? 2 : 0) + (bNormals ? 3 : 0);
+			mStride = quadricStride(mDim);
+
+			mPositions.resize(vertexCount);
+			mPoints.resize((size_t)vertexCount * mDim);
+			for (uint32_t i = 0; i < vertexCount; ++i) {
+				auto v = geo->constGetVertex(i);
+				double* x = &mPoints[(size_t)i * mDim];
+				mPositions[i] = v.position();
+				uint32_t k = 0;
+				for (uint32_t j = 0; j < 3; ++j)
+					x[k++] = mPositions[i][j];
+				if (bUVs) {
+					auto uv = v.uv();
+					x[k++] = params.mUVWeight * uv.x;
+					x[k++] = params.mUVWeight * uv.y;
+				}
+				if (bNormals) {
+					auto normal = v.normal();
+					for (uint32_t j = 0; j < 3; ++j)
+						x[k++] = params.mNormalWeight * normal[j];
+				}
+			}
+
+			// Triangulate faces as fans
+			for (auto face = geo->constGetFace(0); face.valid(); face = face.nextById()) {
+				auto vertIt = face.vertices();
+				uint32_t first = (uint32_t)vertIt().id();
+				vertIt.next();
+				uint32_t last = (uint32_t)vertIt().id();
+				vertIt.next();
+
+				for (; vertIt.valid(); vertIt.next()) {
+					uint32_t current = (uint32_t)vertIt().id();
+					mIndices.push_back(first);
+					mIndices.push_back(last);
+					mIndices.push_back(current);
+					last = current;
+				}
+			}
+
+			uint32_t triangleCount = (uint32_t)(mIndices.size() / 3);
+			mTriangleCount = triangleCount;
+			bTriangleRemoved.resize(triangleCount, false);
+			mVertexTriangles.resize(vertexCount);
+			bVertexRemoved.resize(vertexCount, false);
+			bVertexBoundary.resize(vertexCount, false);
+			mStamps.resize(vertexCount, 0);
+			mQuadrics.resize((size_t)vertexCount * mStride, 0.0);
+			mPositionQuadrics.resize((size_t)vertexCount * quadricStride(3), 0.0);
+
+			std::vector<double> triangleQuadric(mStride);
+			std::vector<double> trianglePositionQuadric(quadricStride(3));
+			for (uint32_t t = 0; t < triangleCount; ++t) {
+				uint32_t i0 = mIndices[3 * t];
+				uint32_t i1 = mIndices[3 * t + 1];
+				uint32_t i2 = mIndices[3 * t + 2];
+
+				double area = 0.5 * glm::length(glm::cross(mPositions[i1] - mPositions[i0],
+					mPositions[i2] - mPositions[i0]));
+
+				std::fill(triangleQuadric.begin(), triangleQuadric.end(), 0.0);
+				std::fill(trianglePositionQuadric.begin(), trianglePositionQuadric.end(), 0.0);
+				quadricAddTriangle(&triangleQuadric[0], mDim, point(i0), point(i1), point(i2), area);
+
+				double p[3][3];
+				for (uint32_t j = 0; j < 3; ++j) {
+					p[0][j] = mPositions[i0][j];
+					p[1][j] = mPositions[i1][j];
+					p[2][j] = mPositions[i2][j];
+				}
+				quadricAddTriangle(&trianglePositionQuadric[0], 3, p[0], p[1], p[2], area);
+
+				for (uint32_t j = 0; j < 3; ++j) {
+					uint32_t v = mIndices[3 * t + j];
+					quadricAdd(quadric(v), &triangleQuadric[0], mDim);
+					quadricAdd(positionQuadric(v), &trianglePositionQuadric[0], 3);
+					mVertexTriangles[v].push_back(t);
+				}
+			}
+
+			// Count the triangles on each edge to find the boundary
+			std::unordered_map<uint64_t, uint32_t> edgeCounts;
+			auto edgeKey = [](uint32_t a, uint32_t b) {
+				return ((uint64_t)std::min(a, b) << 32) | (uint64_t)std::max(a, b);
+			};
+			for (uint32_t t = 0; t < triangleCount; ++t)
+				for (uint32_t j = 0; j < 3; ++j)
+					++edgeCounts[edgeKey(mIndices[3 * t + j], mIndices[3 * t + (j + 1) % 3])];
+
+			// Hold boundary edges in place with planes perpendicular to their triangles
+			for (uint32_t t = 0; t < triangleCount; ++t) {
+				glm::vec3 normal = glm::cross(mPositions[mIndices[3 * t + 1]] - mPositions[mIndices[3 * t]],
+					mPositions[mIndices[3 * t + 2]] - mPositions[mIndices[3 * t]]);
+				float normalLength = glm::length(normal);
+				if (normalLength < 1e-12f)
+					continue;
+				normal /= normalLength;
+
+				for (uint32_t j = 0; j < 3; ++j) {
+					uint32_t a = mIndices[3 * t + j];
+					uint32_t b = mIndices[3 * t + (j + 1) % 3];
+					if (edgeCounts[edgeKey(a, b)] != 1)
+						continue;
+
+					glm::vec3 edge = mPositions[b] - mPositions[a];
+					glm::vec3 planeNormal = glm::cross(edge, normal);
+					float planeNormalLength = glm::length(planeNormal);
+					if (planeNormalLength < 1e-12f)
+						continue;
+					planeNormal /= planeNormalLength;
+					double d = -glm::dot(planeNormal, mPositions[a]);
+					double weight = params.mBoundaryWeight * glm::dot(edge, edge);
+
+					quadricAddPlane(quadric(a), mDim, planeNormal, d, weight);
+					quadricAddPlane(quadric(b), mDim, planeNormal, d, weight);
+					quadricAddPlane(positionQuadric(a), 3, planeNormal, d, weight);
+					quadricAddPlane(positionQuadric(b), 3, planeNormal, d, weight);
+					bVertexBoundary[a] = true;
+					bVertexBoundary[b] = true;
+				}
+			}
+
+			for (auto& it : edgeCounts)
+				pushEdge((uint32_t)(it.first >> 32), (uint32_t)(it.first & 0xFFFFFFFF));
+		}
+
+		void run(uint32_t targetTriangleCount, float maxError) {
+			const double maxErrorSquared = (double)maxError * (double)maxError;
+			std::vector<uint32_t> scratchA;
+			std::vector<uint32_t> scratchB;
+			std::vector<uint32_t> around;
+
+			while (mTriangleCount > targetTriangleCount && !mHeap.empty()) {
+				auto candidate = mHeap.top();
+				mHeap.pop();
+
+				// Skip candidates that were invalidated by earlier collapses
+				if (bVertexRemoved[candidate.mFrom] || bVertexRemoved[candidate.mTo] ||
+					mStamps[candidate.mFrom] != candidate.mFromStamp ||
+					mStamps[candidate.mTo] != candidate.mToStamp)
+					continue;
+
+				if (!isValidCollapse(candidate.mFrom, candidate.mTo, &scratchA, &scratchB))
+					continue;
+
+				// Check the geometric error before committing. The heap is ordered by the
+				// combined cost, so a candidate further down may still be within bounds, only
+				// drop this one. It is pushed again if its neighborhood changes.
+				double* qTo = positionQuadric(candidate.mTo);
+				double* qFrom = positionQuadric(candidate.mFrom);
+				double weight = quadricWeight(qTo, 3) + quadricWeight(qFrom, 3);
+				double error = (quadricEvaluate(qTo, 3, point(candidate.mTo)) +
+					quadricEvaluate(qFrom, 3, point(candidate.mTo))) / std::max(weight, 1e-12);
+				if (error > maxErrorSquared)
+					continue;
+
+				collapse(candidate.mFrom, candidate.mTo);
+
+				// Costs of all edges around the surviving vertex have changed
+				neighbors(candidate.mTo, &around);
+				for (auto w : around)
+					pushEdge(candidate.mTo, w);
+			}
+		}
+
+		HalfEdgeGeometry* output(const HalfEdgeGeometry* geo) const {
+			uint32_t vertexCount = (uint32_t)geo->vertexCount();
+			std::vector<uint32_t> remap(vertexCount, (uint32_t)-1);
+			std::vector<uint32_t> sources;
+			std::vector<vec3type> positions;
+			std::vector<uint32_t> faceIndices;
+
+			for (uint32_t t = 0; t < bTriangleRemoved.size(); ++t) {
+				if (bTriangleRemoved[t])
+					continue;
+				for (uint32_t j = 0; j < 3; ++j) {
+					uint32_t v = mIndices[3 * t + j];
+					if (remap[v] == (uint32_t)-1) {
+						remap[v] = (uint32_t)sources.size();
+						sources.push_back(v);
+						positions.push_back(mPositions[v]);
+					}
+					faceIndices.push_back(remap[v]);
+				}
+			}
+
+			std::vector<uint32_t> faceSizes(faceIndices.size() / 3, 3);
+			auto result = makeHalfEdgeGeometry(positions, faceIndices, faceSizes);
+
+			// Collapses never create vertices, so all attributes come straight from the input
+			if (geo->hasUVs()) {
+				result->createUVs();
+				for (uint32_t i = 0; i < sources.size(); ++i)
+					result->getVertex(i).setUV(geo->constGetVertex(sources[i]).uv());
+			}
+			if (geo->hasNormals()) {
+				result->createNormals();
+				for (uint32_t i = 0; i < sources.size(); ++i)
+					result->getVertex(i).setNormal(geo->constGetVertex(sources[i]).normal());
+			}
+			if (geo->hasTangents()) {
+				result->createTangents();
+				for (uint32_t i = 0; i < sources.size(); ++i)
+					result->getVertex(i).setTangent(geo->constGetVertex(sources[i]).tangent());
+			}
+			if (geo->hasColors()) {
+				result->createColors();
+				for (uint32_t i = 0; i < sources.size(); ++i)
+					result->getVertex(i).setColor(geo->constGetVertex(sources[i]).color());
+			}
+
+			return result;
+		}
+
+		inline uint32_t triangleCount() const { return mTriangleCount; }
+		inline uint32_t initialTriangleCount() const { return (uint32_t)(mIndices.size() / 3); }
+		inline float maxPositionError() const { return (float)std::sqrt(mMaxPositionError); }
+	};
+
+	HalfEdgeGeometry* simplify(const HalfEdgeGeometry* geo,
+		const SimplifyParameters& params, float* error) {
+		QuadricSimplifier simplifier(geo, params);
+
+		uint32_t target = params.mTargetTriangleCount;
+		if (target == 0)
+			target = (uint32_t)(params.mTargetRatio * simplifier.initialTriangleCount());
+
+		simplifier.run(target, params.mMaxError);
+
+		if (error)
+			*error = simplifier.maxPositionError();
+		return simplifier.output(geo);
+	}
+
+	void generateLodChain(const HalfEdgeGeometry* geo, uint32_t levelCount, float ratio,
+		const SimplifyParameters& params, std::vector<HalfEdgeGeometry*>* lods,
+		std::vector<float>* errors) {
+		SimplifyParameters levelParams = params;
+		levelParams.mTargetTriangleCount = 0;
+		levelParams.mTargetRatio = ratio;
+
+		const HalfEdgeGeometry* previous = geo;
+		size_t previousFaces = 0;
+		for (auto face = geo->constGetFace(0); face.valid(); face = face.nextById())
+			previousFaces += face.vertexCount() - 2;
+		float previousError = 0.0f;
+
+		for (uint32_t level = 0; level < levelCount; ++level) {
+			float levelError = 0.0f;
+			auto lod = simplify(previous, levelParams, &levelError);
+
+			// Nothing left to collapse
+			if (lod->faceCount() >= previousFaces) {
+				delete lod;
+				break;
+			}
+
+			// Errors relative to the previous level add up
+			previousError += levelError;
+			previousFaces = lod->faceCount();
+			previous = lod;
+
+			lods->push_back(lod);
+			errors->push_back(previousError);
+
+			logVerbose() << "Generated LOD " << level + 1 << " with " << previousFaces
+				<< " triangles (error " << previousError << ")";
+		}
+	}
+}
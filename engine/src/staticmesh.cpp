@@ -1,4 +1,6 @@
 #include <engine/staticmesh.hpp>
+#include <engine/halfedgeloader.hpp>
+#include <engine/simplify.hpp>
 #include <engine/json.hpp>
 
 #include <fstream>
@@ -24,6 +26,26 @@ namespace Morpheus {
 		addChild(geo);
 		mGeometry = geo;
 	}
+	void StaticMesh::addLod(Geometry* geo, float error) {
+		addChild(geo);
+
+		StaticMeshLod lod;
+		lod.mGeometry = geo;
+		lod.mError = error;
+		mLods.push_back(lod);
+	}
+
+	uint32_t StaticMesh::selectLod(float errorScale, float threshold) const {
+		// Errors grow with the level, so take the last one that is still acceptable
+		uint32_t lod = 0;
+		for (uint32_t i = 0; i < mLods.size(); ++i) {
+			if (mLods[i].mError * errorScale > threshold)
+				break;
+			lod = i + 1;
+		}
+		return lod;
+	}
+
 	void StaticMesh::setMaterial(Material* mat) {
 		if (mMaterial) {
 			removeChild(mMaterial);
@@ -37,17 +59,12 @@ namespace Morpheus {
 	INodeOwner* ContentFactory<StaticMesh>::load(const std::string& source, Node loadInto) {
 		std::cout << "Loading static mesh " << source << "..." << std::endl;
 
-		ifstream f(source);
-
-		if (!f.is_open()) {
+		json j;
+		if (!readContentJson(source, content()->derivedCache(), &j)) {
 			cout << "Error: failed to open " << source << "!" << endl;
 			return nullptr;
 		}
 
-		json j;
-		f >> j;
-		f.close();
-
 		string materialSrc;
 		string geometrySrc;
 
@@ -75,6 +92,56 @@ namespace Morpheus {
 		staticMesh->mGeometry = geometry;
 		staticMesh->mMaterial = material;
 
+		// Levels of detail that were cooked with the geometry are owned by it
+		for (auto& cookedLod : geometry->lods()) {
+			StaticMeshLod lod;
+			lod.mGeometry = cookedLod.mGeometry;
+			lod.mError = cookedLod.mError;
+			staticMesh->mLods.push_back(lod);
+		}
+
+		// Generate simplified levels of detail from the same source
+		if (j.contains("lods") && staticMesh->mLods.empty()) {
+			auto lodConfig = j["lods"];
+			uint32_t levels = lodConfig.value("levels", 3u);
+			float ratio = lodConfig.value("ratio", 0.5f);
+
+			SimplifyParameters params = SimplifyParameters::defaults();
+			params.mUVWeight = lodConfig.value("uv_weight", params.mUVWeight);
+			params.mNormalWeight = lodConfig.value("normal_weight", params.mNormalWeight);
+
+			// Do not weld vertices, so that UV and normal seams stay intact as boundaries
+			HalfEdgeLoadParameters loadParams;
+			loadParams.mRelativeJoinEpsilon = 0.0f;
+
+			auto halfEdgeFactory = getFactory<HalfEdgeGeometry>();
+			auto geometryFactory = getFactory<Geometry>();
+			auto halfEdge = halfEdgeFactory->loadUnmanaged(geometrySrc, loadParams);
+
+			if (halfEdge) {
+				std::vector<HalfEdgeGeometry*> lods;
+				std::vector<float> errors;
+				generateLodChain(halfEdge, levels, ratio, params, &lods, &errors);
+
+				for (uint32_t i = 0; i < lods.size(); ++i) {
+					auto lodGeometry = geometryFactory->makeGeometry(lods[i]);
+					loadInto.addChild(lodGeometry->node());
+
+					StaticMeshLod lod;
+					lod.mGeometry = lodGeometry;
+					lod.mError = errors[i];
+					staticMesh->mLods.push_back(lod);
+
+					halfEdgeFactory->unload(lods[i]);
+				}
+
+				halfEdgeFactory->unload(halfEdge);
+			}
+			else {
+				cout << "Warning: failed to generate levels of detail for " << source << endl;
+			}
+		}
+
 		return staticMesh;
 	}
 
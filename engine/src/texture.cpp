@@ -1,14 +1,39 @@
 #include <engine/texture.hpp>
+#include <engine/gldelete.hpp>
 #include <lodepng/lodepng.h>
 #include <stb_image.h>
 
+#include <cstring>
 #include <iostream>
 #include <gli/gli.hpp>
 #include <glad/glad.h>
 
 namespace Morpheus {
 
-	ContentFactory<Texture>::ContentFactory() {
+	gli::format blockFormatToGli(BlockFormat format, bool bSRGB) {
+		switch (format) {
+		case BlockFormat::BC1:
+			return bSRGB ? gli::FORMAT_RGB_DXT1_SRGB_BLOCK8 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+		case BlockFormat::BC3:
+			return bSRGB ? gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16 : gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+		case BlockFormat::BC4:
+			return gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+		case BlockFormat::BC5:
+			return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+		case BlockFormat::BC7:
+			return bSRGB ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RGBA_BP_UNORM_BLOCK16;
+		default:
+			return gli::FORMAT_UNDEFINED;
+		}
+	}
+
+	ContentFactory<Texture>::ContentFactory() :
+		mMipParameters(MipGenParameters::defaults()),
+		mMipGenerator(nullptr),
+		mCompressParameters(BlockCompressParameters::defaults()),
+		bCompressOnCook(false),
+		mCompressor(nullptr),
+		mStreamer(nullptr) {
 		mExtensionToLoader["dds"] = TextureLoader::GLI;
 		mExtensionToLoader["ktx"] = TextureLoader::GLI;
 		mExtensionToLoader["kmg"] = TextureLoader::GLI;
@@ -25,6 +50,85 @@ namespace Morpheus {
 		mExtensionToLoader["pgm"] = TextureLoader::STB;
 	}
 
+	bool isSRGBFormat(GLenum internalFormat) {
+		return internalFormat == GL_SRGB8 || internalFormat == GL_SRGB8_ALPHA8;
+	}
+
+	uint internalFormatSize(GLenum internalFormat) {
+		switch (internalFormat) {
+		case GL_R8:
+		case GL_R8_SNORM:
+		case GL_R8I:
+		case GL_R8UI:
+		case GL_STENCIL_INDEX8:
+			return 1;
+		case GL_RG8:
+		case GL_RG8_SNORM:
+		case GL_RG8I:
+		case GL_RG8UI:
+		case GL_R16:
+		case GL_R16_SNORM:
+		case GL_R16F:
+		case GL_R16I:
+		case GL_R16UI:
+		case GL_DEPTH_COMPONENT16:
+			return 2;
+		case GL_RGB8:
+		case GL_RGB8_SNORM:
+		case GL_RGB8I:
+		case GL_RGB8UI:
+		case GL_SRGB8:
+			return 3;
+		case GL_RGBA8:
+		case GL_RGBA8_SNORM:
+		case GL_RGBA8I:
+		case GL_RGBA8UI:
+		case GL_SRGB8_ALPHA8:
+		case GL_RGB10_A2:
+		case GL_RGB10_A2UI:
+		case GL_R11F_G11F_B10F:
+		case GL_RGB9_E5:
+		case GL_RG16:
+		case GL_RG16_SNORM:
+		case GL_RG16I:
+		case GL_RG16UI:
+		case GL_RG16F:
+		case GL_R32F:
+		case GL_R32I:
+		case GL_R32UI:
+		case GL_DEPTH_COMPONENT24:
+		case GL_DEPTH24_STENCIL8:
+		case GL_DEPTH_COMPONENT32:
+		case GL_DEPTH_COMPONENT32F:
+			return 4;
+		case GL_RGB16:
+		case GL_RGB16_SNORM:
+		case GL_RGB16I:
+		case GL_RGB16UI:
+		case GL_RGB16F:
+			return 6;
+		case GL_RGBA16:
+		case GL_RGBA16_SNORM:
+		case GL_RGBA16I:
+		case GL_RGBA16UI:
+		case GL_RGBA16F:
+		case GL_RG32F:
+		case GL_RG32I:
+		case GL_RG32UI:
+		case GL_DEPTH32F_STENCIL8:
+			return 8;
+		case GL_RGB32F:
+		case GL_RGB32I:
+		case GL_RGB32UI:
+			return 12;
+		case GL_RGBA32F:
+		case GL_RGBA32I:
+		case GL_RGBA32UI:
+			return 16;
+		}
+		return 0;
+	}
+
 	Texture* Texture::toTexture() {
 		return this;
 	}
@@ -269,6 +373,13 @@ namespace Morpheus {
 			internalFormatToUse = internalFormat;
 		}
 
+		if (mMipGenerator) {
+			Texture* tex = makeTextureFromImage(pixel_data, x, y, comp, b_hdr, internalFormatToUse, format,
+				!overrideFormat || isSRGBFormat(internalFormatToUse));
+			stbi_image_free(pixel_data);
+			return tex;
+		}
+
 		GLuint TextureName = 0;
 		glGenTextures(1, &TextureName);
 		glBindTexture(GL_TEXTURE_2D, TextureName);
@@ -316,7 +427,11 @@ namespace Morpheus {
 
 		//the pixels are now in the vector "image", 4 bytes per pixel, ordered RGBARGBA..., use it as texture, draw it, ...
 		//State state contains extra information about the PNG such as text chunks, ...
-		if (!error) {
+		if (!error && mMipGenerator) {
+			return makeTextureFromImage(&image[0], width, height, 4, false, internalFormatToUse, GL_RGBA,
+				!overrideFormat || isSRGBFormat(internalFormatToUse));
+		}
+		else if (!error) {
 			GLuint TextureName = 0;
 
 			glGenTextures(1, &TextureName);
@@ -346,6 +461,19 @@ namespace Morpheus {
 		}
 	}
 
+	template <bool overrideFormat>
+	Texture* ContentFactory<Texture>::loadStreamedInternal(const std::string& source,
+		GLenum internalFormat) {
+		if constexpr (!overrideFormat) {
+			if (mStreamer) {
+				Texture* tex = mStreamer->load(source);
+				if (tex)
+					return tex;
+			}
+		}
+		return loadGliInternal<overrideFormat>(source, internalFormat);
+	}
+
 	template <bool overrideFormat>
 	Texture* ContentFactory<Texture>::loadInternal(const std::string& source,
 		GLenum internalFormat) {
@@ -356,10 +484,22 @@ namespace Morpheus {
 			auto it = mExtensionToLoader.find(ext);
 
 			if (it != mExtensionToLoader.end()) {
+				// Prefer a cooked version with a precomputed mip chain. Block compressed
+				// cooked data cannot be uploaded into storage of an overridden format, nor
+				// does it carry the sRGB intent of the override, so decode the source then.
+				std::string cachedPath;
+				auto cache = content()->derivedCache();
+				bool bCacheUsable = !(overrideFormat && bCompressOnCook);
+				if (it->second != TextureLoader::GLI && cache && bCacheUsable &&
+					cache->find(source, cacheParameters(), TEXTURE_CACHE_EXTENSION, &cachedPath)) {
+					std::cout << " (using derived data cache)..." << std::endl;
+					return loadStreamedInternal<overrideFormat>(cachedPath, internalFormat);
+				}
+
 				switch (it->second) {
 				case TextureLoader::GLI:
 					std::cout << " (using gli)..." << std::endl;
-					return loadGliInternal<overrideFormat>(source, internalFormat);
+					return loadStreamedInternal<overrideFormat>(source, internalFormat);
 				case TextureLoader::LODEPNG:
 					std::cout << " (using lodepng)..." << std::endl;
 					return loadPngInternal<overrideFormat>(source, internalFormat);
@@ -382,6 +522,87 @@ namespace Morpheus {
 		}
 	}
 
+	bool ContentFactory<Texture>::cook(const std::string& source, const std::string& destination) const {
+		size_t loc = source.rfind('.');
+		auto it = loc == std::string::npos ? mExtensionToLoader.end() :
+			mExtensionToLoader.find(source.substr(loc + 1));
+		if (it == mExtensionToLoader.end() || it->second == TextureLoader::GLI) {
+			std::cout << "Error: cannot cook texture " << source << "!" << std::endl;
+			return false;
+		}
+
+		int width = 0;
+		int height = 0;
+		int comp = 4;
+		bool bHdr = false;
+		void* pixels = nullptr;
+		std::vector<uint8_t> image;
+
+		if (it->second == TextureLoader::LODEPNG) {
+			uint32_t pngWidth, pngHeight;
+			uint32_t error = lodepng::decode(image, pngWidth, pngHeight, source);
+			if (error) {
+				std::cout << "Decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+				return false;
+			}
+			width = (int)pngWidth;
+			height = (int)pngHeight;
+			pixels = image.data();
+		}
+		else {
+			bHdr = stbi_is_hdr(source.c_str());
+			if (bHdr)
+				pixels = stbi_loadf(source.c_str(), &width, &height, &comp, 0);
+			else
+				pixels = stbi_load(source.c_str(), &width, &height, &comp, 0);
+			if (!pixels) {
+				std::cout << "Error: failed to load image file " << source << "!" << std::endl;
+				return false;
+			}
+		}
+
+		static const gli::format ldrFormats[] = { gli::FORMAT_R8_UNORM_PACK8, gli::FORMAT_RG8_UNORM_PACK8,
+			gli::FORMAT_RGB8_UNORM_PACK8, gli::FORMAT_RGBA8_UNORM_PACK8 };
+		static const gli::format hdrFormats[] = { gli::FORMAT_R32_SFLOAT_PACK32, gli::FORMAT_RG32_SFLOAT_PACK32,
+			gli::FORMAT_RGB32_SFLOAT_PACK32, gli::FORMAT_RGBA32_SFLOAT_PACK32 };
+		gli::format format = bHdr ? hdrFormats[comp - 1] : ldrFormats[comp - 1];
+
+		// Cooking usually runs many textures in parallel, so levels are generated on this thread
+		std::vector<MipLevel> levels;
+		MipGenerator generator(0);
+		generator.generate(pixels, width, height, comp, bHdr, mMipParameters, &levels);
+
+		if (it->second == TextureLoader::STB)
+			stbi_image_free(pixels);
+
+		// There is no encoder for BC6H, so HDR images stay uncompressed
+		if (bCompressOnCook && !bHdr) {
+			BlockFormat blockFormat = resolveBlockFormat(mCompressParameters.mFormat, comp);
+			BlockCompressor compressor(0);
+			compressor.compress(&levels, comp, blockFormat, mCompressParameters.mQuality);
+			format = blockFormatToGli(blockFormat, mCompressParameters.bSRGB);
+		}
+
+		gli::texture2d tex(format, gli::extent2d(width, height), levels.size());
+		for (size_t level = 0; level < levels.size(); ++level)
+			std::memcpy(tex.data(0, 0, level), levels[level].mData.data(), levels[level].mData.size());
+
+		bool bSaved = destination.size() >= 4 && destination.compare(destination.size() - 4, 4, ".dds") == 0 ?
+			gli::save_dds(tex, destination) : gli::save_ktx(tex, destination);
+		if (!bSaved) {
+			std::cout << "Error: failed to write " << destination << "!" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	std::string ContentFactory<Texture>::cacheParameters() const {
+		std::string params = "texture ktx " + mMipParameters.cacheParameters();
+		if (bCompressOnCook)
+			params += " " + mCompressParameters.cacheParameters();
+		return params;
+	}
+
 	Texture* ContentFactory<Texture>::loadGliUnmanaged(const std::string& source) {
 		return loadGliInternal<false>(source, 0);
 	}
@@ -577,13 +798,152 @@ namespace Morpheus {
 		GL_ASSERT;
 	}
 
+	void Texture::uploadMips(const std::vector<MipLevel>& levels, GLenum format, GLenum type) {
+		glBindTexture(GL_TEXTURE_2D, mId);
+		// Rows of RGB8 and smaller levels are not 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (size_t level = 0; level < levels.size() && level < mLevels; ++level) {
+			glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, levels[level].mWidth, levels[level].mHeight,
+				format, type, levels[level].mData.data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		GL_ASSERT;
+	}
+
+	void Texture::uploadCompressedMips(const std::vector<MipLevel>& levels) {
+		glBindTexture(GL_TEXTURE_2D, mId);
+		for (size_t level = 0; level < levels.size() && level < mLevels; ++level) {
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, levels[level].mWidth, levels[level].mHeight,
+				mFormat, (GLsizei)levels[level].mData.size(), levels[level].mData.data());
+		}
+		GL_ASSERT;
+	}
+
+	size_t Texture::gpuSize() const {
+		uint texelSize = internalFormatSize(mFormat);
+		size_t faces = (mGLTarget == GL_TEXTURE_CUBE_MAP) ? 6 : 1;
+		size_t size = 0;
+
+		for (uint level = 0; level < mLevels; ++level) {
+			if (texelSize > 0) {
+				size_t width = std::max(mWidth >> level, 1u);
+				size_t height = std::max(mHeight >> level, 1u);
+				size_t depth = (mGLTarget == GL_TEXTURE_3D) ?
+					std::max(mDepth >> level, 1u) : std::max(mDepth, 1u);
+				size += width * height * depth * texelSize;
+			} else {
+				// Block compressed formats and anything missing from the table are easier
+				// to ask the driver about
+				GLint bCompressed = 0;
+				glGetTextureLevelParameteriv(mId, level, GL_TEXTURE_COMPRESSED, &bCompressed);
+				if (bCompressed) {
+					GLint levelSize = 0;
+					glGetTextureLevelParameteriv(mId, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+					size += levelSize;
+					continue;
+				}
+
+				const GLenum componentSizes[] = {
+					GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+					GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE,
+					GL_TEXTURE_SHARED_SIZE
+				};
+				GLint texelBits = 0;
+				for (auto component : componentSizes) {
+					GLint bits = 0;
+					glGetTextureLevelParameteriv(mId, level, component, &bits);
+					texelBits += bits;
+				}
+				GLint width = 0;
+				GLint height = 0;
+				GLint depth = 0;
+				glGetTextureLevelParameteriv(mId, level, GL_TEXTURE_WIDTH, &width);
+				glGetTextureLevelParameteriv(mId, level, GL_TEXTURE_HEIGHT, &height);
+				glGetTextureLevelParameteriv(mId, level, GL_TEXTURE_DEPTH, &depth);
+				size += ((size_t)width * std::max(height, 1) * std::max(depth, 1) * texelBits + 7) / 8;
+			}
+		}
+
+		return size * faces * std::max(mSamples, 1u);
+	}
+
+	ContentSize ContentFactory<Texture>::measure(INodeOwner* ref) const {
+		return ContentSize{0, ref->toTexture()->gpuSize()};
+	}
+
 	void ContentFactory<Texture>::unload(INodeOwner* ref) {
 		auto tex = ref->toTexture();
-		glDeleteTextures(1, &tex->mId);
+		if (mStreamer)
+			mStreamer->remove(tex);
+		glDeleteQueue()->deleteTextures(1, &tex->mId);
 		delete tex;
 	}
 
 	ContentFactory<Texture>::~ContentFactory() {
+		delete mMipGenerator;
+		delete mCompressor;
+		delete mStreamer;
+	}
+
+	void ContentFactory<Texture>::enableCpuMips(uint32_t threadCount) {
+		delete mMipGenerator;
+		mMipGenerator = new MipGenerator(threadCount);
+	}
+
+	void ContentFactory<Texture>::disableCpuMips() {
+		delete mMipGenerator;
+		mMipGenerator = nullptr;
+		disableCompressionOnLoad();
+	}
+
+	void ContentFactory<Texture>::enableCompressionOnLoad(uint32_t threadCount) {
+		// Compressed levels are encoded from CPU generated mips
+		if (!mMipGenerator)
+			enableCpuMips(threadCount);
+		delete mCompressor;
+		mCompressor = new BlockCompressor(threadCount);
+	}
+
+	void ContentFactory<Texture>::disableCompressionOnLoad() {
+		delete mCompressor;
+		mCompressor = nullptr;
+	}
+
+	void ContentFactory<Texture>::enableStreaming(const TextureStreamingParameters& params) {
+		delete mStreamer;
+		mStreamer = new TextureStreamer(params);
+	}
+
+	void ContentFactory<Texture>::disableStreaming() {
+		delete mStreamer;
+		mStreamer = nullptr;
+	}
+
+	Texture* ContentFactory<Texture>::makeTextureFromImage(const void* pixels, uint width, uint height,
+		uint components, bool bFloat, GLenum internalFormat, GLenum format, bool bAllowCompression) {
+		MipGenParameters params = mMipParameters;
+		params.bSRGB = params.bSRGB || isSRGBFormat(internalFormat);
+
+		std::vector<MipLevel> levels;
+		mMipGenerator->generate(pixels, width, height, components, bFloat, params, &levels);
+
+		if (mCompressor && bAllowCompression && !bFloat) {
+			BlockFormat blockFormat = resolveBlockFormat(mCompressParameters.mFormat, components);
+			mCompressor->compress(&levels, components, blockFormat, mCompressParameters.mQuality);
+
+			gli::gl GL(gli::gl::PROFILE_GL33);
+			gli::format gliFormat = blockFormatToGli(blockFormat, mCompressParameters.bSRGB || isSRGBFormat(internalFormat));
+			GLenum compressedFormat = GL.translate(gliFormat, gli::swizzles(gli::SWIZZLE_RED,
+				gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA)).Internal;
+
+			Texture* tex = makeTexture2DUnmanaged(width, height, compressedFormat, (int)levels.size());
+			tex->uploadCompressedMips(levels);
+			return tex;
+		}
+
+		Texture* tex = makeTexture2DUnmanaged(width, height, internalFormat, (int)levels.size());
+		tex->uploadMips(levels, format, bFloat ? GL_FLOAT : GL_UNSIGNED_BYTE);
+		return tex;
 	}
 
 	Texture* ContentFactory<Texture>::makeTexture2DUnmanaged(const uint32_t width, const uint32_t height, 
@@ -0,0 +1,466 @@
+#include <engine/texturestreamer.hpp>
+#include <engine/texture.hpp>
+#include <engine/gldelete.hpp>
+
+#include <gli/gli.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <queue>
+
+#define TEXTURE_STREAMING_NO_REQUEST 0xFFFFFFFFu
+#define TEXTURE_STREAMING_WAIT_TIMEOUT_NS 1000000000ull
+
+namespace Morpheus {
+
+	TextureStreamingParameters TextureStreamingParameters::defaults() {
+		TextureStreamingParameters params;
+		params.mBudget = (size_t)512 << 20;
+		params.mMinResidentSize = 64;
+		params.mThreads = 2;
+		params.mStagingBuffers = 4;
+		params.mEvictFrames = 120;
+		params.mUploadBytesPerFrame = (size_t)16 << 20;
+		params.mLodBias = 0.0f;
+		return params;
+	}
+
+	TextureStreamingParameters TextureStreamingParameters::fromConfig(const nlohmann::json& config) {
+		TextureStreamingParameters params = defaults();
+
+		if (config.contains("texture_streaming")) {
+			auto& streamingConfig = config["texture_streaming"];
+			params.mBudget = (size_t)(streamingConfig.value("budget_mb", (double)(params.mBudget >> 20)) * (1 << 20));
+			params.mMinResidentSize = streamingConfig.value("min_resident_size", params.mMinResidentSize);
+			params.mThreads = streamingConfig.value("threads", params.mThreads);
+			params.mStagingBuffers = streamingConfig.value("staging_buffers", params.mStagingBuffers);
+			params.mEvictFrames = streamingConfig.value("evict_frames", params.mEvictFrames);
+			params.mUploadBytesPerFrame = (size_t)(streamingConfig.value("upload_mb_per_frame",
+				(double)params.mUploadBytesPerFrame / (1 << 20)) * (1 << 20));
+			params.mLodBias = streamingConfig.value("lod_bias", params.mLodBias);
+		}
+
+		return params;
+	}
+
+	TextureStreamer::TextureStreamer(const TextureStreamingParameters& params) :
+		mParameters(params),
+		mNextStaging(0),
+		mFrame(0),
+		mNextSerial(0),
+		mStats{0, 0, 0, 0, 0, 0, 0, 0},
+		mWorkers(params.mThreads) {
+		mStaging.resize(std::max(params.mStagingBuffers, 1u));
+		for (auto& staging : mStaging) {
+			glCreateBuffers(1, &staging.mBuffer);
+			staging.mCapacity = 0;
+			staging.mFence = nullptr;
+		}
+	}
+
+	TextureStreamer::~TextureStreamer() {
+		mWorkers.wait();
+		for (auto& staging : mStaging) {
+			if (staging.mFence)
+				glDeleteSync(staging.mFence);
+			glDeleteQueue()->deleteBuffers(1, &staging.mBuffer);
+		}
+	}
+
+	size_t TextureStreamer::residentSize(const StreamedTexture& record, uint32_t finestLevel) const {
+		size_t size = 0;
+		for (uint32_t level = finestLevel; level < record.mLevelCount; ++level)
+			size += record.mLevelSizes[level];
+		return size;
+	}
+
+	void TextureStreamer::setBaseLevel(StreamedTexture* record) {
+		uint32_t validLevel = std::min(record->mValidLevel, record->mLevelCount - 1);
+		glTextureParameteri(record->mTexture->mId, GL_TEXTURE_BASE_LEVEL,
+			(GLint)(validLevel - record->mAllocatedLevel));
+	}
+
+	void TextureStreamer::reallocate(StreamedTexture* record, uint32_t finestLevel) {
+		Texture* texture = record->mTexture;
+		uint32_t levelCount = record->mLevelCount - finestLevel;
+		uint32_t width = std::max(record->mWidth >> finestLevel, 1u);
+		uint32_t height = std::max(record->mHeight >> finestLevel, 1u);
+
+		// Immutable storage cannot grow or shrink, so the texture moves into new storage
+		// and the old one is deleted, which is what actually gives the memory back
+		GLuint id;
+		glCreateTextures(GL_TEXTURE_2D, 1, &id);
+		glTextureStorage2D(id, (GLsizei)levelCount, record->mInternalFormat, width, height);
+		glTextureParameteriv(id, GL_TEXTURE_SWIZZLE_RGBA, record->mSwizzles);
+		glTextureParameteri(id, GL_TEXTURE_MAX_LEVEL, (GLint)(levelCount - 1));
+
+		uint32_t validLevel = std::max(record->mValidLevel, finestLevel);
+		if (finestLevel > record->mValidLevel)
+			mStats.mLevelsDropped += finestLevel - record->mValidLevel;
+
+		if (texture->mId) {
+			for (uint32_t level = validLevel; level < record->mLevelCount; ++level) {
+				glCopyImageSubData(
+					texture->mId, GL_TEXTURE_2D, (GLint)(level - record->mAllocatedLevel), 0, 0, 0,
+					id, GL_TEXTURE_2D, (GLint)(level - finestLevel), 0, 0, 0,
+					std::max(record->mWidth >> level, 1u), std::max(record->mHeight >> level, 1u), 1);
+			}
+			glDeleteQueue()->deleteTextures(1, &texture->mId);
+		}
+
+		texture->mId = id;
+		texture->mWidth = width;
+		texture->mHeight = height;
+		texture->mLevels = levelCount;
+		record->mAllocatedLevel = finestLevel;
+		record->mValidLevel = validLevel;
+		setBaseLevel(record);
+		GL_ASSERT;
+	}
+
+	Texture* TextureStreamer::load(const std::string& source) {
+		gli::texture tex = gli::load(source);
+		if (tex.empty())
+			return nullptr;
+
+		// Only plain 2D textures with a mip chain are worth streaming
+		if (tex.target() != gli::TARGET_2D || tex.layers() > 1 || tex.faces() > 1 || tex.levels() < 2)
+			return nullptr;
+
+		gli::gl GL(gli::gl::PROFILE_GL33);
+		gli::gl::format const format = GL.translate(tex.format(), tex.swizzles());
+		glm::tvec3<GLsizei> const extent(tex.extent());
+
+		StreamedTexture record;
+		record.mSource = source;
+		record.mSerial = mNextSerial++;
+		record.mInternalFormat = format.Internal;
+		record.mExternalFormat = format.External;
+		record.mType = format.Type;
+		for (int i = 0; i < 4; ++i)
+			record.mSwizzles[i] = format.Swizzles[i];
+		record.bCompressed = gli::is_compressed(tex.format());
+		record.mWidth = extent.x;
+		record.mHeight = extent.y;
+		record.mLevelCount = (uint32_t)tex.levels();
+		record.mLevelSizes.resize(record.mLevelCount);
+		for (uint32_t level = 0; level < record.mLevelCount; ++level)
+			record.mLevelSizes[level] = tex.size(level);
+
+		record.mResidentLevel = record.mLevelCount - 1;
+		for (uint32_t level = 0; level < record.mLevelCount; ++level) {
+			if (std::max(record.mWidth >> level, 1u) <= mParameters.mMinResidentSize &&
+				std::max(record.mHeight >> level, 1u) <= mParameters.mMinResidentSize) {
+				record.mResidentLevel = level;
+				break;
+			}
+		}
+
+		record.mAllocatedLevel = record.mLevelCount;
+		record.mValidLevel = record.mLevelCount;
+		record.mRequestedLevel = TEXTURE_STREAMING_NO_REQUEST;
+		record.mWantedLevel = record.mResidentLevel;
+		record.mLastRequestFrame = mFrame;
+		record.bLoading = false;
+
+		Texture* texture = new Texture();
+		texture->mType = TextureType::TEXTURE_2D;
+		texture->mGLTarget = GL_TEXTURE_2D;
+		texture->mDepth = 1;
+		texture->mFormat = format.Internal;
+		record.mTexture = texture;
+
+		reallocate(&record, record.mResidentLevel);
+
+		// The resident levels are small, upload them right away
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (uint32_t level = record.mResidentLevel; level < record.mLevelCount; ++level) {
+			GLint glLevel = (GLint)(level - record.mAllocatedLevel);
+			GLsizei width = std::max(record.mWidth >> level, 1u);
+			GLsizei height = std::max(record.mHeight >> level, 1u);
+			if (record.bCompressed)
+				glCompressedTextureSubImage2D(texture->mId, glLevel, 0, 0, width, height,
+					record.mInternalFormat, (GLsizei)tex.size(level), tex.data(0, 0, level));
+			else
+				glTextureSubImage2D(texture->mId, glLevel, 0, 0, width, height,
+					record.mExternalFormat, record.mType, tex.data(0, 0, level));
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		record.mValidLevel = record.mResidentLevel;
+		setBaseLevel(&record);
+		GL_ASSERT;
+
+		mTextures.emplace(texture, std::move(record));
+		return texture;
+	}
+
+	void TextureStreamer::remove(const Texture* texture) {
+		// Loads that are still running are discarded when their serial does not match
+		mTextures.erase(texture);
+	}
+
+	bool TextureStreamer::isStreamed(const Texture* texture) const {
+		return mTextures.find(texture) != mTextures.end();
+	}
+
+	void TextureStreamer::request(const Texture* texture, float screenSize) {
+		auto it = mTextures.find(texture);
+		if (it == mTextures.end())
+			return;
+
+		// One texel per pixel, rounded towards the finer level
+		float size = (float)std::max(it->second.mWidth, it->second.mHeight);
+		float level = std::log2(size / std::max(screenSize, 1.0f)) + mParameters.mLodBias;
+		requestLevel(texture, level > 0.0f ? (uint32_t)std::floor(level) : 0u);
+	}
+
+	void TextureStreamer::requestLevel(const Texture* texture, uint32_t level) {
+		auto it = mTextures.find(texture);
+		if (it == mTextures.end())
+			return;
+
+		auto& record = it->second;
+		record.mRequestedLevel = std::min(record.mRequestedLevel,
+			std::min(level, record.mLevelCount - 1));
+		record.mLastRequestFrame = mFrame;
+	}
+
+	void TextureStreamer::submitLoad(StreamedTexture* record) {
+		record->bLoading = true;
+
+		Texture* texture = record->mTexture;
+		uint64_t serial = record->mSerial;
+		std::string source = record->mSource;
+		uint32_t firstLevel = record->mWantedLevel;
+		uint32_t endLevel = record->mValidLevel;
+
+		// gli has no way of reading single levels, the whole file is read on a worker and
+		// only the missing levels are kept
+		mWorkers.submit([this, texture, serial, source, firstLevel, endLevel]() {
+			LoadResult result;
+			result.mTexture = texture;
+			result.mSerial = serial;
+			result.bSuccess = false;
+
+			gli::texture tex = gli::load(source);
+			if (!tex.empty() && tex.levels() >= endLevel) {
+				for (uint32_t level = endLevel; level-- > firstLevel;) {
+					LevelData data;
+					data.mLevel = level;
+					auto bytes = reinterpret_cast<const uint8_t*>(tex.data(0, 0, level));
+					data.mData.assign(bytes, bytes + tex.size(level));
+					result.mLevels.emplace_back(std::move(data));
+				}
+				result.bSuccess = true;
+			}
+
+			std::lock_guard<std::mutex> lock(mResultMutex);
+			mResults.emplace_back(std::move(result));
+		});
+	}
+
+	void TextureStreamer::applyResults() {
+		std::vector<LoadResult> results;
+		{
+			std::lock_guard<std::mutex> lock(mResultMutex);
+			results.swap(mResults);
+		}
+
+		for (auto& result : results) {
+			auto it = mTextures.find(result.mTexture);
+			if (it == mTextures.end() || it->second.mSerial != result.mSerial)
+				continue;
+
+			auto& record = it->second;
+			record.bLoading = false;
+			if (!result.bSuccess) {
+				std::cout << "Warning: failed to stream levels of " << record.mSource << "!" << std::endl;
+				continue;
+			}
+
+			// Levels were dropped while loading, the chain has a gap and is loaded again
+			if (result.mLevels.empty() || result.mLevels.front().mLevel + 1 != record.mValidLevel)
+				continue;
+
+			for (auto& level : result.mLevels) {
+				if (level.mLevel < record.mWantedLevel)
+					break;
+				record.mPendingUploads.emplace_back(std::move(level));
+			}
+
+			if (!record.mPendingUploads.empty() &&
+				record.mPendingUploads.back().mLevel < record.mAllocatedLevel)
+				reallocate(&record, record.mPendingUploads.back().mLevel);
+		}
+	}
+
+	void TextureStreamer::chooseLevels() {
+		size_t requestedBytes = 0;
+		for (auto& entry : mTextures) {
+			auto& record = entry.second;
+			if (record.mRequestedLevel != TEXTURE_STREAMING_NO_REQUEST)
+				record.mWantedLevel = std::min(record.mRequestedLevel, record.mResidentLevel);
+			else if (mFrame - record.mLastRequestFrame > mParameters.mEvictFrames)
+				record.mWantedLevel = record.mResidentLevel;
+			record.mRequestedLevel = TEXTURE_STREAMING_NO_REQUEST;
+			requestedBytes += residentSize(record, record.mWantedLevel);
+		}
+		mStats.mRequestedBytes = requestedBytes;
+
+		// Over budget, repeatedly give up the finest level of whichever texture has the
+		// largest one, since that frees the most memory for the least loss in detail
+		size_t totalBytes = requestedBytes;
+		if (totalBytes > mParameters.mBudget) {
+			auto isSmaller = [](const StreamedTexture* a, const StreamedTexture* b) {
+				return a->mLevelSizes[a->mWantedLevel] < b->mLevelSizes[b->mWantedLevel];
+			};
+			std::priority_queue<StreamedTexture*, std::vector<StreamedTexture*>,
+				decltype(isSmaller)> largest(isSmaller);
+
+			for (auto& entry : mTextures) {
+				if (entry.second.mWantedLevel < entry.second.mResidentLevel)
+					largest.push(&entry.second);
+			}
+
+			while (totalBytes > mParameters.mBudget && !largest.empty()) {
+				auto record = largest.top();
+				largest.pop();
+				totalBytes -= record->mLevelSizes[record->mWantedLevel];
+				++record->mWantedLevel;
+				if (record->mWantedLevel < record->mResidentLevel)
+					largest.push(record);
+			}
+		}
+
+		for (auto& entry : mTextures) {
+			auto& record = entry.second;
+
+			// Levels that are no longer wanted are never uploaded
+			while (!record.mPendingUploads.empty() &&
+				record.mPendingUploads.back().mLevel < record.mWantedLevel)
+				record.mPendingUploads.pop_back();
+
+			if (record.mWantedLevel > record.mAllocatedLevel)
+				reallocate(&record, record.mWantedLevel);
+			else if (record.mWantedLevel < record.mValidLevel && !record.bLoading &&
+				record.mPendingUploads.empty())
+				submitLoad(&record);
+		}
+	}
+
+	TextureStreamer::StagingBuffer* TextureStreamer::acquireStaging(size_t size, bool bWait) {
+		StagingBuffer* staging = &mStaging[mNextStaging];
+
+		// The GPU may still be reading from the buffer, try again next frame
+		if (staging->mFence) {
+			GLenum status = bWait ?
+				glClientWaitSync(staging->mFence, GL_SYNC_FLUSH_COMMANDS_BIT, TEXTURE_STREAMING_WAIT_TIMEOUT_NS) :
+				glClientWaitSync(staging->mFence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				return nullptr;
+			glDeleteSync(staging->mFence);
+			staging->mFence = nullptr;
+		}
+
+		mNextStaging = (mNextStaging + 1) % mStaging.size();
+
+		if (staging->mCapacity < size) {
+			glNamedBufferData(staging->mBuffer, size, nullptr, GL_STREAM_DRAW);
+			staging->mCapacity = size;
+		}
+
+		return staging;
+	}
+
+	void TextureStreamer::upload(StreamedTexture* record, const LevelData& level, StagingBuffer* staging) {
+		size_t size = level.mData.size();
+		void* mapped = glMapNamedBufferRange(staging->mBuffer, 0, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		std::memcpy(mapped, level.mData.data(), size);
+		glUnmapNamedBuffer(staging->mBuffer);
+
+		GLuint id = record->mTexture->mId;
+		GLint glLevel = (GLint)(level.mLevel - record->mAllocatedLevel);
+		GLsizei width = std::max(record->mWidth >> level.mLevel, 1u);
+		GLsizei height = std::max(record->mHeight >> level.mLevel, 1u);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging->mBuffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		if (record->bCompressed)
+			glCompressedTextureSubImage2D(id, glLevel, 0, 0, width, height,
+				record->mInternalFormat, (GLsizei)size, nullptr);
+		else
+			glTextureSubImage2D(id, glLevel, 0, 0, width, height,
+				record->mExternalFormat, record->mType, nullptr);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		staging->mFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		// Commands execute in order, so sampling the level after this is safe
+		record->mValidLevel = level.mLevel;
+		setBaseLevel(record);
+
+		++mStats.mLevelsStreamedIn;
+		mStats.mUploadedBytes += size;
+		GL_ASSERT;
+	}
+
+	void TextureStreamer::uploadPending(bool bWait) {
+		std::vector<StreamedTexture*> waiting;
+		for (auto& entry : mTextures) {
+			if (!entry.second.mPendingUploads.empty())
+				waiting.push_back(&entry.second);
+		}
+
+		// Cheap levels first, so that as many textures as possible improve every frame
+		std::sort(waiting.begin(), waiting.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+			return a->mPendingUploads.front().mData.size() < b->mPendingUploads.front().mData.size();
+		});
+
+		size_t uploadedBytes = 0;
+		for (auto record : waiting) {
+			while (!record->mPendingUploads.empty()) {
+				auto& level = record->mPendingUploads.front();
+				if (!bWait && mParameters.mUploadBytesPerFrame > 0 && uploadedBytes > 0 &&
+					uploadedBytes + level.mData.size() > mParameters.mUploadBytesPerFrame)
+					return;
+
+				StagingBuffer* staging = acquireStaging(level.mData.size(), bWait);
+				if (!staging)
+					return;
+
+				upload(record, level, staging);
+				uploadedBytes += level.mData.size();
+				record->mPendingUploads.erase(record->mPendingUploads.begin());
+			}
+		}
+	}
+
+	void TextureStreamer::update() {
+		applyResults();
+		chooseLevels();
+		uploadPending(false);
+
+		mStats.mTextures = (uint32_t)mTextures.size();
+		mStats.mResidentBytes = 0;
+		mStats.mPendingLoads = 0;
+		mStats.mPendingUploads = 0;
+		for (auto& entry : mTextures) {
+			auto& record = entry.second;
+			mStats.mResidentBytes += residentSize(record, record.mAllocatedLevel);
+			mStats.mPendingLoads += record.bLoading ? 1 : 0;
+			mStats.mPendingUploads += (uint32_t)record.mPendingUploads.size();
+		}
+
+		++mFrame;
+	}
+
+	void TextureStreamer::flush() {
+		mWorkers.wait();
+		applyResults();
+		uploadPending(true);
+	}
+}
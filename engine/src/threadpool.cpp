@@ -0,0 +1,61 @@
+#include <engine/threadpool.hpp>
+
+namespace Morpheus {
+
+	ThreadPool::ThreadPool(uint32_t threadCount) : mBusy(0), bExit(false) {
+		for (uint32_t i = 0; i < threadCount; ++i)
+			mThreads.emplace_back([this]() { run(); });
+	}
+
+	ThreadPool::~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			bExit = true;
+		}
+		mWake.notify_all();
+		for (auto& thread : mThreads)
+			thread.join();
+	}
+
+	void ThreadPool::run() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mWake.wait(lock, [this]() { return bExit || !mJobs.empty(); });
+				if (mJobs.empty())
+					return;
+				job = std::move(mJobs.front());
+				mJobs.pop_front();
+				++mBusy;
+			}
+
+			job();
+
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				--mBusy;
+				if (mBusy == 0 && mJobs.empty())
+					mIdle.notify_all();
+			}
+		}
+	}
+
+	void ThreadPool::submit(std::function<void()>&& job) {
+		if (mThreads.empty()) {
+			job();
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mJobs.emplace_back(std::move(job));
+		}
+		mWake.notify_one();
+	}
+
+	void ThreadPool::wait() {
+		std::unique_lock<std::mutex> lock(mMutex);
+		mIdle.wait(lock, [this]() { return mBusy == 0 && mJobs.empty(); });
+	}
+}
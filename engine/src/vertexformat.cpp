@@ -0,0 +1,236 @@
+#include <engine/vertexformat.hpp>
+#include <engine/glslpreprocessor.hpp>
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace Morpheus {
+
+	VertexFormat VertexFormat::defaults() {
+		VertexFormat format;
+		format.mPositions = VertexPositionFormat::FLOAT;
+		format.mNormals = VertexNormalFormat::FLOAT;
+		format.mUVs = VertexUVFormat::FLOAT;
+		format.bShortIndices = true;
+		return format;
+	}
+
+	VertexFormat VertexFormat::compressed() {
+		VertexFormat format;
+		format.mPositions = VertexPositionFormat::SNORM16;
+		format.mNormals = VertexNormalFormat::OCTAHEDRAL;
+		format.mUVs = VertexUVFormat::HALF;
+		format.bShortIndices = true;
+		return format;
+	}
+
+	VertexFormat VertexFormat::fromConfig(const nlohmann::json& config) {
+		VertexFormat format = defaults();
+		if (config.contains("vertex_format")) {
+			auto& formatConfig = config["vertex_format"];
+			if (formatConfig.contains("positions"))
+				format.mPositions = positionFormatFromString(formatConfig["positions"].get<std::string>());
+			if (formatConfig.contains("normals"))
+				format.mNormals = normalFormatFromString(formatConfig["normals"].get<std::string>());
+			if (formatConfig.contains("uvs"))
+				format.mUVs = uvFormatFromString(formatConfig["uvs"].get<std::string>());
+			format.bShortIndices = formatConfig.value("short_indices", format.bShortIndices);
+		}
+		return format;
+	}
+
+	void VertexFormat::addDefines(GLSLPreprocessorConfig* config) const {
+		// Positions and UVs are converted by the vertex fetch and the world matrix,
+		// only normals need to be decoded by hand
+		if (mNormals == VertexNormalFormat::OCTAHEDRAL)
+			config->mDefines["VERTEX_OCTAHEDRAL_NORMALS"] = "1";
+		else
+			config->mDefines.erase("VERTEX_OCTAHEDRAL_NORMALS");
+	}
+
+	VertexPositionFormat positionFormatFromString(const std::string& str) {
+		if (str == "float")
+			return VertexPositionFormat::FLOAT;
+		else if (str == "half")
+			return VertexPositionFormat::HALF;
+		else if (str == "snorm16")
+			return VertexPositionFormat::SNORM16;
+		std::cout << "Warning: position format " << str << " not recognized, defaulting to float!" << std::endl;
+		return VertexPositionFormat::FLOAT;
+	}
+
+	VertexNormalFormat normalFormatFromString(const std::string& str) {
+		if (str == "float")
+			return VertexNormalFormat::FLOAT;
+		else if (str == "octahedral")
+			return VertexNormalFormat::OCTAHEDRAL;
+		std::cout << "Warning: normal format " << str << " not recognized, defaulting to float!" << std::endl;
+		return VertexNormalFormat::FLOAT;
+	}
+
+	VertexUVFormat uvFormatFromString(const std::string& str) {
+		if (str == "float")
+			return VertexUVFormat::FLOAT;
+		else if (str == "half")
+			return VertexUVFormat::HALF;
+		std::cout << "Warning: UV format " << str << " not recognized, defaulting to float!" << std::endl;
+		return VertexUVFormat::FLOAT;
+	}
+
+	glm::vec2 octahedralEncode(const glm::vec3& n) {
+		float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (l1 == 0.0f)
+			return glm::vec2(0.0f, 0.0f);
+
+		glm::vec2 p(n.x / l1, n.y / l1);
+		if (n.z < 0.0f) {
+			// Fold the lower hemisphere over the diagonals
+			p = glm::vec2((1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+				(1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f));
+		}
+		return p;
+	}
+
+	glm::vec3 octahedralDecode(const glm::vec2& e) {
+		glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return glm::normalize(n);
+	}
+
+	// Size in bytes of an attribute with the given number of float components once packed
+	uint32_t packedAttributeSize(const VertexAttributeSource& attribute, const VertexFormat& format) {
+		switch (attribute.mKind) {
+		case VertexAttributeKind::POSITION:
+			// 16 bit positions are padded to four components to keep 4 byte alignment
+			return format.mPositions == VertexPositionFormat::FLOAT ?
+				attribute.mComponents * sizeof(float) : 4 * sizeof(uint16_t);
+		case VertexAttributeKind::NORMAL:
+			return format.mNormals == VertexNormalFormat::FLOAT ?
+				attribute.mComponents * sizeof(float) : 2 * sizeof(uint16_t);
+		case VertexAttributeKind::UV:
+			return format.mUVs == VertexUVFormat::FLOAT ?
+				attribute.mComponents * sizeof(float) : 2 * sizeof(uint16_t);
+		default:
+			return attribute.mComponents * sizeof(float);
+		}
+	}
+
+	void packVertices(const float* vertices, uint32_t vertexCount, uint32_t stride,
+		const std::vector<VertexAttributeSource>& attributes, const VertexFormat& format,
+		const BoundingBox& aabb, PackedVertexBuffer* output) {
+
+		// Quantize positions relative to the bounding box
+		glm::vec3 center = 0.5f * (aabb.mLower + aabb.mUpper);
+		glm::vec3 halfExtent = 0.5f * (aabb.mUpper - aabb.mLower);
+		for (int k = 0; k < 3; ++k) {
+			if (!(halfExtent[k] > 0.0f) || !std::isfinite(halfExtent[k]))
+				halfExtent[k] = 1.0f;
+			if (!std::isfinite(center[k]))
+				center[k] = 0.0f;
+		}
+
+		output->mPositionDecode = glm::identity<glm::mat4>();
+		if (format.mPositions == VertexPositionFormat::HALF)
+			output->mPositionDecode = glm::translate(output->mPositionDecode, center);
+		else if (format.mPositions == VertexPositionFormat::SNORM16)
+			output->mPositionDecode = glm::scale(
+				glm::translate(output->mPositionDecode, center), halfExtent);
+
+		// Lay out the packed attributes
+		output->mAttributes.clear();
+		uint32_t offset = 0;
+		for (auto& attribute : attributes) {
+			PackedVertexAttribute packed;
+			packed.mLocation = attribute.mLocation;
+			packed.mComponents = attribute.mComponents;
+			packed.mType = GL_FLOAT;
+			packed.bNormalized = GL_FALSE;
+			packed.mOffset = offset;
+
+			switch (attribute.mKind) {
+			case VertexAttributeKind::POSITION:
+				if (format.mPositions == VertexPositionFormat::HALF)
+					packed.mType = GL_HALF_FLOAT;
+				else if (format.mPositions == VertexPositionFormat::SNORM16) {
+					packed.mType = GL_SHORT;
+					packed.bNormalized = GL_TRUE;
+				}
+				break;
+			case VertexAttributeKind::NORMAL:
+				if (format.mNormals == VertexNormalFormat::OCTAHEDRAL) {
+					packed.mComponents = 2;
+					packed.mType = GL_SHORT;
+					packed.bNormalized = GL_TRUE;
+				}
+				break;
+			case VertexAttributeKind::UV:
+				if (format.mUVs == VertexUVFormat::HALF)
+					packed.mType = GL_HALF_FLOAT;
+				break;
+			default:
+				break;
+			}
+
+			output->mAttributes.push_back(packed);
+			offset += packedAttributeSize(attribute, format);
+		}
+		output->mStride = offset;
+
+		output->mData.resize((size_t)vertexCount * output->mStride);
+		uint8_t* dest = output->mData.empty() ? nullptr : &output->mData[0];
+
+		for (uint32_t v = 0; v < vertexCount; ++v) {
+			const float* src = vertices + (size_t)v * stride;
+			uint8_t* vertexDest = dest + (size_t)v * output->mStride;
+
+			for (size_t i = 0; i < attributes.size(); ++i) {
+				auto& attribute = attributes[i];
+				auto& packed = output->mAttributes[i];
+				const float* x = src + attribute.mOffset;
+				uint8_t* y = vertexDest + packed.mOffset;
+
+				if (packed.mType == GL_FLOAT) {
+					std::memcpy(y, x, attribute.mComponents * sizeof(float));
+					continue;
+				}
+
+				uint16_t packedValues[4] = { 0, 0, 0, 0 };
+				uint32_t packedCount = 0;
+
+				switch (attribute.mKind) {
+				case VertexAttributeKind::POSITION:
+					for (uint32_t k = 0; k < attribute.mComponents; ++k) {
+						float rel = x[k] - center[k];
+						packedValues[k] = format.mPositions == VertexPositionFormat::HALF ?
+							glm::packHalf1x16(rel) : glm::packSnorm1x16(rel / halfExtent[k]);
+					}
+					packedCount = 4;
+					break;
+				case VertexAttributeKind::NORMAL: {
+					auto e = octahedralEncode(glm::vec3(x[0], x[1], x[2]));
+					packedValues[0] = glm::packSnorm1x16(e.x);
+					packedValues[1] = glm::packSnorm1x16(e.y);
+					packedCount = 2;
+					break;
+				}
+				case VertexAttributeKind::UV:
+					packedValues[0] = glm::packHalf1x16(x[0]);
+					packedValues[1] = glm::packHalf1x16(x[1]);
+					packedCount = 2;
+					break;
+				default:
+					break;
+				}
+
+				std::memcpy(y, packedValues, packedCount * sizeof(uint16_t));
+			}
+		}
+	}
+}
@@ -2,8 +2,13 @@
 
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texcoords;
+#ifdef VERTEX_OCTAHEDRAL_NORMALS
+layout (location = 2) in vec2 encodedNormal;
+layout (location = 3) in vec2 encodedTangent;
+#else
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec3 tangent;
+#endif
 layout (location = 4) in vec3 color;
 
 out vec2 vTexcoords; 
@@ -17,8 +22,15 @@ uniform mat4 modelInverseTranspose;
 uniform mat4 view; 
 uniform mat4 projection; 
 
+#pragma include <internal/vertexformat.glsl>
+vec3 decodeOctahedral(vec2 e);
+
 void main()
 {
+#ifdef VERTEX_OCTAHEDRAL_NORMALS
+	vec3 normal = decodeOctahedral(encodedNormal);
+	vec3 tangent = decodeOctahedral(encodedTangent);
+#endif
     vTexcoords = texcoords;
 	vNormal = (modelInverseTranspose * vec4(normal, 0.0)).xyz;
 	vec4 worldPosition = model * vec4(position, 1.0f);
@@ -0,0 +1,191 @@
+#include <engine/derivedcache.hpp>
+#include <engine/geometry.hpp>
+#include <engine/texture.hpp>
+#include <engine/threadpool.hpp>
+
+#include <assimp/Importer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
+
+using namespace Morpheus;
+using namespace std;
+
+namespace fs = std::filesystem;
+
+// Cooks everything under a content directory into the derived data cache that the
+// engine reads from. Entries are keyed by the hash of their source, so running the
+// cooker again only cooks what has changed since the last run.
+//
+// Usage: morpheus-cook [content directory] [config file]
+
+enum class AssetKind {
+	NONE,
+	GEOMETRY,
+	TEXTURE,
+	JSON
+};
+
+static const set<string> gTextureExtensions = {
+	".png", ".jpg", ".jpeg", ".hdr", ".bmp", ".tga", ".psd", ".gif", ".pic", ".ppm", ".pgm"
+};
+
+AssetKind classify(const fs::path& path, Assimp::Importer* importer) {
+	string ext = path.extension().string();
+	transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	if (ext.empty() || ext == COOKED_GEOMETRY_EXTENSION)
+		return AssetKind::NONE;
+	if (gTextureExtensions.count(ext))
+		return AssetKind::TEXTURE;
+	if (ext == ".json") {
+		// Only materials and static meshes are read as content
+		ifstream f(path);
+		auto j = nlohmann::json::parse(f, nullptr, false);
+		if (j.is_object() && (j.contains("shader") || (j.contains("geometry") && j.contains("material"))))
+			return AssetKind::JSON;
+		return AssetKind::NONE;
+	}
+	if (importer->IsExtensionSupported(ext))
+		return AssetKind::GEOMETRY;
+	return AssetKind::NONE;
+}
+
+bool cookJson(const string& source, const string& destination) {
+	ifstream f(source);
+	auto j = nlohmann::json::parse(f, nullptr, false);
+	if (j.is_discarded()) {
+		cout << "Error: failed to parse " << source << "!" << endl;
+		return false;
+	}
+
+	auto msgpack = nlohmann::json::to_msgpack(j);
+	ofstream out(destination, ios::binary);
+	out.write(reinterpret_cast<const char*>(msgpack.data()), msgpack.size());
+	return out.good();
+}
+
+int main(int argc, char* argv[]) {
+	string contentDir = argc > 1 ? argv[1] : "content";
+	string configPath = argc > 2 ? argv[2] : "config.json";
+
+	nlohmann::json config;
+	ifstream configFile(configPath);
+	if (configFile.is_open())
+		configFile >> config;
+	else
+		cout << "Warning: could not open " << configPath << ", using default cook settings." << endl;
+
+	string cacheRoot = "ddc";
+	if (config.contains("derived_data_cache"))
+		cacheRoot = config["derived_data_cache"].value("path", cacheRoot);
+
+	uint32_t threadCount = max(thread::hardware_concurrency(), 1u);
+	if (config.contains("cook"))
+		threadCount = config["cook"].value("threads", threadCount);
+
+	DerivedDataCache cache(cacheRoot);
+	ContentFactory<Geometry> geometryFactory;
+	ContentFactory<Texture> textureFactory;
+	Assimp::Importer importer;
+
+	// Must match the parameters that the engine looks up, see ContentManager::init
+	GeometryCookParameters geometryParams = GeometryCookParameters::fromConfig(config);
+	string geometryKeyParams = geometryParams.cacheParameters();
+	textureFactory.setMipParameters(MipGenParameters::fromConfig(config));
+	textureFactory.setCompressParameters(BlockCompressParameters::fromConfig(config));
+	if (config.contains("texture_compression"))
+		textureFactory.setCompressOnCook(config["texture_compression"].value("cook", true));
+	string textureKeyParams = textureFactory.cacheParameters();
+
+	atomic<uint32_t> cooked(0);
+	atomic<uint32_t> skipped(0);
+	atomic<uint32_t> failed(0);
+	mutex outputMutex;
+
+	ThreadPool pool(threadCount);
+
+	for (auto& entry : fs::recursive_directory_iterator(contentDir)) {
+		if (!entry.is_regular_file())
+			continue;
+
+		string source = entry.path().string();
+		AssetKind kind = classify(entry.path(), &importer);
+
+		string parameters;
+		string extension;
+		function<bool(const string&)> cook;
+
+		switch (kind) {
+		case AssetKind::GEOMETRY:
+			parameters = geometryKeyParams;
+			extension = COOKED_GEOMETRY_EXTENSION;
+			cook = [&, source](const string& dest) {
+				return geometryFactory.cook(source, dest, geometryParams);
+			};
+			break;
+		case AssetKind::TEXTURE:
+			parameters = textureKeyParams;
+			extension = TEXTURE_CACHE_EXTENSION;
+			cook = [&, source](const string& dest) {
+				return textureFactory.cook(source, dest);
+			};
+			break;
+		case AssetKind::JSON:
+			parameters = DERIVED_JSON_PARAMETERS;
+			extension = DERIVED_JSON_EXTENSION;
+			cook = [source](const string& dest) {
+				return cookJson(source, dest);
+			};
+			break;
+		default:
+			continue;
+		}
+
+		pool.submit([&, source, parameters, extension, cook]() {
+			string key;
+			if (!cache.makeKey(source, parameters, &key)) {
+				++failed;
+				return;
+			}
+
+			string dest = cache.path(key, extension);
+			if (fs::exists(dest)) {
+				++skipped;
+				return;
+			}
+
+			// Write next to the entry and move it into place, so that a cook that is
+			// interrupted never leaves a partial entry behind
+			error_code ec;
+			fs::create_directories(fs::path(dest).parent_path(), ec);
+			string temp = dest + ".tmp";
+			if (cook(temp)) {
+				fs::rename(temp, dest, ec);
+				if (!ec) {
+					++cooked;
+					lock_guard<mutex> lock(outputMutex);
+					cout << source << " -> " << dest << endl;
+					return;
+				}
+			}
+
+			fs::remove(temp, ec);
+			++failed;
+			lock_guard<mutex> lock(outputMutex);
+			cout << "Error: failed to cook " << source << "!" << endl;
+		});
+	}
+
+	pool.wait();
+
+	cout << "Cooked " << cooked << ", up to date " << skipped << ", failed " << failed << "." << endl;
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+#include <engine/morpheus.hpp>
+#include <engine/sequence.hpp>
+
+#include <iostream>
+#include <cstring>
+
+using namespace Morpheus;
+using namespace std;
+
+void printUsage() {
+	cerr << "Usage: sequence-render <static mesh> <camera path> <output> [format] [fps] [frames]" << endl;
+	cerr << "\t<output> is a file, - for stdout or a printf pattern (i.e., frame_%05d.ppm) for ppm" << endl;
+	cerr << "\t[format] is one of y4m (default), ppm or raw" << endl;
+	cerr << "Example: sequence-render mesh.json content/turntable.json - | ffmpeg -i - out.mp4" << endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		printUsage();
+		return 1;
+	}
+
+	SequenceRenderParams params;
+	params.mOutput = argv[3];
+	if (argc > 4) {
+		if (strcmp(argv[4], "ppm") == 0)
+			params.mFormat = SequenceOutputFormat::PPM_SEQUENCE;
+		else if (strcmp(argv[4], "raw") == 0)
+			params.mFormat = SequenceOutputFormat::RAW_RGB;
+		else
+			params.mFormat = SequenceOutputFormat::Y4M;
+	}
+	if (argc > 5)
+		params.mFrameRate = atof(argv[5]);
+	if (argc > 6)
+		params.mFrameCount = (uint32_t)atoi(argv[6]);
+
+	// Frames go to stdout, so keep the engine's logging out of the way
+	streambuf* coutBuffer = cout.rdbuf();
+	if (params.mOutput == "-")
+		cout.rdbuf(cerr.rdbuf());
+
+	Engine en;
+
+	if (en.startup("config.json").isSuccess()) {
+		auto scene = en.makeScene();
+
+		auto camera = new Camera();
+		createNode(camera, scene);
+
+		auto transform = new TransformNode();
+		createNode(transform, scene);
+		auto staticMesh = load<StaticMesh>(argv[1], scene);
+		transform->addChild(staticMesh);
+
+		CameraPath path;
+		path.load(argv[2]);
+
+		init(scene);
+
+		{
+			SequenceRenderer sequenceRenderer;
+			auto stats = sequenceRenderer.render(scene, camera, path, params);
+			stats.print(cerr);
+		}
+	}
+	en.shutdown();
+
+	cout.rdbuf(coutBuffer);
+}